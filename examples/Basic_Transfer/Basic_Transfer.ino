@@ -30,6 +30,8 @@ const char* TEST_FILENAME_BIN = "/test_image.bin"; // Example binary file
 
 // --- Function Prototypes ---
 void onMeshtasticReceived(ReceivedPacket& packet); // Callback for Meshtastic packets
+void onZmodemProgress(int session, size_t bytes, size_t total, void* ctx);
+void onZmodemComplete(int session, AkitaMeshZmodem::TransferState result, void* ctx);
 void createTestFiles(); // Helper to create files for sending
 NodeNum parseNodeId(const char* str); // Helper to parse Node ID
 
@@ -61,6 +63,8 @@ void setup() {
     // --- Initialize Akita ZModem Library ---
     // Pass the Meshtastic instance, the filesystem (SPIFFS), and Serial for debug output
     akitaZmodem.begin(mesh, SPIFFS, &Serial);
+    akitaZmodem.onProgress(onZmodemProgress);
+    akitaZmodem.onComplete(onZmodemComplete);
     Serial.println("AkitaMeshZmodem library initialized.");
 
     // --- Create Test Files (Optional) ---
@@ -85,35 +89,30 @@ void loop() {
     }
 
     // --- Update the Akita ZModem State Machine ---
-    AkitaMeshZmodem::TransferState currentState = akitaZmodem.loop();
-
-    // --- Optional: Provide feedback based on state changes ---
-    static AkitaMeshZmodem::TransferState lastReportedState = AkitaMeshZmodem::TransferState::IDLE;
-
-    if (currentState != lastReportedState) {
-        switch (currentState) {
-            case AkitaMeshZmodem::TransferState::IDLE:
-                 if (lastReportedState != AkitaMeshZmodem::TransferState::IDLE) {
-                     Serial.println("[ZModem Status: IDLE]");
-                 }
-                break;
-            case AkitaMeshZmodem::TransferState::SENDING:
-                Serial.println("[ZModem Status: SENDING]");
-                break;
-            case AkitaMeshZmodem::TransferState::RECEIVING:
-                Serial.println("[ZModem Status: RECEIVING]");
-                break;
-            case AkitaMeshZmodem::TransferState::COMPLETE:
-                Serial.println("[ZModem Status: COMPLETE]");
-                break;
-            case AkitaMeshZmodem::TransferState::ERROR:
-                Serial.println("[ZModem Status: ERROR]");
-                break;
-        }
-        lastReportedState = currentState; // Update last reported state
-    }
+    // Progress and completion are reported through the callbacks set in setup()
+    akitaZmodem.loop();
+
+    // Sleep until the next ZModem retry/timeout is due, but keep polling the
+    // radio: a data packet is processed as soon as it is handed over.
+    uint32_t sleepMs = akitaZmodem.nextDeadline();
+    delay(sleepMs < 20 ? sleepMs : 20);
+}
 
-    delay(20);
+// --- ZModem Event Callbacks ---
+void onZmodemProgress(int session, size_t bytes, size_t total, void* ctx) {
+    static unsigned long lastPrint = 0;
+    if (millis() - lastPrint < 2000) return; // Rate-limit serial output
+    lastPrint = millis();
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[ZModem S%d: %lu / %lu bytes]", session, (unsigned long)bytes, (unsigned long)total);
+    Serial.println(buf);
+}
+
+void onZmodemComplete(int session, AkitaMeshZmodem::TransferState result, void* ctx) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "[ZModem S%d: %s]", session,
+             result == AkitaMeshZmodem::TransferState::COMPLETE ? "COMPLETE" : "ERROR");
+    Serial.println(buf);
 }
 
 // --- Meshtastic Packet Handler ---
@@ -149,10 +148,10 @@ void onMeshtasticReceived(ReceivedPacket& packet) {
             return; // Ignore
         }
 
-        // Check if a transfer is already active
-        if (akitaZmodem.getCurrentState() != AkitaMeshZmodem::TransferState::IDLE) {
-            Serial.println("Ignoring command: Transfer already in progress.");
-            Serial.print("Current state: "); Serial.println((int)akitaZmodem.getCurrentState());
+        // Check that a session slot is free
+        if ((int)akitaZmodem.getActiveSessionCount() >= akitaZmodem.getMaxSessions()) {
+            Serial.println("Ignoring command: All transfer sessions busy.");
+            free(msg);
             return;
         }
         
@@ -227,12 +226,10 @@ void onMeshtasticReceived(ReceivedPacket& packet) {
     // 2. Check for DATA (on the dedicated data port)
     } else if (packet.isValid && packet.decoded.portnum == AKZ_ZMODEM_DATA_PORTNUM) {
         
-        // This is a data packet, feed it to the library
-        if (akitaZmodem.getCurrentState() == AkitaMeshZmodem::TransferState::RECEIVING) {
-            Serial.print("."); // Indicate data packet received
-            akitaZmodem.processDataPacket(packet);
-        } else {
-            // Not expecting data, ignore it
+        // This is a data packet, feed it to the library. Both senders (ACKs)
+        // and receivers (data) need these; the library routes by session.
+        if (akitaZmodem.processDataPacket(packet)) {
+            Serial.print("."); // Indicate data packet consumed
         }
     }
     // Ignore other packet types
@@ -6,6 +6,44 @@
 
 #include "AkitaMeshZmodem.h"
 #include "AkitaMeshZmodemConfig.h"
+#include "utility/ZModemBundle.h" // ZModemBundle::match() for listings
+
+// Wire header on every data packet: identifier, session id, 16-bit packet id
+static const size_t STREAM_HEADER_LEN = 4;
+// Session id bit set on packets sent by the responder (receiver) of a session,
+// so two nodes may each initiate a session with the same id without colliding.
+static const uint8_t SESSION_RESPONDER_BIT = 0x80;
+#if AKZ_ENABLE_SEND_CHECKPOINT
+// A send checkpoints its packet id at least every SEND_PACKET_ID_SAVE_EVERY
+// packets; restored, it skips SEND_PACKET_ID_SKIP ids so it is past every
+// id its receiver has seen. Both stay well below half the 16-bit id space,
+// the window of the receiver's duplicate check.
+static const uint16_t SEND_PACKET_ID_SAVE_EVERY = 0x1000;
+static const uint16_t SEND_PACKET_ID_SKIP = 0x2000;
+#endif
+
+// Build and send one data-port packet (stream header already in 'data')
+static bool sendDataPacket(Meshtastic* mesh, NodeNum to, const uint8_t* data, size_t len) {
+    MeshPacket genericPacket;
+    genericPacket.set_payload(data, len);
+    genericPacket.set_to(to);
+    genericPacket.set_portnum(AKZ_ZMODEM_DATA_PORTNUM);
+    genericPacket.set_want_ack(false);
+    genericPacket.set_hop_limit(3);
+    return mesh->sendPacket(&genericPacket);
+}
+
+// A sender opens a session with a hex ZRQINIT header at the start of a packet
+static bool opensSession(const uint8_t* payload, size_t len) {
+    static const uint8_t ZRQINIT_HEX[] = {ZPAD, ZPAD, ZDLE, ZHEX, '0', '0'};
+    return len >= sizeof(ZRQINIT_HEX) && memcmp(payload, ZRQINIT_HEX, sizeof(ZRQINIT_HEX)) == 0;
+}
+
+// A stream joining a live link skips the handshake and opens with a binary ZFILE header
+static bool opensJoinedStream(const uint8_t* payload, size_t len) {
+    static const uint8_t ZFILE_BIN[] = {ZPAD, ZDLE, ZBIN, ZFILE};
+    return len >= sizeof(ZFILE_BIN) && memcmp(payload, ZFILE_BIN, sizeof(ZFILE_BIN)) == 0;
+}
 
 // --- MeshtasticZModemStream (Transport Layer) ---
 
@@ -15,80 +53,131 @@ private:
     Stream* _debug;
     size_t _maxPacketSize;
     uint8_t _packetIdentifier;
+    uint8_t _sessionByte = 0;
     NodeNum _destinationNodeId = BROADCAST_ADDR;
-    uint8_t _rxBuffer[AKZ_STREAM_RX_BUFFER_SIZE];
+    ZModemBufferPool* _pool;
+    ZModemAirtimeMeter* _airtime = nullptr;
+    uint8_t* _rxBuffer;   // AKZ_STREAM_RX_BUFFER_SIZE, borrowed from the pool
     uint16_t _rxBufferIndex = 0;
     uint16_t _rxBufferSize = 0;
     uint16_t _expectedPacketId = 0;
-    uint8_t _txBuffer[AKZ_STREAM_TX_BUFFER_SIZE];
+    uint8_t* _txBuffer;   // AKZ_STREAM_TX_BUFFER_SIZE, borrowed from the pool
     uint16_t _txBufferIndex = 0;
     uint16_t _sentPacketId = 0;
+#if AKZ_ENABLE_ENGINE_TASK
+    // Threaded mode: frames are queued for the mesh thread instead of sent
+    ZModemSpscRing<ZModemQueuedPacket, AKZ_ENGINE_TX_QUEUE_DEPTH>* _txQueue = nullptr;
+#endif
 
     void _streamLog(const char* msg) { if(_debug) { _debug->print("MeshStream: "); _debug->println(msg); } }
 
+    size_t _maxPayload() const {
+        // Ensure _maxPacketSize is reasonable to avoid underflow when subtracting header bytes
+        size_t effectiveMaxPacket = (_maxPacketSize <= STREAM_HEADER_LEN) ? STREAM_HEADER_LEN + 1 : _maxPacketSize;
+        if (effectiveMaxPacket > AKZ_STREAM_TX_BUFFER_SIZE) effectiveMaxPacket = AKZ_STREAM_TX_BUFFER_SIZE;
+        return effectiveMaxPacket - STREAM_HEADER_LEN;
+    }
+
     bool sendPacket() {
-        if (_txBufferIndex == 0 || !_mesh) return true;
+        if (_txBufferIndex == 0 || !_mesh || !_txBuffer) return true;
         if (_destinationNodeId == BROADCAST_ADDR) return false;
 
         // Use a fixed-size packet buffer (avoid VLA). Ensure we don't exceed
         // either the configured max packet size or the internal TX buffer size.
         uint8_t packet[AKZ_STREAM_TX_BUFFER_SIZE];
-        // Ensure _maxPacketSize is reasonable to avoid underflow when subtracting header bytes
-        size_t effectiveMaxPacket = (_maxPacketSize < 4) ? 4 : _maxPacketSize;
-        size_t maxPayload = (effectiveMaxPacket < AKZ_STREAM_TX_BUFFER_SIZE) ? (effectiveMaxPacket - 3) : (AKZ_STREAM_TX_BUFFER_SIZE - 3);
+        size_t maxPayload = _maxPayload();
 
         packet[0] = _packetIdentifier;
-        packet[1] = (_sentPacketId >> 8) & 0xFF;
-        packet[2] = _sentPacketId & 0xFF;
+        packet[1] = _sessionByte;
+        packet[2] = (_sentPacketId >> 8) & 0xFF;
+        packet[3] = _sentPacketId & 0xFF;
 
         size_t dataLen = _txBufferIndex;
         if (dataLen > maxPayload) dataLen = maxPayload;
 
-        memcpy(packet + 3, _txBuffer, dataLen);
+        memcpy(packet + STREAM_HEADER_LEN, _txBuffer, dataLen);
 
-        MeshPacket genericPacket;
-        genericPacket.set_payload(packet, dataLen + 3);
-        genericPacket.set_to(_destinationNodeId);
-        genericPacket.set_portnum(AKZ_ZMODEM_DATA_PORTNUM);
-        genericPacket.set_want_ack(false);
-        genericPacket.set_hop_limit(3);
-
-        bool success = _mesh->sendPacket(&genericPacket);
+        bool success;
+#if AKZ_ENABLE_ENGINE_TASK
+        if (_txQueue) {
+            // A full ring leaves the bytes buffered until the mesh thread drains it
+            ZModemQueuedPacket* slot = _txQueue->acquireSlot();
+            success = slot != nullptr;
+            if (success) {
+                slot->peer = _destinationNodeId;
+                slot->len = (uint16_t)(dataLen + STREAM_HEADER_LEN);
+                memcpy(slot->data, packet, slot->len);
+                _txQueue->commit();
+            }
+        } else
+#endif
+        success = sendDataPacket(_mesh, _destinationNodeId, packet, dataLen + STREAM_HEADER_LEN);
         if (success) {
+            if (_airtime) _airtime->record(dataLen + STREAM_HEADER_LEN, millis());
             _sentPacketId++;
-            _txBufferIndex = 0;
+            // Keep any bytes beyond this packet's payload for the next one
+            if (dataLen < _txBufferIndex) memmove(_txBuffer, _txBuffer + dataLen, _txBufferIndex - dataLen);
+            _txBufferIndex -= dataLen;
         }
         return success;
     }
 
 public:
-    MeshtasticZModemStream(Meshtastic* m, Stream* d, size_t s, uint8_t i) 
-        : _mesh(m), _debug(d), _maxPacketSize(s), _packetIdentifier(i) {}
+    MeshtasticZModemStream(Meshtastic* m, Stream* d, size_t s, uint8_t i, ZModemBufferPool* pool)
+        : _mesh(m), _debug(d), _maxPacketSize(s), _packetIdentifier(i), _pool(pool) {
+        _rxBuffer = _pool->acquire(AKZ_STREAM_RX_BUFFER_SIZE);
+        _txBuffer = _pool->acquire(AKZ_STREAM_TX_BUFFER_SIZE);
+    }
+    ~MeshtasticZModemStream() {
+        _pool->release(_rxBuffer);
+        _pool->release(_txBuffer);
+    }
+
+    bool hasBuffers() const { return _rxBuffer && _txBuffer; }
+    static size_t borrowedBytes() {
+        return ZModemBufferPool::footprint(AKZ_STREAM_RX_BUFFER_SIZE) + ZModemBufferPool::footprint(AKZ_STREAM_TX_BUFFER_SIZE);
+    }
     
     void setDestination(NodeNum d) { _destinationNodeId = d; }
+    void setAirtimeMeter(ZModemAirtimeMeter* m) { _airtime = m; }
+#if AKZ_ENABLE_ENGINE_TASK
+    void setTxQueue(ZModemSpscRing<ZModemQueuedPacket, AKZ_ENGINE_TX_QUEUE_DEPTH>* q) { _txQueue = q; }
+#endif
+    bool hasPendingTx() const { return _txBufferIndex > 0; }
+    void setSessionByte(uint8_t b) { _sessionByte = b; }
+    // Id of the next packet sent. A send continued after a reboot starts
+    // past the ids its receiver has already seen, or they would be dropped.
+    uint16_t nextPacketId() const { return _sentPacketId; }
+    void setNextPacketId(uint16_t id) { _sentPacketId = id; }
     
-    void pushPacket(MeshPacket& packet) {
-        if (_rxBufferIndex < _rxBufferSize) return;
-        const uint8_t* p = packet.decoded.payload.getBuffer();
-        if (packet.decoded.payload.length() < 3 || p[0] != _packetIdentifier) return;
-        
-        uint16_t pid = (p[1] << 8) | p[2];
-        if (pid == _expectedPacketId) {
-            _rxBufferSize = packet.decoded.payload.length() - 3;
-            if(_rxBufferSize > AKZ_STREAM_RX_BUFFER_SIZE) _rxBufferSize = 0;
-            else {
-                memcpy(_rxBuffer, p + 3, _rxBufferSize);
-                _rxBufferIndex = 0;
-                _expectedPacketId++;
-            }
+    // Append the payload of a data packet (header already stripped by the
+    // session demultiplexer). Packets older than the last accepted one are
+    // duplicates and dropped; gaps are left for ZModem to recover.
+    void pushPayload(const uint8_t* data, size_t len, uint16_t pid) {
+        if (!_rxBuffer) return;
+        if (_expectedPacketId != 0 || _rxBufferSize != 0) {
+            if ((int16_t)(pid - _expectedPacketId) < 0) return;
         }
+        // Compact consumed bytes before appending
+        if (_rxBufferIndex > 0) {
+            memmove(_rxBuffer, _rxBuffer + _rxBufferIndex, _rxBufferSize - _rxBufferIndex);
+            _rxBufferSize -= _rxBufferIndex;
+            _rxBufferIndex = 0;
+        }
+        if (len > (size_t)(AKZ_STREAM_RX_BUFFER_SIZE - _rxBufferSize)) {
+            _streamLog("RX buffer full, dropping packet");
+            return;
+        }
+        memcpy(_rxBuffer + _rxBufferSize, data, len);
+        _rxBufferSize += len;
+        _expectedPacketId = pid + 1;
     }
 
     virtual int available() override { return _rxBufferSize - _rxBufferIndex; }
     virtual int read() override { return available() ? _rxBuffer[_rxBufferIndex++] : -1; }
     virtual int peek() override { return available() ? _rxBuffer[_rxBufferIndex] : -1; }
     virtual size_t write(uint8_t val) override {
-        if (!_mesh || _destinationNodeId == BROADCAST_ADDR) return 0;
+        if (!_mesh || !_txBuffer || _destinationNodeId == BROADCAST_ADDR) return 0;
 
         // Prevent overflow of the internal TX buffer. If full, try to flush
         // the pending packet first; if still full, fail the write.
@@ -98,19 +187,50 @@ public:
         }
 
         _txBuffer[_txBufferIndex++] = val;
-        // Guard against underflow and ensure we don't exceed the max packet payload
-        size_t effectiveMaxPacket2 = (_maxPacketSize < 4) ? 4 : _maxPacketSize;
-        if (_txBufferIndex >= effectiveMaxPacket2 - 3) flush();
+        // Send as soon as a full packet payload is buffered
+        if (_txBufferIndex >= _maxPayload()) sendPacket();
         return 1;
     }
-    virtual void flush() override { sendPacket(); }
+    // Room left in the packet being filled
+    virtual int availableForWrite() override {
+        size_t max = _maxPayload();
+        return (_txBuffer && _txBufferIndex < max) ? (int)(max - _txBufferIndex) : 0;
+    }
+    virtual void flush() override {
+        while (_txBufferIndex > 0) {
+            if (!sendPacket()) break;
+        }
+    }
     void reset() { _rxBufferIndex=0; _rxBufferSize=0; _txBufferIndex=0; _expectedPacketId=0; _sentPacketId=0; _destinationNodeId=BROADCAST_ADDR; }
 };
 
 // --- AkitaMeshZmodem Implementation ---
 
-AkitaMeshZmodem::AkitaMeshZmodem() {}
-AkitaMeshZmodem::~AkitaMeshZmodem() { delete _meshStream; }
+// Pool bytes a session holds for its whole transfer, see ZModemEngine::committedBytes()
+static size_t sessionCommittedBytes(bool sending) {
+    size_t n = MeshtasticZModemStream::borrowedBytes() + ZModemSessionEngine::committedBytes(sending);
+#if AKZ_ENABLE_STORAGE_WORKER
+    n += ZModemStorageWorker::committedBytes();
+#endif
+    return n;
+}
+
+AkitaMeshZmodem::AkitaMeshZmodem() {
+    _admitTimer.setCallback(_onAdmitTimer, this);
+}
+AkitaMeshZmodem::~AkitaMeshZmodem() {
+#if AKZ_ENABLE_ENGINE_TASK
+    _task.stop();
+#endif
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        _sessions[i].queued = false;
+        _releaseSession(i);
+    }
+    _timers.cancel(_admitTimer);
+#if AKZ_ENABLE_STORAGE_WORKER
+    _storage.stop();
+#endif
+}
 
 void AkitaMeshZmodem::begin(Meshtastic& meshInstance, FS& filesystem, Stream* debugStream) {
     _mesh = &meshInstance;
@@ -118,127 +238,2265 @@ void AkitaMeshZmodem::begin(Meshtastic& meshInstance, FS& filesystem, Stream* de
     _debug = debugStream;
     
     if (!_fs) { _logError("FS Invalid"); return; }
-    
-    delete _meshStream;
-    _meshStream = new MeshtasticZModemStream(_mesh, _debug, _maxPacketSize, AKZ_PACKET_IDENTIFIER);
-    
-    _zmodem.begin(*_meshStream);
+
+    ZModemLockGuard guard(_lock);
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        _sessions[i].queued = false;
+        _releaseSession(i);
+        _sessions[i].state = TransferState::IDLE;
+    }
+    _timers.cancel(_admitTimer);
+    _admitDue = false;
+    _primary = INVALID_SESSION;
+#if AKZ_ENABLE_JOB_QUEUE
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) _sessions[i].jobId = 0;
+    // Jobs left by the previous boot; interrupted ones continue their files
+    if (_jobs.load(*_fs, AKZ_JOB_QUEUE_FILE, millis())) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "Job queue restored: %u job(s)", (unsigned)_jobs.count());
+        _log(buf);
+    }
+    _kickJobs();
+#endif
+    // Vary the first session id across reboots so a peer still holding a stale
+    // session is unlikely to match our new one
+    _nextSessionId = 1 + ((_mesh->getNodeNum() ^ millis()) % 127);
+
     _log("Akita ZModem Initialized (Internal Engine)");
-    _resetTransferState();
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage.start(_onStorageProgress, this)) _log("Storage worker started");
+    else _logError("Storage worker failed to start, file I/O stays inline");
+#endif
+    _reofferSends();
+#if AKZ_ENABLE_FILE_INDEX
+    _index.load(*_fs, AKZ_FILE_INDEX_FILE);
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    // Followed files are checked on the first loop()
+    _tails.load(*_fs, AKZ_TAIL_FILE);
+    for (uint8_t i = 0; i < _tails.count(); ++i) _tails.at(i).checkAt = millis();
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+    _spoolFrom.load(*_fs, AKZ_SPOOL_ORIGIN_FILE);
+#endif
+#if AKZ_ENABLE_ENGINE_TASK
+    if (_task.start(_taskStep, this)) _log("Engine task started");
+    else _logError("Engine task failed to start");
+#endif
 }
 
-void AkitaMeshZmodem::_resetTransferState() {
-    if (_transferFile) _transferFile.close();
-    _currentState = TransferState::IDLE;
-    _bytesTransferred = 0;
-    _totalFileSize = 0;
-    _filename = "";
-    _destinationNodeId = BROADCAST_ADDR;
-    if(_meshStream) _meshStream->reset();
-    _zmodem.abort(); // Reset engine state
+int AkitaMeshZmodem::_allocSession() {
+    // Prefer slots other than the primary so its final stats stay readable
+    int fallback = INVALID_SESSION;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        if (_sessions[i].active || _sessions[i].queued) continue;
+        if (i != _primary) return i;
+        fallback = i;
+    }
+    return fallback;
 }
 
-void AkitaMeshZmodem::processDataPacket(MeshPacket& packet) {
-    if(_meshStream && (_currentState == TransferState::RECEIVING || _currentState == TransferState::SENDING)) {
-        _meshStream->pushPacket(packet);
+bool AkitaMeshZmodem::_openSession(int slot, bool sending, NodeNum peer) {
+    Session& s = _sessions[slot];
+    s.stream = new MeshtasticZModemStream(_mesh, _debug, _maxPacketSize, AKZ_PACKET_IDENTIFIER, &_pool);
+    s.engine = new ZModemSessionEngine();
+    if (!s.stream || !s.engine || !s.stream->hasBuffers()) {
+        _logError("Session rejected: buffer pool exhausted");
+        _releaseSession(slot);
+        return false;
     }
+    s.engine->setBufferPool(&_pool);
+    s.engine->setTimerWheel(&_timers);
+    s.stream->setAirtimeMeter(&_airtime);
+#if AKZ_ENABLE_ENGINE_TASK
+    s.stream->setTxQueue(&_txQueue);
+#endif
+    s.engine->begin(*s.stream);
+    if (!sending) s.engine->setAcceptsJoins(AKZ_ACCEPT_JOINED_STREAMS != 0);
+    s.active = true;
+    s.sending = sending;
+    s.peer = peer;
+    s.id = 0;
+    s.source = nullptr;
+    s.sink = nullptr;
+    s.batch = nullptr;
+    s.owner = this;
+    s.held = 0;
+#if AKZ_ENABLE_RESUME_JOURNAL
+    s.journal = false;
+    s.journalFound = false;
+    s.journalLive = false;
+    s.journaled = 0;
+#endif
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    s.checkpoint = false;
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    s.tail = false;
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+    s.spool = false;
+    s.spoolContinued = false;
+    s.spoolName = 0;
+#endif
+    s.totalFileSize = 0;
+    s.bytesTransferred = 0;
+    s.startTime = millis();
+    s.endTime = 0;
+    s.lastProgressUpdate = s.startTime;
+    s.maxLoopUs = 0;
+    s.priority = PRIORITY_NORMAL;
+    s.joined = false;
+    s.openOnAnnounce = false;
+    s.reserved = false;
+    s.state = sending ? TransferState::SENDING : TransferState::RECEIVING;
+    return true;
 }
 
-bool AkitaMeshZmodem::startSend(const String& filePath, NodeNum dest) {
-    if (_currentState != TransferState::IDLE || dest == BROADCAST_ADDR) return false;
-    _resetTransferState();
-    
-    _transferFile = _fs->open(filePath, FILE_READ);
-    if (!_transferFile || _transferFile.isDirectory()) return false;
-    
-    _filename = filePath;
-    _totalFileSize = _transferFile.size();
-    _destinationNodeId = dest;
-    _meshStream->setDestination(dest);
-    
-    _zmodem.setFileStream(&_transferFile, _filename, _totalFileSize);
-    if(_zmodem.send(_zmodemTimeout)) {
-        _currentState = TransferState::SENDING;
-        _transferStartTime = millis();
+void AkitaMeshZmodem::_releaseSession(int slot) {
+    if (slot < 0 || slot >= AKZ_MAX_SESSIONS) return;
+    Session& s = _sessions[slot];
+    // Coalesced and queued writes reach the file before it is closed
+    if (s.engine) s.engine->flushWrites();
+#if AKZ_ENABLE_STORAGE_WORKER
+    _storage.channel(slot).close();
+#endif
+    bool wroteFile = s.active && !s.sending && s.file;
+    if (s.file) s.file.close();
+    if (s.nextFile) s.nextFile.close();
+#if AKZ_ENABLE_AUTO_ACCEPT
+    // A spooled file is kept only once complete. A continued one held a
+    // complete copy before, and what was appended since is in order.
+    if (wroteFile && s.spool && s.state != TransferState::COMPLETE && !s.spoolContinued) {
+        _fs->remove(s.filename);
+        wroteFile = false;
+    }
+    if (wroteFile && s.spool) _noteSpooled(s);
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    if (wroteFile) _indexReceived(s);
+#else
+    (void)wroteFile;
+#endif
+    s.source = nullptr;
+    s.sink = nullptr;
+    s.batch = nullptr;
+    delete s.engine;
+    s.engine = nullptr;
+    delete s.stream;
+    s.stream = nullptr;
+    _table.unbind((uint8_t)slot);
+    if (s.active) {
+        s.endTime = millis();
+        if (s.sending) _dropSendCheckpoint(slot);
+        // Its sender's last packets may still be in flight
+        if (!s.sending && s.peer != BROADCAST_ADDR) {
+            _retiredPeer = s.peer;
+            _retiredId = s.id;
+        }
+        // Freed budget may admit a queued send
+        if (_oldestQueued() != INVALID_SESSION) _timers.arm(_admitTimer, 0);
+    }
+    s.active = false;
+}
+
+// Hand the session's file to the storage worker. Without the worker, or
+// with the pool too dry for its blocks, the engine does its I/O inline.
+void AkitaMeshZmodem::_attachStorage(int slot, bool reading) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    Session& s = _sessions[slot];
+    if (_storage.open(slot, &s.file, reading, reading ? 0 : s.bytesTransferred, reading ? s.totalFileSize : 0, &_pool)) {
+        s.engine->setStorage(&_storage.channel(slot));
+    }
+#else
+    (void)slot;
+    (void)reading;
+#endif
+}
+
+bool AkitaMeshZmodem::processDataPacket(MeshPacket& packet) {
+    unsigned long t0 = micros();
+    const uint8_t* p = packet.decoded.payload.getBuffer();
+    size_t len = packet.decoded.payload.length();
+    bool consumed = false;
+#if AKZ_ENABLE_ENGINE_TASK
+    // Lock-free hand-off: the engine task routes the packet on its next step
+    if (p && len >= STREAM_HEADER_LEN && p[0] == AKZ_PACKET_IDENTIFIER && len <= sizeof(ZModemQueuedPacket::data)) {
+        ZModemQueuedPacket* slot = _rxQueue.acquireSlot();
+        if (slot) {
+            slot->peer = packet.from;
+            slot->len = (uint16_t)len;
+            memcpy(slot->data, p, len);
+            _rxQueue.commit();
+            _task.wake();
+            consumed = true;
+        } else {
+            _rxQueueDrops++; // ZModem recovers the gap like any lost packet
+        }
+    }
+#else
+    int slot = _routeDataPacket(packet.from, p, len);
+    if (slot != INVALID_SESSION) {
+        // Answer now instead of on the next loop() call
+        _timers.advance(millis());
+        _serviceSession(slot, _loopBudgetUs);
+        consumed = true;
+    }
+#endif
+    uint32_t tookUs = micros() - t0;
+    _packetLatency.add(tookUs);
+    if (_loopBudgetUs && tookUs > _loopBudgetUs) _overBudget++;
+    return consumed;
+}
+
+int AkitaMeshZmodem::_routeDataPacket(NodeNum from, const uint8_t* p, size_t len) {
+    if (!p || len < STREAM_HEADER_LEN || p[0] != AKZ_PACKET_IDENTIFIER) return INVALID_SESSION;
+
+    uint8_t sessionByte = p[1];
+    uint16_t pid = ((uint16_t)p[2] << 8) | p[3];
+    uint8_t slot = _table.find(from, sessionByte);
+
+    if (slot == ZModemSessionTable::NO_SLOT) {
+        // Replies for sessions we did not start are stale; drop them
+        if (sessionByte & SESSION_RESPONDER_BIT) return INVALID_SESSION;
+        bool opening = opensSession(p + STREAM_HEADER_LEN, len - STREAM_HEADER_LEN);
+        // Nor may the tail of a receive that just ended (an abort, a
+        // preempted job) start a new one. A sender that rebooted and offers
+        // the same session again starts over with ZRQINIT and is let in.
+        if (from == _retiredPeer && sessionByte == _retiredId) {
+            if (!opening) return INVALID_SESSION;
+            _retiredPeer = BROADCAST_ADDR;
+        }
+        // A new stream from a peer we are already receiving from joins that
+        // link, leaving armed receive sessions for other senders
+        if (opening || opensJoinedStream(p + STREAM_HEADER_LEN, len - STREAM_HEADER_LEN)) {
+            int joined = _joinStream(from, sessionByte);
+            if (joined != INVALID_SESSION) slot = (uint8_t)joined;
+        }
+        // A new sender: bind it to the first armed receive session. Only a
+        // packet opening a session may bind, not the tail of another transfer.
+        for (int i = 0; i < AKZ_MAX_SESSIONS && opening && slot == ZModemSessionTable::NO_SLOT; ++i) {
+            Session& s = _sessions[i];
+            if (!s.active || s.sending || s.peer != BROADCAST_ADDR) continue;
+            if (!_table.bind((uint8_t)i, from, sessionByte)) return INVALID_SESSION;
+            s.peer = from;
+            s.id = sessionByte;
+            s.stream->setDestination(from);
+            s.stream->setSessionByte(sessionByte | SESSION_RESPONDER_BIT);
+            slot = (uint8_t)i;
+            {
+                char buf[96];
+                snprintf(buf, sizeof(buf), "[S%d] Receive bound to 0x%lX (session %u)", i, (unsigned long)from, sessionByte);
+                _log(buf);
+            }
+            break;
+        }
+#if AKZ_ENABLE_AUTO_ACCEPT
+        // Nobody expects this sender: take it into the spool if allowed
+        if (slot == ZModemSessionTable::NO_SLOT && opening) {
+            int spooled = _autoAccept(from, sessionByte);
+            if (spooled != INVALID_SESSION) slot = (uint8_t)spooled;
+        }
+#endif
+        if (slot == ZModemSessionTable::NO_SLOT) return INVALID_SESSION;
+    }
+
+    // The peer's half of a transfer is channel time our sessions take too
+    _airtime.record(len, millis());
+    _sessions[slot].stream->pushPayload(p + STREAM_HEADER_LEN, len - STREAM_HEADER_LEN, pid);
+    return slot;
+}
+
+bool AkitaMeshZmodem::startSend(const String& filePath, NodeNum dest, int* sessionOut, uint8_t priority) {
+    if (!_fs) return false;
+    return _startSend(filePath, nullptr, dest, sessionOut, priority);
+}
+
+bool AkitaMeshZmodem::startSend(ZModemSource& source, const char* name, NodeNum dest, int* sessionOut, uint8_t priority) {
+    return _startSend(String(name ? name : ""), &source, dest, sessionOut, priority);
+}
+
+bool AkitaMeshZmodem::startSendRange(const char* filePath, NodeNum dest, size_t offset, size_t length, int* sessionOut,
+                                     uint8_t priority) {
+    if (!_fs || !filePath) return false;
+    File f = _fs->open(filePath, FILE_READ);
+    if (!f || f.isDirectory()) return false;
+    size_t size = f.size();
+    f.close();
+    if (offset >= size) return false;
+    if (length == 0 || length > size - offset) length = size - offset;
+    return _startSend(String(filePath), nullptr, dest, sessionOut, priority, false, offset, length);
+}
+
+bool AkitaMeshZmodem::startSend(ZModemBatch& batch, NodeNum dest, int* sessionOut, uint8_t priority) {
+    if (!_fs || batch.count() == 0) return false;
+    batch.resetResults();
+    return _startSend(String(batch.path(0)), nullptr, dest, sessionOut, priority, false, 0, 0, &batch);
+}
+
+bool AkitaMeshZmodem::_startSend(const String& filePath, ZModemSource* source, NodeNum dest, int* sessionOut, uint8_t priority,
+                                 bool tail, size_t rangeStart, size_t rangeLength, ZModemBatch* batch) {
+    if (dest == BROADCAST_ADDR) return false;
+    ZModemLockGuard guard(_lock);
+    AdmissionResult& adm = _lastAdmission;
+    _admit(true, dest, priority, adm);
+    int slot = _allocSession();
+    if (slot == INVALID_SESSION) {
+        adm.decision = Admission::REJECTED;
+        adm.limits |= LIMIT_SESSIONS;
+        if (!adm.retryAfterMs) adm.retryAfterMs = _msUntilFirstFinish();
+    }
+    // Sends already waiting go first; a new one queues behind them
+    if (adm.decision == Admission::ADMITTED && _oldestQueued() != INVALID_SESSION) {
+        adm.decision = Admission::REJECTED;
+        adm.retryAfterMs = _msUntilFirstFinish();
+        _timers.arm(_admitTimer, 0);
+    }
+    if (adm.decision != Admission::ADMITTED) {
+#if AKZ_ADMIT_QUEUE_SENDS
+        if (slot != INVALID_SESSION && (source || batch || _fs->exists(filePath))) {
+            Session& s = _sessions[slot];
+            s.queued = true;
+            s.source = source;
+            s.batch = batch;
+            s.queueSeq = _queueSeq++;
+            s.sending = true;
+            s.peer = dest;
+            s.id = 0;
+            s.priority = priority;
+            s.joined = false;
+#if AKZ_ENABLE_TAIL_SEND
+            s.tail = tail;
+#endif
+            s.rangeStart = rangeStart;
+            s.rangeLength = rangeLength;
+            s.filename = filePath;
+            s.totalFileSize = 0;
+            s.bytesTransferred = 0;
+            s.startTime = millis();
+            s.endTime = 0;
+            s.maxLoopUs = 0;
+            s.state = TransferState::QUEUED;
+            adm.decision = Admission::QUEUED;
+            if (!_admitTimer.isArmed()) _timers.arm(_admitTimer, min((uint32_t)AKZ_ADMIT_RECHECK_MS, adm.retryAfterMs));
+            _primary = slot;
+            if (sessionOut) *sessionOut = slot;
+            char buf[160];
+            snprintf(buf, sizeof(buf), "[S%d] Send to 0x%lX queued: %s", slot, (unsigned long)dest, filePath.c_str());
+            _log(buf);
+            _logAdmission("Send", adm);
+#if AKZ_ENABLE_ENGINE_TASK
+            _task.wake();
+#endif
+            return true;
+        }
+#endif
+        _logAdmission("Send", adm);
+        return false;
+    }
+    if (!_beginSend(slot, filePath, dest, priority, source, nullptr, tail, rangeStart, rangeLength, batch)) return false;
+    // A batch is not offered again after a reboot
+    if (!batch) _checkpointSend(slot);
+    if (sessionOut) *sessionOut = slot;
+#if AKZ_ENABLE_ENGINE_TASK
+    _task.wake();
+#endif
+    return true;
+}
+
+// Open a send session in 'slot' (a free or queued record) and start the engine
+bool AkitaMeshZmodem::_beginSend(int slot, const String& filePath, NodeNum dest, uint8_t priority, ZModemSource* source,
+                                 const ZModemSendRecord* resumed, bool tail, size_t rangeStart, size_t rangeLength,
+                                 ZModemBatch* batch) {
+    bool join = _peerLinkReady(dest);
+    if (!_openSession(slot, true, dest)) return false;
+    Session& s = _sessions[slot];
+
+    if (batch) {
+        int first = _openBatchFile(*batch, 0, s.file);
+        if (first < 0) { _releaseSession(slot); return false; }
+        s.batch = batch;
+        s.batchIndex = (uint8_t)first;
+    } else if (!source) {
+        s.file = _fs->open(filePath, FILE_READ);
+        if (!s.file || s.file.isDirectory()) { _releaseSession(slot); return false; }
+        // A range is sent from the file through s.range, like a caller's
+        // source; the file may have shrunk while the send was queued
+        if (rangeLength) {
+            if (rangeStart + rangeLength > s.file.size()) { _releaseSession(slot); return false; }
+            s.range.attach(&s.file);
+            s.range.setRange(rangeStart, rangeLength);
+            source = &s.range;
+        }
+    }
+    if (source) {
+        s.source = source;
+        source->seek(0);
+    }
+
+    // Pick a session id not already used towards this peer. A send offered
+    // again after a reboot keeps the one its receiver knows.
+    uint8_t id = resumed ? resumed->sessionId : _nextSessionId;
+    for (int tries = 0; tries < 127; ++tries) {
+        if (_table.find(dest, id | SESSION_RESPONDER_BIT) == ZModemSessionTable::NO_SLOT) break;
+        id = (id % 127) + 1;
+    }
+    if (!resumed) _nextSessionId = (id % 127) + 1;
+    if (!_table.bind((uint8_t)slot, dest, id | SESSION_RESPONDER_BIT)) { _releaseSession(slot); return false; }
+
+    s.id = id;
+    s.filename = batch ? String(batch->path(s.batchIndex)) : filePath;
+    s.totalFileSize = source ? source->size() : s.file.size();
+    s.priority = priority;
+    s.stream->setDestination(dest);
+    s.stream->setSessionByte(id);
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    if (resumed) s.stream->setNextPacketId(resumed->packetId + SEND_PACKET_ID_SKIP);
+#endif
+
+    if (source) {
+        s.engine->setSource(source, s.filename.c_str(), s.totalFileSize);
+    } else {
+        s.engine->setFileStream(&s.file, s.filename, s.totalFileSize);
+        _attachStorage(slot, true);
+    }
+    if (batch) s.engine->onBatch(_onBatchNext, _onBatchDone, &s);
+#if AKZ_ENABLE_TAIL_SEND
+    // Past the first delivery the receiver's copy is continued, not replaced
+    s.tail = tail;
+    if (tail) {
+        const ZModemTailRecord* r = _tails.find(filePath.c_str(), dest);
+        s.engine->setCrashRecovery(r && r->offset > 0);
+    }
+#else
+    (void)tail;
+#endif
+    if(s.engine->send(_zmodemTimeout, join)) {
+        s.joined = join;
+        _updateHolds();
+        _logFootprint(slot);
+        _primary = slot;
         {
             char buf[160];
-            snprintf(buf, sizeof(buf), "Starting Send to 0x%lX for: %s", (unsigned long)dest, filePath.c_str());
+            snprintf(buf, sizeof(buf), "[S%d] Starting %s to 0x%lX for: %s%s", slot, join ? "joined stream" : "Send",
+                     (unsigned long)dest, s.filename.c_str(), batch ? " (batch)" : "");
             _log(buf);
         }
         return true;
     }
+    _logError("Session rejected: buffer pool exhausted");
+    _releaseSession(slot);
     return false;
 }
 
-bool AkitaMeshZmodem::startReceive(const String& filePath) {
-    if (_currentState != TransferState::IDLE) return false;
-    _resetTransferState();
+// First file of 'batch' from index 'from' on that opens, into 'f'; the ones
+// that do not are marked FAILED. -1 if none is left.
+int AkitaMeshZmodem::_openBatchFile(ZModemBatch& batch, int from, File& f) {
+    for (int i = from; i < batch.count(); ++i) {
+        f = _fs->open(batch.path(i), FILE_READ);
+        if (f && !f.isDirectory()) return i;
+        if (f) f.close();
+        batch.setResult((uint8_t)i, ZModemBatch::Result::FAILED);
+        char buf[160];
+        snprintf(buf, sizeof(buf), "Batch: cannot open %s, passing over it", batch.path(i));
+        _logError(buf);
+    }
+    return -1;
+}
+
+bool AkitaMeshZmodem::_onBatchNext(void* ctx, char* name, size_t cap, size_t& size) {
+    Session* s = static_cast<Session*>(ctx);
+    if (!s->owner->_batchNext((int)(s - s->owner->_sessions))) return false;
+    snprintf(name, cap, "%s", s->batch->path(s->nextIndex));
+    size = s->nextFile.size();
+    return true;
+}
+
+bool AkitaMeshZmodem::_onBatchDone(void* ctx, bool delivered) {
+    Session* s = static_cast<Session*>(ctx);
+    return s->owner->_batchDone((int)(s - s->owner->_sessions), delivered);
+}
+
+// Open the batch's file after the current one into nextFile, once
+bool AkitaMeshZmodem::_batchNext(int slot) {
+    Session& s = _sessions[slot];
+    if (s.nextFile) return true;
+    int next = _openBatchFile(*s.batch, s.batchIndex + 1, s.nextFile);
+    if (next < 0) return false;
+    s.nextIndex = (uint8_t)next;
+    return true;
+}
+
+// The receiver has the current file or skipped it: attach the next one
+bool AkitaMeshZmodem::_batchDone(int slot, bool delivered) {
+    Session& s = _sessions[slot];
+    s.batch->setResult(s.batchIndex, delivered ? ZModemBatch::Result::SENT : ZModemBatch::Result::SKIPPED);
+    char buf[160];
+    snprintf(buf, sizeof(buf), "[S%d] %s %s (%u/%u)", slot, s.filename.c_str(), delivered ? "delivered" : "skipped by receiver",
+             s.batchIndex + 1, s.batch->count());
+    _log(buf);
+#if AKZ_ENABLE_STORAGE_WORKER
+    s.engine->setStorage(nullptr);
+    _storage.channel(slot).close();
+#endif
+    s.file.close();
+    if (!_batchNext(slot)) return false;
+    s.file = s.nextFile;
+    s.nextFile = File();
+    s.batchIndex = s.nextIndex;
+    s.filename = s.batch->path(s.batchIndex);
+    s.totalFileSize = s.file.size();
+    s.bytesTransferred = 0;
+    s.engine->setFileStream(&s.file, s.filename, s.totalFileSize);
+    _attachStorage(slot, true);
+    return true;
+}
+
+bool AkitaMeshZmodem::startReceive(const String& filePath, int* sessionOut, bool resume) {
+    if (!_fs) return false;
+    ZModemLockGuard guard(_lock);
+    // Receives are never queued: the sender is about to start
+    _admit(false, BROADCAST_ADDR, PRIORITY_NORMAL, _lastAdmission);
+    int slot = _lastAdmission.decision == Admission::ADMITTED ? _allocSession() : INVALID_SESSION;
+    if (slot == INVALID_SESSION) {
+        _lastAdmission.decision = Admission::REJECTED;
+        if (!_lastAdmission.limits) {
+            _lastAdmission.limits = LIMIT_SESSIONS;
+            _lastAdmission.retryAfterMs = _msUntilFirstFinish();
+        }
+        _logAdmission("Receive", _lastAdmission);
+        return false;
+    }
+    if (!_beginReceive(slot, filePath, resume)) return false;
+    if (sessionOut) *sessionOut = slot;
+    return true;
+}
+
+// Open a receive session in free record 'slot' and start the engine
+bool AkitaMeshZmodem::_beginReceive(int slot, const String& filePath, bool resume) {
+    if (!_openSession(slot, false, BROADCAST_ADDR)) return false;
+    Session& s = _sessions[slot];
     
-    _transferFile = _fs->open(filePath, FILE_WRITE);
-    if (!_transferFile) return false;
+    // Resuming keeps what an earlier run received and appends to it
+    bool exists = _fs->exists(filePath);
+    resume = resume && exists;
+#if AKZ_ENABLE_RESUME_JOURNAL
+    // So does a journal left by an interrupted run; ZFILE then tells
+    // whether the same file is coming again (see _checkJournal)
+    s.journal = true;
+    s.journalFound = exists && ZModemResumeJournal::load(*_fs, filePath, s.journalRec);
+    resume = resume || s.journalFound;
+#endif
+    // Otherwise an existing file is still kept until ZFILE: a sender
+    // asking for crash recovery continues it (see _acceptFile)
+    s.file = _fs->open(filePath, exists ? FILE_APPEND : FILE_WRITE);
+    if (!s.file) { _releaseSession(slot); return false; }
     
-    _filename = filePath;
-    _zmodem.setFileStream(&_transferFile, _filename, 0);
+    s.filename = filePath;
+    s.engine->setFileStream(&s.file, s.filename, 0);
+    s.held = exists ? s.file.size() : 0;
+    if (resume) {
+        s.bytesTransferred = s.held;
+#if AKZ_ENABLE_RESUME_JOURNAL
+        if (s.journalFound && s.journalRec.offset < s.bytesTransferred) {
+            // Past the journaled offset the data may be torn: write it again
+            s.file.close();
+            s.file = _fs->open(filePath, "r+");
+            if (!s.file || !s.file.seek(s.journalRec.offset)) { _releaseSession(slot); return false; }
+            s.bytesTransferred = s.journalRec.offset;
+        }
+#endif
+        s.held = s.bytesTransferred;
+        s.engine->setResumeOffset(s.bytesTransferred);
+    }
+    s.engine->onAnnounce(_onAnnounce, &s);
+    s.engine->onNextFile(_onNextFile, &s);
+    _attachStorage(slot, false);
     
-    if(_zmodem.receive(_zmodemTimeout)) {
-        _currentState = TransferState::RECEIVING;
-        _transferStartTime = millis();
+    if(s.engine->receive(_zmodemTimeout)) {
+        _logFootprint(slot);
+        _primary = slot;
         {
             char buf[160];
-            snprintf(buf, sizeof(buf), "Starting Receive to: %s", filePath.c_str());
+            snprintf(buf, sizeof(buf), "[S%d] Starting Receive to: %s%s", slot, filePath.c_str(),
+                     resume ? " (resuming)" : "");
             _log(buf);
         }
         return true;
     }
+    _logError("Session rejected: buffer pool exhausted");
+    _releaseSession(slot);
     return false;
 }
 
+bool AkitaMeshZmodem::startReceive(ZModemSink& sink, int* sessionOut) {
+    ZModemLockGuard guard(_lock);
+    _admit(false, BROADCAST_ADDR, PRIORITY_NORMAL, _lastAdmission);
+    int slot = _lastAdmission.decision == Admission::ADMITTED ? _allocSession() : INVALID_SESSION;
+    if (slot == INVALID_SESSION) {
+        _lastAdmission.decision = Admission::REJECTED;
+        if (!_lastAdmission.limits) {
+            _lastAdmission.limits = LIMIT_SESSIONS;
+            _lastAdmission.retryAfterMs = _msUntilFirstFinish();
+        }
+        _logAdmission("Receive", _lastAdmission);
+        return false;
+    }
+    if (!_openSession(slot, false, BROADCAST_ADDR)) return false;
+    Session& s = _sessions[slot];
+    s.sink = &sink;
+    s.filename = "(sink)";
+    s.engine->setSink(&sink);
+    // Whatever the sink already holds is kept; the sender continues after it
+    s.bytesTransferred = sink.size();
+    if (s.bytesTransferred) s.engine->setResumeOffset(s.bytesTransferred);
+    if (!s.engine->receive(_zmodemTimeout)) {
+        _logError("Session rejected: buffer pool exhausted");
+        _releaseSession(slot);
+        return false;
+    }
+    _logFootprint(slot);
+    _primary = slot;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "[S%d] Starting Receive to sink", slot);
+    _log(buf);
+    if (sessionOut) *sessionOut = slot;
+    return true;
+}
+
 // C-string overloads (convenience wrappers to avoid callers allocating Arduino Strings)
-bool AkitaMeshZmodem::startSend(const char* filePath, NodeNum dest) {
+bool AkitaMeshZmodem::startSend(const char* filePath, NodeNum dest, int* sessionOut, uint8_t priority) {
     if (!filePath) return false;
-    return startSend(String(filePath), dest);
+    return startSend(String(filePath), dest, sessionOut, priority);
 }
 
-bool AkitaMeshZmodem::startReceive(const char* filePath) {
+bool AkitaMeshZmodem::startReceive(const char* filePath, int* sessionOut, bool resume) {
     if (!filePath) return false;
-    return startReceive(String(filePath));
+    return startReceive(String(filePath), sessionOut, resume);
+}
+
+// --- Admission control ---
+
+// Would one more session fit the session count, the pool memory committed to
+// running sessions and the projected airtime share?
+void AkitaMeshZmodem::_admit(bool sending, NodeNum peer, uint8_t priority, AdmissionResult& out) const {
+    size_t running = 0;
+    size_t committed = 0;
+    uint32_t estimatePct = 0;
+    bool displaces = false;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        const Session& s = _sessions[i];
+        if (!s.active) continue;
+        running++;
+        committed += sessionCommittedBytes(s.sending);
+        estimatePct += s.sending ? AKZ_ADMIT_SEND_AIRTIME_PCT : AKZ_ADMIT_RECV_AIRTIME_PCT;
+        // An outranked stream to the same peer is held, not added to. A new
+        // stream from a peer already sending to us shares that link: its
+        // sender admitted it against the same channel, holding what it outranks.
+        if (sending && s.sending && s.peer == peer && s.priority < priority) displaces = true;
+        if (!sending && !s.sending && peer != BROADCAST_ADDR && s.peer == peer) displaces = true;
+    }
+    uint32_t measuredPct = _airtime.sharePercent(millis());
+    uint32_t projectedPct = max(measuredPct, estimatePct) + (sending ? AKZ_ADMIT_SEND_AIRTIME_PCT : AKZ_ADMIT_RECV_AIRTIME_PCT);
+    size_t reserve = (size_t)AKZ_ADMIT_POOL_RESERVE_SLABS * ZModemBufferPool::SLAB_SIZE;
+
+    out.limits = 0;
+    if (running >= AKZ_ADMIT_MAX_ACTIVE) out.limits |= LIMIT_SESSIONS;
+    if (committed + sessionCommittedBytes(sending) + reserve > _pool.capacityBytes()) out.limits |= LIMIT_MEMORY;
+    if (projectedPct > AKZ_ADMIT_AIRTIME_PCT && !displaces) out.limits |= LIMIT_AIRTIME;
+    out.decision = out.limits ? Admission::REJECTED : Admission::ADMITTED;
+    out.committedBytes = committed;
+    out.airtimePct = projectedPct > 255 ? 255 : (uint8_t)projectedPct;
+    out.retryAfterMs = 0;
+    if (!out.limits) return;
+
+    uint32_t wait = _msUntilFirstFinish();
+    if ((out.limits & LIMIT_AIRTIME) && measuredPct > estimatePct) {
+        // Once that traffic stops, the window sheds the excess linearly
+        uint32_t excess = min(projectedPct - AKZ_ADMIT_AIRTIME_PCT, measuredPct);
+        wait += (uint32_t)((uint64_t)AKZ_AIRTIME_WINDOW_MS * excess / measuredPct);
+    }
+    out.retryAfterMs = wait;
+}
+
+// Projected time until the first running session ends, from its average rate
+// so far, bounded by AKZ_ADMIT_MIN/MAX_RETRY_MS
+uint32_t AkitaMeshZmodem::_msUntilFirstFinish() const {
+    uint32_t best = 0xFFFFFFFFUL;
+    bool running = false;
+    unsigned long now = millis();
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        const Session& s = _sessions[i];
+        if (!s.active) continue;
+        running = true;
+        if (s.bytesTransferred == 0 || s.totalFileSize <= s.bytesTransferred) continue;
+        uint64_t eta = (uint64_t)(s.totalFileSize - s.bytesTransferred) * (now - s.startTime) / s.bytesTransferred;
+        if (eta < best) best = (uint32_t)min(eta, (uint64_t)0xFFFFFFFEUL);
+    }
+    uint32_t ms = !running ? 0 : (best == 0xFFFFFFFFUL ? (uint32_t)AKZ_ADMIT_DEFAULT_RETRY_MS : best);
+    if (ms < AKZ_ADMIT_MIN_RETRY_MS) ms = AKZ_ADMIT_MIN_RETRY_MS;
+    if (ms > AKZ_ADMIT_MAX_RETRY_MS) ms = AKZ_ADMIT_MAX_RETRY_MS;
+    return ms;
+}
+
+int AkitaMeshZmodem::_oldestQueued() const {
+    int oldest = INVALID_SESSION;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        if (!_sessions[i].queued) continue;
+        if (oldest == INVALID_SESSION || (int32_t)(_sessions[i].queueSeq - _sessions[oldest].queueSeq) < 0) oldest = i;
+    }
+    return oldest;
+}
+
+// Start queued sends in arrival order while they fit; the first one that
+// does not fit waits for the next re-check
+void AkitaMeshZmodem::_admitQueued() {
+    _admitDue = false;
+    for (int slot = _oldestQueued(); slot != INVALID_SESSION; slot = _oldestQueued()) {
+        Session& s = _sessions[slot];
+        AdmissionResult adm;
+        _admit(true, s.peer, s.priority, adm);
+        if (adm.decision != Admission::ADMITTED) {
+            _timers.arm(_admitTimer, min((uint32_t)AKZ_ADMIT_RECHECK_MS, adm.retryAfterMs));
+            return;
+        }
+        s.queued = false;
+        String path = s.filename;
+        bool tail = false;
+#if AKZ_ENABLE_TAIL_SEND
+        tail = s.tail;
+#endif
+        ZModemBatch* batch = s.batch;
+        if (_beginSend(slot, path, s.peer, s.priority, s.source, nullptr, tail, s.rangeStart, s.rangeLength, batch)) {
+            if (!batch) _checkpointSend(slot);
+            continue;
+        }
+        // Removed meanwhile, or the pool is fragmented: report it like any failed transfer
+        s.state = TransferState::ERROR;
+        s.endTime = millis();
+        char buf[160];
+        snprintf(buf, sizeof(buf), "[S%d] Queued send failed to start: %s", slot, path.c_str());
+        _logError(buf);
+        _jobSessionEnded(s, false);
+        if (_completeCb) _completeCb(slot, s.state, _completeCtx);
+#if AKZ_HAVE_COROUTINES
+        if (s.waiter) s.waiterReady = true;
+#endif
+    }
+}
+
+void AkitaMeshZmodem::_onAdmitTimer(void* ctx) {
+    static_cast<AkitaMeshZmodem*>(ctx)->_admitDue = true;
+}
+
+void AkitaMeshZmodem::_logAdmission(const char* what, const AdmissionResult& adm) {
+    if (!_debug || adm.decision == Admission::ADMITTED) return;
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%s %s:%s%s%s (committed %lu B, airtime %u%%), retry after %lu ms", what,
+             adm.decision == Admission::QUEUED ? "queued" : "rejected",
+             (adm.limits & LIMIT_SESSIONS) ? " sessions" : "",
+             (adm.limits & LIMIT_MEMORY) ? " memory" : "",
+             (adm.limits & LIMIT_AIRTIME) ? " airtime" : "",
+             (unsigned long)adm.committedBytes, adm.airtimePct, (unsigned long)adm.retryAfterMs);
+    _log(buf);
+}
+
+AkitaMeshZmodem::AdmissionResult AkitaMeshZmodem::getLastAdmission() const {
+    ZModemLockGuard guard(_lock);
+    return _lastAdmission;
+}
+
+bool AkitaMeshZmodem::checkAdmission(bool sending, NodeNum peer, AdmissionResult& out, uint8_t priority) const {
+    ZModemLockGuard guard(_lock);
+    _admit(sending, peer, priority, out);
+    return out.decision == Admission::ADMITTED;
+}
+
+uint8_t AkitaMeshZmodem::getAirtimePercent() const {
+    ZModemLockGuard guard(_lock);
+    return _airtime.sharePercent(millis());
 }
 
 void AkitaMeshZmodem::abortTransfer() {
-    _zmodem.abort();
-    _resetTransferState();
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) abortSession(i);
+}
+
+void AkitaMeshZmodem::abortSession(int slot) {
+    if (slot < 0 || slot >= AKZ_MAX_SESSIONS) return;
+    ZModemLockGuard guard(_lock);
+    Session& s = _sessions[slot];
+    bool ended = s.active || s.queued;
+    if (s.active && s.engine) s.engine->abort();
+    s.queued = false;
+    _releaseSession(slot);
+    s.state = TransferState::IDLE;
+    // A job's run aborted from outside counts as a failed run
+    if (ended) _jobSessionEnded(s, false);
+    _updateHolds();
+#if AKZ_HAVE_COROUTINES
+    if (s.waiter) s.waiterReady = true;
+#endif
 }
 
 AkitaMeshZmodem::TransferState AkitaMeshZmodem::loop() {
-    if (_currentState == TransferState::IDLE || _currentState == TransferState::COMPLETE || _currentState == TransferState::ERROR) return _currentState;
+    return loop(_loopBudgetUs);
+}
+
+AkitaMeshZmodem::TransferState AkitaMeshZmodem::loop(uint32_t budgetUs) {
+    unsigned long t0 = micros();
+    TransferState st;
+#if AKZ_ENABLE_ENGINE_TASK
+    // Sessions run on the engine task; just pass its frames to the mesh
+    (void)budgetUs;
+    _drainTxQueue();
+    st = (TransferState)_publishedState.load();
+#else
+    _runEngines(budgetUs);
+    st = getCurrentState();
+#endif
+    // In threaded mode the scheduler and the followed files are checked on
+    // the engine task, like the sessions they start
+#if AKZ_ENABLE_JOB_QUEUE && !AKZ_ENABLE_ENGINE_TASK
+    _runJobs();
+    // The queue file rewrite waits for a tick that has budget left
+    if (!budgetUs || micros() - t0 < budgetUs) _saveJobs();
+#endif
+#if AKZ_ENABLE_TAIL_SEND && !AKZ_ENABLE_ENGINE_TASK
+    _followTails();
+    _saveTails();
+#endif
+#if AKZ_ENABLE_FILE_INDEX && !AKZ_ENABLE_ENGINE_TASK
+    _saveIndex();
+    if (!budgetUs || micros() - t0 < budgetUs) _hashIndexStep();
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT && !AKZ_ENABLE_ENGINE_TASK
+    _saveSpoolFrom();
+#endif
+#if AKZ_HAVE_COROUTINES
+    _resumeWaiters();
+#endif
+    uint32_t tookUs = micros() - t0;
+    _loopLatency.add(tookUs);
+    if (budgetUs && tookUs > budgetUs) _overBudget++;
+    return st;
+}
+
+uint32_t AkitaMeshZmodem::nextDeadline() {
+#if AKZ_HAVE_COROUTINES
+    // A finished session's awaiting coroutine is resumed by the next loop()
+    {
+        ZModemLockGuard guard(_lock);
+        for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+            if (_sessions[i].waiterReady) return 0;
+        }
+    }
+#endif
+#if AKZ_ENABLE_FILE_INDEX && !AKZ_ENABLE_ENGINE_TASK
+    if (_index.dirty || _index.hashPending()) return 0; // saved or hashed by the next loop()
+#endif
+#if AKZ_ENABLE_ENGINE_TASK
+    // Timers, jobs and followed files run on the engine task; the mesh thread
+    // only has to come back for the frames it queues
+    if (_txQueue.size() > 0) return 0;
+    return getActiveSessionCount() > 0 ? (uint32_t)AKZ_ENGINE_TX_POLL_MS : NO_DEADLINE;
+#else
+    uint32_t jobWait = NO_DEADLINE;
+#if AKZ_ENABLE_JOB_QUEUE
+    jobWait = _msUntilJobCheck();
+    if (jobWait == 0) return 0;
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    // The checks of followed files also run from loop()
+    jobWait = min(jobWait, _msUntilTailCheck());
+    if (jobWait == 0) return 0;
+#endif
+    if (_admitDue) return 0;
+    uint32_t storageWait = NO_DEADLINE;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        Session& s = _sessions[i];
+        if (!s.active) continue;
+        if (s.engine->hasPendingWork() || s.stream->hasPendingTx()) return 0;
+        // The storage worker cannot wake this thread: poll until it is done
+        if (s.engine->isWaitingOnStorage()) storageWait = AKZ_STORAGE_POLL_MS;
+    }
+    return min(min(_timers.msUntilNextDeadline(millis()), jobWait), storageWait);
+#endif
+}
+
+void AkitaMeshZmodem::_runEngines(uint32_t budgetUs) {
+    // Fire due deadlines first; engines with nothing due and no input return at once
+    _timers.advance(millis());
+    if (_admitDue) _admitQueued();
+    _updateHolds();
+    unsigned long t0 = micros();
+    // Round-robin from the cursor so a busy session cannot starve the others
+    // when the budget runs out part way through
+    for (int n = 0; n < AKZ_MAX_SESSIONS; ++n) {
+        int i = (_serviceCursor + n) % AKZ_MAX_SESSIONS;
+        if (!_sessions[i].active) continue;
+        uint32_t left = 0;
+        if (budgetUs) {
+            uint32_t used = micros() - t0;
+            if (used >= budgetUs) { _serviceCursor = i; return; }
+            left = budgetUs - used;
+        }
+        _serviceSession(i, left);
+    }
+}
+
+#if AKZ_ENABLE_ENGINE_TASK
+uint32_t AkitaMeshZmodem::_taskStep(void* ctx) {
+    AkitaMeshZmodem* self = static_cast<AkitaMeshZmodem*>(ctx);
+    ZModemLockGuard guard(self->_lock);
+    while (ZModemQueuedPacket* pkt = self->_rxQueue.front()) {
+        self->_routeDataPacket(pkt->peer, pkt->data, pkt->len);
+        self->_rxQueue.pop();
+    }
+    self->_runEngines(0); // off the mesh thread: no need to bound the step
+#if AKZ_ENABLE_JOB_QUEUE
+    self->_runJobs();
+    self->_saveJobs();
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    self->_followTails();
+#endif
+    self->_publishedState = (uint8_t)self->getCurrentState();
+#if AKZ_ENABLE_FILE_INDEX
+    self->_hashIndexStep();
+    self->_saveIndex();
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    self->_saveTails();
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+    self->_saveSpoolFrom();
+#endif
 
-    int res = _zmodem.loop();
+    // Sleep until the next deadline unless a session can make progress now
+    uint32_t sleepMs = self->_timers.msUntilNextDeadline(millis());
+#if AKZ_ENABLE_JOB_QUEUE
+    sleepMs = min(sleepMs, self->_msUntilJobCheck());
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    sleepMs = min(sleepMs, self->_msUntilTailCheck());
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    // Files left to hash: come back after a tick for the next piece
+    if (self->_index.hashPending() && sleepMs > 1) sleepMs = 1;
+#endif
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        Session& s = self->_sessions[i];
+        if (!s.active) continue;
+        if (s.engine->hasPendingWork()) return 0;
+        // Frames stuck behind a full TX ring: retry shortly
+        if (s.stream->hasPendingTx()) {
+            s.stream->flush();
+            if (sleepMs > 1) sleepMs = 1;
+        }
+    }
+    return sleepMs;
+}
+
+void AkitaMeshZmodem::_drainTxQueue() {
+    bool drained = false;
+    while (ZModemQueuedPacket* pkt = _txQueue.front()) {
+        if (!sendDataPacket(_mesh, pkt->peer, pkt->data, pkt->len)) break; // retry next loop()
+        _txQueue.pop();
+        drained = true;
+    }
+    if (drained) _task.wake();
+}
+#endif
+
+#if AKZ_ENABLE_FILE_INDEX
+// Rewrite the index file after a change. Called where the sessions run,
+// loop() or the engine task, so the write stays off the mesh thread in
+// threaded mode.
+void AkitaMeshZmodem::_saveIndex() {
+    ZModemLockGuard guard(_lock);
+    if (!_index.dirty) return;
+    if (!_index.save(*_fs, AKZ_FILE_INDEX_FILE)) {
+        _logError("File index could not be saved");
+        _index.dirty = false; // retried with the next change
+    }
+}
+
+// Hash a piece of a file the index has no current hash for, where the
+// sessions run. Listings and sync only ask for hashes, so they never read a
+// whole file on the mesh thread.
+void AkitaMeshZmodem::_hashIndexStep() {
+    ZModemLockGuard guard(_lock);
+    _index.hashStep(*_fs, AKZ_INDEX_HASH_STEP_BYTES);
+}
+
+// Record the file a receive just closed. Its hash was taken by the engine as
+// the data was written; a file resumed part way is hashed at the next lookup.
+void AkitaMeshZmodem::_indexReceived(Session& s) {
+    uint8_t sha[ZModemSha256::DIGEST_SIZE];
+    bool hashed = s.engine && !s.engine->hasWriteError() && s.engine->receivedSha256(sha);
+    _index.noteWritten(*_fs, s.filename.c_str(), hashed ? sha : nullptr);
+}
+#endif
+
+void AkitaMeshZmodem::_serviceSession(int slot, uint32_t budgetUs) {
+    Session& s = _sessions[slot];
+    size_t bytesBefore = s.bytesTransferred;
+    unsigned long t0 = micros();
+    int res = s.engine->loop(budgetUs);
+    if (s.engine->getMaxLoopUs() > s.maxLoopUs) s.maxLoopUs = s.engine->getMaxLoopUs();
 
     // Mirror ZModem engine state into our public TransferState for better observability
-    _handleZmodemState((int)_zmodem.getState());
+    _handleZmodemState(s, (int)s.engine->getState());
 
     // Update progress markers
-    _bytesTransferred = _zmodem.getBytesTransferred();
-    _totalFileSize = _zmodem.getFileSize(); // Try to get size from receiver status
-    _updateProgress();
+    s.bytesTransferred = s.engine->getBytesTransferred();
+    if (s.engine->getFileSize() > 0) s.totalFileSize = s.engine->getFileSize(); // Receiver learns size from ZFILE
+    if (res == 0 && !s.sending && !s.reserved && (s.file || s.sink) && s.totalFileSize > 0 && !_reserveFile(slot)) {
+        s.engine->abort();
+        res = -1;
+    }
+#if AKZ_ENABLE_RESUME_JOURNAL
+    // Batched: one journal update per AKZ_RESUME_JOURNAL_BYTES received. It
+    // is a flash write of its own, so a tick that has used up its budget
+    // leaves it to a later one, by at most another interval. A failed
+    // transfer records how far it got, unless a write failed.
+    size_t due = s.journaled + AKZ_RESUME_JOURNAL_BYTES;
+    if (budgetUs && micros() - t0 >= budgetUs) due += AKZ_RESUME_JOURNAL_BYTES;
+    if (s.journalLive && ((res == 0 && s.bytesTransferred >= due) ||
+                          (res == -1 && s.bytesTransferred > s.journaled && !s.engine->hasWriteError()))) {
+        _journalCheckpoint(slot, res == -1);
+    }
+    if (res == 1 && s.journal) ZModemResumeJournal::remove(*_fs, s.filename);
+#endif
+    if (res == 0 && s.sending) _updateSendCheckpoint(slot);
+    _updateProgress(slot);
+    if (_progressCb && s.bytesTransferred != bytesBefore) {
+        _progressCb(slot, s.bytesTransferred, s.totalFileSize, _progressCtx);
+    }
 
     if (res == 1) {
-        _currentState = TransferState::COMPLETE;
-        _log("Transfer Complete!");
-        _transferFile.close();
+        s.state = TransferState::COMPLETE;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "[S%d] Transfer Complete!", slot);
+        _log(buf);
+        if (s.sending) _tailDelivered(slot);
+        _releaseSession(slot);
     } else if (res == -1) {
-        _currentState = TransferState::ERROR;
-        _logError("Transfer Error (ZModem Engine reported failure)");
-        _transferFile.close();
+        s.state = TransferState::ERROR;
+        char buf[96];
+        snprintf(buf, sizeof(buf), "[S%d] Transfer Error (ZModem Engine reported failure)", slot);
+        _logError(buf);
+        _releaseSession(slot);
+    }
+    if (res != 0) _jobSessionEnded(s, res == 1);
+    if (res != 0 && _completeCb) _completeCb(slot, s.state, _completeCtx);
+#if AKZ_HAVE_COROUTINES
+    if (res != 0 && s.waiter) s.waiterReady = true;
+#endif
+    _updateHolds();
+}
+
+// True if a send to 'peer' is past its handshake and the peer's ZRINIT
+// advertised CANJOIN, so it has a receive session bound to us that will take
+// a joined stream. Otherwise a new stream opens with its own handshake.
+bool AkitaMeshZmodem::_peerLinkReady(NodeNum peer) const {
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        const Session& s = _sessions[i];
+        if (!s.active || !s.sending || s.peer != peer || !s.engine->peerAcceptsJoins()) continue;
+        ZModemEngine::State st = s.engine->getState();
+        if (st == ZModemEngine::STATE_SEND_ZFILE || st == ZModemEngine::STATE_SEND_ZDATA || st == ZModemEngine::STATE_SEND_ZEOF) return true;
+    }
+    return false;
+}
+
+// Open a receive session for a new stream from a peer that already has one
+// running here. Returns the slot, or INVALID_SESSION to fall back to the
+// armed receive sessions.
+int AkitaMeshZmodem::_joinStream(NodeNum from, uint8_t sessionByte) {
+#if AKZ_ACCEPT_JOINED_STREAMS
+    int parent = INVALID_SESSION;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        const Session& s = _sessions[i];
+        if (s.active && !s.sending && s.peer == from) { parent = i; break; }
+    }
+    if (parent == INVALID_SESSION) return INVALID_SESSION;
+    // Remote streams pass the same admission as local ones; the sender keeps
+    // repeating ZFILE, so a stream that does not fit yet is simply not joined
+    AdmissionResult adm;
+    _admit(false, from, PRIORITY_NORMAL, adm);
+    if (adm.decision != Admission::ADMITTED) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "Stream %u from 0x%lX", sessionByte, (unsigned long)from);
+        _logAdmission(buf, adm);
+        return INVALID_SESSION;
+    }
+    int slot = _allocSession();
+    if (slot == INVALID_SESSION || !_openSession(slot, false, from)) return INVALID_SESSION;
+    Session& s = _sessions[slot];
+    // Saved next to the running receive, under the name ZFILE announces
+    const String& parentPath = _sessions[parent].filename;
+    int cut = parentPath.lastIndexOf('/');
+    s.filename = cut >= 0 ? parentPath.substring(0, cut + 1) : String("/");
+    s.id = sessionByte;
+    s.joined = true;
+    s.openOnAnnounce = true;
+    s.engine->setFileStream(&s.file, "", 0);
+    s.engine->onAnnounce(_onAnnounce, &s);
+    s.engine->onNextFile(_onNextFile, &s);
+    if (!_table.bind((uint8_t)slot, from, sessionByte) || !s.engine->receive(_zmodemTimeout, true)) {
+        _releaseSession(slot);
+        return INVALID_SESSION;
+    }
+    s.stream->setDestination(from);
+    s.stream->setSessionByte(sessionByte | SESSION_RESPONDER_BIT);
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[S%d] Stream %u from 0x%lX joined S%d", slot, sessionByte, (unsigned long)from, parent);
+    _log(buf);
+    return slot;
+#else
+    (void)from;
+    (void)sessionByte;
+    return INVALID_SESSION;
+#endif
+}
+
+bool AkitaMeshZmodem::_openJoinedFile(int slot) {
+    Session& s = _sessions[slot];
+    s.openOnAnnounce = false;
+    String path = s.filename;
+    const char* what = s.joined ? "joined stream" : "next file";
+    const char* saving = s.joined ? "Joined stream" : "Next file";
+#if AKZ_ENABLE_AUTO_ACCEPT
+    if (s.spool) {
+        if (!_spoolPath(slot, path)) return false;
+        what = "auto-accepted file";
+        saving = "Auto-accepted file";
+    } else
+#endif
+    {
+        // Keep only the last path component; the sender does not pick directories
+        const char* name = s.engine->getFilename();
+        const char* base = strrchr(name, '/');
+        base = base ? base + 1 : name;
+        char def[24];
+        if (!base[0] || strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+            snprintf(def, sizeof(def), "stream%u.bin", s.id);
+            base = def;
+        }
+        // Never over an existing file: the sender only names new ones
+        String dir = path;
+        if (!_freePath(slot, dir, base, path)) {
+            char buf[160];
+            snprintf(buf, sizeof(buf), "[S%d] Refusing %s: no free name in %s", slot, base, dir.c_str());
+            _logError(buf);
+            return false;
+        }
+    }
+    s.filename = path;
+#if AKZ_ENABLE_AUTO_ACCEPT
+    s.file = _fs->open(path, s.spoolContinued ? FILE_APPEND : FILE_WRITE);
+#else
+    s.file = _fs->open(path, FILE_WRITE);
+#endif
+    char buf[160];
+    if (!s.file) {
+        snprintf(buf, sizeof(buf), "[S%d] Cannot open %s for %s", slot, path.c_str(), what);
+        _logError(buf);
+        return false;
+    }
+    _attachStorage(slot, false);
+    snprintf(buf, sizeof(buf), "[S%d] %s saving to %s", slot, saving, path.c_str());
+    _log(buf);
+    return true;
+}
+
+// 'dir' + 'name', with "-k" before its extension for k > 0
+String AkitaMeshZmodem::_suffixedPath(const String& dir, const char* name, int k) {
+    String path = dir;
+    if (k == 0) {
+        path += name;
+        return path;
+    }
+    const char* dot = strrchr(name, '.');
+    size_t stem = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+    char suffix[8];
+    snprintf(suffix, sizeof(suffix), "-%d", k);
+    path += String(name).substring(0, stem);
+    path += suffix;
+    path += name + stem;
+    return path;
+}
+
+// 'dir' + 'name', or with "-1", "-2"... before its extension if that name is
+// taken, on flash or by another running receive. False if none is free.
+bool AkitaMeshZmodem::_freePath(int slot, const String& dir, const char* name, String& path) {
+    for (int k = 0; k < 100; ++k) {
+        path = _suffixedPath(dir, name, k);
+        bool taken = _fs->exists(path);
+        for (int i = 0; i < AKZ_MAX_SESSIONS && !taken; ++i) {
+            const Session& o = _sessions[i];
+            taken = i != slot && o.active && !o.sending && o.filename == path;
+        }
+        if (!taken) return true;
+    }
+    return false;
+}
+
+#if AKZ_ENABLE_AUTO_ACCEPT
+// Open a receive session for a sender no armed receive took, if the
+// auto-accept policy lets it in. Returns the slot, or INVALID_SESSION.
+int AkitaMeshZmodem::_autoAccept(NodeNum from, uint8_t sessionByte) {
+    if (_spoolDir.length() == 0) return INVALID_SESSION;
+    bool allowed = _spoolPeerCount == 0;
+    for (uint8_t i = 0; i < _spoolPeerCount && !allowed; ++i) allowed = _spoolPeers[i] == from;
+    if (!allowed) return INVALID_SESSION;
+    // As a joined stream: the sender repeats ZRQINIT until it fits
+    AdmissionResult adm;
+    _admit(false, from, PRIORITY_NORMAL, adm);
+    if (adm.decision != Admission::ADMITTED) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "Auto-accept from 0x%lX", (unsigned long)from);
+        _logAdmission(buf, adm);
+        return INVALID_SESSION;
+    }
+    int slot = _allocSession();
+    if (slot == INVALID_SESSION || !_openSession(slot, false, from)) return INVALID_SESSION;
+    Session& s = _sessions[slot];
+    s.filename = _spoolDir;
+    s.id = sessionByte;
+    s.spool = true;
+    s.openOnAnnounce = true;
+    s.engine->setFileStream(&s.file, "", 0);
+    s.engine->onAnnounce(_onAnnounce, &s);
+    s.engine->onNextFile(_onNextFile, &s);
+    s.stream->setDestination(from);
+    s.stream->setSessionByte(sessionByte | SESSION_RESPONDER_BIT);
+    // The ZRQINIT being routed gets the ZRINIT
+    if (!_table.bind((uint8_t)slot, from, sessionByte) || !s.engine->receive(_zmodemTimeout, true)) {
+        _releaseSession(slot);
+        return INVALID_SESSION;
+    }
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[S%d] Auto-accepting from 0x%lX (session %u)", slot, (unsigned long)from, sessionByte);
+    _log(buf);
+    return slot;
+}
+
+// Where the file ZFILE announced goes in the spool, or false if the policy
+// refuses it. The name is the announced one's last component, with anything
+// but letters, digits, '.', '-' and '_' replaced and leading dots dropped;
+// a name already taken gets "-1", "-2"... before its extension. A sender
+// continuing a file (s.spoolContinued on entry) appends to the copy it left
+// here if there is one, see _spoolContinuation().
+bool AkitaMeshZmodem::_spoolPath(int slot, String& path) {
+    Session& s = _sessions[slot];
+    size_t size = s.engine->getFileSize();
+
+    static const size_t NAME_MAX_LEN = 32;
+    const char* announced = s.engine->getFilename();
+    const char* base = strrchr(announced, '/');
+    base = base ? base + 1 : announced;
+    while (*base == '.') base++;
+    char name[NAME_MAX_LEN + 1];
+    size_t n = 0;
+    for (; *base && n < NAME_MAX_LEN - 4; ++base) {
+        char c = *base;
+        name[n++] = isalnum((unsigned char)c) || c == '.' || c == '-' || c == '_' ? c : '_';
+    }
+    name[n] = '\0';
+    if (n == 0) snprintf(name, sizeof(name), "file%u.bin", s.id);
+    s.spoolName = ZModemListing::nameHash(announced);
+    if (s.spoolContinued) s.spoolContinued = _spoolContinuation(slot, name, size, path);
+
+    const char* why = nullptr;
+    if ((_spoolMaxFile || _spoolQuota) && size == 0) {
+        why = "size unknown";
+    } else if (_spoolMaxFile && size > _spoolMaxFile) {
+        why = "too large";
+    } else if (_spoolQuota) {
+        // What the spool holds, and what the other spooled receives still expect
+        size_t used = 0;
+        File dir = _fs->open(_spoolDir.length() > 1 ? _spoolDir.substring(0, _spoolDir.length() - 1) : _spoolDir, FILE_READ);
+        if (dir && dir.isDirectory()) {
+            for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+                if (!f.isDirectory()) used += f.size();
+            }
+        }
+        for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+            const Session& o = _sessions[i];
+            if (i != slot && o.active && o.spool && o.totalFileSize > o.bytesTransferred) {
+                used += o.totalFileSize - o.bytesTransferred;
+            }
+        }
+        // A continued file already counts what it holds
+        if (used + size - s.held > _spoolQuota) why = "spool quota";
+    }
+    char buf[224]; // the announced name (up to 127 chars) and why it was refused
+    if (why) {
+        snprintf(buf, sizeof(buf), "[S%d] Refusing %s (%lu B) from 0x%lX: %s", slot, s.engine->getFilename(),
+                 (unsigned long)size, (unsigned long)s.peer, why);
+        _logError(buf);
+        return false;
+    }
+    if (s.spoolContinued) {
+        snprintf(buf, sizeof(buf), "[S%d] Continuing %s at %lu for 0x%lX", slot, path.c_str(), (unsigned long)s.held,
+                 (unsigned long)s.peer);
+        _log(buf);
+        return true;
     }
+    if (_freePath(slot, _spoolDir, name, path)) return true;
+    snprintf(buf, sizeof(buf), "[S%d] Refusing %s: no free name in %s", slot, announced, _spoolDir.c_str());
+    _logError(buf);
+    return false;
+}
 
-    return _currentState;
+// The spool file a sender continuing 'name' (ZCRESUM) last completed there:
+// of that name or with a "-N" suffix, received from the same node under the
+// same announced name, still the size it was then and no larger than what is
+// announced now. The most recently received one wins. Sets s.held and
+// s.bytesTransferred to its size.
+bool AkitaMeshZmodem::_spoolContinuation(int slot, const char* name, size_t size, String& path) {
+    Session& s = _sessions[slot];
+    int best = -1;
+    for (int k = 0; k < 100; ++k) {
+        String p = _suffixedPath(_spoolDir, name, k);
+        const ZModemTailRecord* r = _spoolFrom.find(p.c_str(), s.peer);
+        int order = r ? (int)(r - &_spoolFrom.at(0)) : -1;
+        if (order <= best || r->fingerprint != s.spoolName || r->offset > size) continue;
+        bool busy = false;
+        for (int i = 0; i < AKZ_MAX_SESSIONS && !busy; ++i) {
+            const Session& o = _sessions[i];
+            busy = i != slot && o.active && !o.sending && o.filename == p;
+        }
+        File f = busy ? File() : _fs->open(p, FILE_READ);
+        if (!f || f.isDirectory() || f.size() != r->offset) continue;
+        f.close();
+        best = order;
+        path = p;
+        s.held = r->offset;
+    }
+    if (best < 0) return false;
+    s.bytesTransferred = s.held;
+    return true;
 }
 
+// Remember which node a kept spool file came from, and its size
+void AkitaMeshZmodem::_noteSpooled(const Session& s) {
+    File f = _fs->open(s.filename, FILE_READ);
+    if (!f) return;
+    ZModemTailRecord* r = _spoolFrom.use(s.filename.c_str(), s.peer);
+    if (r) {
+        r->offset = (uint32_t)f.size();
+        r->fingerprint = s.spoolName;
+        _spoolFrom.dirty = true;
+    }
+    f.close();
+}
+
+// Rewrite the spool origins after a change, like _saveIndex()
+void AkitaMeshZmodem::_saveSpoolFrom() {
+    ZModemLockGuard guard(_lock);
+    if (!_spoolFrom.dirty) return;
+    if (!_spoolFrom.save(*_fs, AKZ_SPOOL_ORIGIN_FILE)) {
+        _logError("Spool origins could not be saved");
+        _spoolFrom.dirty = false; // retried with the next change
+    }
+}
+
+bool AkitaMeshZmodem::setAutoAccept(const AutoAcceptPolicy& policy) {
+    const char* dir = policy.spoolDir;
+    if (!_fs || !dir || dir[0] != '/' || policy.peerCount > AKZ_AUTO_ACCEPT_PEERS || (policy.peerCount && !policy.peers)) {
+        return false;
+    }
+    ZModemLockGuard guard(_lock);
+    String d(dir);
+    if (!d.endsWith("/")) d += '/';
+    if (d.length() > 1) {
+        String bare = d.substring(0, d.length() - 1);
+        if (!_fs->exists(bare)) _fs->mkdir(bare);
+    }
+    _spoolDir = d;
+    _spoolMaxFile = policy.maxFileBytes;
+    _spoolQuota = policy.quotaBytes;
+    _spoolPeerCount = policy.peerCount;
+    for (uint8_t i = 0; i < policy.peerCount; ++i) _spoolPeers[i] = policy.peers[i];
+    char buf[160];
+    snprintf(buf, sizeof(buf), "Auto-accepting into %s from %s (file limit %lu B, quota %lu B)", d.c_str(),
+             policy.peerCount ? "listed nodes" : "any node", (unsigned long)_spoolMaxFile, (unsigned long)_spoolQuota);
+    _log(buf);
+    return true;
+}
+
+void AkitaMeshZmodem::disableAutoAccept() {
+    ZModemLockGuard guard(_lock);
+    _spoolDir = "";
+}
+#endif
+
+bool AkitaMeshZmodem::_onNextFile(void* ctx, const char* name, size_t size, size_t& offset) {
+    (void)name;
+    (void)offset;
+    Session* s = static_cast<Session*>(ctx);
+    return s->owner->_nextReceiveFile((int)(s - s->owner->_sessions), size);
+}
+
+// The sender goes on with another file; the current one is complete and
+// flushed. The new one is saved next to it under the name ZFILE announces
+// (or in the spool), with "-1", "-2"... if that is taken (_freePath), from
+// the start: follow-up files keep no journal.
+bool AkitaMeshZmodem::_nextReceiveFile(int slot, size_t size) {
+    Session& s = _sessions[slot];
+#if AKZ_ENABLE_STORAGE_WORKER
+    s.engine->setStorage(nullptr);
+    _storage.channel(slot).close();
+#endif
+    size_t got = s.file ? s.file.size() : 0;
+    if (s.file) {
+        s.file.close();
+#if AKZ_ENABLE_FILE_INDEX
+        _indexReceived(s);
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+        if (s.spool) _noteSpooled(s);
+#endif
+    }
+#if AKZ_ENABLE_RESUME_JOURNAL
+    if (s.journal) ZModemResumeJournal::remove(*_fs, s.filename);
+    s.journal = false;
+    s.journalLive = false;
+#endif
+    char buf[160];
+    snprintf(buf, sizeof(buf), "[S%d] Received %s (%lu B)", slot, s.filename.c_str(), (unsigned long)got);
+    _log(buf);
+    int cut = s.filename.lastIndexOf('/');
+    s.filename = cut >= 0 ? s.filename.substring(0, cut + 1) : String("/");
+    s.reserved = false;
+    s.held = 0;
+    s.bytesTransferred = 0;
+    s.totalFileSize = size;
+#if AKZ_ENABLE_AUTO_ACCEPT
+    s.spoolContinued = false;
+#endif
+    return _openJoinedFile(slot);
+}
+
+bool AkitaMeshZmodem::_onAnnounce(void* ctx, const char* name, size_t size, size_t& offset) {
+    Session* s = static_cast<Session*>(ctx);
+    return s->owner->_acceptFile((int)(s - s->owner->_sessions), name, size, offset);
+}
+
+// ZFILE named the file: settle where its data goes before ZRPOS answers. A
+// sender asking for crash recovery (ZCRESUM) continues what the file holds,
+// unless that is more than it announces. A resumed receive continues where
+// it stopped; with the journal, only if the same sender announces the same
+// file again. Anything else replaces the file.
+bool AkitaMeshZmodem::_acceptFile(int slot, const char* name, size_t size, size_t& offset) {
+    Session& s = _sessions[slot];
+    if (!s.file) {
+        if (!s.openOnAnnounce) return true; // a sink
+        // A joined or auto-accepted stream learns its file from ZFILE. A
+        // sender continuing a file may append to its copy in the spool.
+#if AKZ_ENABLE_AUTO_ACCEPT
+        s.spoolContinued = s.spool && s.engine->isCrashRecovery();
+#endif
+        if (!_openJoinedFile(slot)) return false;
+        offset = s.bytesTransferred;
+        return true;
+    }
+    bool keep = offset > 0;
+#if AKZ_ENABLE_RESUME_JOURNAL
+    keep = keep && s.journalFound && s.journalRec.matches(s.peer, name, size);
+#endif
+    bool recover = s.engine->isCrashRecovery() && s.held > 0 && s.held <= size;
+    char buf[160];
+    if (recover) {
+        snprintf(buf, sizeof(buf), "[S%d] Continuing %s at %lu", slot, s.filename.c_str(), (unsigned long)s.held);
+        _log(buf);
+    } else if (keep) {
+        snprintf(buf, sizeof(buf), "[S%d] Resuming %s at %lu from journal", slot, s.filename.c_str(), (unsigned long)offset);
+        _log(buf);
+    } else if (offset > 0) {
+        snprintf(buf, sizeof(buf), "[S%d] %s holds another transfer, starting over", slot, s.filename.c_str());
+        _log(buf);
+    }
+    size_t at = recover ? s.held : keep ? offset : 0;
+    if (at != offset || (at == 0 && s.held > 0)) {
+#if AKZ_ENABLE_STORAGE_WORKER
+        s.engine->setStorage(nullptr);
+        _storage.channel(slot).close();
+#endif
+        if (at == 0) {
+            s.file.close();
+            s.file = _fs->open(s.filename, FILE_WRITE);
+            if (!s.file) return false;
+        }
+        s.bytesTransferred = at;
+        offset = at;
+        _attachStorage(slot, false);
+    }
+#if AKZ_ENABLE_RESUME_JOURNAL
+    return _checkJournal(slot, name, size, offset);
+#else
+    (void)name;
+    s.bytesTransferred = offset;
+    return true;
+#endif
+}
+
+#if AKZ_ENABLE_RESUME_JOURNAL
+// Journal the transfer ZFILE announced, from 'offset' on
+bool AkitaMeshZmodem::_checkJournal(int slot, const char* name, size_t size, size_t& offset) {
+    Session& s = _sessions[slot];
+    s.journalRec.peer = s.peer;
+    s.journalRec.size = (uint32_t)size;
+    strncpy(s.journalRec.name, name, sizeof(s.journalRec.name) - 1);
+    s.journalRec.name[sizeof(s.journalRec.name) - 1] = '\0';
+    s.journalLive = true;
+    s.bytesTransferred = offset;
+    _journalCheckpoint(slot, false);
+    return true;
+}
+
+// Record how much of the file is on flash. Data still gathered for a write
+// unit is left there, so units stay whole, unless 'flush' (the transfer
+// ended) writes it out first.
+bool AkitaMeshZmodem::_journalCheckpoint(int slot, bool flush) {
+    Session& s = _sessions[slot];
+    if (flush) s.engine->flushWrites();
+#if AKZ_ENABLE_STORAGE_WORKER
+    // Queued writes first; retried on a later tick while they are pending
+    ZModemStorageChannel& ch = _storage.channel(slot);
+    if (ch.isOpen() && !ch.ready(0)) return false;
+#endif
+    if (s.engine->hasWriteError()) return false;
+    s.file.flush();
+    s.journalRec.offset = (uint32_t)(s.bytesTransferred - s.engine->pendingWrites());
+    if (!ZModemResumeJournal::save(*_fs, s.filename, s.journalRec)) return false;
+    s.journaled = s.journalRec.offset;
+    return true;
+}
+#endif
+
+// --- Send checkpoint ---
+
+// Record a file send so a reboot does not lose it. Sends from a caller's
+// source are not recorded, nor are job sends: the job queue restores those.
+// Neither are tail sends; the next one continues from the tail table. A
+// range send has s.source set and is left out with the caller's sources.
+void AkitaMeshZmodem::_checkpointSend(int slot) {
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    Session& s = _sessions[slot];
+    if (!s.active || s.source || s.filename.length() >= AKZ_JOB_PATH_MAX) return;
+#if AKZ_ENABLE_TAIL_SEND
+    if (s.tail) return;
+#endif
+    ZModemSendRecord& r = _sendCkpt.at((uint8_t)slot);
+    size_t size;
+    r.fingerprint = ZModemSendCheckpoint::fingerprint(*_fs, s.filename.c_str(), size);
+    if (size == 0 || size != s.totalFileSize) return;
+    r.used = true;
+    r.sessionId = s.id;
+    r.priority = s.priority;
+    r.packetId = s.stream->nextPacketId();
+    r.peer = s.peer;
+    r.size = (uint32_t)size;
+    r.offset = 0;
+    strncpy(r.path, s.filename.c_str(), sizeof(r.path) - 1);
+    r.path[sizeof(r.path) - 1] = '\0';
+    s.checkpoint = true;
+    if (!_sendCkpt.save(*_fs, AKZ_SEND_CHECKPOINT_FILE)) _logError("Send checkpoint could not be saved");
+#else
+    (void)slot;
+#endif
+}
+
+// Batched like the receive journal: one update per AKZ_SEND_CHECKPOINT_BYTES
+// acknowledged, or when the packet ids have moved on far enough that a
+// restored stream might reuse one its receiver has seen
+void AkitaMeshZmodem::_updateSendCheckpoint(int slot) {
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    Session& s = _sessions[slot];
+    if (!s.checkpoint) return;
+    ZModemSendRecord& r = _sendCkpt.at((uint8_t)slot);
+    size_t acked = s.engine->getAckedBytes();
+    uint16_t pid = s.stream->nextPacketId();
+    if (acked < r.offset + AKZ_SEND_CHECKPOINT_BYTES && (uint16_t)(pid - r.packetId) < SEND_PACKET_ID_SAVE_EVERY) return;
+    r.offset = (uint32_t)acked;
+    r.packetId = pid;
+    _sendCkpt.save(*_fs, AKZ_SEND_CHECKPOINT_FILE);
+#else
+    (void)slot;
+#endif
+}
+
+// The send ended (complete, failed or cancelled): nothing to offer again
+void AkitaMeshZmodem::_dropSendCheckpoint(int slot) {
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    Session& s = _sessions[slot];
+    if (!s.checkpoint) return;
+    s.checkpoint = false;
+    _sendCkpt.clear((uint8_t)slot);
+    _sendCkpt.save(*_fs, AKZ_SEND_CHECKPOINT_FILE);
+#else
+    (void)slot;
+#endif
+}
+
+// Offer each send the previous boot left unfinished to its receiver again,
+// under the session id the receiver knows. The receiver's ZRPOS then says
+// where to continue: a receive still running there, or one resumed from its
+// journal, asks for the unacknowledged tail only.
+void AkitaMeshZmodem::_reofferSends() {
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    ZModemSendCheckpoint saved;
+    if (!saved.load(*_fs, AKZ_SEND_CHECKPOINT_FILE)) return;
+    for (uint8_t i = 0; i < ZModemSendCheckpoint::CAPACITY; ++i) {
+        const ZModemSendRecord& r = saved.at(i);
+        if (!r.used) continue;
+        char buf[160];
+        size_t size;
+        if (ZModemSendCheckpoint::fingerprint(*_fs, r.path, size) != r.fingerprint || size != r.size) {
+            snprintf(buf, sizeof(buf), "Interrupted send of %s not resumed: file changed", r.path);
+            _log(buf);
+            continue;
+        }
+        int slot = _allocSession();
+        if (slot == INVALID_SESSION || !_beginSend(slot, String(r.path), r.peer, r.priority, nullptr, &r)) {
+            snprintf(buf, sizeof(buf), "Interrupted send of %s could not be restarted", r.path);
+            _logError(buf);
+            continue;
+        }
+        _checkpointSend(slot);
+        _sendCkpt.at((uint8_t)slot).offset = r.offset;
+        snprintf(buf, sizeof(buf), "[S%d] Offering %s again (%lu of %lu bytes acknowledged before the reboot)", slot,
+                 r.path, (unsigned long)r.offset, (unsigned long)r.size);
+        _log(buf);
+    }
+    // Sends that could not be restarted are dropped
+    _sendCkpt.save(*_fs, AKZ_SEND_CHECKPOINT_FILE);
+#endif
+}
+
+// Offer a receive's announced size to the reserve callback, once
+bool AkitaMeshZmodem::_reserveFile(int slot) {
+    Session& s = _sessions[slot];
+    s.reserved = true;
+    if (!_reserveCb) return true;
+    size_t needed = s.totalFileSize > s.bytesTransferred ? s.totalFileSize - s.bytesTransferred : 0;
+    if (_reserveCb(slot, s.file, needed, _reserveCtx)) return true;
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[S%d] No room for %lu more bytes, refusing file", slot, (unsigned long)needed);
+    _logError(buf);
+    return false;
+}
+
+// Hold each send's next chunk while a higher-priority send to the same peer
+// is streaming data, so the urgent stream gets the channel
+void AkitaMeshZmodem::_updateHolds() {
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        Session& s = _sessions[i];
+        if (!s.active || !s.sending) continue;
+        bool outranked = false;
+        for (int j = 0; j < AKZ_MAX_SESSIONS && !outranked; ++j) {
+            const Session& o = _sessions[j];
+            if (j == i || !o.active || !o.sending || o.peer != s.peer || o.priority <= s.priority) continue;
+            outranked = o.engine->getState() == ZModemEngine::STATE_SEND_ZDATA;
+        }
+        s.engine->setHold(outranked, AKZ_STREAM_MAX_DEFER_MS);
+    }
+}
+
+bool AkitaMeshZmodem::setSessionPriority(int slot, uint8_t priority) {
+    if (slot < 0 || slot >= AKZ_MAX_SESSIONS) return false;
+    ZModemLockGuard guard(_lock);
+    if (!_sessions[slot].active && !_sessions[slot].queued) return false;
+    _sessions[slot].priority = priority;
+    _updateHolds();
+    return true;
+}
+
+// --- Tail sends ---
+
+#if AKZ_ENABLE_TAIL_SEND
+bool AkitaMeshZmodem::startTail(const char* filePath, NodeNum dest, int* sessionOut, uint8_t priority) {
+    if (!_fs || !filePath || dest == BROADCAST_ADDR) return false;
+    ZModemLockGuard guard(_lock);
+    if (sessionOut) *sessionOut = INVALID_SESSION;
+    if (!_fs->exists(filePath)) return false;
+    ZModemTailRecord* r = _tails.use(filePath, dest);
+    if (!r) return false;
+    size_t size;
+    uint32_t fp = ZModemSendCheckpoint::fingerprint(*_fs, filePath, size, r->offset);
+    char buf[160];
+    // Shrunk, or the part already delivered changed: rotated, start over
+    if (r->offset > 0 && (size < r->offset || fp != r->fingerprint)) {
+        snprintf(buf, sizeof(buf), "%s changed before offset %lu, sending it in full", filePath, (unsigned long)r->offset);
+        _log(buf);
+        r->offset = 0;
+        r->fingerprint = 0;
+    }
+    // An empty file has nothing to send either
+    if (size == r->offset) {
+        snprintf(buf, sizeof(buf), "%s: nothing new for 0x%lX", filePath, (unsigned long)dest);
+        _log(buf);
+        return true;
+    }
+    if (_tailRunning(filePath, dest)) return false;
+    return _startSend(String(filePath), nullptr, dest, sessionOut, priority, true);
+}
+
+// Rewrite the tail offsets after a change, like _saveIndex()
+void AkitaMeshZmodem::_saveTails() {
+    ZModemLockGuard guard(_lock);
+    if (!_tails.dirty) return;
+    if (!_tails.save(*_fs, AKZ_TAIL_FILE)) {
+        _logError("Tail offsets could not be saved");
+        _tails.dirty = false; // retried with the next change
+    }
+}
+
+bool AkitaMeshZmodem::followTail(const char* filePath, NodeNum dest, uint32_t periodMs) {
+    if (!filePath || dest == BROADCAST_ADDR) return false;
+    ZModemLockGuard guard(_lock);
+    ZModemTailRecord* r = periodMs ? _tails.use(filePath, dest) : _tails.find(filePath, dest);
+    if (!r) return periodMs == 0;
+    r->followMs = periodMs;
+    r->checkAt = millis();
+    _tails.dirty = true;
+#if AKZ_ENABLE_ENGINE_TASK
+    _task.wake(); // checked there
+#endif
+    return true;
+}
+
+size_t AkitaMeshZmodem::getTailOffset(const char* filePath, NodeNum dest) {
+    ZModemLockGuard guard(_lock);
+    const ZModemTailRecord* r = _tails.find(filePath, dest);
+    return r ? r->offset : 0;
+}
+
+// A tail send of the file to the peer is running or queued
+bool AkitaMeshZmodem::_tailRunning(const char* path, NodeNum peer) const {
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        const Session& s = _sessions[i];
+        if ((s.active || s.queued) && s.tail && s.peer == peer && s.filename == path) return true;
+    }
+    return false;
+}
+
+// Check the followed files that are due. One whose size moved since its
+// last delivery gets a tail send. One that stays the same length is checked
+// by its fingerprint (the first and last 256 bytes), so a rotation that
+// reached the same length is still sent. At most one send starts per call,
+// since startTail() reorders the table; files still due are checked on the
+// next call.
+void AkitaMeshZmodem::_followTails() {
+    ZModemLockGuard guard(_lock);
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < _tails.count(); ++i) {
+        ZModemTailRecord& r = _tails.at(i);
+        if (!r.followMs || (int32_t)(now - r.checkAt) < 0) continue;
+        r.checkAt = now + r.followMs;
+        if (_tailRunning(r.path, r.peer)) continue;
+        size_t size;
+        uint32_t fp = ZModemSendCheckpoint::fingerprint(*_fs, r.path, size, r.offset);
+        if (!size || (size == r.offset && fp == r.fingerprint)) continue;
+        char path[sizeof(r.path)]; // startTail() may reorder the table
+        memcpy(path, r.path, sizeof(path));
+        startTail(path, r.peer);
+        return;
+    }
+}
+
+uint32_t AkitaMeshZmodem::_msUntilTailCheck() const {
+    ZModemLockGuard guard(_lock);
+    uint32_t now = millis();
+    uint32_t wait = NO_DEADLINE;
+    for (uint8_t i = 0; i < _tails.count(); ++i) {
+        const ZModemTailRecord& r = _tails.at(i);
+        if (!r.followMs) continue;
+        int32_t left = (int32_t)(r.checkAt - now);
+        if (left <= 0) return 0;
+        if ((uint32_t)left < wait) wait = (uint32_t)left;
+    }
+    return wait;
+}
+#endif
+
+// A tail send completed: the peer now holds the file up to the size it was
+// announced with. Recorded with the fingerprint of that part, so a later
+// rewrite of it is noticed.
+void AkitaMeshZmodem::_tailDelivered(int slot) {
+#if AKZ_ENABLE_TAIL_SEND
+    Session& s = _sessions[slot];
+    if (!s.tail) return;
+    ZModemTailRecord* r = _tails.use(s.filename.c_str(), s.peer);
+    if (!r) return;
+    size_t size;
+    r->offset = (uint32_t)s.totalFileSize;
+    r->fingerprint = ZModemSendCheckpoint::fingerprint(*_fs, r->path, size, r->offset);
+#else
+    (void)slot;
+#endif
+}
+
+// --- File index ---
+
+#if AKZ_ENABLE_FILE_INDEX
+bool AkitaMeshZmodem::getFileInfo(const char* path, FileInfo& out, bool hash) {
+    if (!_fs) return false;
+    ZModemLockGuard guard(_lock);
+    const ZModemFileEntry* e = hash ? _index.lookup(*_fs, path) : _index.refresh(*_fs, path);
+    if (!e) return false;
+#if AKZ_ENABLE_ENGINE_TASK
+    if (!e->hashed) _task.wake(); // hashed there
+#endif
+    _fillFileInfo(*e, out);
+    return true;
+}
+
+size_t AkitaMeshZmodem::getIndexedFileCount() const {
+    ZModemLockGuard guard(_lock);
+    return _index.count();
+}
+
+bool AkitaMeshZmodem::getIndexedFile(size_t i, FileInfo& out) const {
+    ZModemLockGuard guard(_lock);
+    if (i >= _index.count()) return false;
+    _fillFileInfo(_index.at((uint8_t)i), out);
+    return true;
+}
+
+void AkitaMeshZmodem::_fillFileInfo(const ZModemFileEntry& e, FileInfo& out) {
+    out.path = e.path;
+    out.size = e.size;
+    out.mtime = e.mtime;
+    out.hashed = e.hashed;
+    memcpy(out.sha256, e.sha256, sizeof(out.sha256));
+}
+#endif
+
+// --- Listings ---
+
+#if AKZ_ENABLE_LISTING
+// One pass over the directory: every matching entry counts towards the total
+// and the token, and those from the cursor on go into the page while they fit
+size_t AkitaMeshZmodem::listDirectory(const char* dir, const ListRequest& req, uint8_t* page, size_t cap) {
+    if (!_fs || !dir || cap < AKZ_LIST_PAGE_BYTES) return 0;
+    ZModemListingWriter w;
+    if (!w.begin(page, AKZ_LIST_PAGE_BYTES, req.since ? ZModemListing::PAGE_SINCE : 0)) return 0;
+    File d = _fs->open(dir, FILE_READ);
+    if (!d || !d.isDirectory()) return 0;
+    size_t dirLen = strlen(dir);
+    while (dirLen > 1 && dir[dirLen - 1] == '/') dirLen--;
+
+    ZModemLockGuard guard(_lock);
+    uint32_t total = 0, token = 0, listed = 0, cursor = 0;
+    for (File f = d.openNextFile(); f; f = d.openNextFile()) {
+        // Older cores give the full path, newer ones the name alone
+        const char* name = f.name();
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        if (!ZModemBundle::match(req.pattern, name)) continue;
+        total++;
+        uint32_t mtime = 0;
+#if AKZ_FS_HAS_MTIME
+        mtime = (uint32_t)f.getLastWrite();
+#endif
+        if (mtime > token) token = mtime;
+        if (req.since && mtime < req.since) continue;
+        if (listed++ < req.cursor || cursor) continue;
+        bool isDir = f.isDirectory();
+        uint32_t size = isDir ? 0 : (uint32_t)f.size();
+        const uint8_t* sha = nullptr;
+#if AKZ_ENABLE_FILE_INDEX
+        char path[AKZ_JOB_PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%.*s/%s", dirLen == 1 ? 0 : (int)dirLen, dir, name);
+        const ZModemFileEntry* e = nullptr;
+        if ((req.hashes || req.hashFiles) && !isDir && n > 0 && (size_t)n < sizeof(path)) {
+            e = req.hashFiles ? _index.refresh(*_fs, path) : _index.find(path);
+        }
+        if (e && e->hashed && e->size == size && e->mtime == mtime) sha = e->sha256;
+#endif
+        // The first entry that does not fit starts the next page
+        if (!w.add(name, isDir ? ZModemListing::ENTRY_DIR : 0, size, mtime, sha)) cursor = listed - 1;
+    }
+    d.close();
+#if AKZ_ENABLE_FILE_INDEX && AKZ_ENABLE_ENGINE_TASK
+    if (req.hashFiles) _task.wake(); // to hash what the page had no hash for
+#endif
+    return w.finish(total, token, cursor);
+}
+#endif
+
+// --- Transfer jobs ---
+
+// Called whenever a session ends (completion, failure to start, abort): the
+// job it ran, if any, is handed back to the scheduler
+void AkitaMeshZmodem::_jobSessionEnded(Session& s, bool ok) {
+#if AKZ_ENABLE_JOB_QUEUE
+    if (!s.jobId) return;
+    ZModemJob* job = _jobs.find(s.jobId);
+    s.jobId = 0;
+    if (!job) return;
+    job->state = ZModemJob::FINISHED;
+    job->lastOk = ok;
+    job->offset = s.bytesTransferred;
+    job->session = -1;
+    _kickJobs();
+#else
+    (void)s;
+    (void)ok;
+#endif
+}
+
+#if AKZ_ENABLE_JOB_QUEUE
+uint16_t AkitaMeshZmodem::enqueueSend(const char* filePath, NodeNum dest) {
+    return _enqueue(true, filePath, dest, JobOptions());
+}
+
+uint16_t AkitaMeshZmodem::enqueueSend(const char* filePath, NodeNum dest, const JobOptions& options) {
+    return _enqueue(true, filePath, dest, options);
+}
+
+uint16_t AkitaMeshZmodem::enqueueReceive(const char* filePath) {
+    return _enqueue(false, filePath, BROADCAST_ADDR, JobOptions());
+}
+
+uint16_t AkitaMeshZmodem::enqueueReceive(const char* filePath, const JobOptions& options) {
+    return _enqueue(false, filePath, BROADCAST_ADDR, options);
+}
+
+uint16_t AkitaMeshZmodem::_enqueue(bool sending, const char* filePath, NodeNum peer, const JobOptions& options) {
+    if (!_fs || !filePath || !filePath[0] || strlen(filePath) >= AKZ_JOB_PATH_MAX) return 0;
+    if (sending && (peer == BROADCAST_ADDR || !_fs->exists(filePath))) return 0;
+    ZModemLockGuard guard(_lock);
+    ZModemJob* job = _jobs.add();
+    if (!job) {
+        _logError("Job queue full");
+        return 0;
+    }
+    uint32_t now = millis();
+    job->sending = sending;
+    job->priority = options.priority;
+    job->maxAttempts = options.maxAttempts ? options.maxAttempts : 1;
+    job->peer = sending ? peer : 0;
+    job->owner = options.owner;
+    job->backoffMs = options.retryBackoffMs;
+    job->notBeforeMs = now;
+    if (options.deadlineMs) {
+        job->deadlineMs = now + options.deadlineMs;
+        if (!job->deadlineMs) job->deadlineMs = 1; // 0 means no deadline
+    }
+    strncpy(job->path, filePath, sizeof(job->path) - 1);
+    _kickJobs();
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "[J%u] Queued %s %s (priority %u)", (unsigned)job->id,
+             sending ? "send of" : "receive to", job->path, (unsigned)job->priority);
+    _log(buf);
+    return job->id;
+}
+
+bool AkitaMeshZmodem::cancelJob(uint16_t id) {
+    ZModemLockGuard guard(_lock);
+    ZModemJob* job = _jobs.find(id);
+    if (!job) return false;
+    if (job->state == ZModemJob::RUNNING && job->session >= 0) {
+        int slot = job->session;
+        _sessions[slot].jobId = 0;
+        abortSession(slot);
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "[J%u] Cancelled", (unsigned)id);
+    _log(buf);
+    _jobs.remove(*job);
+    _kickJobs();
+    return true;
+}
+
+bool AkitaMeshZmodem::setJobPriority(uint16_t id, uint8_t priority) {
+    ZModemLockGuard guard(_lock);
+    ZModemJob* job = _jobs.find(id);
+    if (!job) return false;
+    job->priority = priority;
+    _jobs.dirty = true;
+    if (job->session >= 0) setSessionPriority(job->session, priority);
+    _kickJobs();
+    return true;
+}
+
+bool AkitaMeshZmodem::moveJobToFront(uint16_t id) {
+    ZModemLockGuard guard(_lock);
+    ZModemJob* job = _jobs.find(id);
+    if (!job) return false;
+    _jobs.moveToFront(*job);
+    _kickJobs();
+    return true;
+}
+
+size_t AkitaMeshZmodem::getJobCount() const {
+    ZModemLockGuard guard(_lock);
+    return _jobs.count();
+}
+
+bool AkitaMeshZmodem::getJob(size_t position, JobInfo& out) const {
+    ZModemLockGuard guard(_lock);
+    ZModemJob* order[ZModemJobQueue::CAPACITY];
+    // ordered() only reads; the queue is logically const here
+    uint8_t n = const_cast<ZModemJobQueue&>(_jobs).ordered(order);
+    if (position >= n) return false;
+    _fillJobInfo(*order[position], out);
+    return true;
+}
+
+bool AkitaMeshZmodem::findJob(uint16_t id, JobInfo& out) const {
+    ZModemLockGuard guard(_lock);
+    ZModemJob* job = const_cast<ZModemJobQueue&>(_jobs).find(id);
+    if (!job) return false;
+    _fillJobInfo(*job, out);
+    return true;
+}
+
+void AkitaMeshZmodem::_fillJobInfo(const ZModemJob& job, JobInfo& out) const {
+    uint32_t now = millis();
+    out.id = job.id;
+    out.sending = job.sending;
+    out.priority = job.priority;
+    out.peer = job.sending ? job.peer : BROADCAST_ADDR;
+    out.owner = job.owner;
+    out.path = job.path;
+    out.session = job.session >= 0 ? job.session : INVALID_SESSION;
+    out.bytesDone = job.session >= 0 ? _sessions[job.session].bytesTransferred : job.offset;
+    out.failures = job.failures;
+    out.maxAttempts = job.maxAttempts;
+    int32_t wait = (int32_t)(job.notBeforeMs - now);
+    out.startsInMs = wait > 0 ? (uint32_t)wait : 0;
+    if (job.state != ZModemJob::PENDING) out.state = JobState::RUNNING;
+    else out.state = out.startsInMs ? JobState::WAITING : JobState::PENDING;
+    int32_t left = (int32_t)(job.deadlineMs - now);
+    out.deadlineInMs = !job.deadlineMs ? NO_DEADLINE : (left > 0 ? (uint32_t)left : 0);
+}
+
+// Ask for a scheduler pass. In threaded mode it runs on the engine task,
+// which may be asleep.
+void AkitaMeshZmodem::_kickJobs() {
+    _jobsKick = true;
+#if AKZ_ENABLE_ENGINE_TASK
+    _task.wake();
+#endif
+}
+
+// Time until loop() (or the engine task) next needs to run the scheduler or
+// save the queue
+uint32_t AkitaMeshZmodem::_msUntilJobCheck() const {
+    ZModemLockGuard guard(_lock);
+    if (_jobsKick || _jobs.dirty) return 0;
+    if (_jobs.count() == 0) return NO_DEADLINE;
+    int32_t wait = (int32_t)(_jobsPollAt - millis());
+    return wait > 0 ? (uint32_t)wait : 0;
+}
+
+// Scheduler pass, from loop() or the engine task: settle finished runs, then start jobs in run
+// order. The first ready job that cannot start stops the pass, so a large
+// low-priority job never overtakes a waiting higher one; if a lower-priority
+// job is running, it is preempted to make room.
+void AkitaMeshZmodem::_runJobs() {
+    uint32_t now = millis();
+    ZModemLockGuard guard(_lock);
+    if (!_jobsKick && (int32_t)(now - _jobsPollAt) < 0) return;
+    _jobsKick = false;
+    _jobsPollAt = now + AKZ_JOB_POLL_MS;
+
+    ZModemJob* order[ZModemJobQueue::CAPACITY];
+    uint8_t n = _jobs.ordered(order);
+    for (uint8_t i = 0; i < n; ++i) {
+        if (order[i]->state == ZModemJob::FINISHED) _jobRunEnded(*order[i], now);
+    }
+
+    n = _jobs.ordered(order);
+    for (uint8_t i = 0; i < n; ++i) {
+        ZModemJob& job = *order[i];
+        if (job.id == 0 || job.state != ZModemJob::PENDING) continue;
+        if (job.deadlineMs && (int32_t)(now - job.deadlineMs) >= 0) {
+            _jobDone(job, TransferState::ERROR, "deadline passed");
+            continue;
+        }
+        if ((int32_t)(now - job.notBeforeMs) < 0) continue; // backing off
+
+        JobStart r = _startJob(job, 0);
+        uint8_t freed = 0;
+        if (r == JOB_BLOCKED && _preemptFor(job, freed)) r = _startJob(job, freed);
+        if (r == JOB_BLOCKED) break;
+        if (r == JOB_FAILED) {
+            job.state = ZModemJob::FINISHED;
+            job.lastOk = false;
+            _jobRunEnded(job, now);
+        }
+    }
+}
+
+// Rewrite the queue file after a change, where the scheduler runs: loop()
+// or the engine task.
+void AkitaMeshZmodem::_saveJobs() {
+    ZModemLockGuard guard(_lock);
+    if (!_jobs.dirty) return;
+    if (!_jobs.save(*_fs, AKZ_JOB_QUEUE_FILE, millis())) {
+        _logError("Job queue could not be saved");
+        _jobs.dirty = false; // retried with the next change
+    }
+}
+
+// Start a run of 'job'. Admission limits in 'ignoreLimits' were just freed
+// by preempting a job, whose measured airtime has not aged out yet.
+AkitaMeshZmodem::JobStart AkitaMeshZmodem::_startJob(ZModemJob& job, uint8_t ignoreLimits) {
+    AdmissionResult adm;
+    _admit(job.sending, job.peer, job.priority, adm);
+    int slot = _allocSession();
+    // Sends already queued for admission go first
+    if ((adm.limits & ~ignoreLimits) || slot == INVALID_SESSION ||
+        (job.sending && _oldestQueued() != INVALID_SESSION)) {
+        return JOB_BLOCKED;
+    }
+    // A resumed send continues wherever the receiver's ZRPOS asks it to
+    String path(job.path);
+    bool ok = job.sending ? _beginSend(slot, path, job.peer, job.priority) : _beginReceive(slot, path, job.resume);
+    if (!ok) return JOB_FAILED;
+
+    Session& s = _sessions[slot];
+    s.jobId = job.id;
+    job.state = ZModemJob::RUNNING;
+    job.session = (int8_t)slot;
+    _jobs.dirty = true;
+    char buf[160];
+    snprintf(buf, sizeof(buf), "[J%u] Running as S%d%s", (unsigned)job.id, slot,
+             job.resume ? " (resuming)" : "");
+    _log(buf);
+#if AKZ_ENABLE_ENGINE_TASK
+    _task.wake();
+#endif
+    return JOB_STARTED;
+}
+
+// Send the lowest-priority running job below 'job' back to the queue. Its
+// run is aborted; the next one resumes from the partial file.
+bool AkitaMeshZmodem::_preemptFor(const ZModemJob& job, uint8_t& freedLimits) {
+    ZModemJob* order[ZModemJobQueue::CAPACITY];
+    uint8_t n = _jobs.ordered(order);
+    ZModemJob* victim = nullptr;
+    // Run order is priority first, so the last running one below 'job' is the lowest
+    for (uint8_t i = 0; i < n; ++i) {
+        ZModemJob* j = order[i];
+        if (j->state == ZModemJob::RUNNING && j->session >= 0 && j->priority < job.priority) victim = j;
+    }
+    if (!victim) return false;
+
+    int slot = victim->session;
+    Session& s = _sessions[slot];
+    // Its traffic both ways stops now; the measured share just lags behind
+    freedLimits = LIMIT_SESSIONS | LIMIT_MEMORY | LIMIT_AIRTIME;
+    victim->offset = s.bytesTransferred;
+    victim->state = ZModemJob::PENDING;
+    victim->resume = true;
+    victim->session = -1;
+    _jobs.dirty = true;
+    s.jobId = 0;
+
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[J%u] Preempted by J%u at offset %lu", (unsigned)victim->id, (unsigned)job.id,
+             (unsigned long)victim->offset);
+    _log(buf);
+    abortSession(slot);
+    return true;
+}
+
+// Retry policy for a run that ended
+void AkitaMeshZmodem::_jobRunEnded(ZModemJob& job, uint32_t now) {
+    if (job.lastOk) {
+        _jobDone(job, TransferState::COMPLETE, nullptr);
+        return;
+    }
+    job.failures++;
+    if (job.failures >= job.maxAttempts) {
+        _jobDone(job, TransferState::ERROR, "out of attempts");
+        return;
+    }
+    uint32_t wait = job.backoffMs;
+    for (uint8_t i = 1; i < job.failures && wait < AKZ_JOB_RETRY_MAX_MS; ++i) wait *= 2;
+    if (wait > AKZ_JOB_RETRY_MAX_MS) wait = AKZ_JOB_RETRY_MAX_MS;
+    job.state = ZModemJob::PENDING;
+    job.resume = true; // a receive keeps what it already has
+    job.notBeforeMs = now + wait;
+    _jobs.dirty = true;
+
+    char buf[96];
+    snprintf(buf, sizeof(buf), "[J%u] Run %u/%u failed at offset %lu, retry in %lu ms", (unsigned)job.id,
+             (unsigned)job.failures, (unsigned)job.maxAttempts, (unsigned long)job.offset, (unsigned long)wait);
+    _log(buf);
+}
+
+// Remove a job for good and report it
+void AkitaMeshZmodem::_jobDone(ZModemJob& job, TransferState result, const char* why) {
+    JobInfo info;
+    _fillJobInfo(job, info);
+    char buf[160];
+    if (result == TransferState::COMPLETE) {
+        snprintf(buf, sizeof(buf), "[J%u] Done: %s", (unsigned)job.id, job.path);
+        _log(buf);
+    } else {
+        snprintf(buf, sizeof(buf), "[J%u] Failed (%s): %s", (unsigned)job.id, why, job.path);
+        _logError(buf);
+    }
+    _jobs.remove(job);
+    if (_jobCb) _jobCb(info, result, _jobCtx);
+}
+#endif // AKZ_ENABLE_JOB_QUEUE
+
+#if AKZ_HAVE_COROUTINES
+bool AkitaMeshZmodem::TransferAwaiter::await_ready() const {
+    if (session < 0 || session >= AKZ_MAX_SESSIONS) return true;
+    ZModemLockGuard guard(owner->_lock);
+    const Session& s = owner->_sessions[session];
+    return !s.active && !s.queued;
+}
+
+void AkitaMeshZmodem::TransferAwaiter::await_suspend(std::coroutine_handle<> h) {
+    ZModemLockGuard guard(owner->_lock);
+    Session& s = owner->_sessions[session];
+    s.waiter = h;
+    s.waiterReady = !s.active && !s.queued; // ended between await_ready() and now
+}
+
+AkitaMeshZmodem::TransferState AkitaMeshZmodem::TransferAwaiter::await_resume() const {
+    if (session < 0 || session >= AKZ_MAX_SESSIONS) return TransferState::IDLE;
+    ZModemLockGuard guard(owner->_lock);
+    return owner->_sessions[session].state;
+}
+
+// Resume host coroutines whose session ended. Outside the lock and on the
+// loop() caller's thread, so they may start new transfers straight away.
+void AkitaMeshZmodem::_resumeWaiters() {
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+        std::coroutine_handle<> h;
+        {
+            ZModemLockGuard guard(_lock);
+            Session& s = _sessions[i];
+            if (!s.waiter || !s.waiterReady) continue;
+            h = s.waiter;
+            s.waiter = nullptr;
+            s.waiterReady = false;
+        }
+        h.resume();
+    }
+}
+#endif
+
 
 // Map internal ZModem engine states to the public TransferState and log transitions
-void AkitaMeshZmodem::_handleZmodemState(int zState) {
-    // Don't override terminal states (COMPLETE/ERROR) here — loop() handles those.
+void AkitaMeshZmodem::_handleZmodemState(Session& s, int zState) {
+    // Don't override terminal states (COMPLETE/ERROR) here — _serviceSession() handles those.
+    // Receive sessions report RECEIVING throughout; the engine parks them in AWAIT_ZRINIT.
+    if (!s.sending) return;
     switch(static_cast<ZModemEngine::State>(zState)) {
         case ZModemEngine::STATE_SEND_ZRQINIT:
         case ZModemEngine::STATE_SEND_ZFILE:
@@ -248,35 +2506,145 @@ void AkitaMeshZmodem::_handleZmodemState(int zState) {
         case ZModemEngine::STATE_AWAIT_ZRINIT:
         case ZModemEngine::STATE_AWAIT_ZRPOS:
         case ZModemEngine::STATE_AWAIT_ZFIN:
-            _currentState = TransferState::SENDING;
+            s.state = TransferState::SENDING;
             break;
 
         default:
-            // leave _currentState unchanged for other intermediary states
+            // leave state unchanged for other intermediary states
             break;
     }
 }
 
 // Getters & Setters
-AkitaMeshZmodem::TransferState AkitaMeshZmodem::getCurrentState() const { return _currentState; }
-size_t AkitaMeshZmodem::getBytesTransferred() const { return _bytesTransferred; }
-size_t AkitaMeshZmodem::getTotalFileSize() const { return _totalFileSize > 0 ? _totalFileSize : _zmodem.getFileSize(); }
-String AkitaMeshZmodem::getFilename() const { return _filename; }
+AkitaMeshZmodem::TransferState AkitaMeshZmodem::getCurrentState() const {
+    ZModemLockGuard guard(_lock);
+    return _primary == INVALID_SESSION ? TransferState::IDLE : _sessions[_primary].state;
+}
+size_t AkitaMeshZmodem::getBytesTransferred() const {
+    ZModemLockGuard guard(_lock);
+    return _primary == INVALID_SESSION ? 0 : _sessions[_primary].bytesTransferred;
+}
+size_t AkitaMeshZmodem::getTotalFileSize() const {
+    ZModemLockGuard guard(_lock);
+    return _primary == INVALID_SESSION ? 0 : _sessions[_primary].totalFileSize;
+}
+String AkitaMeshZmodem::getFilename() const {
+    ZModemLockGuard guard(_lock);
+    return _primary == INVALID_SESSION ? String("") : _sessions[_primary].filename;
+}
+
+size_t AkitaMeshZmodem::getActiveSessionCount() const {
+    ZModemLockGuard guard(_lock);
+    size_t n = 0;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) if (_sessions[i].active) n++;
+    return n;
+}
+
+size_t AkitaMeshZmodem::getQueuedSessionCount() const {
+    ZModemLockGuard guard(_lock);
+    size_t n = 0;
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) if (_sessions[i].queued) n++;
+    return n;
+}
+
+bool AkitaMeshZmodem::getSessionStats(int slot, SessionStats& out) const {
+    if (slot < 0 || slot >= AKZ_MAX_SESSIONS) return false;
+    ZModemLockGuard guard(_lock);
+    const Session& s = _sessions[slot];
+    if (!s.active && s.state == TransferState::IDLE) return false;
+    out.sessionId = s.id;
+    out.peer = s.peer;
+    out.sending = s.sending;
+    out.state = s.state;
+    out.bytesTransferred = s.bytesTransferred;
+    out.totalFileSize = s.totalFileSize;
+    out.elapsedMs = (s.active || s.queued ? millis() : s.endTime) - s.startTime;
+    out.filename = s.filename;
+    out.controlBytes = sizeof(Session);
+    out.bufferBytes = 0;
+    out.maxLoopUs = s.maxLoopUs;
+    out.priority = s.priority;
+    out.joined = s.joined;
+    if (s.active) {
+        out.controlBytes += sizeof(ZModemSessionEngine) + sizeof(MeshtasticZModemStream);
+        out.bufferBytes = s.engine->getBorrowedBytes() + MeshtasticZModemStream::borrowedBytes();
+#if AKZ_ENABLE_STORAGE_WORKER
+        if (_storage.channel(slot).isOpen()) out.bufferBytes += ZModemStorageWorker::committedBytes();
+#endif
+    }
+    return true;
+}
+
+size_t AkitaMeshZmodem::getIdleSessionFootprint() const { return sizeof(Session); }
+size_t AkitaMeshZmodem::getPoolFreeBytes() const { ZModemLockGuard guard(_lock); return _pool.freeBytes(); }
+size_t AkitaMeshZmodem::getPoolCapacityBytes() const { return _pool.capacityBytes(); }
+
+void AkitaMeshZmodem::_logFootprint(int slot) {
+    SessionStats st;
+    if (!_debug || !getSessionStats(slot, st)) return;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "[S%d] Footprint: %lu B control + %lu B pooled (pool free %lu/%lu B)", slot,
+             (unsigned long)st.controlBytes, (unsigned long)st.bufferBytes,
+             (unsigned long)_pool.freeBytes(), (unsigned long)_pool.capacityBytes());
+    _log(buf);
+}
+
+void AkitaMeshZmodem::getMeshThreadLatency(MeshThreadLatency& out) const {
+    out.loopCalls = _loopLatency.calls;
+    out.loopMaxUs = _loopLatency.maxUs;
+    out.loopAvgUs = _loopLatency.calls ? (uint32_t)(_loopLatency.totalUs / _loopLatency.calls) : 0;
+    out.packetCalls = _packetLatency.calls;
+    out.packetMaxUs = _packetLatency.maxUs;
+    out.packetAvgUs = _packetLatency.calls ? (uint32_t)(_packetLatency.totalUs / _packetLatency.calls) : 0;
+    out.rxQueueDrops = _rxQueueDrops;
+    out.overBudget = _overBudget;
+}
+
+#if AKZ_ENABLE_STORAGE_WORKER
+void AkitaMeshZmodem::getStorageStats(StorageStats& out) const {
+    const ZModemStorageCounters& c = _storage.counters();
+    out.reads = c.reads.load();
+    out.writes = c.writes.load();
+    out.bytesRead = c.bytesRead.load();
+    out.bytesWritten = c.bytesWritten.load();
+    out.maxOpUs = c.maxOpUs.load();
+    out.waits = c.waits.load();
+}
+
+// Worker thread: a request finished, so an engine waiting on it can go on
+void AkitaMeshZmodem::_onStorageProgress(void* ctx) {
+#if AKZ_ENABLE_ENGINE_TASK
+    static_cast<AkitaMeshZmodem*>(ctx)->_task.wake();
+#else
+    (void)ctx; // unthreaded: nextDeadline() polls every AKZ_STORAGE_POLL_MS
+#endif
+}
+#endif
+
+void AkitaMeshZmodem::resetMeshThreadLatency() {
+    _loopLatency = LatencyCounter();
+    _packetLatency = LatencyCounter();
+    _rxQueueDrops = 0;
+    _overBudget = 0;
+}
+
 void AkitaMeshZmodem::setTimeout(unsigned long t) { _zmodemTimeout = t; }
 void AkitaMeshZmodem::setMaxPacketSize(size_t s) { _maxPacketSize = s; }
 void AkitaMeshZmodem::setProgressUpdateInterval(unsigned long i) { _progressUpdateInterval = i; }
+void AkitaMeshZmodem::setLoopBudget(uint32_t us) { _loopBudgetUs = us; }
 
-void AkitaMeshZmodem::_updateProgress() {
-    if (_progressUpdateInterval > 0 && millis() - _lastProgressUpdate > _progressUpdateInterval) {
+void AkitaMeshZmodem::_updateProgress(int slot) {
+    Session& s = _sessions[slot];
+    if (_progressUpdateInterval > 0 && millis() - s.lastProgressUpdate > _progressUpdateInterval) {
         char buf[128];
-        if (getTotalFileSize() > 0) {
-            float percent = (float)_bytesTransferred / getTotalFileSize() * 100.0f;
-            snprintf(buf, sizeof(buf), "Progress: %lu bytes (%.1f%%)", (unsigned long)_bytesTransferred, percent);
+        if (s.totalFileSize > 0) {
+            float percent = (float)s.bytesTransferred / s.totalFileSize * 100.0f;
+            snprintf(buf, sizeof(buf), "[S%d] Progress: %lu bytes (%.1f%%)", slot, (unsigned long)s.bytesTransferred, percent);
         } else {
-            snprintf(buf, sizeof(buf), "Progress: %lu bytes", (unsigned long)_bytesTransferred);
+            snprintf(buf, sizeof(buf), "[S%d] Progress: %lu bytes", slot, (unsigned long)s.bytesTransferred);
         }
         _log(buf);
-        _lastProgressUpdate = millis();
+        s.lastProgressUpdate = millis();
     }
 }
 
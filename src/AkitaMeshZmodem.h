@@ -15,63 +15,647 @@
 #include <FS.h>
 #include "AkitaMeshZmodemConfig.h"
 #include "utility/ZModemEngine.h" // Use internal engine
+#include "utility/ZModemSessionTable.h"
+#include "utility/ZModemBufferPool.h"
+#include "utility/ZModemTimerWheel.h"
+#include "utility/ZModemAirtimeMeter.h"
+#include "utility/ZModemJobQueue.h"
+#include "utility/ZModemEngineTask.h"
+#include "utility/ZModemStorageWorker.h"
+#include "utility/ZModemResumeJournal.h"
+#include "utility/ZModemSendCheckpoint.h"
+#include "utility/ZModemFileIndex.h"
+#include "utility/ZModemTailTable.h"
+#include "utility/ZModemListing.h"
+#include "utility/ZModemBatch.h"
+#if AKZ_HAVE_COROUTINES
+#include <coroutine>
+#include "utility/ZModemCoEngine.h"
+#endif
+#if AKZ_ENABLE_ENGINE_TASK
+#include <atomic>
+#include "utility/ZModemSpscRing.h"
+#endif
 
 class MeshtasticZModemStream;
 
+// Engine that runs each session: the state machine, or its coroutine twin
+#if AKZ_ENABLE_COROUTINE_ENGINE
+typedef ZModemCoEngine ZModemSessionEngine;
+#else
+typedef ZModemEngine ZModemSessionEngine;
+#endif
+
 class AkitaMeshZmodem {
 public:
     enum class TransferState {
-        IDLE, RECEIVING, SENDING, COMPLETE, ERROR
+        IDLE, RECEIVING, SENDING, COMPLETE, ERROR,
+        QUEUED // send accepted, waiting for admission (see getLastAdmission())
+    };
+
+    /**
+     * @brief Outcome of admission control for a new session, see
+     * getLastAdmission() and checkAdmission().
+     */
+    enum class Admission : uint8_t {
+        ADMITTED, QUEUED, REJECTED
+    };
+    // Bits of AdmissionResult::limits: the budgets the request did not fit
+    static const uint8_t LIMIT_SESSIONS = 0x01; // AKZ_ADMIT_MAX_ACTIVE sessions running (or no free record)
+    static const uint8_t LIMIT_MEMORY = 0x02;   // buffer pool already committed
+    static const uint8_t LIMIT_AIRTIME = 0x04;  // projected airtime share over AKZ_ADMIT_AIRTIME_PCT
+    struct AdmissionResult {
+        Admission decision;
+        uint8_t limits;         // LIMIT_* bits, 0 when admitted
+        uint32_t retryAfterMs;  // When it should fit, if not admitted now
+        size_t committedBytes;  // Pool bytes held by running sessions (this one excluded)
+        uint8_t airtimePct;     // Projected airtime share with this session, in percent
+    };
+
+    /**
+     * @brief Snapshot of one transfer session, see getSessionStats().
+     */
+    struct SessionStats {
+        uint8_t sessionId;      // Wire session id (0 until a receive is bound to a sender)
+        NodeNum peer;           // Remote node (BROADCAST_ADDR until a receive is bound)
+        bool sending;
+        TransferState state;
+        size_t bytesTransferred;
+        size_t totalFileSize;
+        unsigned long elapsedMs;
+        String filename;
+        size_t controlBytes;    // Session record, plus engine and stream while active
+        size_t bufferBytes;     // Borrowed from the shared slab pool (0 once finished)
+        uint32_t maxLoopUs;     // Longest single engine tick of this session
+        uint8_t priority;       // Stream priority, higher goes first (sends only)
+        bool joined;            // Stream joined a session already running with the peer
+    };
+
+    /**
+     * @brief Time spent on the caller's (mesh) thread inside loop() and
+     * processDataPacket(), see getMeshThreadLatency().
+     */
+    struct MeshThreadLatency {
+        uint32_t loopCalls;
+        uint32_t loopMaxUs;
+        uint32_t loopAvgUs;
+        uint32_t packetCalls;
+        uint32_t packetMaxUs;
+        uint32_t packetAvgUs;
+        uint32_t rxQueueDrops;  // Threaded mode: packets dropped on a full engine RX ring
+        uint32_t overBudget;    // Calls that ran past the loop budget (one unit of work overran)
+    };
+
+#if AKZ_ENABLE_STORAGE_WORKER
+    /**
+     * @brief Storage worker activity since begin(), see getStorageStats().
+     */
+    struct StorageStats {
+        uint32_t reads;         // blocks prefetched for sends
+        uint32_t writes;        // write calls for receives (adjacent full blocks go in one)
+        uint32_t bytesRead;
+        uint32_t bytesWritten;
+        uint32_t maxOpUs;       // longest single filesystem call, off the engine thread
+        uint32_t waits;         // times an engine had to wait for the worker
+    };
+#endif
+
+    static const int INVALID_SESSION = -1;
+    // Stream priorities for setSessionPriority(); any 0-255 value works
+    static const uint8_t PRIORITY_BULK = 0;
+    static const uint8_t PRIORITY_NORMAL = 64;
+    static const uint8_t PRIORITY_URGENT = 192;
+    static const uint32_t NO_DEADLINE = ZModemTimerWheel::NO_DEADLINE;
+
+    // Event callbacks, invoked from loop()/processDataPacket() (or from the
+    // engine task in threaded mode). 'ctx' is passed back unchanged.
+    // Progress fires whenever a session's byte count moves; completion fires
+    // once when the engine finishes (COMPLETE or ERROR), after the session's
+    // resources are released. abortSession() does not fire it.
+    typedef void (*ProgressCallback)(int session, size_t bytesTransferred, size_t totalFileSize, void* ctx);
+    typedef void (*CompletionCallback)(int session, TransferState result, void* ctx);
+    // Fired once per receive when ZFILE announces the size, before the data
+    // follows. 'needed' is what is still to come (less a resumed part).
+    // Arduino FS has no preallocation call, so this is where the host checks
+    // free space or makes room; it must not write to 'file'. Returning false
+    // refuses the file and aborts the session. For startReceive(sink)
+    // 'file' is a closed File.
+    typedef bool (*ReserveCallback)(int session, File& file, size_t needed, void* ctx);
+
+#if AKZ_ENABLE_JOB_QUEUE
+    /**
+     * @brief Transfer jobs: sends and receives kept in a queue on the
+     * filesystem (AKZ_JOB_QUEUE_FILE) and started from loop() in priority
+     * order as admission allows. A failed run is retried after a growing
+     * backoff until maxAttempts runs have failed; a job still waiting when
+     * its deadline passes is dropped. A ready job that cannot start preempts
+     * the lowest-priority running job below it, which goes back to the queue
+     * and continues from its partial file when it runs again.
+     */
+    struct JobOptions {
+        uint8_t priority;       // Higher runs first (PRIORITY_*)
+        uint32_t deadlineMs;    // Must start within this long, 0 for none
+        uint8_t maxAttempts;    // Runs before the job fails
+        uint32_t retryBackoffMs; // Wait before the first retry, doubled per failure
+        NodeNum owner;          // Node the job is for (informational), 0 if local
+        JobOptions()
+            : priority(PRIORITY_NORMAL), deadlineMs(0), maxAttempts(AKZ_JOB_DEFAULT_ATTEMPTS),
+              retryBackoffMs(AKZ_JOB_RETRY_BACKOFF_MS), owner(0) {}
+    };
+    enum class JobState : uint8_t {
+        PENDING,  // ready, waiting for its turn or for admission
+        WAITING,  // backing off after a failed run
+        RUNNING   // has a session (possibly queued for admission)
+    };
+    struct JobInfo {
+        uint16_t id;
+        bool sending;
+        JobState state;
+        uint8_t priority;
+        NodeNum peer;           // Send destination
+        NodeNum owner;
+        String path;
+        int session;            // While running, else INVALID_SESSION
+        size_t bytesDone;       // Running: this run's position; else where the last run stopped
+        uint8_t failures;
+        uint8_t maxAttempts;
+        uint32_t startsInMs;    // WAITING: time left in the backoff
+        uint32_t deadlineInMs;  // NO_DEADLINE if none
+    };
+    // Fired from loop() when a job leaves the queue: COMPLETE, or ERROR once
+    // it is out of attempts or past its deadline. Not fired by cancelJob().
+    typedef void (*JobCallback)(const JobInfo& job, TransferState result, void* ctx);
+#endif
+
+#if AKZ_ENABLE_FILE_INDEX
+    struct FileInfo {
+        String path;
+        uint32_t size;
+        uint32_t mtime;         // 0 if the FS keeps none (AKZ_FS_HAS_MTIME)
+        bool hashed;            // sha256 valid; index listings may not have it yet
+        uint8_t sha256[32];
+    };
+#endif
+
+#if AKZ_ENABLE_LISTING
+    // One page of listDirectory()
+    struct ListRequest {
+        const char* pattern = nullptr;  // '*'/'?' glob on entry names, null for all
+        uint32_t cursor = 0;            // cursor of the previous page, 0 for the first
+        uint32_t since = 0;             // token of an earlier listing, 0 for every entry
+        bool hashes = false;            // add SHA-256 prefixes the file index already holds
+        bool hashFiles = false;         // and queue the files it holds none for to be hashed in the background
     };
+#endif
+
+#if AKZ_ENABLE_AUTO_ACCEPT
+    /**
+     * @brief Which unannounced transfers setAutoAccept() takes, and where they
+     * go. A file larger than maxFileBytes, or one that would take the spool
+     * directory past quotaBytes, is refused at ZFILE (0: no limit; with a
+     * limit, a file of unknown size is refused too). 'peers' lists the nodes
+     * allowed to send (peerCount 0: any node).
+     */
+    struct AutoAcceptPolicy {
+        const char* spoolDir;
+        uint32_t maxFileBytes;
+        uint32_t quotaBytes;
+        const NodeNum* peers;
+        uint8_t peerCount;
+        AutoAcceptPolicy()
+            : spoolDir(nullptr), maxFileBytes(AKZ_AUTO_ACCEPT_MAX_FILE), quotaBytes(AKZ_AUTO_ACCEPT_QUOTA),
+              peers(nullptr), peerCount(0) {}
+    };
+#endif
 
     AkitaMeshZmodem();
     ~AkitaMeshZmodem();
 
     void begin(Meshtastic& meshInstance, FS& filesystem = SPIFFS, Stream* debugStream = nullptr);
+    // Drives every active session. Returns the state of the most recently started one.
+    // With AKZ_ENABLE_ENGINE_TASK the sessions run on the engine task and
+    // loop() only hands their queued frames to the mesh.
     TransferState loop();
-    void processDataPacket(MeshPacket& packet);
+    // As loop(), but stops once budgetUs is spent (0: no limit). Sessions
+    // left unserviced go first next call; hasPendingWork() reports them.
+    TransferState loop(uint32_t budgetUs);
+    // Routes a packet from the data port to its session and processes it
+    // immediately, without waiting for loop(). Returns true if consumed.
+    // In threaded mode: true once queued for the engine task (not yet routed).
+    bool processDataPacket(MeshPacket& packet);
+    // Milliseconds the host may sleep before calling loop() again: 0 if a
+    // session can make progress now, NO_DEADLINE if nothing is pending. An
+    // incoming data packet should still be passed to processDataPacket() at
+    // once. In threaded mode the engine task keeps its own timers and this is
+    // at most AKZ_ENGINE_TX_POLL_MS while a session is active.
+    uint32_t nextDeadline();
+    // True if a session can make progress right now (nextDeadline() == 0)
+    bool hasPendingWork() { return nextDeadline() == 0; }
+
+    void onProgress(ProgressCallback cb, void* ctx = nullptr) { _progressCb = cb; _progressCtx = ctx; }
+    void onComplete(CompletionCallback cb, void* ctx = nullptr) { _completeCb = cb; _completeCtx = ctx; }
+    void onReserve(ReserveCallback cb, void* ctx = nullptr) { _reserveCb = cb; _reserveCtx = ctx; }
+#if AKZ_ENABLE_JOB_QUEUE
+    void onJobDone(JobCallback cb, void* ctx = nullptr) { _jobCb = cb; _jobCtx = ctx; }
+#endif
+
+#if AKZ_HAVE_COROUTINES
+    /**
+     * @brief co_await transfer(session) suspends a host coroutine until the
+     * session ends and yields its final TransferState. The coroutine is
+     * resumed from loop() on the caller's thread (either mode). One waiter
+     * per session; an idle or finished session completes at once.
+     */
+    struct TransferAwaiter {
+        AkitaMeshZmodem* owner;
+        int session;
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        TransferState await_resume() const;
+    };
+    TransferAwaiter transfer(int session) { return TransferAwaiter{this, session}; }
+#endif
 
-    bool startSend(const String& filePath, NodeNum destinationNodeId);
-    bool startReceive(const String& filePath);
+    // Start a session; on success the session handle is stored in *sessionOut.
+    // New sessions pass admission control first (session count, committed
+    // pool memory, projected airtime). A send that does not fit is queued
+    // (returns true, state QUEUED) when AKZ_ADMIT_QUEUE_SENDS is set and a
+    // session record is free; otherwise the call fails. getLastAdmission()
+    // tells which, and when to retry.
+    bool startSend(const String& filePath, NodeNum destinationNodeId, int* sessionOut = nullptr,
+                   uint8_t priority = PRIORITY_NORMAL);
+    // resume: append to an existing file and ask the sender to continue from
+    // its size, instead of starting over
+    bool startReceive(const String& filePath, int* sessionOut = nullptr, bool resume = false);
     // Overloads accepting C-strings to avoid caller-side String temporaries
-    bool startSend(const char* filePath, NodeNum destinationNodeId);
-    bool startReceive(const char* filePath);
-    void abortTransfer();
+    bool startSend(const char* filePath, NodeNum destinationNodeId, int* sessionOut = nullptr,
+                   uint8_t priority = PRIORITY_NORMAL);
+    bool startReceive(const char* filePath, int* sessionOut = nullptr, bool resume = false);
+    // Send from / receive into anything else: a RAM buffer, a flash blob, a
+    // callback (see ZModemDataIO.h). 'name' is what ZFILE announces. The
+    // source or sink is the caller's and must outlive the session; it is
+    // used in place of a file, so the storage worker does not take it. A
+    // receive continues from the sink's size().
+    bool startSend(ZModemSource& source, const char* name, NodeNum destinationNodeId, int* sessionOut = nullptr,
+                   uint8_t priority = PRIORITY_NORMAL);
+    bool startReceive(ZModemSink& sink, int* sessionOut = nullptr);
+    // Send bytes [offset, offset + length) of a file, announced under the
+    // file's name as a file of that length; length 0 (or one past the end)
+    // sends the rest of the file. Asking for the same range again after an
+    // interruption resumes it like any other file. False if offset is not
+    // inside the file.
+    bool startSendRange(const char* filePath, NodeNum destinationNodeId, size_t offset, size_t length,
+                        int* sessionOut = nullptr, uint8_t priority = PRIORITY_NORMAL);
+    // Send the files of a batch one after another in one session: one
+    // handshake, and each file announced while the last one's end is still
+    // being confirmed. Files that cannot be opened are passed over (FAILED);
+    // false if none can. The batch must outlive the session; its results
+    // are final once the session ends. A receive armed with startReceive()
+    // saves each file after the first under its own name, next to the path
+    // it was armed with.
+    bool startSend(ZModemBatch& batch, NodeNum destinationNodeId, int* sessionOut = nullptr,
+                   uint8_t priority = PRIORITY_NORMAL);
+    // Admission decision of the last startSend()/startReceive() call
+    AdmissionResult getLastAdmission() const;
+    // Would a new session fit right now? Fills 'out' without starting anything.
+    bool checkAdmission(bool sending, NodeNum peer, AdmissionResult& out, uint8_t priority = PRIORITY_NORMAL) const;
+    // Measured airtime share of our transfers over AKZ_AIRTIME_WINDOW_MS
+    uint8_t getAirtimePercent() const;
+    void abortTransfer(); // Aborts all sessions
+    void abortSession(int session);
+    // Sends to the same peer are logical streams of one link: a send started
+    // while another to that peer is past its handshake joins it (no new
+    // ZRQINIT/ZRINIT round trip). While a higher-priority stream is sending
+    // data, lower ones hold their next chunk (up to AKZ_STREAM_MAX_DEFER_MS).
+    // New sessions start at PRIORITY_NORMAL.
+    bool setSessionPriority(int session, uint8_t priority);
+
+#if AKZ_ENABLE_JOB_QUEUE
+    // Add a job; returns its id, or 0 if the queue is full, the path is too
+    // long or (for a send) the file does not exist
+    uint16_t enqueueSend(const char* filePath, NodeNum destinationNodeId);
+    uint16_t enqueueSend(const char* filePath, NodeNum destinationNodeId, const JobOptions& options);
+    uint16_t enqueueReceive(const char* filePath);
+    uint16_t enqueueReceive(const char* filePath, const JobOptions& options);
+    // Remove a job, aborting its session if it is running
+    bool cancelJob(uint16_t id);
+    // Reorder: a new priority, or first in line among jobs of its priority
+    bool setJobPriority(uint16_t id, uint8_t priority);
+    bool moveJobToFront(uint16_t id);
+    size_t getJobCount() const;
+    // Job at 'position' in run order (0 runs first)
+    bool getJob(size_t position, JobInfo& out) const;
+    bool findJob(uint16_t id, JobInfo& out) const;
+#endif
+
+#if AKZ_ENABLE_TAIL_SEND
+    // Send what was appended to a file since its last tail send to this
+    // node. It is announced with ZCRESUM, so the receiver keeps its copy and
+    // asks only for the rest. A file that shrank or was rewritten is sent
+    // in full instead. True with *sessionOut INVALID_SESSION if there is
+    // nothing new.
+    bool startTail(const char* filePath, NodeNum destinationNodeId, int* sessionOut = nullptr,
+                   uint8_t priority = PRIORITY_NORMAL);
+    // Keep tailing the file: loop() checks it every periodMs and starts a
+    // tail send when it has grown or been rotated. 0 stops following.
+    bool followTail(const char* filePath, NodeNum destinationNodeId, uint32_t periodMs);
+    // Bytes of the file the node has confirmed so far
+    size_t getTailOffset(const char* filePath, NodeNum destinationNodeId);
+#endif
+
+#if AKZ_ENABLE_FILE_INDEX
+    // Size, mtime and SHA-256 of a file, from the index. The file is read
+    // only if it changed since it was indexed (or was never hashed). With
+    // 'hash' false it is never read: such a file comes back with hashed
+    // false and is hashed in the background, AKZ_INDEX_HASH_STEP_BYTES per
+    // loop(). False if it does not exist.
+    bool getFileInfo(const char* path, FileInfo& out, bool hash = true);
+    // Indexed files in path order, as recorded; nothing is read or hashed
+    size_t getIndexedFileCount() const;
+    bool getIndexedFile(size_t i, FileInfo& out) const;
+#endif
+
+#if AKZ_ENABLE_LISTING
+    // One page of the entries directly in 'dir', encoded as described in
+    // ZModemListing.h: files and subdirectories matching the pattern, in
+    // the order the FS lists them, from req.cursor on. With req.since only
+    // entries whose mtime is at or after it are listed; the page's token is
+    // the newest mtime seen. Such a listing covers additions and changes
+    // only: a deleted entry shows only as a lower total. Hashes come from the index, so no file is read;
+    // req.hashFiles has the missing ones hashed from loop() for a later
+    // listing. Returns the page length, or 0 if 'dir' is not a directory or
+    // cap is under AKZ_LIST_PAGE_BYTES.
+    size_t listDirectory(const char* dir, const ListRequest& req, uint8_t* page, size_t cap = AKZ_LIST_PAGE_BYTES);
+#endif
+
+#if AKZ_ENABLE_AUTO_ACCEPT
+    // Accept transfers nobody armed a receive for. A ZRQINIT from an allowed
+    // node that no armed receive or running stream takes opens a receive
+    // session (after admission); the file is saved in the spool directory
+    // under the announced name, cleaned up, with "-1", "-2"... added before
+    // the extension if taken. A failed transfer leaves nothing behind. False
+    // if the policy is unusable (no directory, too many peers).
+    bool setAutoAccept(const AutoAcceptPolicy& policy);
+    void disableAutoAccept();
+    bool isAutoAccepting() const { return _spoolDir.length() > 0; }
+#endif
 
+    // Legacy single-transfer view: reports the most recently started session
     TransferState getCurrentState() const;
     size_t getBytesTransferred() const;
     size_t getTotalFileSize() const;
     String getFilename() const;
 
+    // Per-session view. Handles are 0..getMaxSessions()-1.
+    int getMaxSessions() const { return AKZ_MAX_SESSIONS; }
+    size_t getActiveSessionCount() const;
+    size_t getQueuedSessionCount() const;
+    bool getSessionStats(int session, SessionStats& out) const;
+
+    // Memory accounting: a never-used or finished session costs only its
+    // record; buffers come from a fixed pool of AKZ_POOL_SLAB_COUNT slabs.
+    size_t getIdleSessionFootprint() const;
+    size_t getPoolFreeBytes() const;
+    size_t getPoolCapacityBytes() const;
+
+    // Mesh-thread cost of loop() and processDataPacket(), in either mode
+    bool isEngineThreaded() const { return AKZ_ENABLE_ENGINE_TASK != 0; }
+    void getMeshThreadLatency(MeshThreadLatency& out) const;
+    void resetMeshThreadLatency();
+#if AKZ_ENABLE_STORAGE_WORKER
+    // File I/O done by the storage worker on behalf of all sessions
+    void getStorageStats(StorageStats& out) const;
+#endif
+
     // Config setters
     void setTimeout(unsigned long timeoutMs);
     void setProgressUpdateInterval(unsigned long intervalMs);
     void setMaxPacketSize(size_t maxSize);
+    // Work budget for loop() and processDataPacket(), 0 for unbounded
+    void setLoopBudget(uint32_t budgetUs);
 
 private:
+    struct Session {
+        bool active = false;            // Holds engine/stream/file resources
+        bool sending = false;
+        uint8_t id = 0;                 // Session id as chosen by the initiator
+        NodeNum peer = BROADCAST_ADDR;
+        MeshtasticZModemStream* stream = nullptr;
+        ZModemSessionEngine* engine = nullptr;
+        File file;
+        ZModemSource* source = nullptr; // caller's data in place of 'file'
+        ZModemSink* sink = nullptr;
+        ZModemFileSource range;         // Range send: 'file' limited to the range, used as 'source'
+        size_t rangeStart = 0;          // Queued range send: the range to send once admitted
+        size_t rangeLength = 0;
+        ZModemBatch* batch = nullptr;   // Batch send: the caller's file list
+        uint8_t batchIndex = 0;         // its file being sent ('file')
+        uint8_t nextIndex = 0;          // and the one after, once opened into 'nextFile'
+        File nextFile;
+        String filename = "";
+        TransferState state = TransferState::IDLE;
+        size_t totalFileSize = 0;
+        size_t bytesTransferred = 0;
+        unsigned long startTime = 0;
+        unsigned long endTime = 0;
+        unsigned long lastProgressUpdate = 0;
+        uint32_t maxLoopUs = 0;
+        uint8_t priority = PRIORITY_NORMAL;
+        bool joined = false;            // Stream within a session already running with the peer
+        bool openOnAnnounce = false;    // Joined receive: open the file once ZFILE names it
+        bool reserved = false;          // Receive: announced size passed to the reserve callback
+        bool queued = false;            // Send waiting for admission, holds no resources
+        size_t held = 0;                // Receive: bytes the file held before ZFILE (kept until it decides)
+        AkitaMeshZmodem* owner = nullptr; // for the engine's announce callback
+#if AKZ_ENABLE_RESUME_JOURNAL
+        bool journal = false;           // Receive into a file that keeps a resume journal
+        bool journalFound = false;      // journalRec is what an earlier run left
+        bool journalLive = false;       // journalRec describes this transfer (ZFILE seen)
+        size_t journaled = 0;           // offset last written to the journal
+        ZModemResumeRecord journalRec;
+#endif
+#if AKZ_ENABLE_SEND_CHECKPOINT
+        bool checkpoint = false;        // Send recorded in the send checkpoint
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+        bool tail = false;              // Tail send (startTail), its offset recorded on completion
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+        bool spool = false;             // Auto-accepted receive into the spool directory
+        bool spoolContinued = false;    // appending to a spool file of the same sender (ZCRESUM)
+        uint32_t spoolName = 0;         // ZModemListing::nameHash() of the name ZFILE announced
+#endif
+        uint32_t queueSeq = 0;          // Admission order of queued sends
+#if AKZ_ENABLE_JOB_QUEUE
+        uint16_t jobId = 0;             // Job this session runs, cleared when it ends
+#endif
+#if AKZ_HAVE_COROUTINES
+        std::coroutine_handle<> waiter;  // host coroutine in co_await transfer()
+        bool waiterReady = false;        // session ended, resume from loop()
+#endif
+    };
+
     Meshtastic* _mesh = nullptr;
     FS* _fs = nullptr;
     Stream* _debug = nullptr;
-    MeshtasticZModemStream* _meshStream = nullptr;
-    ZModemEngine _zmodem; // Internal engine instance
 
-    File _transferFile;
-    String _filename = "";
-    TransferState _currentState = TransferState::IDLE;
-    NodeNum _destinationNodeId = BROADCAST_ADDR;
+    Session _sessions[AKZ_MAX_SESSIONS];
+    ZModemSessionTable _table;
+    ZModemBufferPool _pool;
+    ZModemTimerWheel _timers; // retry/keepalive/timeout deadlines of every session
+    int _primary = INVALID_SESSION;     // Most recently started session
+    // Guards sessions, table, pool and timers against the engine task; a
+    // no-op unless AKZ_ENABLE_ENGINE_TASK is set
+    mutable ZModemMutex _lock;
+    uint8_t _nextSessionId = 1;
+    NodeNum _retiredPeer = BROADCAST_ADDR; // last receive to end, see _routeDataPacket()
+    uint8_t _retiredId = 0;
+#if AKZ_ENABLE_SEND_CHECKPOINT
+    ZModemSendCheckpoint _sendCkpt; // record i belongs to session slot i
+#endif
+#if AKZ_ENABLE_TAIL_SEND
+    ZModemTailTable _tails;
+    bool _tailRunning(const char* path, NodeNum peer) const;
+    void _followTails();
+    void _saveTails();
+    uint32_t _msUntilTailCheck() const;
+#endif
+#if AKZ_ENABLE_AUTO_ACCEPT
+    String _spoolDir;           // with a trailing '/'; empty: auto-accept off
+    uint32_t _spoolMaxFile = 0;
+    uint32_t _spoolQuota = 0;
+    NodeNum _spoolPeers[AKZ_AUTO_ACCEPT_PEERS];
+    uint8_t _spoolPeerCount = 0;
+    // Spool file -> node it came from; offset: its size when received,
+    // fingerprint: nameHash() of the name it was announced under
+    ZModemTailTable _spoolFrom;
+    int _autoAccept(NodeNum from, uint8_t sessionByte);
+    bool _spoolPath(int slot, String& path);
+    bool _spoolContinuation(int slot, const char* name, size_t size, String& path);
+    void _noteSpooled(const Session& s);
+    void _saveSpoolFrom();
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    ZModemFileIndex _index;
+    static void _fillFileInfo(const ZModemFileEntry& e, FileInfo& out);
+    void _saveIndex();
+    void _hashIndexStep();
+    void _indexReceived(Session& s);
+#endif
+
+    ZModemAirtimeMeter _airtime; // our data-port packets, fed by the streams
+    ZModemTimer _admitTimer;     // re-check queued sends
+    bool _admitDue = false;
+    uint32_t _queueSeq = 0;
+    AdmissionResult _lastAdmission = {Admission::ADMITTED, 0, 0, 0, 0};
+
+#if AKZ_ENABLE_JOB_QUEUE
+    ZModemJobQueue _jobs;
+    bool _jobsKick = false;      // a job was added or finished: run the scheduler now (_kickJobs())
+    uint32_t _jobsPollAt = 0;    // next periodic scheduler pass
+    JobCallback _jobCb = nullptr;
+    void* _jobCtx = nullptr;
+    enum JobStart { JOB_STARTED, JOB_BLOCKED, JOB_FAILED };
+    uint16_t _enqueue(bool sending, const char* filePath, NodeNum peer, const JobOptions& options);
+    void _runJobs();
+    void _saveJobs();
+    void _kickJobs();
+    JobStart _startJob(ZModemJob& job, uint8_t ignoreLimits);
+    bool _preemptFor(const ZModemJob& job, uint8_t& freedLimits);
+    void _jobRunEnded(ZModemJob& job, uint32_t now);
+    void _jobDone(ZModemJob& job, TransferState result, const char* why);
+    void _fillJobInfo(const ZModemJob& job, JobInfo& out) const;
+    uint32_t _msUntilJobCheck() const;
+#endif
+
+    struct LatencyCounter {
+        uint32_t calls = 0;
+        uint32_t maxUs = 0;
+        uint64_t totalUs = 0;
+        void add(uint32_t us) { calls++; totalUs += us; if (us > maxUs) maxUs = us; }
+    };
+    ProgressCallback _progressCb = nullptr;
+    void* _progressCtx = nullptr;
+    CompletionCallback _completeCb = nullptr;
+    void* _completeCtx = nullptr;
+    ReserveCallback _reserveCb = nullptr;
+    void* _reserveCtx = nullptr;
+
+    LatencyCounter _loopLatency;
+    LatencyCounter _packetLatency;
+    uint32_t _rxQueueDrops = 0;
+    uint32_t _overBudget = 0;
+    int _serviceCursor = 0; // first session serviced by the next budgeted pass
 
-    size_t _totalFileSize = 0;
-    size_t _bytesTransferred = 0;
+#if AKZ_ENABLE_ENGINE_TASK
+    ZModemEngineTask _task;
+    ZModemSpscRing<ZModemQueuedPacket, AKZ_ENGINE_RX_QUEUE_DEPTH> _rxQueue; // mesh -> engine
+    ZModemSpscRing<ZModemQueuedPacket, AKZ_ENGINE_TX_QUEUE_DEPTH> _txQueue; // engine -> mesh
+    std::atomic<uint8_t> _publishedState{(uint8_t)TransferState::IDLE}; // for loop()
+    static uint32_t _taskStep(void* ctx);
+    void _drainTxQueue();
+#endif
+#if AKZ_ENABLE_STORAGE_WORKER
+    ZModemStorageWorker _storage; // channel i serves session slot i
+    static void _onStorageProgress(void* ctx);
+#endif
 
     unsigned long _zmodemTimeout = AKZ_DEFAULT_ZMODEM_TIMEOUT;
     unsigned long _progressUpdateInterval = AKZ_DEFAULT_PROGRESS_UPDATE_INTERVAL;
     size_t _maxPacketSize = AKZ_DEFAULT_MAX_PACKET_SIZE;
-    unsigned long _lastProgressUpdate = 0;
-    unsigned long _transferStartTime = 0;
+    uint32_t _loopBudgetUs = AKZ_DEFAULT_LOOP_BUDGET_US;
 
-    void _resetTransferState();
-    void _updateProgress();
-    void _handleZmodemState(int zState); // Adjusted signature
+    int _allocSession();
+    void _admit(bool sending, NodeNum peer, uint8_t priority, AdmissionResult& out) const;
+    uint32_t _msUntilFirstFinish() const;
+    bool _startSend(const String& filePath, ZModemSource* source, NodeNum dest, int* sessionOut, uint8_t priority,
+                    bool tail = false, size_t rangeStart = 0, size_t rangeLength = 0, ZModemBatch* batch = nullptr);
+    bool _beginSend(int slot, const String& filePath, NodeNum dest, uint8_t priority, ZModemSource* source = nullptr,
+                    const ZModemSendRecord* resumed = nullptr, bool tail = false, size_t rangeStart = 0,
+                    size_t rangeLength = 0, ZModemBatch* batch = nullptr);
+    int _openBatchFile(ZModemBatch& batch, int from, File& f);
+    static bool _onBatchNext(void* ctx, char* name, size_t cap, size_t& size);
+    static bool _onBatchDone(void* ctx, bool delivered);
+    bool _batchNext(int slot);
+    bool _batchDone(int slot, bool delivered);
+    static bool _onNextFile(void* ctx, const char* name, size_t size, size_t& offset);
+    bool _nextReceiveFile(int slot, size_t size);
+    bool _beginReceive(int slot, const String& filePath, bool resume);
+    int _oldestQueued() const;
+    void _admitQueued();
+    void _logAdmission(const char* what, const AdmissionResult& adm);
+    static void _onAdmitTimer(void* ctx);
+    bool _openSession(int slot, bool sending, NodeNum peer);
+    void _releaseSession(int slot);
+    void _attachStorage(int slot, bool reading);
+    void _jobSessionEnded(Session& s, bool ok);
+    int _routeDataPacket(NodeNum from, const uint8_t* p, size_t len); // slot, or INVALID_SESSION
+    bool _peerLinkReady(NodeNum peer) const;
+    int _joinStream(NodeNum from, uint8_t sessionByte);
+    bool _openJoinedFile(int slot);
+    bool _freePath(int slot, const String& dir, const char* name, String& path);
+    static String _suffixedPath(const String& dir, const char* name, int k);
+    bool _reserveFile(int slot);
+    static bool _onAnnounce(void* ctx, const char* name, size_t size, size_t& offset);
+    bool _acceptFile(int slot, const char* name, size_t size, size_t& offset);
+#if AKZ_ENABLE_RESUME_JOURNAL
+    bool _checkJournal(int slot, const char* name, size_t size, size_t& offset);
+    bool _journalCheckpoint(int slot, bool flush);
+#endif
+    void _checkpointSend(int slot);
+    void _updateSendCheckpoint(int slot);
+    void _dropSendCheckpoint(int slot);
+    void _reofferSends();
+    void _tailDelivered(int slot);
+    void _updateHolds();
+    void _runEngines(uint32_t budgetUs);
+    void _serviceSession(int slot, uint32_t budgetUs);
+    void _updateProgress(int slot);
+    void _logFootprint(int slot);
+#if AKZ_HAVE_COROUTINES
+    void _resumeWaiters();
+#endif
+    void _handleZmodemState(Session& s, int zState); // Adjusted signature
     void _log(const char* message);
     void _logError(const char* message);
 };
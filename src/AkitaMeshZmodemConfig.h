@@ -28,7 +28,7 @@
  * @brief Default maximum payload size for Meshtastic packets used by this library.
  * This should not exceed the actual MTU (Maximum Transmission Unit) of the
  * Meshtastic network/radio configuration (typically around 230-240 bytes).
- * The ZModem stream wrapper needs 3 bytes for header (ID + Packet ID).
+ * The ZModem stream wrapper needs 4 bytes for header (ID + Session ID + Packet ID).
  */
 #ifndef AKZ_DEFAULT_MAX_PACKET_SIZE
 #define AKZ_DEFAULT_MAX_PACKET_SIZE 230
@@ -42,21 +42,34 @@
 #define AKZ_DEFAULT_PROGRESS_UPDATE_INTERVAL 5000 // 5 seconds
 #endif
 
+/**
+ * @brief Default per-call work budget, in microseconds, for loop() and the
+ * immediate processing in processDataPacket(). A session stops after the
+ * header or data subpacket that exhausts the budget and resumes on the next
+ * call. 0 disables the limit. See getMeshThreadLatency() to pick a value.
+ */
+#ifndef AKZ_DEFAULT_LOOP_BUDGET_US
+#define AKZ_DEFAULT_LOOP_BUDGET_US 0
+#endif
+
 /**
  * @brief The byte value used to identify packets belonging to this ZModem stream.
  * This helps differentiate ZModem data from other Meshtastic traffic.
  * Ensure this doesn't conflict with other protocols on the network.
+ * It also versions the wire format: 0xAF marked the 3-byte header of 1.1.0,
+ * 0xB0 the 4-byte header with a session id, so mixed nodes ignore each other.
  */
 #ifndef AKZ_PACKET_IDENTIFIER
-#define AKZ_PACKET_IDENTIFIER 0xAF // Changed from 0xFF to avoid potential conflicts
+#define AKZ_PACKET_IDENTIFIER 0xB0
 #endif
 
 /**
  * @brief Internal buffer size for the MeshtasticZModemStream receive buffer.
- * Should be at least AKZ_DEFAULT_MAX_PACKET_SIZE.
+ * Should hold at least two packets of AKZ_DEFAULT_MAX_PACKET_SIZE: one 256-byte
+ * data chunk spans two mesh packets, which often arrive between two loop() calls.
  */
 #ifndef AKZ_STREAM_RX_BUFFER_SIZE
-#define AKZ_STREAM_RX_BUFFER_SIZE 256 // Slightly larger than max packet size
+#define AKZ_STREAM_RX_BUFFER_SIZE 512
 #endif
 
 /**
@@ -67,6 +80,645 @@
 #define AKZ_STREAM_TX_BUFFER_SIZE 256 // Slightly larger than max packet size
 #endif
 
+/**
+ * @brief Maximum number of concurrent transfer sessions (send or receive).
+ * Each active session owns its own engine state, mesh stream and file handle.
+ * Incoming data packets are routed by (source NodeNum, session id).
+ */
+#ifndef AKZ_MAX_SESSIONS
+#define AKZ_MAX_SESSIONS 4
+#endif
+
+/**
+ * @brief Slab size in bytes of the shared session buffer pool.
+ * Sessions borrow their working buffers (input parse buffer, chunk cache,
+ * stream RX/TX) from this pool only while a transfer is active.
+ */
+#ifndef AKZ_POOL_SLAB_SIZE
+#define AKZ_POOL_SLAB_SIZE 256
+#endif
+
+/**
+ * @brief Bytes a receiver gathers before writing them to the file (0: write
+ * each subpacket as it arrives). Writes are cut at multiples of this size in
+ * the file, so each one covers whole flash pages and the filesystem sees a
+ * few large appends instead of many small ones. Should be a multiple of the
+ * flash page (256 bytes on ESP32). Borrowed from the pool for the transfer;
+ * with AKZ_ENABLE_STORAGE_WORKER the worker's queue blocks gather instead.
+ */
+#ifndef AKZ_WRITE_COALESCE_BYTES
+#define AKZ_WRITE_COALESCE_BYTES 512
+#endif
+
+/**
+ * @brief Number of slabs in the shared buffer pool (max 32).
+ * An active session borrows 6 slabs (1.5 KB with 256-byte slabs); a receiver
+ * briefly borrows one more while parsing ZFILE, and holds
+ * AKZ_WRITE_COALESCE_BYTES more for write coalescing. The coroutine engine
+ * borrows one more per session for its frame, the storage worker
+ * AKZ_STORAGE_QUEUE_BLOCKS more for its queue. When the pool runs dry new
+ * sessions are rejected rather than starving running ones.
+ */
+#ifndef AKZ_POOL_SLAB_COUNT
+#if defined(AKZ_ENABLE_STORAGE_WORKER) && AKZ_ENABLE_STORAGE_WORKER
+#define AKZ_POOL_SLAB_COUNT 32
+#elif defined(AKZ_ENABLE_COROUTINE_ENGINE) && AKZ_ENABLE_COROUTINE_ENGINE
+#define AKZ_POOL_SLAB_COUNT (AKZ_WRITE_COALESCE_BYTES ? 32 : 30)
+#else
+#define AKZ_POOL_SLAB_COUNT (AKZ_WRITE_COALESCE_BYTES ? 30 : 26)
+#endif
+#endif
+
+/**
+ * @brief Resolution in milliseconds of the shared retry/keepalive timer wheel.
+ * Deadlines are rounded up to the next tick, so timers never fire early and
+ * fire at most one tick (plus loop latency) late.
+ */
+#ifndef AKZ_TIMER_TICK_MS
+#define AKZ_TIMER_TICK_MS 8
+#endif
+
+// --- Stream Multiplexing ---
+
+/**
+ * @brief Accept a new stream from a peer that already has a receive session
+ * running here, without a separate RECV. The stream is saved under the
+ * filename the sender announces, in the directory of the running receive,
+ * or with a "-N" suffix if that name is taken. Off by default: any peer with
+ * a running receive may then create files in that directory. Receive
+ * sessions advertise it in their ZRINIT (CANJOIN), and senders only skip the
+ * handshake towards a peer that did.
+ */
+#ifndef AKZ_ACCEPT_JOINED_STREAMS
+#define AKZ_ACCEPT_JOINED_STREAMS 0
+#endif
+
+/**
+ * @brief Longest a lower-priority send to a peer holds back its next chunk
+ * while a higher-priority stream to that peer is sending data. Must stay well
+ * below the ZModem timeout so the held stream's receiver does not give up.
+ */
+#ifndef AKZ_STREAM_MAX_DEFER_MS
+#define AKZ_STREAM_MAX_DEFER_MS 4000
+#endif
+
+// --- Admission Control ---
+
+/**
+ * @brief Most sessions that may hold buffers and run at once. Session
+ * records beyond this (up to AKZ_MAX_SESSIONS) can only hold queued sends.
+ */
+#ifndef AKZ_ADMIT_MAX_ACTIVE
+#define AKZ_ADMIT_MAX_ACTIVE AKZ_MAX_SESSIONS
+#endif
+
+/**
+ * @brief Pool slabs kept out of admission for transient buffers (a
+ * receiver's ZFILE parse, the XMODEM block), so running sessions are not
+ * starved by a newly admitted one.
+ */
+#ifndef AKZ_ADMIT_POOL_RESERVE_SLABS
+#define AKZ_ADMIT_POOL_RESERVE_SLABS 1
+#endif
+
+/**
+ * @brief Airtime budget: the largest projected share, in percent, of channel
+ * time this node's transfers may take. The projection is the larger of the
+ * measured share and the sum of the running sessions' estimates below, plus
+ * the new session's estimate. A send that outranks a running send to the same
+ * peer is exempt: it holds that stream instead of adding load.
+ */
+#ifndef AKZ_ADMIT_AIRTIME_PCT
+#define AKZ_ADMIT_AIRTIME_PCT 90
+#endif
+
+#ifndef AKZ_ADMIT_SEND_AIRTIME_PCT
+#define AKZ_ADMIT_SEND_AIRTIME_PCT 50 // data stream
+#endif
+
+#ifndef AKZ_ADMIT_RECV_AIRTIME_PCT
+#define AKZ_ADMIT_RECV_AIRTIME_PCT 5 // acknowledgements only
+#endif
+
+/**
+ * @brief Airtime model used to meter our own packets: a fixed cost per packet
+ * (preamble, LoRa and mesh headers) plus a cost per byte. The defaults
+ * approximate the LongFast preset (SF11, 250 kHz, CR 4/5).
+ */
+#ifndef AKZ_AIRTIME_PACKET_US
+#define AKZ_AIRTIME_PACKET_US 315000
+#endif
+
+#ifndef AKZ_AIRTIME_US_PER_BYTE
+#define AKZ_AIRTIME_US_PER_BYTE 7450
+#endif
+
+/**
+ * @brief Window over which the measured airtime share is averaged.
+ */
+#ifndef AKZ_AIRTIME_WINDOW_MS
+#define AKZ_AIRTIME_WINDOW_MS 30000
+#endif
+
+/**
+ * @brief Queue sends that do not fit instead of rejecting them. A queued send
+ * keeps a spare session record and starts, oldest first, once admission
+ * allows; receives are never queued.
+ */
+#ifndef AKZ_ADMIT_QUEUE_SENDS
+#define AKZ_ADMIT_QUEUE_SENDS 1
+#endif
+
+/**
+ * @brief Retry-after hint bounds. The hint is the projected time until the
+ * first running session finishes (plus the airtime window draining, when
+ * airtime was the limit); AKZ_ADMIT_DEFAULT_RETRY_MS is used when no running
+ * session has a usable rate yet. Queued sends are re-checked at least every
+ * AKZ_ADMIT_RECHECK_MS and whenever a session ends.
+ */
+#ifndef AKZ_ADMIT_DEFAULT_RETRY_MS
+#define AKZ_ADMIT_DEFAULT_RETRY_MS 30000
+#endif
+
+#ifndef AKZ_ADMIT_MIN_RETRY_MS
+#define AKZ_ADMIT_MIN_RETRY_MS 2000
+#endif
+
+#ifndef AKZ_ADMIT_MAX_RETRY_MS
+#define AKZ_ADMIT_MAX_RETRY_MS 600000
+#endif
+
+#ifndef AKZ_ADMIT_RECHECK_MS
+#define AKZ_ADMIT_RECHECK_MS 5000
+#endif
+
+// --- Transfer Job Queue ---
+
+/**
+ * @brief Keep a persistent queue of transfer jobs (enqueueSend/Receive).
+ * Jobs run one after another in priority order, are retried on failure and
+ * survive a reboot. Set to 0 to drop the queue and its RAM.
+ */
+#ifndef AKZ_ENABLE_JOB_QUEUE
+#define AKZ_ENABLE_JOB_QUEUE 1
+#endif
+
+/**
+ * @brief Jobs the queue can hold, running ones included. Each costs about
+ * 40 bytes plus AKZ_JOB_PATH_MAX of RAM.
+ */
+#ifndef AKZ_JOB_QUEUE_CAPACITY
+#define AKZ_JOB_QUEUE_CAPACITY 8
+#endif
+
+/**
+ * @brief Longest file path a job can carry, terminator included.
+ */
+#ifndef AKZ_JOB_PATH_MAX
+#define AKZ_JOB_PATH_MAX 64
+#endif
+
+/**
+ * @brief Where the queue is kept. It is rewritten (through "<file>.tmp")
+ * whenever a job is added, finishes or changes, and removed when empty.
+ */
+#ifndef AKZ_JOB_QUEUE_FILE
+#define AKZ_JOB_QUEUE_FILE "/.akz_jobs"
+#endif
+
+/**
+ * @brief Default retry policy: runs per job before it is given up, and the
+ * wait before the first retry. The wait doubles with each further failure,
+ * up to AKZ_JOB_RETRY_MAX_MS.
+ */
+#ifndef AKZ_JOB_DEFAULT_ATTEMPTS
+#define AKZ_JOB_DEFAULT_ATTEMPTS 3
+#endif
+
+#ifndef AKZ_JOB_RETRY_BACKOFF_MS
+#define AKZ_JOB_RETRY_BACKOFF_MS 30000
+#endif
+
+#ifndef AKZ_JOB_RETRY_MAX_MS
+#define AKZ_JOB_RETRY_MAX_MS 600000
+#endif
+
+/**
+ * @brief How often loop() re-evaluates waiting jobs when nothing else has
+ * changed (a job finishing or being added is handled at once).
+ */
+#ifndef AKZ_JOB_POLL_MS
+#define AKZ_JOB_POLL_MS 1000
+#endif
+
+// --- Resume Journal ---
+
+/**
+ * @brief Keep a small journal ("<file>" AKZ_RESUME_JOURNAL_SUFFIX) next to
+ * each file being received: the sender, the name and size it announced, and
+ * how much of the file is known to be on flash. After a reboot,
+ * startReceive() on the same path keeps the partial file and asks the sender
+ * to continue from the journaled offset, if the same file is announced
+ * again. The journal is removed once the file is complete.
+ */
+#ifndef AKZ_ENABLE_RESUME_JOURNAL
+#define AKZ_ENABLE_RESUME_JOURNAL 1
+#endif
+
+#ifndef AKZ_RESUME_JOURNAL_SUFFIX
+#define AKZ_RESUME_JOURNAL_SUFFIX ".akj"
+#endif
+
+/**
+ * @brief Progress between journal updates. Each update flushes the file and
+ * rewrites the journal, so this bounds the extra flash writes (one small
+ * file per this many bytes) and the data a reboot can cost.
+ */
+#ifndef AKZ_RESUME_JOURNAL_BYTES
+#define AKZ_RESUME_JOURNAL_BYTES 8192
+#endif
+
+// --- Send Checkpoint ---
+
+/**
+ * @brief Keep a checkpoint (AKZ_SEND_CHECKPOINT_FILE) of the file sends in
+ * progress: path, a fingerprint of the file, destination, session id and
+ * the offset the receiver has acknowledged. begin() offers the sends a
+ * reboot interrupted to their receivers again, under the same session id;
+ * the receiver answers with the offset it wants the data from. Sends run as
+ * transfer jobs are restored by the job queue instead.
+ */
+#ifndef AKZ_ENABLE_SEND_CHECKPOINT
+#define AKZ_ENABLE_SEND_CHECKPOINT 1
+#endif
+
+#ifndef AKZ_SEND_CHECKPOINT_FILE
+#define AKZ_SEND_CHECKPOINT_FILE "/.akz_sends"
+#endif
+
+/**
+ * @brief Acknowledged bytes between checkpoint updates. Only the progress
+ * shown after a reboot depends on it; what is re-sent is decided by the
+ * receiver.
+ */
+#ifndef AKZ_SEND_CHECKPOINT_BYTES
+#define AKZ_SEND_CHECKPOINT_BYTES 8192
+#endif
+
+// --- File Index ---
+
+/**
+ * @brief Keep an index of file metadata (size, modification time, SHA-256)
+ * in AKZ_FILE_INDEX_FILE, so getFileInfo() answers without reading the file
+ * back. Files this library receives are recorded as they are written; files
+ * changed by other code are noticed by their size and mtime and hashed
+ * again on the next lookup, or in the background for listings and sync.
+ */
+#ifndef AKZ_ENABLE_FILE_INDEX
+#define AKZ_ENABLE_FILE_INDEX 1
+#endif
+
+/**
+ * @brief Files the index holds. Each costs about 80 bytes plus
+ * AKZ_JOB_PATH_MAX of RAM; when full, the file looked up least recently is
+ * dropped.
+ */
+#ifndef AKZ_FILE_INDEX_CAPACITY
+#define AKZ_FILE_INDEX_CAPACITY 16
+#endif
+
+#ifndef AKZ_FILE_INDEX_FILE
+#define AKZ_FILE_INDEX_FILE "/.akz_index"
+#endif
+
+/**
+ * @brief Bytes of a file the index hashes per loop() call (or engine task
+ * step) for listings and sync, which only ask for hashes and never wait for
+ * them.
+ */
+#ifndef AKZ_INDEX_HASH_STEP_BYTES
+#define AKZ_INDEX_HASH_STEP_BYTES 4096
+#endif
+
+/**
+ * @brief The filesystem's File has getLastWrite(). Without it a file is
+ * checked against the index by its size only.
+ */
+#ifndef AKZ_FS_HAS_MTIME
+#if defined(ESP32) || defined(ESP8266)
+#define AKZ_FS_HAS_MTIME 1
+#else
+#define AKZ_FS_HAS_MTIME 0
+#endif
+#endif
+
+// --- Tail Sends ---
+
+/**
+ * @brief startTail() sends only what was appended to a file since its last
+ * tail send to the same node. The offset each node has confirmed is kept
+ * per (file, node) in AKZ_TAIL_FILE, with a fingerprint of the data before
+ * it; a file that shrank or whose delivered part changed (rotated) is sent
+ * again from the start.
+ */
+#ifndef AKZ_ENABLE_TAIL_SEND
+#define AKZ_ENABLE_TAIL_SEND 1
+#endif
+
+/**
+ * @brief (file, node) pairs remembered. Each costs about 24 bytes plus
+ * AKZ_JOB_PATH_MAX of RAM; when full, the pair sent least recently is
+ * forgotten and its next tail send starts over.
+ */
+#ifndef AKZ_TAIL_CAPACITY
+#define AKZ_TAIL_CAPACITY 8
+#endif
+
+#ifndef AKZ_TAIL_FILE
+#define AKZ_TAIL_FILE "/.akz_tails"
+#endif
+
+// --- Bundles ---
+
+/**
+ * @brief Most files one ZModemBundleSource carries. Each costs 8 bytes plus
+ * AKZ_BUNDLE_NAME_MAX of RAM in the source, for as long as it lives; files
+ * past the limit are left out (see skipped()).
+ */
+#ifndef AKZ_BUNDLE_MAX_FILES
+#define AKZ_BUNDLE_MAX_FILES 64
+#endif
+
+/**
+ * @brief Longest member name plus its terminator. Members are named relative
+ * to the bundled directory; longer names are left out.
+ */
+#ifndef AKZ_BUNDLE_NAME_MAX
+#define AKZ_BUNDLE_NAME_MAX 32
+#endif
+
+// --- Batches ---
+
+/**
+ * @brief Most files one ZModemBatch sends in a single session. Each costs 3
+ * bytes of RAM in the batch; add() past the limit fails.
+ */
+#ifndef AKZ_BATCH_MAX_FILES
+#define AKZ_BATCH_MAX_FILES 32
+#endif
+
+/**
+ * @brief Bytes a ZModemBatch holds for the paths of all its files,
+ * terminators included.
+ */
+#ifndef AKZ_BATCH_PATH_BYTES
+#define AKZ_BATCH_PATH_BYTES 1024
+#endif
+
+// --- Auto-accept ---
+
+/**
+ * @brief setAutoAccept() lets a sender start a transfer without an armed
+ * receive: its ZRQINIT opens a receive session that saves the file in a
+ * spool directory under the name ZFILE announces. Off until called.
+ */
+#ifndef AKZ_ENABLE_AUTO_ACCEPT
+#define AKZ_ENABLE_AUTO_ACCEPT 1
+#endif
+
+/**
+ * @brief Nodes an auto-accept policy can list; an empty list admits any node.
+ */
+#ifndef AKZ_AUTO_ACCEPT_PEERS
+#define AKZ_AUTO_ACCEPT_PEERS 8
+#endif
+
+/**
+ * @brief Default policy limits: the largest file accepted, and the most the
+ * spool directory may hold in total. 0 for no limit.
+ */
+#ifndef AKZ_AUTO_ACCEPT_MAX_FILE
+#define AKZ_AUTO_ACCEPT_MAX_FILE 65536
+#endif
+
+#ifndef AKZ_AUTO_ACCEPT_QUOTA
+#define AKZ_AUTO_ACCEPT_QUOTA 262144
+#endif
+
+/**
+ * @brief The node each kept spool file came from, and its size, so a sender
+ * continuing a file (ZCRESUM, e.g. a tail send) appends to its copy instead
+ * of starting a new "-N" one. Holds AKZ_TAIL_CAPACITY files; the least
+ * recently received is forgotten first.
+ */
+#ifndef AKZ_SPOOL_ORIGIN_FILE
+#define AKZ_SPOOL_ORIGIN_FILE "/.akz_spool"
+#endif
+
+/**
+ * @brief ZmodemModule spools into this directory from setup() when set,
+ * e.g. "/spool". Empty keeps auto-accept off in the module.
+ */
+#ifndef AKZ_AUTO_ACCEPT_DIR
+#define AKZ_AUTO_ACCEPT_DIR ""
+#endif
+
+// --- Listings ---
+
+/**
+ * @brief listDirectory() encodes a directory as compact pages (see
+ * ZModemListing.h) that a remote node can ask for one at a time; the
+ * module answers LIST: and STAT: with them.
+ */
+#ifndef AKZ_ENABLE_LISTING
+#define AKZ_ENABLE_LISTING 1
+#endif
+
+/**
+ * @brief Largest listing page, header included. It must fit one packet on
+ * the command port, under AKZ_DEFAULT_MAX_PACKET_SIZE.
+ */
+#ifndef AKZ_LIST_PAGE_BYTES
+#define AKZ_LIST_PAGE_BYTES 200
+#endif
+
+/**
+ * @brief Longest name a listing carries as is. A longer one is cut to this
+ * length and followed by a 32-bit hash of the full name.
+ */
+#ifndef AKZ_LIST_NAME_MAX
+#define AKZ_LIST_NAME_MAX 24
+#endif
+
+// --- Sync ---
+
+/**
+ * @brief ZmodemModule's SYNC: gives up when the other node has not answered
+ * a manifest or receive request for this long.
+ */
+#ifndef AKZ_SYNC_REPLY_TIMEOUT_MS
+#define AKZ_SYNC_REPLY_TIMEOUT_MS 60000
+#endif
+
+// --- Threaded Engine (optional) ---
+
+/**
+ * @brief Run the ZModem engines on a dedicated task instead of in loop().
+ * The mesh thread then only copies data packets into a lock-free RX ring in
+ * processDataPacket() and hands queued outgoing frames to the mesh in loop();
+ * file I/O, CRC and the protocol state machines run on the engine task.
+ * Uses a FreeRTOS task on ESP32 and std::thread elsewhere. Off by default.
+ */
+#ifndef AKZ_ENABLE_ENGINE_TASK
+#define AKZ_ENABLE_ENGINE_TASK 0
+#endif
+
+/**
+ * @brief ESP32 core the engine task is pinned to. The default keeps it off
+ * core 1, where the Arduino loopTask (and with it Meshtastic) runs
+ * (ARDUINO_RUNNING_CORE).
+ */
+#ifndef AKZ_ENGINE_TASK_CORE
+#define AKZ_ENGINE_TASK_CORE 0
+#endif
+
+#ifndef AKZ_ENGINE_TASK_STACK
+#define AKZ_ENGINE_TASK_STACK 8192
+#endif
+
+#ifndef AKZ_ENGINE_TASK_PRIORITY
+#define AKZ_ENGINE_TASK_PRIORITY 1
+#endif
+
+/**
+ * @brief Depth (power of two) of the mesh-to-engine and engine-to-mesh packet
+ * rings. Each slot holds one packet of up to AKZ_STREAM_TX_BUFFER_SIZE bytes.
+ */
+#ifndef AKZ_ENGINE_RX_QUEUE_DEPTH
+#define AKZ_ENGINE_RX_QUEUE_DEPTH 8
+#endif
+
+#ifndef AKZ_ENGINE_TX_QUEUE_DEPTH
+#define AKZ_ENGINE_TX_QUEUE_DEPTH 8
+#endif
+
+/**
+ * @brief Threaded mode: longest nextDeadline() reported while a session is
+ * active, so loop() keeps draining frames the engine task queues meanwhile.
+ */
+#ifndef AKZ_ENGINE_TX_POLL_MS
+#define AKZ_ENGINE_TX_POLL_MS 10
+#endif
+
+// --- Storage Worker (optional) ---
+
+/**
+ * @brief Do file reads and writes on a background worker thread instead of
+ * inside the engine tick. A send prefetches the next blocks of its file; a
+ * receive queues decoded data and acknowledges it once queued, so a flash
+ * write that stalls on a block erase no longer stalls mesh RX. When the
+ * write queue is full the receiver withholds its ACK until there is room,
+ * which pauses the sender instead of dropping data. The filesystem must be
+ * usable from two threads (the ESP32 VFS is). FreeRTOS task on ESP32,
+ * std::thread elsewhere. Off by default.
+ */
+#ifndef AKZ_ENABLE_STORAGE_WORKER
+#define AKZ_ENABLE_STORAGE_WORKER 0
+#endif
+
+/**
+ * @brief Blocks (AKZ_POOL_SLAB_SIZE bytes each) a session queues between its
+ * engine and the worker: read-ahead depth for a send, write-behind depth for
+ * a receive. Borrowed from the shared pool while the transfer runs. At
+ * least two, so the largest subpacket (ZModemEngine::IN_BUF_SIZE) fits.
+ */
+#ifndef AKZ_STORAGE_QUEUE_BLOCKS
+#define AKZ_STORAGE_QUEUE_BLOCKS 2
+#endif
+
+/**
+ * @brief How often nextDeadline() asks to be polled while an engine waits
+ * for the worker (unthreaded mode; the engine task is woken directly).
+ */
+#ifndef AKZ_STORAGE_POLL_MS
+#define AKZ_STORAGE_POLL_MS 5
+#endif
+
+#ifndef AKZ_STORAGE_TASK_CORE
+#define AKZ_STORAGE_TASK_CORE 0
+#endif
+
+#ifndef AKZ_STORAGE_TASK_STACK
+#define AKZ_STORAGE_TASK_STACK 4096
+#endif
+
+#ifndef AKZ_STORAGE_TASK_PRIORITY
+#define AKZ_STORAGE_TASK_PRIORITY 1
+#endif
+
+// Receivers coalesce in the engine unless the worker's queue does it
+#if AKZ_WRITE_COALESCE_BYTES && !AKZ_ENABLE_STORAGE_WORKER
+#define AKZ_HAVE_WRITE_COALESCER 1
+#else
+#define AKZ_HAVE_WRITE_COALESCER 0
+#endif
+
+// Either option needs ZModemEngineTask's thread wrapper
+#if AKZ_ENABLE_ENGINE_TASK || AKZ_ENABLE_STORAGE_WORKER
+#define AKZ_HAVE_WORKER_THREADS 1
+#else
+#define AKZ_HAVE_WORKER_THREADS 0
+#endif
+
+// --- Coroutine Engine (optional) ---
+
+// Set when the compiler implements C++20 coroutines (e.g. -std=gnu++20 on
+// GCC 10+, which also needs -fcoroutines before GCC 11)
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define AKZ_HAVE_COROUTINES 1
+#endif
+#endif
+#ifndef AKZ_HAVE_COROUTINES
+#define AKZ_HAVE_COROUTINES 0
+#endif
+
+/**
+ * @brief Run each session on ZModemCoEngine, the coroutine implementation of
+ * the protocol, instead of the ZModemEngine state machine. Same wire format
+ * and API; requires AKZ_HAVE_COROUTINES.
+ */
+#ifndef AKZ_ENABLE_COROUTINE_ENGINE
+#define AKZ_ENABLE_COROUTINE_ENGINE 0
+#endif
+
+#if AKZ_ENABLE_COROUTINE_ENGINE && !AKZ_HAVE_COROUTINES
+#error "AKZ_ENABLE_COROUTINE_ENGINE needs a compiler with C++20 coroutines (-std=gnu++20)"
+#endif
+
+// --- OTA Sink ---
+
+/**
+ * @brief Bytes a ZModemOtaSink keeps for chunks that arrive ahead of the
+ * image's write position, written once the gap before them is filled. Part
+ * of the sink object. 0 drops such chunks; the sender resends them.
+ */
+#ifndef AKZ_OTA_STAGE_BYTES
+#define AKZ_OTA_STAGE_BYTES 1024
+#endif
+
+// --- Staging Sink ---
+
+/**
+ * @brief Most memory a ZModemStagingSink holds a received file in before
+ * writing it out: PSRAM on ESP32, the heap elsewhere. A file up to this size
+ * reaches flash in one write, after it is verified; a larger one is not
+ * staged and is written as it arrives (ZModemStagingSink::unverified()).
+ */
+#ifndef AKZ_STAGE_MAX_BYTES
+#define AKZ_STAGE_MAX_BYTES (1024UL * 1024UL)
+#endif
+
 // --- PortNum Definitions ---
 
 /**
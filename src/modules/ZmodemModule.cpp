@@ -21,6 +21,15 @@
 // Forward declaration of helper defined at end of file
 static NodeNum parseNodeId(const char* str);
 
+// Text this module sends as replies, never a command
+static bool isReply(const char* msg) {
+    static const char* const PREFIXES[] = {"OK:", "Error:", "BUSY:", "DONE:", "FAILED:", "Unknown command:", "STAT ", "Jobs "};
+    for (const char* p : PREFIXES) {
+        if (strncmp(msg, p, strlen(p)) == 0) return true;
+    }
+    return false;
+}
+
 // --- Module Initialization ---
 
 // Constructor
@@ -40,6 +49,22 @@ void ZmodemModule::setup() {
     // akitaZmodem.setTimeout(45000);
     // akitaZmodem.setProgressUpdateInterval(3000);
 
+    // Report finished transfers as they happen instead of polling the state
+    akitaZmodem.onComplete(onTransferComplete, this);
+#if AKZ_ENABLE_JOB_QUEUE
+    // SEND/RECV run as queued jobs; tell their requesters how they end
+    akitaZmodem.onJobDone(onJobDone, this);
+#endif
+
+#if AKZ_ENABLE_AUTO_ACCEPT
+    // Senders need no RECV: unannounced files land in the spool directory
+    if (AKZ_AUTO_ACCEPT_DIR[0]) {
+        AkitaMeshZmodem::AutoAcceptPolicy policy;
+        policy.spoolDir = AKZ_AUTO_ACCEPT_DIR;
+        if (!akitaZmodem.setAutoAccept(policy)) LOG_ERROR("ZmodemModule: Cannot auto-accept into %s", AKZ_AUTO_ACCEPT_DIR);
+    }
+#endif
+
     LOG_INFO("Zmodem Module initialized successfully. Listening for commands on PortNum %d.", AKZ_ZMODEM_COMMAND_PORTNUM);
 }
 
@@ -47,31 +72,105 @@ void ZmodemModule::setup() {
 void ZmodemModule::loop() {
     // Call the Akita ZModem library's loop function frequently
     // This handles the ZModem state machine, timeouts, and data processing
-    AkitaMeshZmodem::TransferState currentState = akitaZmodem.loop();
+    akitaZmodem.loop();
 
     // Optional: Add any module-specific periodic tasks here
     static unsigned long lastStatusReport = 0;
-    static AkitaMeshZmodem::TransferState lastReportedState = AkitaMeshZmodem::TransferState::IDLE;
 
-    if (currentState != lastReportedState) {
-        if (currentState == AkitaMeshZmodem::TransferState::COMPLETE || currentState == AkitaMeshZmodem::TransferState::ERROR) {
-            // Final state messages are logged by the library itself
-            LOG_INFO("Zmodem transfer finished. State: %d", (int)currentState);
-        } else {
-             LOG_INFO("Zmodem Status: %d", (int)currentState);
+    // Periodic per-session status update if busy
+    if (akitaZmodem.getActiveSessionCount() > 0 && millis() - lastStatusReport > 15000) { // Report every 15s if active
+        AkitaMeshZmodem::SessionStats st;
+        for (int i = 0; i < akitaZmodem.getMaxSessions(); ++i) {
+            if (!akitaZmodem.getSessionStats(i, st)) continue;
+            LOG_INFO("Zmodem Session %d: State %d, Peer 0x%x, Transferred: %d / %d",
+                     i, (int)st.state, st.peer,
+                     st.bytesTransferred,
+                     st.totalFileSize);
         }
-        lastReportedState = currentState;
         lastStatusReport = millis();
     }
-    // Periodic status update if busy
-    else if (currentState != AkitaMeshZmodem::TransferState::IDLE && millis() - lastStatusReport > 15000) { // Report every 15s if active
-        LOG_INFO("Zmodem Status: %d, Transferred: %d / %d",
-                 (int)currentState,
-                 akitaZmodem.getBytesTransferred(),
-                 akitaZmodem.getTotalFileSize());
-        lastStatusReport = millis();
+
+#if AKZ_ENABLE_LISTING
+    // A synced node that stopped answering; a running bundle ends on its own
+    if (sync && sync->phase != SyncJob::Phase::SENDING && millis() - sync->lastReplyMs > AKZ_SYNC_REPLY_TIMEOUT_MS) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "Error: Sync of %s stopped, node 0x%lx did not answer", sync->dir,
+                 (unsigned long)sync->peer);
+        endSync(buf);
+    }
+#endif
+}
+
+// Completion callback registered in setup(); the library has already logged the details
+void ZmodemModule::onTransferComplete(int session, AkitaMeshZmodem::TransferState result, void* ctx) {
+    ZmodemModule* self = static_cast<ZmodemModule*>(ctx);
+    LOG_INFO("Zmodem session %d finished. State: %d", session, (int)result);
+    if (!self) return;
+#if AKZ_ENABLE_LISTING
+    bool syncDone = self->sync && self->sync->phase == SyncJob::Phase::SENDING && session == self->bundleOutSession;
+#endif
+    if (self->bundleOut && session == self->bundleOutSession) {
+        delete self->bundleOut;
+        self->bundleOut = nullptr;
+        self->bundleOutSession = AkitaMeshZmodem::INVALID_SESSION;
+    }
+    if (self->bundleIn && session == self->bundleInSession) {
+        LOG_INFO("Zmodem bundle unpacked %u files", (unsigned)self->bundleIn->count());
+#if AKZ_ENABLE_LISTING
+        if (result == AkitaMeshZmodem::TransferState::COMPLETE && self->bundleIn->finished()) {
+            self->unpackedFor = self->bundleInRequester;
+            snprintf(self->unpackedDir, sizeof(self->unpackedDir), "%s", self->bundleIn->dir());
+            self->unpackedMs = millis();
+        }
+#endif
+        delete self->bundleIn;
+        self->bundleIn = nullptr;
+        self->bundleInSession = AkitaMeshZmodem::INVALID_SESSION;
+    }
+    if (self->batchOut && session == self->batchOutSession) {
+        ZModemBatch* b = self->batchOut;
+        char buf[160];
+        snprintf(buf, sizeof(buf), "%s: Batch of %u files: %u sent, %u skipped, %u failed to open",
+                 result == AkitaMeshZmodem::TransferState::COMPLETE ? "DONE" : "FAILED", (unsigned)b->count(),
+                 (unsigned)b->countOf(ZModemBatch::Result::SENT), (unsigned)b->countOf(ZModemBatch::Result::SKIPPED),
+                 (unsigned)b->countOf(ZModemBatch::Result::FAILED));
+        LOG_INFO("ZmodemModule: %s", buf);
+        if (self->batchRequester) self->sendReply(buf, self->batchRequester);
+        delete self->batchOut;
+        self->batchOut = nullptr;
+        self->batchOutSession = AkitaMeshZmodem::INVALID_SESSION;
+    }
+#if AKZ_ENABLE_LISTING
+    if (syncDone) {
+        if (result == AkitaMeshZmodem::TransferState::COMPLETE) {
+            self->finishSync();
+        } else {
+            char buf[160];
+            snprintf(buf, sizeof(buf), "Error: Sync of %s failed sending the changed files", self->sync->dir);
+            self->endSync(buf);
+        }
+    }
+#endif
+}
+
+#if AKZ_ENABLE_JOB_QUEUE
+// Job callback registered in setup(): report the outcome to whoever queued it
+void ZmodemModule::onJobDone(const AkitaMeshZmodem::JobInfo& job, AkitaMeshZmodem::TransferState result, void* ctx) {
+    ZmodemModule* self = static_cast<ZmodemModule*>(ctx);
+    char buf[160];
+    if (result == AkitaMeshZmodem::TransferState::COMPLETE) {
+        snprintf(buf, sizeof(buf), "DONE: Job %u %s %s", (unsigned)job.id, job.sending ? "SEND" : "RECV", job.path.c_str());
+    } else if (job.failures >= job.maxAttempts) {
+        snprintf(buf, sizeof(buf), "FAILED: Job %u %s %s after %u runs", (unsigned)job.id,
+                 job.sending ? "SEND" : "RECV", job.path.c_str(), (unsigned)job.failures);
+    } else {
+        snprintf(buf, sizeof(buf), "FAILED: Job %u %s %s, deadline passed", (unsigned)job.id,
+                 job.sending ? "SEND" : "RECV", job.path.c_str());
     }
+    LOG_INFO("ZmodemModule: %s", buf);
+    if (self && job.owner) self->sendReply(buf, job.owner);
 }
+#endif
 
 // Handle Received Packets: Called by firmware when a packet arrives
 bool ZmodemModule::handleReceived(MeshPacket& packet) {
@@ -87,6 +186,17 @@ bool ZmodemModule::handleReceived(MeshPacket& packet) {
               size_t payloadLen = packet.decoded.payload.length();
               const uint8_t* payloadBuf = packet.decoded.payload.getBuffer();
               if (payloadLen == 0 || !payloadBuf) return false;
+#if AKZ_ENABLE_LISTING
+              // A listing page answering our LIST, not a command
+              if (payloadBuf[0] == ZModemListing::MAGIC) {
+                  if (sync && sync->phase == SyncJob::Phase::MANIFEST && packet.from == sync->peer) {
+                      syncPage(payloadBuf, payloadLen);
+                  } else {
+                      logListingPage(payloadBuf, payloadLen, packet.from);
+                  }
+                  return true;
+              }
+#endif
               char* msg = new char[payloadLen + 1];
               memcpy(msg, payloadBuf, payloadLen);
               msg[payloadLen] = '\0';
@@ -104,15 +214,15 @@ bool ZmodemModule::handleReceived(MeshPacket& packet) {
 
     // 2. Is it a DATA packet?
     } else if (packet.decoded.portnum == AKZ_ZMODEM_DATA_PORTNUM) {
-        // This is a data packet, feed it to the library's stream processor
-        // Only process if we are actively receiving
-        if (akitaZmodem.getCurrentState() == AkitaMeshZmodem::TransferState::RECEIVING) {
-            LOG_DEBUG("ZmodemModule pushing DATA packet to library.");
-            akitaZmodem.processDataPacket(packet);
+        // This is a data packet, feed it to the library's stream processor.
+        // Senders need their ACKs as much as receivers need data, so every
+        // session gets its packets; the library routes by (sender, session id).
+        if (akitaZmodem.processDataPacket(packet)) {
+            LOG_DEBUG("ZmodemModule pushed DATA packet to library.");
             return true; // We consumed this packet
         } else {
-            LOG_DEBUG("ZmodemModule ignoring DATA packet (not in RECEIVING state).");
-            return false; // Not actively receiving, let it be dropped
+            LOG_DEBUG("ZmodemModule ignoring DATA packet (no matching session).");
+            return false; // No session for it, let it be dropped
         }
 
     // 3. Not for us
@@ -123,18 +233,66 @@ bool ZmodemModule::handleReceived(MeshPacket& packet) {
 
 // --- Private Helper Methods ---
 
-// Parse and handle incoming commands (SEND:!NodeID:/path, RECV:/path)
+// Parse and handle incoming commands (SEND:!NodeID:/path, URGENT:!NodeID:/path, RECV:/path,
+// each optionally followed by job options, see queueJob(); SEND/URGENT also take
+// /a,/b,/dir/*.log as one batch, see sendBatch(); TAIL:!NodeID:/path [f=<s>];
+// BUNDLE:!NodeID:/dir [pattern], RECVBUNDLE:/dir; GET:/path [range];
+// LIST:/dir [pattern] [c=<cursor>] [s=<token>] [h|H], STAT:/path;
+// SYNC:!NodeID:/dir [d], SYNCDEL:/dir names)
 void ZmodemModule::handleCommand(const char* msg, NodeNum fromNodeId) {
     if (!msg) return;
+#if AKZ_ENABLE_LISTING
+    if (sync && fromNodeId == sync->peer && syncReply(msg)) return;
+#endif
 
     const char* args = nullptr;
     bool isSend = false;
-    if (strncmp(msg, "SEND:", 5) == 0) {
+    bool urgent = false;
+    if (strcmp(msg, "STATUS") == 0) {
+        sendStatus(fromNodeId);
+        return;
+#if AKZ_ENABLE_JOB_QUEUE
+    } else if (handleJobCommand(msg, fromNodeId)) {
+        return;
+#endif
+    } else if (strncmp(msg, "BUNDLE:", 7) == 0 || strncmp(msg, "RECVBUNDLE:", 11) == 0) {
+        handleBundleCommand(msg, fromNodeId);
+        return;
+#if AKZ_ENABLE_TAIL_SEND
+    } else if (strncmp(msg, "TAIL:", 5) == 0) {
+        handleTailCommand(msg + 5, fromNodeId);
+        return;
+#endif
+#if AKZ_ENABLE_LISTING
+    } else if (strncmp(msg, "LIST:", 5) == 0 || strncmp(msg, "STAT:", 5) == 0) {
+        handleListCommand(msg, fromNodeId);
+        return;
+    } else if (strncmp(msg, "SYNC:", 5) == 0) {
+        handleSyncCommand(msg + 5, fromNodeId);
+        return;
+    } else if (strncmp(msg, "SYNCDEL:", 8) == 0) {
+        handleSyncDelete(msg + 8, fromNodeId);
+        return;
+#endif
+    } else if (strncmp(msg, "GET:", 4) == 0) {
+        handleGetCommand(msg + 4, fromNodeId);
+        return;
+    } else if (strncmp(msg, "SEND:", 5) == 0) {
         isSend = true;
         args = msg + 5; // after SEND:
+    } else if (strncmp(msg, "URGENT:", 7) == 0) {
+        // As SEND, but as a high-priority stream that overtakes bulk sends to the same node
+        isSend = true;
+        urgent = true;
+        args = msg + 7;
     } else if (strncmp(msg, "RECV:", 5) == 0) {
         isSend = false;
         args = msg + 5; // after RECV:
+    } else if (isReply(msg)) {
+        // The answer to a command this node sent (SYNC sends some): answering
+        // it in turn would start an endless exchange of "Unknown command"
+        LOG_INFO("ZmodemModule: Reply from 0x%x: %s", fromNodeId, msg);
+        return;
     } else {
         LOG_WARNING("ZmodemModule: Received unknown command '%s'", msg);
         char buf[192];
@@ -143,15 +301,6 @@ void ZmodemModule::handleCommand(const char* msg, NodeNum fromNodeId) {
         return;
     }
 
-    // Check if a transfer is already active
-    if (akitaZmodem.getCurrentState() != AkitaMeshZmodem::TransferState::IDLE) {
-        LOG_WARNING("ZmodemModule: Ignoring command '%s', transfer already in progress.", msg);
-        char buf[128];
-        snprintf(buf, sizeof(buf), "Error: Transfer already in progress (State: %d)", (int)akitaZmodem.getCurrentState());
-        sendReply(buf, fromNodeId);
-        return;
-    }
-
     if (!isSend) {
         // RECV: args is filename
         const char* filename = args;
@@ -161,18 +310,22 @@ void ZmodemModule::handleCommand(const char* msg, NodeNum fromNodeId) {
             return;
         }
 
+#if AKZ_ENABLE_JOB_QUEUE
+        queueJob("RECV", filename, 0, AkitaMeshZmodem::PRIORITY_NORMAL, fromNodeId);
+#else
         LOG_INFO("ZmodemModule: Initiating RECEIVE to '%s'", filename);
         bool success = akitaZmodem.startReceive(filename);
         if (success) {
             char buf[192];
             snprintf(buf, sizeof(buf), "OK: Starting RECV to %s. Waiting for sender...", filename);
             sendReply(buf, fromNodeId);
-        } else {
+        } else if (!sendBusyReply("RECV", filename, fromNodeId)) {
             char buf[160];
             snprintf(buf, sizeof(buf), "Error: Failed to start RECV to %s", filename);
             sendReply(buf, fromNodeId);
             LOG_ERROR("ZmodemModule: akitaZmodem.startReceive failed for '%s'", filename);
         }
+#endif
 
     } else {
         // SEND: args format: !NodeID:/path/file.txt
@@ -209,21 +362,913 @@ void ZmodemModule::handleCommand(const char* msg, NodeNum fromNodeId) {
             return;
         }
 
+        uint8_t priority = urgent ? AkitaMeshZmodem::PRIORITY_URGENT : AkitaMeshZmodem::PRIORITY_NORMAL;
+        // Several paths, or a pattern: all of them in one session
+        size_t listLen = strcspn(filename, " ");
+        const char* multi = strpbrk(filename, ",*?");
+        if (multi && (size_t)(multi - filename) < listLen) {
+            sendBatch(urgent ? "URGENT" : "SEND", filename, destNodeId, nodeBuf, priority, fromNodeId);
+            return;
+        }
+#if AKZ_ENABLE_JOB_QUEUE
+        queueJob(urgent ? "URGENT" : "SEND", filename, destNodeId, priority, fromNodeId);
+#else
         LOG_INFO("ZmodemModule: Initiating SEND for '%s' to Node 0x%x", filename, destNodeId);
-        bool success = akitaZmodem.startSend(filename, destNodeId);
-        if (success) {
+        int session = AkitaMeshZmodem::INVALID_SESSION;
+        bool success = akitaZmodem.startSend(filename, destNodeId, &session, priority);
+        AkitaMeshZmodem::AdmissionResult adm = akitaZmodem.getLastAdmission();
+        if (success && adm.decision == AkitaMeshZmodem::Admission::QUEUED) {
+            // Over budget right now: the library starts it once it fits
             char buf[192];
-            snprintf(buf, sizeof(buf), "OK: Starting SEND for %s to %s", filename, nodeBuf);
+            snprintf(buf, sizeof(buf), "QUEUED: %s for %s to %s as S%d, expected start in ~%lus",
+                     urgent ? "URGENT" : "SEND", filename, nodeBuf, session, (unsigned long)(adm.retryAfterMs / 1000));
             sendReply(buf, fromNodeId);
-        } else {
+        } else if (success) {
+            char buf[192];
+            snprintf(buf, sizeof(buf), "OK: Starting %s for %s to %s", urgent ? "URGENT" : "SEND", filename, nodeBuf);
+            sendReply(buf, fromNodeId);
+        } else if (!sendBusyReply(urgent ? "URGENT" : "SEND", filename, fromNodeId)) {
             char buf[160];
             snprintf(buf, sizeof(buf), "Error: Failed to start SEND for %s", filename);
             sendReply(buf, fromNodeId);
             LOG_ERROR("ZmodemModule: akitaZmodem.startSend failed for '%s'", filename);
         }
+#endif
     }
 }
 
+// The batch of a SEND naming several files. 'list' runs to the first space:
+// comma-separated absolute paths, each of which may have '*' and '?' in its
+// last component to take the matching files of that directory.
+void ZmodemModule::sendBatch(const char* what, const char* list, NodeNum destNodeId, const char* nodeName,
+                             uint8_t priority, NodeNum fromNodeId) {
+    char buf[192];
+    if (batchOut) {
+        sendReply("Error: A batch send is already running", fromNodeId);
+        return;
+    }
+    batchOut = new ZModemBatch();
+    if (!batchOut) {
+        sendReply("Error: Out of memory for the batch", fromNodeId);
+        return;
+    }
+    const char* end = list + strcspn(list, " ");
+    bool full = false;
+    const char* p = list;
+    while (p < end && !full) {
+        size_t len = strcspn(p, ", ");
+        char path[AKZ_JOB_PATH_MAX];
+        if (len == 0 || len >= sizeof(path) || p[0] != '/') {
+            snprintf(buf, sizeof(buf), "Error: Invalid %s path in list: %.*s", what, (int)(len < 64 ? len : 64), p);
+            sendReply(buf, fromNodeId);
+            delete batchOut;
+            batchOut = nullptr;
+            return;
+        }
+        memcpy(path, p, len);
+        path[len] = '\0';
+        char* slash = strrchr(path, '/');
+        if (strpbrk(slash, "*?")) {
+            // '/dir/pattern': the directory, or the root for '/pattern'
+            const char* pattern = slash + 1;
+            char dir[AKZ_JOB_PATH_MAX];
+            snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+            batchOut->addMatching(Filesystem, dir, pattern);
+        } else {
+            full = !batchOut->add(path);
+        }
+        full = full || batchOut->count() == AKZ_BATCH_MAX_FILES;
+        p += len;
+        if (*p == ',') p++;
+    }
+    bool cut = full && p < end;
+    if (batchOut->count() == 0) {
+        delete batchOut;
+        batchOut = nullptr;
+        size_t listLen = (size_t)(end - list);
+        snprintf(buf, sizeof(buf), "Error: No files to %s in %.*s", what, (int)(listLen < 96 ? listLen : 96), list);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    LOG_INFO("ZmodemModule: Initiating %s batch of %u files to Node 0x%x", what, (unsigned)batchOut->count(), destNodeId);
+    if (akitaZmodem.startSend(*batchOut, destNodeId, &batchOutSession, priority)) {
+        batchRequester = fromNodeId;
+        snprintf(buf, sizeof(buf), "OK: Starting %s of %u files to %s in one session%s", what,
+                 (unsigned)batchOut->count(), nodeName, cut ? ", list cut at the batch limit" : "");
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    unsigned files = batchOut->count();
+    delete batchOut;
+    batchOut = nullptr;
+    snprintf(buf, sizeof(buf), "batch of %u files", files);
+    if (!sendBusyReply(what, buf, fromNodeId)) {
+        snprintf(buf, sizeof(buf), "Error: Failed to start %s of %u files", what, files);
+        sendReply(buf, fromNodeId);
+        LOG_ERROR("ZmodemModule: akitaZmodem.startSend failed for a batch of %u files", files);
+    }
+}
+
+#if AKZ_ENABLE_JOB_QUEUE
+// Queue a transfer job. 'args' is the path, then optional space-separated
+// options: p=<priority 0-255>, d=<seconds to start within>, r=<runs before giving up>
+void ZmodemModule::queueJob(const char* what, const char* args, NodeNum destNodeId, uint8_t priority, NodeNum fromNodeId) {
+    char path[AKZ_JOB_PATH_MAX];
+    size_t pathLen = strcspn(args, " ");
+    if (pathLen >= sizeof(path)) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    memcpy(path, args, pathLen);
+    path[pathLen] = '\0';
+
+    AkitaMeshZmodem::JobOptions opt;
+    opt.priority = priority;
+    opt.owner = fromNodeId;
+    for (const char* p = args + pathLen; *p;) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        char* end = (char*)p;
+        unsigned long v = 0;
+        if (p[1] == '=' && p[2] >= '0' && p[2] <= '9') v = strtoul(p + 2, &end, 10);
+        bool valid = end != p && (*end == '\0' || *end == ' ');
+        if (p[0] == 'p') valid = valid && v <= 255;
+        else if (p[0] == 'r') valid = valid && v >= 1 && v <= 255;
+        else if (p[0] == 'd') valid = valid && v <= 4000000UL; // under 2^32 ms
+        else valid = false;
+        if (!valid) {
+            char buf[160];
+            snprintf(buf, sizeof(buf), "Error: Bad option '%.*s'. Use p=<0-255> d=<seconds> r=<runs>",
+                     (int)strcspn(p, " "), p);
+            sendReply(buf, fromNodeId);
+            return;
+        }
+        if (p[0] == 'p') opt.priority = (uint8_t)v;
+        else if (p[0] == 'r') opt.maxAttempts = (uint8_t)v;
+        else opt.deadlineMs = v * 1000UL;
+        p = end;
+    }
+
+    bool sending = destNodeId != 0;
+    uint16_t id = sending ? akitaZmodem.enqueueSend(path, destNodeId, opt) : akitaZmodem.enqueueReceive(path, opt);
+    char buf[192];
+    if (!id) {
+        snprintf(buf, sizeof(buf), "Error: Cannot queue %s for %s (%s)", what, path,
+                 akitaZmodem.getJobCount() >= AKZ_JOB_QUEUE_CAPACITY ? "queue full" : "no such file");
+        LOG_ERROR("ZmodemModule: %s", buf);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    // Place in line; the scheduler starts it from loop() when its turn comes
+    AkitaMeshZmodem::JobInfo job;
+    size_t pos = 0;
+    while (akitaZmodem.getJob(pos, job) && job.id != id) pos++;
+    LOG_INFO("ZmodemModule: Queued %s for '%s' as job %u", what, path, id);
+    snprintf(buf, sizeof(buf), "OK: Job %u %s for %s queued, priority %u, position %u of %u", (unsigned)id, what, path,
+             (unsigned)opt.priority, (unsigned)pos + 1, (unsigned)akitaZmodem.getJobCount());
+    sendReply(buf, fromNodeId);
+}
+
+// JOBS, PRIO:<id>:<priority>, TOP:<id>, CANCEL:<id>
+bool ZmodemModule::handleJobCommand(const char* msg, NodeNum fromNodeId) {
+    if (strcmp(msg, "JOBS") == 0) {
+        sendJobList(fromNodeId);
+        return true;
+    }
+    const char* args;
+    if (strncmp(msg, "PRIO:", 5) == 0) args = msg + 5;
+    else if (strncmp(msg, "TOP:", 4) == 0) args = msg + 4;
+    else if (strncmp(msg, "CANCEL:", 7) == 0) args = msg + 7;
+    else return false;
+
+    char* end;
+    unsigned long id = strtoul(args, &end, 10);
+    unsigned long priority = 0;
+    bool ok = id > 0 && id <= 0xFFFF;
+    if (msg[0] == 'P') {
+        ok = ok && *end == ':';
+        if (ok) priority = strtoul(end + 1, &end, 10);
+        ok = ok && priority <= 255;
+    }
+    if (!ok || *end != '\0') {
+        sendReply("Error: Use PRIO:<job>:<0-255>, TOP:<job> or CANCEL:<job>", fromNodeId);
+        return true;
+    }
+
+    char buf[96];
+    if (msg[0] == 'P') ok = akitaZmodem.setJobPriority((uint16_t)id, (uint8_t)priority);
+    else if (msg[0] == 'T') ok = akitaZmodem.moveJobToFront((uint16_t)id);
+    else ok = akitaZmodem.cancelJob((uint16_t)id);
+    if (!ok) snprintf(buf, sizeof(buf), "Error: No job %lu", id);
+    else if (msg[0] == 'P') snprintf(buf, sizeof(buf), "OK: Job %lu priority %lu", id, priority);
+    else if (msg[0] == 'T') snprintf(buf, sizeof(buf), "OK: Job %lu first among its priority", id);
+    else snprintf(buf, sizeof(buf), "OK: Job %lu cancelled", id);
+    sendReply(buf, fromNodeId);
+    return true;
+}
+
+// Reply with one line per job in run order: J<id> <S|R> p<prio> <state> <peer> <bytes> <failures>/<runs> <path>
+void ZmodemModule::sendJobList(NodeNum destinationNodeId) {
+    static const char* const STATES[] = {"pend", "wait", "run"};
+    char buf[200];
+    size_t used = snprintf(buf, sizeof(buf), "Jobs %u/%u", (unsigned)akitaZmodem.getJobCount(),
+                           (unsigned)AKZ_JOB_QUEUE_CAPACITY);
+    AkitaMeshZmodem::JobInfo job;
+    for (size_t i = 0; used < sizeof(buf) && akitaZmodem.getJob(i, job); ++i) {
+        used += snprintf(buf + used, sizeof(buf) - used, "\nJ%u %c p%u %s !%08lx %lu %u/%u %s",
+                         (unsigned)job.id, job.sending ? 'S' : 'R', (unsigned)job.priority,
+                         STATES[(int)job.state], (unsigned long)(job.sending ? job.peer : 0),
+                         (unsigned long)job.bytesDone, (unsigned)job.failures, (unsigned)job.maxAttempts,
+                         job.path.c_str());
+    }
+    sendReply(buf, destinationNodeId);
+}
+#endif
+
+// BUNDLE:!NodeID:/dir [pattern] sends the directory's matching files as one
+// bundle; RECVBUNDLE:/dir unpacks the next one to arrive into /dir
+void ZmodemModule::handleBundleCommand(const char* msg, NodeNum fromNodeId) {
+    char buf[192];
+    if (msg[0] == 'R') {
+        const char* dir = msg + 11;
+        if (dir[0] != '/') {
+            sendReply("Error: Invalid RECVBUNDLE format. Use RECVBUNDLE:/dir", fromNodeId);
+            return;
+        }
+        if (bundleIn) {
+            sendReply("Error: A bundle receive is already armed", fromNodeId);
+            return;
+        }
+        bundleIn = new ZModemBundleSink(Filesystem, dir);
+        if (bundleIn && akitaZmodem.startReceive(*bundleIn, &bundleInSession)) {
+            bundleInRequester = fromNodeId;
+            snprintf(buf, sizeof(buf), "OK: Starting RECVBUNDLE into %s. Waiting for sender...", dir);
+            sendReply(buf, fromNodeId);
+            return;
+        }
+        delete bundleIn;
+        bundleIn = nullptr;
+        if (!sendBusyReply("RECVBUNDLE", dir, fromNodeId)) {
+            snprintf(buf, sizeof(buf), "Error: Failed to start RECVBUNDLE into %s", dir);
+            sendReply(buf, fromNodeId);
+        }
+        return;
+    }
+
+    // BUNDLE: !NodeID:/dir [pattern]
+    const char* args = msg + 7;
+    const char* colon = strchr(args, ':');
+    size_t nodeIdLen = colon ? (size_t)(colon - args) : 0;
+    if (nodeIdLen == 0 || nodeIdLen >= 32 || colon[1] != '/') {
+        sendReply("Error: Invalid BUNDLE format. Use BUNDLE:!NodeID:/dir [pattern]", fromNodeId);
+        return;
+    }
+    char nodeBuf[40];
+    memcpy(nodeBuf, args, nodeIdLen);
+    nodeBuf[nodeIdLen] = '\0';
+    NodeNum destNodeId = parseNodeId(nodeBuf);
+    if (destNodeId == 0 || destNodeId == BROADCAST_ADDR) {
+        snprintf(buf, sizeof(buf), "Error: Invalid BUNDLE destination NodeID: %s", nodeBuf);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    char dir[AKZ_JOB_PATH_MAX];
+    const char* path = colon + 1;
+    size_t dirLen = strcspn(path, " ");
+    if (dirLen >= sizeof(dir)) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    memcpy(dir, path, dirLen);
+    dir[dirLen] = '\0';
+    const char* pattern = path + dirLen;
+    while (*pattern == ' ') pattern++;
+    if (bundleOut) {
+        sendReply("Error: A bundle send is already running", fromNodeId);
+        return;
+    }
+
+    bundleOut = new ZModemBundleSource();
+    if (!bundleOut || !bundleOut->open(Filesystem, dir, pattern)) {
+        delete bundleOut;
+        bundleOut = nullptr;
+        snprintf(buf, sizeof(buf), "Error: No files to bundle in %s", dir);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    // Named after the directory; the receiving sink does not use the name
+    const char* base = strrchr(dir, '/');
+    char name[AKZ_BUNDLE_NAME_MAX + 8];
+    snprintf(name, sizeof(name), "%s.akb", base && base[1] ? base + 1 : "root");
+    LOG_INFO("ZmodemModule: Initiating BUNDLE of %u files from '%s' to Node 0x%x", (unsigned)bundleOut->count(), dir,
+             destNodeId);
+    if (akitaZmodem.startSend(*bundleOut, name, destNodeId, &bundleOutSession)) {
+        snprintf(buf, sizeof(buf), "OK: Starting BUNDLE of %u files (%lu B) from %s to %s%s",
+                 (unsigned)bundleOut->count(), (unsigned long)bundleOut->size(), dir, nodeBuf,
+                 bundleOut->skipped() ? ", some left out" : "");
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    delete bundleOut;
+    bundleOut = nullptr;
+    if (!sendBusyReply("BUNDLE", dir, fromNodeId)) {
+        snprintf(buf, sizeof(buf), "Error: Failed to start BUNDLE from %s", dir);
+        sendReply(buf, fromNodeId);
+        LOG_ERROR("ZmodemModule: akitaZmodem.startSend failed for bundle of '%s'", dir);
+    }
+}
+
+// A byte range of a file of 'size' bytes: "a-b" (inclusive, b past the end
+// meaning the end), "a-" (from a to the end) or "-n" (the last n bytes)
+static bool parseRange(const char* str, size_t size, size_t& offset, size_t& length) {
+    char* end = nullptr;
+    if (str[0] == '-') {
+        if (str[1] < '0' || str[1] > '9') return false;
+        unsigned long n = strtoul(str + 1, &end, 10);
+        if (*end != '\0' || n == 0 || size == 0) return false;
+        offset = n < size ? size - n : 0;
+        length = size - offset;
+        return true;
+    }
+    if (str[0] < '0' || str[0] > '9') return false;
+    unsigned long first = strtoul(str, &end, 10);
+    if (*end != '-' || first >= size) return false;
+    offset = first;
+    length = size - first;
+    if (end[1] == '\0') return true;
+    if (end[1] < '0' || end[1] > '9') return false;
+    unsigned long last = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || last < first) return false;
+    if (last < size) length = last - first + 1;
+    return true;
+}
+
+// GET:/path [range] sends the file, or the range of it, to the node asking.
+// That node must be ready for it: auto-accepting, or a RECV armed.
+void ZmodemModule::handleGetCommand(const char* args, NodeNum fromNodeId) {
+    if (args[0] != '/') {
+        sendReply("Error: Invalid GET format. Use GET:/path/file.txt [a-b|a-|-n]", fromNodeId);
+        return;
+    }
+    char path[AKZ_JOB_PATH_MAX];
+    size_t pathLen = strcspn(args, " ");
+    if (pathLen >= sizeof(path)) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    memcpy(path, args, pathLen);
+    path[pathLen] = '\0';
+    const char* range = args + pathLen;
+    while (*range == ' ') range++;
+
+    char buf[192];
+    File f = Filesystem.open(path, FILE_READ);
+    bool isFile = f && !f.isDirectory();
+    size_t size = isFile ? f.size() : 0;
+    if (f) f.close();
+    if (!isFile) {
+        snprintf(buf, sizeof(buf), "Error: No file %s", path);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    size_t offset = 0;
+    size_t length = size;
+    if (*range && !parseRange(range, size, offset, length)) {
+        snprintf(buf, sizeof(buf), "Error: Bad range %s for %s (%lu bytes). Use a-b, a- or -n", range, path,
+                 (unsigned long)size);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+
+    LOG_INFO("ZmodemModule: Initiating GET of '%s' [%u+%u] to Node 0x%x", path, (unsigned)offset, (unsigned)length,
+             fromNodeId);
+    // A whole file goes as a plain send, which a reboot does not lose
+    bool started = *range ? akitaZmodem.startSendRange(path, fromNodeId, offset, length)
+                          : akitaZmodem.startSend(path, fromNodeId);
+    if (started) {
+        if (*range) {
+            snprintf(buf, sizeof(buf), "OK: Starting GET of %s bytes %lu-%lu (%lu B)", path, (unsigned long)offset,
+                     (unsigned long)(offset + length - 1), (unsigned long)length);
+        } else {
+            snprintf(buf, sizeof(buf), "OK: Starting GET of %s (%lu B)", path, (unsigned long)size);
+        }
+        sendReply(buf, fromNodeId);
+    } else if (!sendBusyReply("GET", path, fromNodeId)) {
+        snprintf(buf, sizeof(buf), "Error: Failed to start GET of %s", path);
+        sendReply(buf, fromNodeId);
+        LOG_ERROR("ZmodemModule: GET failed for '%s'", path);
+    }
+}
+
+#if AKZ_ENABLE_LISTING
+// LIST:/dir replies with a page of the directory's entries; its options are a
+// name pattern, c=<cursor> for a later page, s=<token> for entries changed
+// since an earlier listing and h for hashes the file index has. STAT:/path
+// replies with one file's details as text.
+void ZmodemModule::handleListCommand(const char* msg, NodeNum fromNodeId) {
+    char buf[192];
+    const char* args = msg + 5;
+    if (args[0] != '/') {
+        sendReply(msg[0] == 'L' ? "Error: Invalid LIST format. Use LIST:/dir [pattern] [c=<cursor>] [s=<token>] [h]"
+                                : "Error: Invalid STAT format. Use STAT:/path",
+                  fromNodeId);
+        return;
+    }
+    char path[AKZ_JOB_PATH_MAX];
+    size_t pathLen = strcspn(args, " ");
+    if (pathLen >= sizeof(path)) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    memcpy(path, args, pathLen);
+    path[pathLen] = '\0';
+
+    if (msg[0] == 'S') {
+        File f = Filesystem.open(path, FILE_READ);
+        bool isDir = f && f.isDirectory();
+        if (f) f.close();
+        if (isDir) {
+            snprintf(buf, sizeof(buf), "STAT %s: directory", path);
+            sendReply(buf, fromNodeId);
+            return;
+        }
+#if AKZ_ENABLE_FILE_INDEX
+        AkitaMeshZmodem::FileInfo info;
+        // Never reads the file here: a missing hash is filled in the background
+        if (akitaZmodem.getFileInfo(path, info, false)) {
+            char hex[2 * sizeof(info.sha256) + 1];
+            for (size_t i = 0; i < sizeof(info.sha256); ++i) snprintf(hex + 2 * i, 3, "%02x", info.sha256[i]);
+            snprintf(buf, sizeof(buf), "STAT %s: %lu B, mtime %lu, sha256 %s", path, (unsigned long)info.size,
+                     (unsigned long)info.mtime, info.hashed ? hex : "-");
+            sendReply(buf, fromNodeId);
+            return;
+        }
+#else
+        uint32_t size, mtime;
+        if (ZModemFileIndex::stat(Filesystem, path, size, mtime)) {
+            snprintf(buf, sizeof(buf), "STAT %s: %lu B, mtime %lu", path, (unsigned long)size, (unsigned long)mtime);
+            sendReply(buf, fromNodeId);
+            return;
+        }
+#endif
+        snprintf(buf, sizeof(buf), "Error: No file %s", path);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+
+    // Options, in any order; the one that is none of the others is the pattern
+    AkitaMeshZmodem::ListRequest req;
+    char pattern[AKZ_LIST_NAME_MAX + 1] = "";
+    const char* opt = args + pathLen;
+    while (*opt) {
+        while (*opt == ' ') opt++;
+        size_t len = strcspn(opt, " ");
+        if (len == 0) break;
+        char* end = nullptr;
+        if ((opt[0] == 'c' || opt[0] == 's') && opt[1] == '=' && opt[2] >= '0' && opt[2] <= '9') {
+            unsigned long v = strtoul(opt + 2, &end, 10);
+            if (end != opt + len) break;
+            (opt[0] == 'c' ? req.cursor : req.since) = (uint32_t)v;
+        } else if (len == 1 && opt[0] == 'h') {
+            req.hashes = true;
+        } else if (len == 1 && opt[0] == 'H') {
+            req.hashFiles = true;
+        } else if (!pattern[0] && len < sizeof(pattern)) {
+            memcpy(pattern, opt, len);
+            pattern[len] = '\0';
+        } else {
+            break;
+        }
+        opt += len;
+    }
+    if (*opt) {
+        snprintf(buf, sizeof(buf), "Error: Unknown LIST option %s", opt);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    if (pattern[0]) req.pattern = pattern;
+
+    uint8_t page[AKZ_LIST_PAGE_BYTES];
+    size_t len = akitaZmodem.listDirectory(path, req, page, sizeof(page));
+    if (len == 0) {
+        snprintf(buf, sizeof(buf), "Error: No directory %s", path);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    LOG_INFO("ZmodemModule: LIST of '%s' from cursor %u, %u B page to Node 0x%x", path, (unsigned)req.cursor,
+             (unsigned)len, fromNodeId);
+    sendBinaryReply(page, len, fromNodeId);
+}
+
+// One log line per entry: name, size (or <dir>), mtime, hash prefix
+void ZmodemModule::logListingPage(const uint8_t* page, size_t len, NodeNum fromNodeId) {
+    ZModemListingReader r;
+    if (!r.open(page, len)) {
+        LOG_WARNING("ZmodemModule: Malformed listing page from 0x%x", fromNodeId);
+        return;
+    }
+    LOG_INFO("ZmodemModule: Listing from 0x%x: %u entries, token %lu, next cursor %lu%s", fromNodeId,
+             (unsigned)r.total(), (unsigned long)r.token(), (unsigned long)r.cursor(),
+             (r.flags() & ZModemListing::PAGE_SINCE) ? " (changes only)" : "");
+    ZModemListEntry e;
+    while (r.next(e)) {
+        char hash[2 * ZModemListing::SHA_PREFIX + 1] = "";
+        if (e.flags & ZModemListing::ENTRY_SHA) {
+            for (size_t i = 0; i < ZModemListing::SHA_PREFIX; ++i) snprintf(hash + 2 * i, 3, "%02x", e.sha[i]);
+        }
+        char size[16];
+        if (e.flags & ZModemListing::ENTRY_DIR) snprintf(size, sizeof(size), "<dir>");
+        else snprintf(size, sizeof(size), "%lu", (unsigned long)e.size);
+        LOG_INFO("  %s%s %s %lu %s", e.name, (e.flags & ZModemListing::ENTRY_NAME_HASHED) ? "~" : "", size,
+                 (unsigned long)e.mtime, hash);
+    }
+    if (r.malformed()) LOG_WARNING("ZmodemModule: Listing page from 0x%x cut short", fromNodeId);
+}
+
+// SYNC:!NodeID:/dir [d] makes the node's copy of /dir match this one. Its
+// manifest comes from LIST:/dir H (hashes computed where missing), page by
+// page; what differs goes as one bundle after RECVBUNDLE:/dir has armed its
+// receive; with d, SYNCDEL:/dir removes there what is not here.
+void ZmodemModule::handleSyncCommand(const char* args, NodeNum fromNodeId) {
+    char buf[192];
+    const char* colon = strchr(args, ':');
+    size_t nodeIdLen = colon ? (size_t)(colon - args) : 0;
+    if (nodeIdLen == 0 || nodeIdLen >= 32 || colon[1] != '/') {
+        sendReply("Error: Invalid SYNC format. Use SYNC:!NodeID:/dir [d]", fromNodeId);
+        return;
+    }
+    char nodeBuf[40];
+    memcpy(nodeBuf, args, nodeIdLen);
+    nodeBuf[nodeIdLen] = '\0';
+    NodeNum peer = parseNodeId(nodeBuf);
+    if (peer == 0 || peer == BROADCAST_ADDR) {
+        snprintf(buf, sizeof(buf), "Error: Invalid SYNC destination NodeID: %s", nodeBuf);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    const char* dir = colon + 1;
+    size_t dirLen = strcspn(dir, " ");
+    if (dirLen >= AKZ_JOB_PATH_MAX) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    const char* opt = dir + dirLen;
+    while (dirLen > 1 && dir[dirLen - 1] == '/') dirLen--;
+    while (*opt == ' ') opt++;
+    if (*opt && strcmp(opt, "d") != 0) {
+        sendReply("Error: Unknown SYNC option. Use d to delete what is gone here", fromNodeId);
+        return;
+    }
+    if (*opt && dirLen == 1) {
+        sendReply("Error: SYNC does not delete in /. Sync it without d", fromNodeId);
+        return;
+    }
+    if (sync || bundleOut) {
+        sendReply(sync ? "Error: A sync is already running" : "Error: A bundle send is already running", fromNodeId);
+        return;
+    }
+
+    sync = new SyncJob();
+    if (!sync) return;
+    memcpy(sync->dir, dir, dirLen);
+    sync->dir[dirLen] = '\0';
+    File d = Filesystem.open(sync->dir, FILE_READ);
+    bool isDir = d && d.isDirectory();
+    if (d) d.close();
+    if (!isDir) {
+        snprintf(buf, sizeof(buf), "Error: No directory %s", sync->dir);
+        delete sync;
+        sync = nullptr;
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    sync->peer = peer;
+    sync->requester = fromNodeId;
+    sync->deletes = *opt == 'd';
+    sync->lastReplyMs = millis();
+    LOG_INFO("ZmodemModule: Initiating SYNC of '%s' to Node 0x%x", sync->dir, peer);
+    snprintf(buf, sizeof(buf), "LIST:%s H", sync->dir);
+    sendReply(buf, peer); // a command to the synced node
+    snprintf(buf, sizeof(buf), "OK: Syncing %s to %s, reading its manifest", sync->dir, nodeBuf);
+    sendReply(buf, fromNodeId);
+}
+
+// SYNCDEL:/dir a.cfg/b.cfg removes those files from /dir. Names are
+// separated by '/', which no name contains.
+void ZmodemModule::handleSyncDelete(const char* args, NodeNum fromNodeId) {
+    char buf[192];
+    size_t dirLen = strcspn(args, " ");
+    if (args[0] != '/' || dirLen >= AKZ_JOB_PATH_MAX || args[dirLen] != ' ') {
+        sendReply("Error: Invalid SYNCDEL format. Use SYNCDEL:/dir name/name", fromNodeId);
+        return;
+    }
+    char dir[AKZ_JOB_PATH_MAX];
+    const char* name = args + dirLen + 1;
+    while (dirLen > 1 && args[dirLen - 1] == '/') dirLen--;
+    memcpy(dir, args, dirLen);
+    dir[dirLen] = '\0';
+    if (dirLen == 1) {
+        sendReply("Error: SYNCDEL does not delete in /", fromNodeId);
+        return;
+    }
+    if (!syncDeleteAllowed(dir, fromNodeId)) {
+        LOG_WARNING("ZmodemModule: SYNCDEL for %s from 0x%x refused", dir, fromNodeId);
+        snprintf(buf, sizeof(buf), "Error: SYNCDEL refused, no bundle from you was just unpacked into %s", dir);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    unsigned asked = 0, deleted = 0;
+    while (*name) {
+        size_t len = strcspn(name, "/");
+        char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%.*s", dir, (int)len, name);
+        asked++;
+        // validName() keeps the delete inside the directory
+        char leaf[AKZ_BUNDLE_NAME_MAX];
+        bool ok = len > 0 && len < sizeof(leaf) && n > 0 && (size_t)n < sizeof(path);
+        if (ok) {
+            memcpy(leaf, name, len);
+            leaf[len] = '\0';
+            ok = ZModemBundle::validName(leaf) && Filesystem.remove(path);
+        }
+        if (ok) deleted++;
+        name += len;
+        if (*name == '/') name++;
+    }
+    snprintf(buf, sizeof(buf), "OK: Deleted %u of %u files in %s", deleted, asked, dir);
+    LOG_INFO("ZmodemModule: %s", buf);
+    sendReply(buf, fromNodeId);
+}
+
+// Deletes come from the node that asked for the bundle last unpacked into
+// 'dir', so they take no more trust than its files did. The master sends
+// them once its side of the session completes, which may be before this
+// side's: a bundle whose end marker is in counts too.
+bool ZmodemModule::syncDeleteAllowed(const char* dir, NodeNum fromNodeId) const {
+    if (bundleIn && bundleIn->finished() && bundleInRequester == fromNodeId && strcmp(bundleIn->dir(), dir) == 0) {
+        return true;
+    }
+    return unpackedFor != 0 && unpackedFor == fromNodeId && strcmp(unpackedDir, dir) == 0 &&
+           millis() - unpackedMs <= AKZ_SYNC_REPLY_TIMEOUT_MS;
+}
+
+// A manifest page from the synced node: ask for the next one, or compare
+void ZmodemModule::syncPage(const uint8_t* page, size_t len) {
+    sync->lastReplyMs = millis();
+    ZModemListingReader r;
+    if (!sync->remote.addPage(page, len) || !r.open(page, len)) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "Error: Sync of %s stopped, manifest too large or malformed", sync->dir);
+        endSync(buf);
+        return;
+    }
+    if (r.cursor()) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "LIST:%s H c=%lu", sync->dir, (unsigned long)r.cursor());
+        sendReply(buf, sync->peer);
+        return;
+    }
+    syncCompare();
+}
+
+// Text from the synced node while a sync runs
+bool ZmodemModule::syncReply(const char* msg) {
+    char buf[AKZ_JOB_PATH_MAX + 144]; // the longest message below, with the node's text cut to 100
+    if (sync->phase == SyncJob::Phase::MANIFEST && strncmp(msg, "Error: No directory", 19) == 0) {
+        // Nothing there yet: every file is new
+        syncCompare();
+        return true;
+    }
+    if (sync->phase == SyncJob::Phase::ARMING && strncmp(msg, "OK: Starting RECVBUNDLE", 23) == 0) {
+        const char* base = strrchr(sync->dir, '/');
+        char name[AKZ_BUNDLE_NAME_MAX + 8];
+        snprintf(name, sizeof(name), "%s.akb", base && base[1] ? base + 1 : "root");
+        if (akitaZmodem.startSend(*bundleOut, name, sync->peer, &bundleOutSession)) {
+            sync->phase = SyncJob::Phase::SENDING;
+            return true;
+        }
+        snprintf(buf, sizeof(buf), "Error: Sync of %s could not start sending", sync->dir);
+        endSync(buf);
+        return true;
+    }
+    if (sync->phase != SyncJob::Phase::SENDING && (strncmp(msg, "Error:", 6) == 0 || strncmp(msg, "BUSY:", 5) == 0)) {
+        snprintf(buf, sizeof(buf), "Error: Sync of %s stopped, node said: %.100s", sync->dir, msg);
+        endSync(buf);
+        return true;
+    }
+    return false;
+}
+
+// Bundle what differs from the manifest; the rest of it is what is gone here.
+// Deletes need a bundle first (see syncDeleteAllowed()): with nothing to
+// send, an empty one.
+void ZmodemModule::syncCompare() {
+    sync->checked = 0;
+    bundleOut = new ZModemBundleSource();
+    bool any = bundleOut && bundleOut->open(Filesystem, sync->dir, syncFilter, this);
+    // Too many files, or names too long for a bundle
+    sync->skipped = bundleOut ? bundleOut->skipped() : 0;
+    if (!any && bundleOut && sync->deletes) {
+        bool orphans = false;
+        for (uint16_t i = 0; i < sync->remote.count() && !orphans; ++i) orphans = sync->remote.orphaned(i);
+        any = orphans && bundleOut->openEmpty(Filesystem, sync->dir);
+    }
+    if (any) {
+        char buf[160];
+        LOG_INFO("ZmodemModule: SYNC of '%s': %u of %u files differ", sync->dir, (unsigned)bundleOut->count(),
+                 (unsigned)sync->checked);
+        sync->phase = SyncJob::Phase::ARMING;
+        sync->sent = bundleOut->count();
+        sync->lastReplyMs = millis();
+        snprintf(buf, sizeof(buf), "RECVBUNDLE:%s", sync->dir);
+        sendReply(buf, sync->peer);
+        return;
+    }
+    delete bundleOut;
+    bundleOut = nullptr;
+    finishSync();
+}
+
+bool ZmodemModule::syncFilter(const char* name, size_t size, void* ctx) {
+    ZmodemModule* self = static_cast<ZmodemModule*>(ctx);
+    SyncJob* job = self->sync;
+    job->checked++;
+    const uint8_t* sha = nullptr;
+#if AKZ_ENABLE_FILE_INDEX
+    char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+    snprintf(path, sizeof(path), "%s/%s", strcmp(job->dir, "/") == 0 ? "" : job->dir, name);
+    AkitaMeshZmodem::FileInfo info;
+    // No hash yet (the file changed): sent, and hashed in the background for
+    // the next sync
+    if (self->akitaZmodem.getFileInfo(path, info, false) && info.hashed) sha = info.sha256;
+#endif
+    return job->remote.differs(name, (uint32_t)size, sha);
+}
+
+// The changed files are there: send the deletes, if asked for, and report
+void ZmodemModule::finishSync() {
+    uint16_t sent = sync->sent;
+    unsigned orphans = 0, deleting = 0;
+    char cmd[200];
+    size_t used = 0;
+    for (uint16_t i = 0; i < sync->remote.count(); ++i) {
+        if (!sync->remote.orphaned(i)) continue;
+        orphans++;
+        if (!sync->deletes) continue;
+        const char* name = sync->remote.at(i).name;
+        // Packed into as few SYNCDEL commands as fit a packet
+        if (used && used + 1 + strlen(name) >= sizeof(cmd)) {
+            sendReply(cmd, sync->peer);
+            used = 0;
+        }
+        if (!used) used = snprintf(cmd, sizeof(cmd), "SYNCDEL:%s ", sync->dir);
+        else cmd[used++] = '/';
+        used += snprintf(cmd + used, sizeof(cmd) - used, "%s", name);
+        deleting++;
+    }
+    if (used) sendReply(cmd, sync->peer);
+
+    char buf[192];
+    int n;
+    if (sent == 0 && deleting == 0 && sync->skipped == 0) {
+        n = snprintf(buf, sizeof(buf), "OK: %s already in sync on 0x%lx (%u files checked)", sync->dir,
+                     (unsigned long)sync->peer, (unsigned)sync->checked);
+    } else {
+        n = snprintf(buf, sizeof(buf), "OK: Synced %s to 0x%lx: %u of %u files sent, %u deleted", sync->dir,
+                     (unsigned long)sync->peer, (unsigned)sent, (unsigned)sync->checked, deleting);
+    }
+    if (n > 0 && (size_t)n < sizeof(buf) && sync->skipped) {
+        n += snprintf(buf + n, sizeof(buf) - n, ", %u left out (name too long or too many)", (unsigned)sync->skipped);
+    }
+    if (n > 0 && (size_t)n < sizeof(buf) && orphans > deleting) {
+        snprintf(buf + n, sizeof(buf) - n, ", %u extra there kept", orphans - deleting);
+    }
+    endSync(buf);
+}
+
+// Report to whoever asked for the sync and forget it. A bundle still
+// waiting for the receive to be armed is dropped; one being sent is freed
+// by onTransferComplete().
+void ZmodemModule::endSync(const char* message) {
+    LOG_INFO("ZmodemModule: %s", message);
+    sendReply(message, sync->requester);
+    if (bundleOut && sync->phase != SyncJob::Phase::SENDING) {
+        delete bundleOut;
+        bundleOut = nullptr;
+    }
+    delete sync;
+    sync = nullptr;
+}
+#endif
+
+#if AKZ_ENABLE_TAIL_SEND
+// TAIL:!NodeID:/path sends what the node has not had of the file yet; f=<seconds>
+// keeps following it at that period, f=0 stops
+void ZmodemModule::handleTailCommand(const char* args, NodeNum fromNodeId) {
+    const char* colon = strchr(args, ':');
+    size_t nodeIdLen = colon ? (size_t)(colon - args) : 0;
+    if (nodeIdLen == 0 || nodeIdLen >= 32 || colon[1] != '/') {
+        sendReply("Error: Invalid TAIL format. Use TAIL:!NodeID:/path/file.log [f=<seconds>]", fromNodeId);
+        return;
+    }
+    char nodeBuf[40];
+    memcpy(nodeBuf, args, nodeIdLen);
+    nodeBuf[nodeIdLen] = '\0';
+    NodeNum destNodeId = parseNodeId(nodeBuf);
+    if (destNodeId == 0 || destNodeId == BROADCAST_ADDR) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Error: Invalid TAIL destination NodeID: %s", nodeBuf);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+
+    char path[AKZ_JOB_PATH_MAX];
+    const char* filename = colon + 1;
+    size_t pathLen = strcspn(filename, " ");
+    if (pathLen >= sizeof(path)) {
+        sendReply("Error: Path too long", fromNodeId);
+        return;
+    }
+    memcpy(path, filename, pathLen);
+    path[pathLen] = '\0';
+    const char* opt = filename + pathLen;
+    while (*opt == ' ') opt++;
+    bool follow = false;
+    unsigned long periodS = 0;
+    if (*opt) {
+        char* end = (char*)opt;
+        if (opt[0] == 'f' && opt[1] == '=' && opt[2] >= '0' && opt[2] <= '9') periodS = strtoul(opt + 2, &end, 10);
+        if (end == opt || *end != '\0' || periodS > 4000000UL) {
+            sendReply("Error: Unknown TAIL option. Use f=<seconds>", fromNodeId);
+            return;
+        }
+        follow = true;
+    }
+
+    char buf[192];
+    if (follow && !akitaZmodem.followTail(path, destNodeId, (uint32_t)periodS * 1000)) {
+        snprintf(buf, sizeof(buf), "Error: Cannot follow %s", path);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+    if (follow && periodS == 0) {
+        snprintf(buf, sizeof(buf), "OK: Stopped following %s for %s", path, nodeBuf);
+        sendReply(buf, fromNodeId);
+        return;
+    }
+
+    LOG_INFO("ZmodemModule: Initiating TAIL for '%s' to Node 0x%x", path, destNodeId);
+    int session = AkitaMeshZmodem::INVALID_SESSION;
+    if (akitaZmodem.startTail(path, destNodeId, &session)) {
+        if (session == AkitaMeshZmodem::INVALID_SESSION) {
+            snprintf(buf, sizeof(buf), "OK: %s up to date for %s at %lu bytes", path, nodeBuf,
+                     (unsigned long)akitaZmodem.getTailOffset(path, destNodeId));
+        } else {
+            snprintf(buf, sizeof(buf), "OK: Starting TAIL for %s to %s from byte %lu%s", path, nodeBuf,
+                     (unsigned long)akitaZmodem.getTailOffset(path, destNodeId), follow ? ", following" : "");
+        }
+        sendReply(buf, fromNodeId);
+    } else if (!sendBusyReply("TAIL", path, fromNodeId)) {
+        snprintf(buf, sizeof(buf), "Error: Failed to start TAIL for %s", path);
+        sendReply(buf, fromNodeId);
+        LOG_ERROR("ZmodemModule: akitaZmodem.startTail failed for '%s'", path);
+    }
+}
+#endif
+
+// If the last start was turned away by admission control, tell the requester
+// which budget was full and when to try again
+bool ZmodemModule::sendBusyReply(const char* what, const char* filename, NodeNum destinationNodeId) {
+    AkitaMeshZmodem::AdmissionResult adm = akitaZmodem.getLastAdmission();
+    if (adm.decision != AkitaMeshZmodem::Admission::REJECTED) return false;
+    char reasons[32] = "";
+    if (adm.limits & AkitaMeshZmodem::LIMIT_SESSIONS) strcat(reasons, ",sessions");
+    if (adm.limits & AkitaMeshZmodem::LIMIT_MEMORY) strcat(reasons, ",memory");
+    if (adm.limits & AkitaMeshZmodem::LIMIT_AIRTIME) strcat(reasons, ",airtime");
+    char buf[192];
+    snprintf(buf, sizeof(buf), "BUSY: Cannot start %s for %s now (%s). Retry after %lus", what, filename,
+             reasons[0] ? reasons + 1 : "busy", (unsigned long)((adm.retryAfterMs + 999) / 1000));
+    LOG_WARNING("ZmodemModule: %s", buf);
+    sendReply(buf, destinationNodeId);
+    return true;
+}
+
+// Reply with one line per known session: S<handle> <S|R> <peer> <state> <bytes>/<total>
+void ZmodemModule::sendStatus(NodeNum destinationNodeId) {
+    char buf[200];
+    size_t used = snprintf(buf, sizeof(buf), "Sessions %u/%d, queued %u, airtime %u%%",
+                           (unsigned)akitaZmodem.getActiveSessionCount(), akitaZmodem.getMaxSessions(),
+                           (unsigned)akitaZmodem.getQueuedSessionCount(), akitaZmodem.getAirtimePercent());
+    AkitaMeshZmodem::SessionStats st;
+    for (int i = 0; i < akitaZmodem.getMaxSessions() && used < sizeof(buf); ++i) {
+        if (!akitaZmodem.getSessionStats(i, st)) continue;
+        used += snprintf(buf + used, sizeof(buf) - used, "\nS%d %c !%08lx %d %lu/%lu",
+                         i, st.sending ? 'S' : 'R', (unsigned long)st.peer, (int)st.state,
+                         (unsigned long)st.bytesTransferred, (unsigned long)st.totalFileSize);
+    }
+    sendReply(buf, destinationNodeId);
+}
+
 // Send a reply text message back to the sender
 void ZmodemModule::sendReply(const char* message, NodeNum destinationNodeId) {
     if (!message) return;
@@ -245,6 +1290,20 @@ void ZmodemModule::sendReply(const char* message, NodeNum destinationNodeId) {
     }
 }
 
+void ZmodemModule::sendBinaryReply(const uint8_t* data, size_t len, NodeNum destinationNodeId) {
+    MeshPacket replyPacket;
+    replyPacket.set_to(destinationNodeId);
+    replyPacket.set_from(mesh.getNodeNum());
+    replyPacket.set_payload(data, len);
+    replyPacket.set_portnum(AKZ_ZMODEM_COMMAND_PORTNUM);
+    replyPacket.set_datatype(MeshPacket_DataType_OPAQUE);
+    replyPacket.set_want_ack(false);
+    replyPacket.set_hop_limit(mesh.getHopLimit());
+    if (!mesh.sendPacket(&replyPacket)) {
+        LOG_ERROR("Failed to send binary reply to 0x%x", destinationNodeId);
+    }
+}
+
 /**
  * @brief Parses a node ID string (like "!1234abcd" or "1234abcd") into a NodeNum.
  * This is a simplified helper; the main firmware has a more robust one.
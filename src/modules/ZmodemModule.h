@@ -14,6 +14,9 @@
 #include "globals.h"   // Access to global objects like mesh, Filesystem
 #include "module.h"    // Base class for Meshtastic modules
 #include <AkitaMeshZmodem.h> // Include the ZModem library we created
+#include <utility/ZModemBundle.h> // Directory bundles (BUNDLE/RECVBUNDLE)
+#include <utility/ZModemBatch.h> // Multi-file SEND
+#include <utility/ZModemManifest.h> // Directory sync (SYNC)
 #include "AkitaMeshZmodemConfig.h" // Include our port definitions
 
 /**
@@ -49,19 +52,176 @@ private:
     // MeshInterface& mesh; // Already a member of the base Module class
     AkitaMeshZmodem akitaZmodem; // Instance of our ZModem library handler
 
+    // Bundle being sent or received, owned until its session ends
+    ZModemBundleSource* bundleOut = nullptr;
+    ZModemBundleSink* bundleIn = nullptr;
+    int bundleOutSession = AkitaMeshZmodem::INVALID_SESSION;
+    int bundleInSession = AkitaMeshZmodem::INVALID_SESSION;
+    NodeNum bundleInRequester = 0;  // who sent the RECVBUNDLE
+
+    // Multi-file SEND being sent, owned until its session ends
+    ZModemBatch* batchOut = nullptr;
+    int batchOutSession = AkitaMeshZmodem::INVALID_SESSION;
+    NodeNum batchRequester = 0;
+
+#if AKZ_ENABLE_LISTING
+    // A SYNC this node runs as the master, one at a time. Its changed files
+    // go as bundleOut.
+    struct SyncJob {
+        enum class Phase : uint8_t { MANIFEST, ARMING, SENDING };
+        Phase phase = Phase::MANIFEST;
+        NodeNum peer = 0;
+        NodeNum requester = 0;
+        bool deletes = false;
+        char dir[AKZ_JOB_PATH_MAX];
+        unsigned long lastReplyMs = 0;  // when the peer last answered
+        uint16_t checked = 0;           // local files compared
+        uint16_t sent = 0;              // of them, different there and bundled
+        uint16_t skipped = 0;           // different there, but left out of the bundle
+        ZModemManifest remote;
+    };
+    SyncJob* sync = nullptr;
+
+    // The last bundle this node unpacked in full: whoever asked for it may
+    // delete in that directory with SYNCDEL for AKZ_SYNC_REPLY_TIMEOUT_MS
+    NodeNum unpackedFor = 0;
+    char unpackedDir[AKZ_JOB_PATH_MAX] = "";
+    unsigned long unpackedMs = 0;
+#endif
+
     // Optional: Add methods for handling MQTT, Serial commands if needed later
 
     /**
-     * @brief Parses incoming text commands for SEND/RECV operations.
+     * @brief Parses incoming text commands for SEND/URGENT/RECV/STATUS/TAIL,
+     * BUNDLE/RECVBUNDLE, GET, LIST/STAT, SYNC and job queue (JOBS/PRIO/TOP/CANCEL) operations.
      * @param msg The command string.
      * @param fromNodeId The Node ID of the sender.
      */
     void handleCommand(const char* msg, NodeNum fromNodeId);
 
+    /**
+     * @brief Completion callback, logs each finished transfer session and
+     * frees the bundle or batch it carried, if any.
+     */
+    static void onTransferComplete(int session, AkitaMeshZmodem::TransferState result, void* ctx);
+
+#if AKZ_ENABLE_JOB_QUEUE
+    /**
+     * @brief Job callback, tells the node that queued the job how it ended.
+     */
+    static void onJobDone(const AkitaMeshZmodem::JobInfo& job, AkitaMeshZmodem::TransferState result, void* ctx);
+
+    /**
+     * @brief Queues a SEND/URGENT/RECV job and replies with its id and place in line.
+     * @param args The path, optionally followed by " p=<priority> d=<deadline s> r=<runs>".
+     */
+    void queueJob(const char* what, const char* args, NodeNum destinationNodeId, uint8_t priority, NodeNum fromNodeId);
+
+    /**
+     * @brief Handles JOBS, PRIO:<id>:<priority>, TOP:<id> and CANCEL:<id>.
+     * @return true if 'msg' was one of them.
+     */
+    bool handleJobCommand(const char* msg, NodeNum fromNodeId);
+
+    /**
+     * @brief Replies with the job queue in run order (JOBS command).
+     */
+    void sendJobList(NodeNum destinationNodeId);
+#endif
+
+    /**
+     * @brief Starts a SEND/URGENT of several files in one session: 'list' is
+     * comma-separated paths, each of which may end in a '*'/'?' pattern.
+     * Runs at once, outside the job queue; one batch at a time.
+     */
+    void sendBatch(const char* what, const char* list, NodeNum destinationNodeId, const char* nodeName,
+                   uint8_t priority, NodeNum fromNodeId);
+
+    /**
+     * @brief Handles BUNDLE:!NodeID:/dir [pattern] and RECVBUNDLE:/dir: the
+     * matching files of a directory as one transfer, unpacked as it arrives.
+     * One bundle of each direction runs at a time.
+     */
+    void handleBundleCommand(const char* msg, NodeNum fromNodeId);
+
+    /**
+     * @brief Handles GET:/path [a-b|a-|-n]: sends the file, or that byte range
+     * of it, to the node asking (which must auto-accept or have a RECV armed).
+     */
+    void handleGetCommand(const char* args, NodeNum fromNodeId);
+
+#if AKZ_ENABLE_LISTING
+    /**
+     * @brief Handles LIST:/dir [pattern] [c=<cursor>] [s=<token>] [h]: replies
+     * with one binary listing page (see ZModemListing.h), and STAT:/path,
+     * which replies with the file's size, mtime and SHA-256 as text.
+     */
+    void handleListCommand(const char* msg, NodeNum fromNodeId);
+
+    /**
+     * @brief Logs the entries of a listing page that came back from a LIST.
+     */
+    void logListingPage(const uint8_t* page, size_t len, NodeNum fromNodeId);
+
+    /**
+     * @brief Handles SYNC:!NodeID:/dir [d]: reads the node's manifest of the
+     * directory, sends it the files that are new or changed here as one
+     * bundle and, with d, deletes there what is gone here.
+     */
+    void handleSyncCommand(const char* args, NodeNum fromNodeId);
+
+    /**
+     * @brief Handles SYNCDEL:/dir name/name/...: the deletes of a SYNC, on the
+     * node being synced. Taken only from the node whose RECVBUNDLE into the
+     * same directory just completed here (see syncDeleteAllowed()), and never
+     * for the root directory.
+     */
+    void handleSyncDelete(const char* args, NodeNum fromNodeId);
+    bool syncDeleteAllowed(const char* dir, NodeNum fromNodeId) const;
+
+    /**
+     * @brief SYNC steps driven by the synced node's answers: manifest pages,
+     * and replies to its LIST and RECVBUNDLE. syncReply() returns true if
+     * the text was one.
+     */
+    void syncPage(const uint8_t* page, size_t len);
+    bool syncReply(const char* msg);
+    void syncCompare();
+    static bool syncFilter(const char* name, size_t size, void* ctx);
+    void finishSync();
+    void endSync(const char* message);
+#endif
+
+#if AKZ_ENABLE_TAIL_SEND
+    /**
+     * @brief Handles TAIL:!NodeID:/path [f=<seconds>]: sends what was appended
+     * since the node's last copy, and optionally keeps following the file.
+     */
+    void handleTailCommand(const char* args, NodeNum fromNodeId);
+#endif
+
+    /**
+     * @brief Replies "BUSY: ... Retry after Ns" if the last start was rejected
+     * by admission control.
+     * @return true if a reply was sent.
+     */
+    bool sendBusyReply(const char* what, const char* filename, NodeNum destinationNodeId);
+
+    /**
+     * @brief Replies with a compact per-session status listing (STATUS command).
+     * @param destinationNodeId The Node ID to send the listing to.
+     */
+    void sendStatus(NodeNum destinationNodeId);
+
     /**
      * @brief Helper to send a reply text message back to the command sender.
      * @param message The text message to send.
      * @param destinationNodeId The Node ID to send the reply to.
      */
     void sendReply(const char* message, NodeNum destinationNodeId);
+
+    /**
+     * @brief As sendReply(), for a binary payload (sent as OPAQUE).
+     */
+    void sendBinaryReply(const uint8_t* data, size_t len, NodeNum destinationNodeId);
 };
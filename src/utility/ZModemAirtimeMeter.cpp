@@ -0,0 +1,45 @@
+/**
+ * @file ZModemAirtimeMeter.cpp
+ * @author Akita Engineering
+ * @brief Airtime meter implementation.
+ * @version 1.1.0
+ */
+
+#include "ZModemAirtimeMeter.h"
+
+ZModemAirtimeMeter::ZModemAirtimeMeter() {
+    for (uint8_t i = 0; i < BUCKETS; ++i) {
+        _airtimeUs[i] = 0;
+        _epoch[i] = 0xFFFFFFFFUL;
+    }
+}
+
+void ZModemAirtimeMeter::record(size_t bytes, uint32_t nowMs) {
+    uint32_t epoch = nowMs / BUCKET_MS;
+    uint8_t i = epoch % BUCKETS;
+    if (_epoch[i] != epoch) {
+        _epoch[i] = epoch;
+        _airtimeUs[i] = 0;
+    }
+    _airtimeUs[i] += packetAirtimeUs(bytes);
+}
+
+uint8_t ZModemAirtimeMeter::sharePercent(uint32_t nowMs) const {
+    uint32_t epoch = nowMs / BUCKET_MS;
+    uint64_t totalUs = 0;
+    uint32_t oldest = 0;
+    for (uint8_t i = 0; i < BUCKETS; ++i) {
+        uint32_t age = epoch - _epoch[i];
+        if (age >= BUCKETS) continue;
+        totalUs += _airtimeUs[i];
+        if (age > oldest) oldest = age;
+    }
+    // Until a full window of history exists, average over what there is
+    // (at least one bucket), so a transfer that just started is not
+    // under-reported
+    uint32_t spanMs = oldest * BUCKET_MS + nowMs % BUCKET_MS;
+    if (spanMs < BUCKET_MS) spanMs = BUCKET_MS;
+    if (spanMs > WINDOW_MS) spanMs = WINDOW_MS;
+    uint64_t pct = totalUs / (spanMs * 10ULL); // us -> percent of the span
+    return pct > 255 ? 255 : (uint8_t)pct;
+}
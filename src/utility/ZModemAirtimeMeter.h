@@ -0,0 +1,42 @@
+/**
+ * @file ZModemAirtimeMeter.h
+ * @author Akita Engineering
+ * @brief Sliding-window estimate of the radio airtime spent on this node's
+ * ZModem packets, used by session admission control.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_AIRTIME_METER_H
+#define ZMODEM_AIRTIME_METER_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_AIRTIME_WINDOW_MS >= 8, "AKZ_AIRTIME_WINDOW_MS too small");
+
+class ZModemAirtimeMeter {
+public:
+    static const uint8_t BUCKETS = 8;
+    static const uint32_t WINDOW_MS = AKZ_AIRTIME_WINDOW_MS;
+
+    ZModemAirtimeMeter();
+
+    // Estimated time on air of one data-port packet of 'bytes' (our header included)
+    static uint32_t packetAirtimeUs(size_t bytes) {
+        return (uint32_t)AKZ_AIRTIME_PACKET_US + (uint32_t)bytes * AKZ_AIRTIME_US_PER_BYTE;
+    }
+
+    void record(size_t bytes, uint32_t nowMs);
+    // Airtime spent in the last WINDOW_MS (or since the oldest recorded
+    // packet, if more recent), as a percentage of that time
+    uint8_t sharePercent(uint32_t nowMs) const;
+
+private:
+    static const uint32_t BUCKET_MS = WINDOW_MS / BUCKETS;
+    // Buckets are tagged with the absolute bucket number they hold, so stale
+    // ones are skipped on read without a rotation step
+    uint32_t _airtimeUs[BUCKETS];
+    uint32_t _epoch[BUCKETS];
+};
+
+#endif // ZMODEM_AIRTIME_METER_H
@@ -0,0 +1,42 @@
+/**
+ * @file ZModemAtomicFile.cpp
+ * @author Akita Engineering
+ * @brief Rewrite through a temporary file, and the matching open and remove.
+ * @version 1.1.0
+ */
+
+#include "ZModemAtomicFile.h"
+
+// "<path>.tmp"; false if it does not fit
+static bool tmpPath(char* buf, size_t len, const char* path) {
+    int n = snprintf(buf, len, "%s.tmp", path);
+    return n > 0 && (size_t)n < len;
+}
+
+bool akzAtomicRewrite(FS& fs, const char* path, AkzFileWriter writer, const void* ctx) {
+    char tmp[AKZ_JOB_PATH_MAX + 16];
+    if (!tmpPath(tmp, sizeof(tmp), path)) return false;
+    File f = fs.open(tmp, FILE_WRITE);
+    if (!f) return false;
+    bool ok = writer(f, ctx);
+    f.close();
+    if (!ok) {
+        fs.remove(tmp);
+        return false;
+    }
+    if (fs.exists(path)) fs.remove(path);
+    return fs.rename(tmp, path);
+}
+
+File akzAtomicOpen(FS& fs, const char* path) {
+    File f = fs.open(path, FILE_READ);
+    char tmp[AKZ_JOB_PATH_MAX + 16];
+    if (!f && tmpPath(tmp, sizeof(tmp), path)) f = fs.open(tmp, FILE_READ);
+    return f;
+}
+
+void akzAtomicRemove(FS& fs, const char* path) {
+    if (fs.exists(path)) fs.remove(path);
+    char tmp[AKZ_JOB_PATH_MAX + 16];
+    if (tmpPath(tmp, sizeof(tmp), path) && fs.exists(tmp)) fs.remove(tmp);
+}
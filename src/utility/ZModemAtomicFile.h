@@ -0,0 +1,31 @@
+/**
+ * @file ZModemAtomicFile.h
+ * @author Akita Engineering
+ * @brief Small state files rewritten so that a reboot mid-save leaves the
+ * old contents or the new ones: the job queue, resume journals, the send
+ * checkpoint, the tail table and the file index.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_ATOMIC_FILE_H
+#define ZMODEM_ATOMIC_FILE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+// Writes the new contents to the open file; false fails the save
+typedef bool (*AkzFileWriter)(File& f, const void* ctx);
+
+// Rewrite 'path' through "<path>.tmp": the writer fills the temporary file,
+// which then replaces 'path'. Not atomic on every filesystem, as the old
+// file is removed before the rename; akzAtomicOpen() then finds the
+// temporary one. False (and 'path' untouched) if the writer fails, or if
+// 'path' is longer than AKZ_JOB_PATH_MAX plus a suffix such as ".akj".
+bool akzAtomicRewrite(FS& fs, const char* path, AkzFileWriter writer, const void* ctx);
+// 'path' for reading, or "<path>.tmp" if a save was cut short
+File akzAtomicOpen(FS& fs, const char* path);
+// Remove 'path' and any temporary a save left
+void akzAtomicRemove(FS& fs, const char* path);
+
+#endif // ZMODEM_ATOMIC_FILE_H
@@ -0,0 +1,65 @@
+/**
+ * @file ZModemBatch.cpp
+ * @author Akita Engineering
+ * @brief Batch file lists.
+ * @version 1.1.0
+ */
+
+#include "ZModemBatch.h"
+#include "ZModemBundle.h"
+
+bool ZModemBatch::add(const char* path) {
+    if (!path || !path[0] || _count == AKZ_BATCH_MAX_FILES) return false;
+    size_t len = strlen(path) + 1;
+    if (len > (size_t)(AKZ_BATCH_PATH_BYTES - _used)) return false;
+    memcpy(_paths + _used, path, len);
+    _offsets[_count] = _used;
+    _results[_count] = Result::PENDING;
+    _used += (uint16_t)len;
+    _count++;
+    return true;
+}
+
+uint8_t ZModemBatch::addMatching(FS& fs, const char* dir, const char* pattern) {
+    size_t n = dir ? strlen(dir) : 0;
+    while (n > 1 && dir[n - 1] == '/') n--;
+    if (n == 0 || n >= AKZ_JOB_PATH_MAX) return 0;
+    char base[AKZ_JOB_PATH_MAX];
+    memcpy(base, dir, n);
+    base[n] = '\0';
+    File d = fs.open(base, FILE_READ);
+    if (!d || !d.isDirectory()) return 0;
+
+    uint8_t added = 0;
+    for (File f = d.openNextFile(); f && _count < AKZ_BATCH_MAX_FILES; f = d.openNextFile()) {
+        if (f.isDirectory()) continue;
+        // Older cores give the full path, newer ones the name alone
+        const char* name = f.name();
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        if (!ZModemBundle::match(pattern, name)) continue;
+        char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+        int len = snprintf(path, sizeof(path), "%s/%s", strcmp(base, "/") == 0 ? "" : base, name);
+        if (len <= 0 || (size_t)len >= sizeof(path) || !add(path)) continue;
+        added++;
+    }
+    d.close();
+    return added;
+}
+
+void ZModemBatch::clear() {
+    _count = 0;
+    _used = 0;
+}
+
+uint8_t ZModemBatch::countOf(Result r) const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < _count; ++i) {
+        if (_results[i] == r) n++;
+    }
+    return n;
+}
+
+void ZModemBatch::resetResults() {
+    for (uint8_t i = 0; i < _count; ++i) _results[i] = Result::PENDING;
+}
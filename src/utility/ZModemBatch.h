@@ -0,0 +1,59 @@
+/**
+ * @file ZModemBatch.h
+ * @author Akita Engineering
+ * @brief A list of files sent one after another in a single session: one
+ * handshake for them all, and each file's ZFILE sent behind the previous
+ * file's ZEOF instead of after its answer. Unlike a bundle, each file
+ * arrives as itself and keeps its own resume, CRCs and staging.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_BATCH_H
+#define ZMODEM_BATCH_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_BATCH_MAX_FILES > 0 && AKZ_BATCH_MAX_FILES <= 255, "AKZ_BATCH_MAX_FILES must be 1..255");
+static_assert(AKZ_BATCH_PATH_BYTES > 1 && AKZ_BATCH_PATH_BYTES <= 65535, "AKZ_BATCH_PATH_BYTES must be 2..65535");
+
+// Send with akitaZmodem.startSend(batch, node). The batch belongs to the
+// caller and must outlive the session; result() tells, once it has ended,
+// what became of each file. The receiver saves each file under its own
+// name next to the path its receive was armed with (see startReceive()).
+class ZModemBatch {
+public:
+    enum class Result : uint8_t {
+        PENDING, // not sent (yet)
+        SENT,    // the receiver has all of it
+        SKIPPED, // the receiver refused it
+        FAILED   // could not be opened
+    };
+
+    // False if the batch is full or the path does not fit
+    bool add(const char* path);
+    // Files directly in 'dir' (not its subdirectories) whose names match
+    // 'pattern' ('*' and '?'; null or empty: all). Returns how many were
+    // added; stops when the batch is full.
+    uint8_t addMatching(FS& fs, const char* dir, const char* pattern = nullptr);
+    void clear();
+
+    uint8_t count() const { return _count; }
+    const char* path(uint8_t i) const { return _paths + _offsets[i]; }
+    Result result(uint8_t i) const { return _results[i]; }
+    uint8_t countOf(Result r) const;
+
+    // Used by AkitaMeshZmodem while the batch is sent
+    void setResult(uint8_t i, Result r) { _results[i] = r; }
+    void resetResults();
+
+private:
+    char _paths[AKZ_BATCH_PATH_BYTES];
+    uint16_t _offsets[AKZ_BATCH_MAX_FILES];
+    Result _results[AKZ_BATCH_MAX_FILES];
+    uint8_t _count = 0;
+    uint16_t _used = 0;
+};
+
+#endif // ZMODEM_BATCH_H
@@ -0,0 +1,50 @@
+/**
+ * @file ZModemBufferPool.cpp
+ * @author Akita Engineering
+ * @brief Slab pool implementation (first-fit over a free bitmask).
+ * @version 1.1.0
+ */
+
+#include "ZModemBufferPool.h"
+
+static uint8_t popCount(uint32_t v) {
+    uint8_t n = 0;
+    while (v) { v &= v - 1; n++; }
+    return n;
+}
+
+ZModemBufferPool::ZModemBufferPool() {
+    _freeMask = (SLAB_COUNT >= 32) ? 0xFFFFFFFFUL : ((1UL << SLAB_COUNT) - 1);
+    for (size_t i = 0; i < SLAB_COUNT; ++i) _runLength[i] = 0;
+    _lowWaterSlabs = SLAB_COUNT;
+}
+
+uint8_t* ZModemBufferPool::acquire(size_t bytes) {
+    size_t need = _slabsFor(bytes);
+    if (need > SLAB_COUNT) return nullptr;
+    uint32_t runMask = (need >= 32) ? 0xFFFFFFFFUL : ((1UL << need) - 1);
+    for (size_t start = 0; start + need <= SLAB_COUNT; ++start) {
+        uint32_t m = runMask << start;
+        if ((_freeMask & m) != m) continue;
+        _freeMask &= ~m;
+        _runLength[start] = (uint8_t)need;
+        uint8_t freeNow = popCount(_freeMask);
+        if (freeNow < _lowWaterSlabs) _lowWaterSlabs = freeNow;
+        return _storage + start * SLAB_SIZE;
+    }
+    return nullptr;
+}
+
+void ZModemBufferPool::release(uint8_t* buf) {
+    if (!buf || buf < _storage || buf >= _storage + sizeof(_storage)) return;
+    size_t start = (size_t)(buf - _storage) / SLAB_SIZE;
+    size_t n = _runLength[start];
+    if (n == 0) return; // not the start of a live run
+    uint32_t runMask = (n >= 32) ? 0xFFFFFFFFUL : ((1UL << n) - 1);
+    _freeMask |= runMask << start;
+    _runLength[start] = 0;
+}
+
+size_t ZModemBufferPool::freeBytes() const {
+    return popCount(_freeMask) * SLAB_SIZE;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file ZModemBufferPool.h
+ * @author Akita Engineering
+ * @brief Fixed, preallocated slab pool that sessions borrow their working
+ * buffers from while a transfer is active.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_BUFFER_POOL_H
+#define ZMODEM_BUFFER_POOL_H
+
+#include <Arduino.h>
+#include <cstddef>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_POOL_SLAB_COUNT > 0 && AKZ_POOL_SLAB_COUNT <= 32, "AKZ_POOL_SLAB_COUNT must be 1..32");
+
+class ZModemBufferPool {
+public:
+    static const size_t SLAB_SIZE = AKZ_POOL_SLAB_SIZE;
+    static const size_t SLAB_COUNT = AKZ_POOL_SLAB_COUNT;
+
+    ZModemBufferPool();
+
+    // Borrow a contiguous run of slabs covering 'bytes'. Returns nullptr when
+    // no run of that length is free; callers must handle a dry pool.
+    uint8_t* acquire(size_t bytes);
+    // Return a buffer obtained from acquire(). nullptr is ignored.
+    void release(uint8_t* buf);
+
+    // Bytes actually reserved for a request of 'bytes' (rounded up to slabs)
+    static size_t footprint(size_t bytes) { return _slabsFor(bytes) * SLAB_SIZE; }
+
+    size_t freeBytes() const;
+    size_t capacityBytes() const { return SLAB_SIZE * SLAB_COUNT; }
+    size_t lowWaterBytes() const { return _lowWaterSlabs * SLAB_SIZE; } // least free ever seen
+
+private:
+    // Max alignment so any object (e.g. a coroutine frame) can live in a slab
+    alignas(alignof(std::max_align_t)) uint8_t _storage[SLAB_SIZE * SLAB_COUNT];
+    uint32_t _freeMask;
+    uint8_t _runLength[SLAB_COUNT]; // slabs held by the run starting at each slab
+    uint8_t _lowWaterSlabs;
+
+    static size_t _slabsFor(size_t bytes) { return bytes == 0 ? 1 : (bytes + SLAB_SIZE - 1) / SLAB_SIZE; }
+};
+
+#endif // ZMODEM_BUFFER_POOL_H
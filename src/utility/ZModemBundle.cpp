@@ -0,0 +1,325 @@
+/**
+ * @file ZModemBundle.cpp
+ * @author Akita Engineering
+ * @brief Directory bundles, built while sent and unpacked while received.
+ * @version 1.1.0
+ */
+
+#include "ZModemBundle.h"
+
+const char* const ZModemBundle::MAGIC = "AKB1";
+
+// Like a shell glob: '*' is any run of characters, '?' any one, and a
+// leading '.' is matched only by a '.' in the pattern
+bool ZModemBundle::match(const char* pattern, const char* name) {
+    if (name[0] == '.' && (!pattern || pattern[0] != '.')) return false;
+    if (!pattern || !pattern[0]) return true;
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') pattern++;
+    return *pattern == '\0';
+}
+
+bool ZModemBundle::validName(const char* name) {
+    return name[0] && !strchr(name, '/') && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+// "<dir>/<name>"; false if it does not fit
+static bool memberPath(char* buf, size_t len, const char* dir, const char* name) {
+    int n = snprintf(buf, len, "%s/%s", strcmp(dir, "/") == 0 ? "" : dir, name);
+    return n > 0 && (size_t)n < len;
+}
+
+// The directory without a trailing '/', except for the root
+static bool copyDir(char* buf, size_t len, const char* dir) {
+    size_t n = dir ? strlen(dir) : 0;
+    while (n > 1 && dir[n - 1] == '/') n--;
+    if (n == 0 || n >= len) return false;
+    memcpy(buf, dir, n);
+    buf[n] = '\0';
+    return true;
+}
+
+// --- Source ---
+
+bool ZModemBundleSource::open(FS& fs, const char* dir, const char* pattern) {
+    return _list(fs, dir, pattern, nullptr, nullptr);
+}
+
+bool ZModemBundleSource::open(FS& fs, const char* dir, Filter filter, void* ctx) {
+    return _list(fs, dir, nullptr, filter, ctx);
+}
+
+bool ZModemBundleSource::openEmpty(FS& fs, const char* dir) {
+    close();
+    if (!copyDir(_dir, sizeof(_dir), dir)) return false;
+    _fs = &fs;
+    _size = ZModemBundle::MAGIC_LEN + 1;
+    return seek(0);
+}
+
+bool ZModemBundleSource::_list(FS& fs, const char* dir, const char* pattern, Filter filter, void* ctx) {
+    close();
+    if (!copyDir(_dir, sizeof(_dir), dir)) return false;
+    File d = fs.open(_dir, FILE_READ);
+    if (!d || !d.isDirectory()) return false;
+
+    size_t at = ZModemBundle::MAGIC_LEN;
+    for (File f = d.openNextFile(); f; f = d.openNextFile()) {
+        if (f.isDirectory()) continue;
+        // Older cores give the full path, newer ones the name alone
+        const char* name = f.name();
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        if (!ZModemBundle::match(pattern, name)) continue;
+        if (filter && !filter(name, f.size(), ctx)) continue;
+        size_t len = strlen(name);
+        if (_count == AKZ_BUNDLE_MAX_FILES || len >= AKZ_BUNDLE_NAME_MAX || !ZModemBundle::validName(name)) {
+            _skipped++;
+            continue;
+        }
+        Member& m = _members[_count++];
+        m.start = (uint32_t)at;
+        m.size = (uint32_t)f.size();
+        memcpy(m.name, name, len + 1);
+        at += ZModemBundle::headerSize(len) + m.size;
+        _payload += m.size;
+    }
+    d.close();
+    if (_count == 0) return false;
+    _fs = &fs;
+    _size = at + 1; // end marker
+    return seek(0);
+}
+
+void ZModemBundleSource::close() {
+    if (_open >= 0) _file.close();
+    _open = -1;
+    _fs = nullptr;
+    _count = 0;
+    _skipped = 0;
+    _payload = 0;
+    _size = 0;
+    _pos = 0;
+    _cur = 0;
+}
+
+bool ZModemBundleSource::seek(size_t pos) {
+    if (!_fs || pos > _size) return false;
+    _pos = pos;
+    // Last member whose header starts at or before pos; read() moves on
+    // from there if pos is past its data
+    uint16_t lo = 0, hi = _count;
+    while (hi - lo > 1) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2);
+        if (_members[mid].start <= pos) lo = mid;
+        else hi = mid;
+    }
+    _cur = lo;
+    return true;
+}
+
+size_t ZModemBundleSource::read(uint8_t* dst, size_t n) {
+    size_t done = 0;
+    while (done < n && _pos < _size) {
+        size_t k;
+        if (_pos < ZModemBundle::MAGIC_LEN) {
+            k = min(n - done, (size_t)ZModemBundle::MAGIC_LEN - _pos);
+            memcpy(dst + done, ZModemBundle::MAGIC + _pos, k);
+        } else {
+            while (_cur < _count && _pos >= _members[_cur].start + ZModemBundle::headerSize(strlen(_members[_cur].name)) +
+                                                 _members[_cur].size) {
+                _cur++;
+            }
+            if (_cur == _count) {
+                dst[done] = 0;
+                k = 1;
+            } else {
+                const Member& m = _members[_cur];
+                size_t len = strlen(m.name);
+                size_t hdr = ZModemBundle::headerSize(len);
+                size_t off = _pos - m.start;
+                if (off < hdr) {
+                    uint8_t h[1 + AKZ_BUNDLE_NAME_MAX + 4];
+                    h[0] = (uint8_t)len;
+                    memcpy(h + 1, m.name, len);
+                    for (int i = 0; i < 4; ++i) h[1 + len + i] = (uint8_t)(m.size >> (8 * i));
+                    k = min(n - done, hdr - off);
+                    memcpy(dst + done, h + off, k);
+                } else {
+                    k = _readMember(m, off - hdr, dst + done, min(n - done, (size_t)m.size - (off - hdr)));
+                }
+            }
+        }
+        done += k;
+        _pos += k;
+    }
+    return done;
+}
+
+// n bytes of member m's data from 'off'. Always n: what the file no longer
+// has is sent as zeros, keeping the sizes in the headers true.
+size_t ZModemBundleSource::_readMember(const Member& m, size_t off, uint8_t* dst, size_t n) {
+    int idx = (int)(&m - _members);
+    if (_open != idx) {
+        if (_open >= 0) _file.close();
+        char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+        memberPath(path, sizeof(path), _dir, m.name);
+        _file = _fs->open(path, FILE_READ);
+        _open = idx;
+        _filePos = 0;
+    }
+    size_t got = 0;
+    if (_file && (_filePos == off || _file.seek(off))) {
+        int r = _file.read(dst, n);
+        got = r > 0 ? (size_t)r : 0;
+    }
+    _filePos = off + got;
+    if (got < n) {
+        memset(dst + got, 0, n - got);
+        _filePos = (size_t)-1; // seek before the next read
+    }
+    if (off + n == m.size) {
+        _file.close();
+        _open = -1;
+    }
+    return n;
+}
+
+// --- Sink ---
+
+ZModemBundleSink::ZModemBundleSink(FS& fs, const char* dir) : _fs(fs) {
+    if (!copyDir(_dir, sizeof(_dir), dir)) {
+        _dir[0] = '\0';
+        _state = State::FAILED;
+    }
+}
+
+ZModemBundleSink::~ZModemBundleSink() {
+    if (_file) _file.close();
+}
+
+void ZModemBundleSink::reset() {
+    if (_file) _file.close();
+    _state = _dir[0] ? State::MAGIC : State::FAILED;
+    _consumed = 0;
+    _expected = 0;
+    _field = 0;
+    _members = 0;
+}
+
+bool ZModemBundleSink::expect(size_t size) {
+    _expected = size;
+    // Smallest bundle: magic and end marker
+    return _dir[0] && size >= (size_t)ZModemBundle::MAGIC_LEN + 1;
+}
+
+bool ZModemBundleSink::_openMember() {
+    char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+    if (!ZModemBundle::validName(_name) || !memberPath(path, sizeof(path), _dir, _name)) return false;
+    if (_members == 0 && strcmp(_dir, "/") != 0 && !_fs.exists(_dir)) _fs.mkdir(_dir);
+    _file = _fs.open(path, FILE_WRITE);
+    return (bool)_file;
+}
+
+void ZModemBundleSink::_endMember() {
+    _file.close();
+    _members++;
+    _state = State::NAME_LEN;
+}
+
+// The member being written is incomplete: remove it
+void ZModemBundleSink::_fail() {
+    if (_file) {
+        _file.close();
+        char path[AKZ_JOB_PATH_MAX + AKZ_BUNDLE_NAME_MAX];
+        if (memberPath(path, sizeof(path), _dir, _name)) _fs.remove(path);
+    }
+    _state = State::FAILED;
+}
+
+size_t ZModemBundleSink::write(const uint8_t* src, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        switch (_state) {
+        case State::MAGIC:
+            if (src[i++] != (uint8_t)ZModemBundle::MAGIC[_field]) {
+                _fail();
+                return 0;
+            }
+            if (++_field == ZModemBundle::MAGIC_LEN) {
+                _state = State::NAME_LEN;
+                _field = 0;
+            }
+            break;
+        case State::NAME_LEN:
+            _nameLen = src[i++];
+            if (_nameLen == 0) {
+                _state = State::END;
+            } else if (_nameLen >= sizeof(_name)) {
+                _fail();
+                return 0;
+            } else {
+                _state = State::NAME;
+                _field = 0;
+            }
+            break;
+        case State::NAME:
+            _name[_field++] = (char)src[i++];
+            if (_field == _nameLen) {
+                _name[_nameLen] = '\0';
+                _state = State::SIZE;
+                _field = 0;
+                _left = 0;
+            }
+            break;
+        case State::SIZE:
+            _left |= (uint32_t)src[i++] << (8 * _field);
+            if (++_field < 4) break;
+            if (!_openMember()) {
+                _fail();
+                return 0;
+            }
+            _state = State::DATA;
+            if (_left == 0) _endMember();
+            break;
+        case State::DATA: {
+            size_t k = min(n - i, (size_t)_left);
+            if (_file.write(src + i, k) != k) {
+                _fail();
+                return 0;
+            }
+            i += k;
+            _left -= (uint32_t)k;
+            if (_left == 0) _endMember();
+            break;
+        }
+        case State::END: // nothing may follow the end marker
+        case State::FAILED:
+            _fail();
+            return 0;
+        }
+    }
+    _consumed += n;
+    return n;
+}
+
+bool ZModemBundleSink::finalize(bool ok) {
+    bool good = ok && _state == State::END && (_expected == 0 || _consumed == _expected);
+    if (!good) _fail();
+    return good;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file ZModemBundle.h
+ * @author Akita Engineering
+ * @brief Many small files as one transfer: ZModemBundleSource streams the
+ * files of a directory as a single archive, built as it is read with no
+ * temporary file, and ZModemBundleSink unpacks it into a directory as it
+ * arrives. One session then carries them all, and resume, CRCs and staging
+ * apply to the bundle as a whole.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_BUNDLE_H
+#define ZMODEM_BUNDLE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+#include "ZModemDataIO.h"
+
+static_assert(AKZ_BUNDLE_MAX_FILES > 0 && AKZ_BUNDLE_MAX_FILES <= 1024, "AKZ_BUNDLE_MAX_FILES must be 1..1024");
+static_assert(AKZ_BUNDLE_NAME_MAX > 1 && AKZ_BUNDLE_NAME_MAX <= 256, "AKZ_BUNDLE_NAME_MAX must be 2..256");
+
+// Bundle layout, integers little-endian:
+//   "AKB1"
+//   per member: name length (1 byte, 1..255), name, size (4 bytes), data
+//   0 (1 byte)
+// Names are relative to the directory and never contain '/'.
+class ZModemBundle {
+public:
+    static const uint8_t MAGIC_LEN = 4;
+    static const char* const MAGIC;
+    // Header bytes in front of a member's data
+    static size_t headerSize(size_t nameLen) { return 1 + nameLen + 4; }
+    // '*' and '?' wildcards; a null or empty pattern matches everything
+    static bool match(const char* pattern, const char* name);
+    // A name a sink may create: not empty, no '/', not "." or ".."
+    static bool validName(const char* name);
+};
+
+// Send with akitaZmodem.startSend(source, "<name>.akb", node). open() lists
+// the directory and fixes each file's size; a file that grows later is sent
+// up to that size, and one that shrinks is padded with zeros, so the bundle
+// stays readable. One file is open at a time, and only while it is read.
+class ZModemBundleSource : public ZModemSource {
+public:
+    // Files directly in 'dir' (not its subdirectories) whose names match
+    // 'pattern'. False if the directory cannot be listed or nothing matched.
+    bool open(FS& fs, const char* dir, const char* pattern = nullptr);
+    // Picks the files itself: true from the filter takes the file in
+    typedef bool (*Filter)(const char* name, size_t size, void* ctx);
+    bool open(FS& fs, const char* dir, Filter filter, void* ctx);
+    // No files: the magic and the end marker alone. A sync that only
+    // deletes sends one, as the field node takes SYNCDEL only after a bundle.
+    bool openEmpty(FS& fs, const char* dir);
+    void close();
+    ~ZModemBundleSource() { close(); }
+
+    size_t size() override { return _size; }
+    size_t remaining() override { return _size - _pos; }
+    bool seek(size_t pos) override;
+    size_t read(uint8_t* dst, size_t n) override;
+
+    // Members in the bundle, and matching files left out (too many, name too long)
+    uint16_t count() const { return _count; }
+    uint16_t skipped() const { return _skipped; }
+    const char* name(uint16_t i) const { return _members[i].name; }
+    // Bytes of member data, without headers
+    size_t payloadSize() const { return _payload; }
+
+private:
+    struct Member {
+        uint32_t start; // offset of its header in the bundle
+        uint32_t size;
+        char name[AKZ_BUNDLE_NAME_MAX];
+    };
+    bool _list(FS& fs, const char* dir, const char* pattern, Filter filter, void* ctx);
+    size_t _readMember(const Member& m, size_t off, uint8_t* dst, size_t n);
+
+    FS* _fs = nullptr;
+    char _dir[AKZ_JOB_PATH_MAX] = "";
+    Member _members[AKZ_BUNDLE_MAX_FILES];
+    uint16_t _count = 0;
+    uint16_t _skipped = 0;
+    size_t _payload = 0;
+    size_t _size = 0;
+    size_t _pos = 0;
+    uint16_t _cur = 0;     // member _pos is in (_count: the end marker)
+    File _file;            // member _open, positioned at _filePos
+    int _open = -1;
+    size_t _filePos = 0;
+};
+
+// Receive with akitaZmodem.startReceive(sink). Each member is written to
+// "<dir>/<name>", replacing a file of that name, as its bytes arrive. A
+// transfer that fails removes the member it was writing; the members before
+// it are complete and stay. The bundle is checked as it is parsed: a bad
+// header or name fails the transfer.
+class ZModemBundleSink : public ZModemSink {
+public:
+    ZModemBundleSink(FS& fs, const char* dir);
+    ~ZModemBundleSink();
+
+    size_t size() override { return _consumed; }
+    size_t write(const uint8_t* src, size_t n) override;
+    bool expect(size_t size) override;
+    bool gathersWrites() const override { return true; }
+    bool finalize(bool ok) override;
+
+    // Members written in full so far
+    uint16_t count() const { return _members; }
+    // The end marker arrived and nothing went wrong
+    bool finished() const { return _state == State::END; }
+    // Where the members go, without a trailing '/'
+    const char* dir() const { return _dir; }
+    // Start over for another bundle
+    void reset();
+
+private:
+    enum class State : uint8_t { MAGIC, NAME_LEN, NAME, SIZE, DATA, END, FAILED };
+    bool _openMember();
+    void _endMember();
+    void _fail();
+
+    FS& _fs;
+    char _dir[AKZ_JOB_PATH_MAX];
+    State _state = State::MAGIC;
+    size_t _consumed = 0;
+    size_t _expected = 0;     // announced in ZFILE, 0 if not known
+    uint8_t _field = 0;       // bytes of the current header field seen
+    uint8_t _nameLen = 0;
+    char _name[AKZ_BUNDLE_NAME_MAX];
+    uint32_t _left = 0;       // data bytes of the current member still to come
+    File _file;
+    uint16_t _members = 0;
+};
+
+#endif // ZMODEM_BUNDLE_H
@@ -0,0 +1,896 @@
+/**
+ * @file ZModemCoEngine.cpp
+ * @author Akita Engineering
+ * @brief Coroutine ZModem engine. The sender and receiver are written as
+ * straight-line coroutines; loop() is the same tick shell as ZModemEngine
+ * and resumes them once per tick.
+ * @version 1.1.0
+ */
+
+#include "ZModemCoEngine.h"
+
+#if AKZ_HAVE_COROUTINES
+
+using namespace ZModemFraming;
+
+ZModemCoEngine::ZModemCoEngine() {
+    _filename[0] = '\0';
+    _timeoutTimer.setCallback(_onTimer, this);
+    _retryTimer.setCallback(_onTimer, this);
+    _holdTimer.setCallback(_onTimer, this);
+    _retryIntervalMs = DEFAULT_BASE_RETRY_MS;
+}
+
+ZModemCoEngine::~ZModemCoEngine() {
+    _cancelTimers();
+    _releaseBuffers();
+}
+
+void ZModemCoEngine::_onTimer(void* ctx) {
+    static_cast<ZModemCoEngine*>(ctx)->_wake = true;
+}
+
+void ZModemCoEngine::_cancelTimers() {
+    if (!_timers) return;
+    _timers->cancel(_timeoutTimer);
+    _timers->cancel(_retryTimer);
+    _timers->cancel(_holdTimer);
+}
+
+void ZModemCoEngine::_enterState(State s) {
+    _state = s;
+    _timers->cancel(_retryTimer);
+}
+
+bool ZModemCoEngine::hasPendingWork() {
+    if (_state == ZModemEngine::STATE_IDLE || _state == ZModemEngine::STATE_COMPLETE || _state == ZModemEngine::STATE_ERROR) return false;
+    if (_storageWait) return _storageReady();
+    return _wake || (_io && _io->available() > 0);
+}
+
+bool ZModemCoEngine::_isWaiting() const {
+    if (_storageWait) return true;
+    if (!_isSender) return true;
+    if (_state == ZModemEngine::STATE_SEND_ZDATA && !_lastDataPending) return _hold && _holdTimer.isArmed();
+    return _retryTimer.isArmed();
+}
+
+void ZModemCoEngine::setHold(bool hold, uint32_t maxDeferMs) {
+    if (!_timers || hold == _hold) return;
+    _hold = hold;
+    _holdMaxMs = maxDeferMs;
+    if (hold) {
+        _timers->arm(_holdTimer, maxDeferMs);
+    } else {
+        _timers->cancel(_holdTimer);
+        _wake = true;
+    }
+}
+
+bool ZModemCoEngine::_holdDeferred() {
+    if (!_hold) return false;
+    if (_holdTimer.isArmed()) return true;
+    _timers->arm(_holdTimer, _holdMaxMs);
+    return false;
+}
+
+bool ZModemCoEngine::_acquireBuffers() {
+    if (!_pool) return false;
+    if (!_inBuf) _inBuf = _pool->acquire(IN_BUF_SIZE);
+    if (_isSender && !_lastDataBuf) _lastDataBuf = _pool->acquire(CHUNK_SIZE);
+    if (!_inBuf || (_isSender && !_lastDataBuf)) {
+        _releaseBuffers();
+        return false;
+    }
+#if AKZ_HAVE_WRITE_COALESCER
+    if (!_isSender && _sink && _sink->gathersWrites()) _coalescer.begin(_pool, _bytesTransferred);
+#endif
+    _inBufLen = 0;
+    return true;
+}
+
+void ZModemCoEngine::_releaseBuffers() {
+    // The coroutine frame lives in the pool too
+    _task.reset();
+    if (!_pool) return;
+#if AKZ_HAVE_WRITE_COALESCER
+    flushWrites();
+    _coalescer.end();
+#endif
+    if (!_isSender) _finishSink(false);
+    _pool->release(_inBuf);
+    _pool->release(_lastDataBuf);
+    _pool->release(_fileInfoBuffer);
+    _inBuf = nullptr;
+    _lastDataBuf = nullptr;
+    _fileInfoBuffer = nullptr;
+    _inBufLen = 0;
+    _lastDataLen = 0;
+    _lastDataPending = false;
+}
+
+size_t ZModemCoEngine::getBorrowedBytes() const {
+    size_t n = _task.borrowedBytes();
+    if (_inBuf) n += ZModemBufferPool::footprint(IN_BUF_SIZE);
+    if (_lastDataBuf) n += ZModemBufferPool::footprint(CHUNK_SIZE);
+    if (_fileInfoBuffer) n += ZModemBufferPool::footprint(FILE_INFO_SIZE);
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) n += ZModemBufferPool::footprint(ZModemWriteCoalescer::UNIT);
+#endif
+    return n;
+}
+
+void ZModemCoEngine::begin(Stream& ioStream) {
+    _io = &ioStream;
+    _inBufLen = 0;
+}
+
+void ZModemCoEngine::setFileStream(File* file, const String& filename, size_t fileSize) {
+    setFileStream(file, filename.c_str(), fileSize);
+}
+
+void ZModemCoEngine::setFileStream(File* file, const char* filename, size_t fileSize) {
+    _fileSource.attach(file);
+    _fileSink.attach(file);
+    setSource(file ? &_fileSource : nullptr, filename, fileSize);
+    _sink = file ? &_fileSink : nullptr;
+}
+
+void ZModemCoEngine::setSource(ZModemSource* source, const char* filename, size_t fileSize) {
+    _source = source;
+    if (filename && filename[0]) {
+        strncpy(_filename, filename, FILENAME_MAX_LEN - 1);
+        _filename[FILENAME_MAX_LEN - 1] = '\0';
+    } else {
+        _filename[0] = '\0';
+    }
+    _fileSize = fileSize;
+    _bytesTransferred = 0;
+    _fileAnnounced = false;
+}
+
+bool ZModemCoEngine::send(unsigned long timeout, bool skipHandshake) {
+    if (!_io || !_source || !_timers) return false;
+    _isSender = true;
+    if (!_acquireBuffers()) return false;
+    _storageWait = false;
+    _fileSeq = 0;
+    _next = NEXT_UNKNOWN;
+    _eofSent = false;
+    {
+        ZModemCoTask::PoolScope scope(framePool());
+        _task = _senderTask(skipHandshake);
+    }
+    if (!_task.valid()) {
+        _releaseBuffers();
+        return false;
+    }
+    _enterState(skipHandshake ? ZModemEngine::STATE_SEND_ZFILE : ZModemEngine::STATE_SEND_ZRQINIT);
+    _timeoutMs = timeout;
+    _touchActivity();
+    _retryCount = 0;
+    _wake = true;
+    return true;
+}
+
+bool ZModemCoEngine::receive(unsigned long timeout, bool joined) {
+    if (!_io || !_timers) return false;
+    _isSender = false;
+    _sinkDone = false;
+    _staged = false;
+    if (!_acquireBuffers()) return false;
+    _storageWait = false;
+    _writeFailed = false;
+    _fileSeq = 0;
+    _fileEnded = false;
+    _followUp = false;
+    _skippedCur = false;
+    _rinitDue = false;
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.reset();
+#endif
+    {
+        ZModemCoTask::PoolScope scope(framePool());
+        _task = _receiverTask();
+    }
+    if (!_task.valid()) {
+        _releaseBuffers();
+        return false;
+    }
+    _state = ZModemEngine::STATE_AWAIT_ZRINIT;
+    _timeoutMs = timeout;
+    _touchActivity();
+    _fileAnnounced = false;
+
+    if (!joined) sendHexHeader(*_io, ZRINIT, _rinitFlags);
+    _timers->arm(_retryTimer, KEEPALIVE_MS);
+    _io->flush();
+    return true;
+}
+
+void ZModemCoEngine::abort() {
+    if (_io) {
+        uint8_t abortSeq[] = {ZDLE, ZCAN, ZDLE, ZCAN, ZDLE, ZCAN, ZDLE, ZCAN};
+        _io->write(abortSeq, 8);
+        _io->flush();
+    }
+    _state = ZModemEngine::STATE_ERROR;
+    _cancelTimers();
+    _releaseBuffers();
+}
+
+void ZModemCoEngine::flushWrites() {
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_sink && _coalescer.isActive() && !_coalescer.flush(_sink)) _writeFailed = true;
+#endif
+}
+
+size_t ZModemCoEngine::pendingWrites() const {
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return _coalescer.pending();
+#endif
+    return 0;
+}
+
+int ZModemCoEngine::loop(uint32_t budgetUs) {
+    if (_state == ZModemEngine::STATE_IDLE || _state == ZModemEngine::STATE_COMPLETE || _state == ZModemEngine::STATE_ERROR) {
+        return (_state == ZModemEngine::STATE_COMPLETE) ? 1 : (_state == ZModemEngine::STATE_ERROR ? -1 : 0);
+    }
+
+    if (_storageWait) {
+        if (!_storageReady() && _timeoutTimer.isArmed()) return 0;
+        _storageWait = false;
+        _wake = true;
+    }
+    if (!_wake && !_io->available()) return 0;
+    _wake = false;
+    _tickStartUs = micros();
+    _tickBudgetUs = budgetUs;
+    _yielded = false;
+    _tickEventSent = false;
+    _progressed = false;
+
+    if (!_timeoutTimer.isArmed()) {
+        _state = ZModemEngine::STATE_ERROR;
+        _cancelTimers();
+        _releaseBuffers();
+        return -1;
+    }
+
+    _task.resume();
+
+    // No ZFILE followed this tick's ZEOF: answer it on its own
+    if (!_isSender) _sendRinit();
+    // Receiver keepalive until the file is announced (see ZModemEngine)
+    if (!_isSender && !_fileAnnounced && !_retryTimer.isArmed() &&
+        _state != ZModemEngine::STATE_COMPLETE && _state != ZModemEngine::STATE_ERROR) {
+        sendHexHeader(*_io, ZRINIT, _rinitFlags);
+        _timers->arm(_retryTimer, KEEPALIVE_MS);
+    }
+
+    _io->flush();
+    if (_state == ZModemEngine::STATE_COMPLETE || _state == ZModemEngine::STATE_ERROR) {
+        _cancelTimers();
+        _releaseBuffers();
+    } else {
+        _wake = _yielded || !_isWaiting();
+    }
+    uint32_t tookUs = (uint32_t)(micros() - _tickStartUs);
+    if (tookUs > _maxLoopUs) _maxLoopUs = tookUs;
+    return (_state == ZModemEngine::STATE_COMPLETE) ? 1 : (_state == ZModemEngine::STATE_ERROR ? -1 : 0);
+}
+
+bool ZModemCoEngine::_budgetSpent() {
+    if (_tickBudgetUs == 0 || (uint32_t)(micros() - _tickStartUs) < _tickBudgetUs) return false;
+    _yielded = true;
+    return true;
+}
+
+// --- Awaiters ---
+
+ZModemCoEngine::Event ZModemCoEngine::_nextEvent() {
+    // Out of budget after a unit of work: leave the rest for the next tick
+    if (_progressed && _budgetSpent()) return EV_NONE;
+    _fillInput();
+    if (ZModemFraming::readHeader(_inBuf, _inBufLen, _rxType, _rxFlags) == 1) {
+        _touchActivity();
+        _progressed = true;
+        return EV_FRAME;
+    }
+    if (_tickEventSent) return EV_NONE;
+    _tickEventSent = true;
+    return _retryTimer.isArmed() ? EV_TX_CREDIT : EV_TIMER;
+}
+
+bool ZModemCoEngine::_moreInput() {
+    if (_progressed && _budgetSpent()) return false;
+    size_t before = _inBufLen;
+    _fillInput();
+    return _inBufLen != before;
+}
+
+// --- Sender ---
+
+ZModemCoTask ZModemCoEngine::_senderTask(bool skipHandshake) {
+    // Offer the session until the receiver answers ZRINIT
+    while (!skipHandshake) {
+        Event ev = co_await _event();
+        if (ev == EV_FRAME) {
+            if (_rxType == ZRINIT) {
+                _peerJoins = (_rxFlags[ZF1] & CANJOIN) != 0;
+                break;
+            }
+        } else if (ev == EV_TIMER) {
+            sendHexHeader(*_io, ZRQINIT, ZERO_FLAGS);
+            _timers->arm(_retryTimer, HEADER_RETRY_MS);
+        }
+    }
+
+    // One pass per file; the handshake above covers them all
+    _enterState(ZModemEngine::STATE_SEND_ZFILE);
+    bool delivered;
+    do {
+        // Announce the file until the receiver names the offset it wants,
+        // or skips it
+        for (;;) {
+            Event ev = co_await _event();
+            if (ev == EV_FRAME) {
+                if (_rxType == ZRPOS) break;
+                if (_rxType == ZSKIP && _rxFlags[ZFSEQ] == _fileSeq) break;
+            } else if (ev == EV_TIMER) {
+                _sendFileInfo();
+            }
+        }
+        delivered = _rxType == ZRPOS;
+        if (!delivered) continue;
+        _bytesTransferred = getPos(_rxFlags);
+        _seekSource(_bytesTransferred);
+        _lastDataPending = false;
+        _lastDataLen = 0;
+        _enterState(ZModemEngine::STATE_SEND_ZDATA);
+
+        // Stream chunks, then ZEOF, until the receiver confirms every byte
+        for (;;) {
+            Event ev = co_await _event();
+            if (ev == EV_FRAME) {
+                if (_rxType == ZACK && _state == ZModemEngine::STATE_SEND_ZDATA) {
+                    if (_lastDataPending && getPos(_rxFlags) == _lastDataPos + _lastDataLen) {
+                        _lastDataPending = false;
+                        _retryCount = 0;
+                        _retryIntervalMs = DEFAULT_BASE_RETRY_MS;
+                        _timers->cancel(_retryTimer);
+                    }
+                } else if (_rxType == ZRPOS) {
+                    size_t pos = getPos(_rxFlags);
+                    _seekSource(pos);
+                    _bytesTransferred = pos;
+                    _eofSent = false;
+                    _enterState(ZModemEngine::STATE_SEND_ZDATA);
+                    if (_lastDataLen > 0 && _lastDataPos == pos) {
+                        // Retransmit the cached chunk right away
+                        _lastDataPending = true;
+                        _bytesTransferred = pos + _lastDataLen;
+                        _seekSource(_bytesTransferred);
+                        _retryIntervalMs = DEFAULT_BASE_RETRY_MS;
+                        _retryCount = 0;
+                    } else {
+                        _lastDataPending = false;
+                    }
+                } else if (_rxType == ZRINIT && _state == ZModemEngine::STATE_SEND_ZEOF && _rxFlags[ZFSEQ] == _fileSeq) {
+                    break;
+                }
+                continue;
+            }
+            if (_state == ZModemEngine::STATE_SEND_ZDATA) {
+                if (!_lastDataPending) {
+                    _sendChunk();
+                } else if (ev == EV_TIMER) {
+                    if (_retryCount >= MAX_RETRIES) {
+                        _state = ZModemEngine::STATE_ERROR;
+                        co_return;
+                    }
+                    _resendChunk();
+                }
+            } else if (ev == EV_TIMER) {
+                _sendEof();
+            }
+        }
+    } while (_nextFile(delivered));
+
+    // Close the session; a lost final ZFIN is not worth a timeout
+    for (;;) {
+        Event ev = co_await _event();
+        if (ev == EV_FRAME) {
+            if (_rxType == ZFIN) {
+                _io->print("OO");
+                break;
+            }
+        } else if (ev == EV_TIMER) {
+            if (_retryCount >= MAX_RETRIES) break;
+            sendHexHeader(*_io, ZFIN, ZERO_FLAGS);
+            _timers->arm(_retryTimer, HEADER_RETRY_MS);
+            _retryCount++;
+        }
+    }
+    _state = ZModemEngine::STATE_COMPLETE;
+}
+
+// ZFILE for the current file. Kept out of the coroutine so the payload
+// buffer is stack, not frame.
+void ZModemCoEngine::_sendFileInfo() {
+    uint8_t payload[FILE_INFO_MAX];
+    _sendZFile(_fileSeq, payload, putFileInfo(payload, sizeof(payload), _filename, _fileSize));
+    _timers->arm(_retryTimer, HEADER_RETRY_MS);
+}
+
+// ZFILE header plus its filename\0filesize\0 subpacket
+void ZModemCoEngine::_sendZFile(uint8_t seq, const uint8_t* payload, size_t len) {
+    uint8_t options[4] = {0, 0, 0, 0};
+    options[ZFSEQ] = seq;
+    if (_crashRecovery) options[ZF0] = ZCRESUM;
+    sendBinaryHeader(*_io, ZFILE, options);
+    sendDataSubpacket(*_io, payload, len, true);
+}
+
+// ZEOF, with the next file's ZFILE right behind it; once that is out, its
+// resends stand in for ZEOF (see ZModemEngine)
+void ZModemCoEngine::_sendEof() {
+    if (!_eofSent || _next != NEXT_PIPELINED) {
+        uint8_t pos[4];
+        putPos(pos, _bytesTransferred);
+        sendHexHeader(*_io, ZEOF, pos);
+    }
+    if (!_eofSent && _next == NEXT_UNKNOWN) _peekNext();
+    if (_next == NEXT_PIPELINED) _sendZFile((uint8_t)(_fileSeq + 1), _fileInfoBuffer, _nextInfoLen);
+    _eofSent = true;
+    _timers->arm(_retryTimer, HEADER_RETRY_MS);
+}
+
+void ZModemCoEngine::_peekNext() {
+    if (!_batchNextFn) {
+        _next = NEXT_NONE;
+        return;
+    }
+    if (!_fileInfoBuffer) _fileInfoBuffer = _pool->acquire(FILE_INFO_SIZE);
+    if (!_fileInfoBuffer) return; // pool dry: the owner is asked at ZRINIT
+    char name[FILENAME_MAX_LEN];
+    size_t size = 0;
+    if (!_batchNextFn(_batchCtx, name, sizeof(name), size)) {
+        _next = NEXT_NONE;
+        _pool->release(_fileInfoBuffer);
+        _fileInfoBuffer = nullptr;
+        return;
+    }
+    _nextInfoLen = putFileInfo(_fileInfoBuffer, FILE_INFO_MAX, name, size);
+    _next = NEXT_PIPELINED;
+}
+
+// The receiver is done with the current file. True with the next one
+// attached and announced (or about to be); false leaves for ZFIN.
+bool ZModemCoEngine::_nextFile(bool delivered) {
+    bool pipelined = _next == NEXT_PIPELINED;
+    bool more = _batchDoneFn && _batchDoneFn(_batchCtx, delivered);
+    _pool->release(_fileInfoBuffer);
+    _fileInfoBuffer = nullptr;
+    _next = NEXT_UNKNOWN;
+    _eofSent = false;
+    _retryCount = 0;
+    if (!more) {
+        _enterState(ZModemEngine::STATE_SEND_ZFIN);
+        return false;
+    }
+    _fileSeq++;
+    _lastDataPending = false;
+    _lastDataLen = 0;
+    _enterState(ZModemEngine::STATE_SEND_ZFILE);
+    if (pipelined) _timers->arm(_retryTimer, HEADER_RETRY_MS);
+    return true;
+}
+
+// Read and send the next chunk, caching it for retransmit
+void ZModemCoEngine::_sendChunk() {
+    if (!_source || !_sourceRemaining()) {
+        if (_bytesTransferred == _fileSize) _enterState(ZModemEngine::STATE_SEND_ZEOF);
+        return;
+    }
+    if (!_storageReadyFor(0)) return; // next block still being read
+    if (_holdDeferred()) return;
+    size_t readLen;
+    const uint8_t* chunk = _readChunk(readLen);
+    if (readLen == 0) return;
+    bool isLast = (_sourceRemaining() == 0);
+    uint8_t pos[4];
+    putPos(pos, _bytesTransferred);
+    sendBinaryHeader(*_io, ZDATA, pos);
+    sendDataSubpacket(*_io, chunk, readLen, isLast);
+    _lastData = chunk;
+    _lastDataLen = readLen;
+    _lastDataPos = _bytesTransferred;
+    _lastDataPending = true;
+    _retryCount = 0;
+    _retryIntervalMs = DEFAULT_BASE_RETRY_MS;
+    _timers->arm(_retryTimer, _retryIntervalMs);
+    _bytesTransferred += readLen;
+    if (isLast) _enterState(ZModemEngine::STATE_SEND_ZEOF);
+}
+
+void ZModemCoEngine::_resendChunk() {
+    uint8_t pos[4];
+    putPos(pos, _lastDataPos);
+    sendBinaryHeader(*_io, ZDATA, pos);
+    sendDataSubpacket(*_io, _lastData, _lastDataLen, false);
+    _retryCount++;
+    _retryIntervalMs = (unsigned long)min((unsigned long)MAX_RETRY_INTERVAL_MS, _retryIntervalMs * 2UL);
+    _timers->arm(_retryTimer, _retryIntervalMs);
+}
+
+// --- Receiver ---
+
+ZModemCoTask ZModemCoEngine::_receiverTask() {
+    for (;;) {
+        if (co_await _event() != EV_FRAME) continue;
+        if (_storageFailed()) {
+            _state = ZModemEngine::STATE_ERROR;
+            co_return;
+        }
+        if (_rxType == ZRQINIT) {
+            _reply(ZRINIT, _rinitFlags);
+        } else if (_rxType == ZFILE) {
+            if (!_fileInfoBuffer) _fileInfoBuffer = _pool->acquire(FILE_INFO_SIZE);
+            if (!_fileInfoBuffer) continue; // pool dry: the sender repeats ZFILE
+            if (!_fileAnnounced) _crashRecovery = _rxFlags[ZF0] == ZCRESUM;
+            _rxFileSeq = _rxFlags[ZFSEQ];
+            _fileInfo.reset();
+            int r;
+            while ((r = _readFileInfo()) == 0) co_await _input();
+            if (r < 0) {
+                _state = ZModemEngine::STATE_ERROR;
+                co_return;
+            }
+            // A file ended by the next one's ZFILE, not yet on disk
+            if (_storageWait) co_await _storageTurn();
+        } else if (_rxType == ZDATA) {
+            _rxDataPos = getPos(_rxFlags);
+            while (!_readDataSubpacket()) {
+                // Write queue full: the ACK waits for room (see ZModemEngine)
+                if (_storageWait) co_await _storageTurn();
+                else co_await _input();
+            }
+        } else if (_rxType == ZEOF) {
+            // Confirm only once every byte is on disk, else ask for the tail
+            if (getPos(_rxFlags) == _bytesTransferred) {
+                while (!_storageReadyFor(0)) co_await _storageTurn();
+                if (_storageFailed() || !_finishSink(true)) {
+                    _state = ZModemEngine::STATE_ERROR;
+                    co_return;
+                }
+                // Held to the end of the tick, for the next ZFILE's answer
+                _sendRinit();
+                _fileEnded = true;
+                _rinitDue = true;
+            } else {
+                uint8_t pos[4];
+                putPos(pos, _bytesTransferred);
+                _reply(ZRPOS, pos);
+            }
+        } else if (_rxType == ZFIN) {
+            _reply(ZFIN, ZERO_FLAGS);
+            _state = ZModemEngine::STATE_COMPLETE;
+            co_return;
+        }
+    }
+}
+
+// Feed the ZFILE subpacket decoder. 1 when the subpacket is finished (good or
+// corrupt), 0 when it needs more input, -1 when it overflows.
+int ZModemCoEngine::_readFileInfo() {
+    size_t used;
+    SubpacketResult r = _fileInfo.feed(_inBuf, _inBufLen, _fileInfoBuffer, FILE_INFO_SIZE, used);
+    if (r == SUB_OVERSIZE) return -1;
+    ZModemFraming::consume(_inBuf, _inBufLen, used);
+    if (used > 0) _progressed = true;
+    if (r == SUB_INCOMPLETE) return 0;
+    if (r == SUB_BAD_CRC) return 1; // wait for the sender to repeat ZFILE
+
+    if (!_fileAnnounced) {
+        getFileInfo(_fileInfoBuffer, _fileInfo.index, _filename, FILENAME_MAX_LEN, _fileSize);
+        _fileSeq = _rxFileSeq;
+        _fileAnnounced = true;
+        if (!_announce()) return -1;
+        _answerFile();
+    } else if (_rxFileSeq == (uint8_t)(_fileSeq + 1)) {
+        if (_endFile()) {
+            getFileInfo(_fileInfoBuffer, _fileInfo.index, _filename, FILENAME_MAX_LEN, _fileSize);
+            _switchFile();
+            _answerFile();
+        } else if (_state == ZModemEngine::STATE_ERROR) {
+            return -1;
+        }
+    } else if (_rxFileSeq == _fileSeq) {
+        _answerFile();
+    }
+    _fileInfo.reset();
+    _pool->release(_fileInfoBuffer);
+    _fileInfoBuffer = nullptr;
+    return 1;
+}
+
+// As ZModemEngine::_readDataSubpacket(); a plain function so its 512-byte
+// decode buffer stays on the stack instead of in the coroutine frame
+bool ZModemCoEngine::_readDataSubpacket() {
+    const size_t SUBBUF_SZ = 512;
+    uint8_t stackBuf[SUBBUF_SZ];
+    size_t span = SUBBUF_SZ;
+    uint8_t* subbuf = _sinkSpan(span);
+    if (!subbuf || span < SUBBUF_SZ) subbuf = stackBuf;
+    size_t subLen;
+    size_t used;
+    uint8_t pos[4];
+
+    SubpacketResult r = decodeSubpacket(_inBuf, _inBufLen, subbuf, SUBBUF_SZ, subLen, used);
+    if (r == SUB_RESYNC) {
+        ZModemFraming::consume(_inBuf, _inBufLen, used);
+        _progressed = true;
+        return true;
+    }
+    if (r == SUB_OK && _rxDataPos == _bytesTransferred && subLen > 0 && !_storageReadyFor(subLen)) {
+        return false;
+    }
+    if (r == SUB_OK || r == SUB_BAD_CRC) {
+        ZModemFraming::consume(_inBuf, _inBufLen, used);
+        _progressed = true;
+        _touchActivity();
+        if (r == SUB_BAD_CRC || _rxDataPos > _bytesTransferred) {
+            if (r == SUB_OK) _stageAhead(subbuf, subLen);
+            putPos(pos, _bytesTransferred);
+            _reply(ZRPOS, pos);
+        } else if (_rxDataPos == _bytesTransferred) {
+            if (subLen > 0 && _sink) {
+                _writeSink(subbuf, subLen);
+                _bytesTransferred += subLen;
+            }
+            if (_staged && _sink->size() > _bytesTransferred) {
+                _bytesTransferred = _sink->size();
+                putPos(pos, _bytesTransferred);
+                _reply(ZRPOS, pos);
+            } else {
+                putPos(pos, _bytesTransferred);
+                _reply(ZACK, pos);
+            }
+        } else {
+            putPos(pos, _rxDataPos + subLen);
+            _reply(ZACK, pos);
+        }
+        return true;
+    }
+
+    if (_inBufLen == IN_BUF_SIZE || r == SUB_OVERSIZE) {
+        _inBufLen = 0;
+        _progressed = true;
+        putPos(pos, _bytesTransferred);
+        _reply(ZRPOS, pos);
+        return true;
+    }
+    return false;
+}
+
+// --- Multi-file receive (as ZModemEngine) ---
+
+void ZModemCoEngine::_sendRinit() {
+    if (!_rinitDue) return;
+    _rinitDue = false;
+    uint8_t flags[4] = {0, 0, 0, 0};
+    flags[ZFSEQ] = _fileSeq;
+    sendHexHeader(*_io, ZRINIT, flags);
+}
+
+void ZModemCoEngine::_reply(uint8_t type, const uint8_t* flags) {
+    _sendRinit();
+    sendHexHeader(*_io, type, flags);
+}
+
+bool ZModemCoEngine::_endFile() {
+    if (_fileEnded || _skippedCur) return true;
+    if (_bytesTransferred != _fileSize) {
+        uint8_t pos[4];
+        putPos(pos, _bytesTransferred);
+        _reply(ZRPOS, pos);
+        return false;
+    }
+    if (!_storageReadyFor(0)) return false; // the sender repeats ZFILE
+    if (_storageFailed() || !_finishSink(true)) {
+        _state = ZModemEngine::STATE_ERROR;
+        return false;
+    }
+    _fileEnded = true;
+    return true;
+}
+
+void ZModemCoEngine::_switchFile() {
+    _fileSeq = _rxFileSeq;
+    _followUp = true;
+    _fileEnded = false;
+    _sinkDone = false;
+    _staged = false;
+    _rxDataPos = 0;
+    size_t at = 0;
+    _skippedCur = !_nextFileFn || !_nextFileFn(_nextFileCtx, _filename, _fileSize, at) ||
+                  (_sink && !_sink->expect(_fileSize));
+    if (_skippedCur) {
+        _sinkDone = true;
+        at = 0;
+    }
+    _bytesTransferred = at;
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) _coalescer.begin(_pool, at);
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.reset();
+#endif
+}
+
+void ZModemCoEngine::_answerFile() {
+    uint8_t flags[4] = {0, 0, 0, 0};
+    if (_followUp) {
+        // Both headers in one packet (see ZModemEngine::_answerFile())
+        if (_io->availableForWrite() < (int)(2 * HEX_HEADER_LEN)) _io->flush();
+        _rinitDue = false;
+        flags[ZFSEQ] = (uint8_t)(_fileSeq - 1);
+        sendHexHeader(*_io, ZRINIT, flags);
+    }
+    if (_skippedCur) {
+        flags[ZFSEQ] = _fileSeq;
+        sendHexHeader(*_io, ZSKIP, flags);
+    } else {
+        putPos(flags, _bytesTransferred);
+        _reply(ZRPOS, flags);
+    }
+}
+
+// --- File access (as ZModemEngine) ---
+
+bool ZModemCoEngine::_storageReadyFor(size_t need) {
+    if (need == 0) flushWrites();
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage && !_storage->ready(need)) {
+        _storageNeed = need;
+        _storageWait = true;
+        return false;
+    }
+#else
+    (void)need;
+#endif
+    return true;
+}
+
+bool ZModemCoEngine::_storageReady() {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->ready(_storageNeed);
+#endif
+    return true;
+}
+
+bool ZModemCoEngine::_storageFailed() const {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->failed();
+#endif
+    return _writeFailed;
+}
+
+size_t ZModemCoEngine::_sourceRemaining() {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->remaining();
+#endif
+    return _source ? _source->remaining() : 0;
+}
+
+size_t ZModemCoEngine::_readSource(uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        int r = _storage->read(buf, n);
+        return r > 0 ? (size_t)r : 0;
+    }
+#endif
+    return _source ? _source->read(buf, n) : 0;
+}
+
+const uint8_t* ZModemCoEngine::_readChunk(size_t& len) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (!_storage)
+#endif
+    {
+        len = CHUNK_SIZE;
+        const uint8_t* p = _source ? _source->readSpan(len) : nullptr;
+        if (p) return p;
+    }
+    len = _readSource(_lastDataBuf, CHUNK_SIZE);
+    return _lastDataBuf;
+}
+
+void ZModemCoEngine::_seekSource(size_t pos) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        _storage->seek(pos);
+        return;
+    }
+#endif
+    if (_source) _source->seek(pos);
+}
+
+void ZModemCoEngine::_writeSink(const uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.update(_bytesTransferred, buf, n);
+#endif
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        _storage->write(buf, n);
+        return;
+    }
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) {
+        if (!_coalescer.write(_sink, buf, n)) _writeFailed = true;
+        return;
+    }
+#endif
+    if (_sink->write(buf, n) != n) _writeFailed = true;
+}
+
+uint8_t* ZModemCoEngine::_sinkSpan(size_t& n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return nullptr;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return nullptr;
+#endif
+    return _sink ? _sink->writeSpan(n) : nullptr;
+}
+
+void ZModemCoEngine::_stageAhead(const uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return;
+#endif
+    if (_sink && n > 0 && _sink->stage(_rxDataPos, buf, n)) _staged = true;
+}
+
+bool ZModemCoEngine::_announce() {
+    if (_sink && !_sink->expect(_fileSize)) return false;
+    if (!_announceFn) return true;
+    size_t at = _bytesTransferred;
+    if (!_announceFn(_announceCtx, _filename, _fileSize, at)) return false;
+    if (at != _bytesTransferred) {
+        _bytesTransferred = at;
+#if AKZ_HAVE_WRITE_COALESCER
+        // Nothing is gathered yet; realign the units to the new offset
+        if (_coalescer.isActive()) _coalescer.begin(_pool, at);
+#endif
+    }
+    return true;
+}
+
+bool ZModemCoEngine::_finishSink(bool ok) {
+    if (_sinkDone || !_sink) return true;
+    _sinkDone = true;
+    if (_sink->finalize(ok) || !ok) return true;
+    _writeFailed = true;
+    return false;
+}
+
+void ZModemCoEngine::_fillInput() {
+    if (!_io || !_inBuf) return;
+    int avail = _io->available();
+    if (avail <= 0) return;
+    size_t space = IN_BUF_SIZE - _inBufLen;
+    if (space == 0) return;
+    int toRead = avail < (int)space ? avail : (int)space;
+    for (int i = 0; i < toRead; ++i) {
+        int c = _io->read();
+        if (c == -1) break;
+        _inBuf[_inBufLen++] = (uint8_t)c;
+    }
+}
+
+#endif // AKZ_HAVE_COROUTINES
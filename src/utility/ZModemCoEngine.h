@@ -0,0 +1,286 @@
+/**
+ * @file ZModemCoEngine.h
+ * @author Akita Engineering
+ * @brief Coroutine implementation of the ZModem engine. Each transfer is one
+ * C++20 coroutine that awaits a received frame, an expired retry timer or
+ * its per-tick send opportunity, instead of a hand-written state machine.
+ * Same API, wire format and timing as ZModemEngine (XMODEM is not ported).
+ * Built only with AKZ_HAVE_COROUTINES.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_CO_ENGINE_H
+#define ZMODEM_CO_ENGINE_H
+
+#include "../AkitaMeshZmodemConfig.h"
+
+#if AKZ_HAVE_COROUTINES
+
+#include <Arduino.h>
+#include <Stream.h>
+#include <FS.h>
+#include "ZModemEngine.h"
+#include "ZModemCoroutine.h"
+
+class ZModemCoEngine {
+public:
+    typedef ZModemEngine::State State;
+
+    ZModemCoEngine();
+    ~ZModemCoEngine();
+
+    void begin(Stream& ioStream);
+    void setBufferPool(ZModemBufferPool* pool) { _pool = pool; }
+    void setTimerWheel(ZModemTimerWheel* wheel) { _timers = wheel; }
+
+    void setFileStream(File* file, const String& filename, size_t fileSize);
+    void setFileStream(File* file, const char* filename, size_t fileSize);
+    // As ZModemEngine::setSource() / setSink()
+    void setSource(ZModemSource* source, const char* filename, size_t fileSize);
+    void setSink(ZModemSink* sink) { setSource(nullptr, nullptr, 0); _sink = sink; }
+    // Receiver only, after setFileStream(): the file already holds this many
+    // bytes (opened for append), so the sender is asked to continue from here
+    void setResumeOffset(size_t offset) { _bytesTransferred = offset; }
+    // As ZModemEngine::onAnnounce()
+    void onAnnounce(ZModemEngine::AnnounceFn fn, void* ctx) { _announceFn = fn; _announceCtx = ctx; }
+    // As ZModemEngine::onNextFile() / onBatch()
+    void onNextFile(ZModemEngine::AnnounceFn fn, void* ctx) { _nextFileFn = fn; _nextFileCtx = ctx; }
+    void onBatch(ZModemEngine::NextFileFn next, ZModemEngine::FileDoneFn done, void* ctx) {
+        _batchNextFn = next;
+        _batchDoneFn = done;
+        _batchCtx = ctx;
+    }
+    // As ZModemEngine::setCrashRecovery() / isCrashRecovery()
+    void setCrashRecovery(bool on) { _crashRecovery = on; }
+    bool isCrashRecovery() const { return _crashRecovery; }
+    // As ZModemEngine::setAcceptsJoins() / peerAcceptsJoins()
+    void setAcceptsJoins(bool on) { _rinitFlags[ZF1] = on ? CANJOIN : 0; }
+    bool peerAcceptsJoins() const { return _peerJoins; }
+#if AKZ_ENABLE_STORAGE_WORKER
+    // As ZModemEngine::setStorage()
+    void setStorage(ZModemStorageChannel* channel) { _storage = channel; }
+#endif
+
+    bool send(unsigned long timeout, bool skipHandshake = false);
+    bool receive(unsigned long timeout, bool joined = false);
+    void abort();
+    void flushWrites();
+    size_t pendingWrites() const;
+#if AKZ_ENABLE_FILE_INDEX
+    // As ZModemEngine::receivedSha256()
+    bool receivedSha256(uint8_t out[ZModemSha256::DIGEST_SIZE]) { return _rxHash.finish(_bytesTransferred, out); }
+#endif
+    void setHold(bool hold, uint32_t maxDeferMs);
+
+    // As ZModemEngine::loop(): resumes the transfer coroutine for one tick
+    int loop(uint32_t budgetUs = 0);
+
+    size_t getBytesTransferred() const { return _bytesTransferred; }
+    size_t getAckedBytes() const { return _lastDataPending ? _lastDataPos : _bytesTransferred; }
+    size_t getFileSize() const { return _fileSize; }
+    const char* getFilename() const { return _filename; }
+    State getState() const { return _state; }
+    bool hasPendingWork();
+    bool isWaitingOnStorage() const { return _storageWait; }
+    bool hasWriteError() const { return _storageFailed(); }
+    uint32_t getMaxLoopUs() const { return _maxLoopUs; }
+    // Bytes currently borrowed from the buffer pool, coroutine frame included
+    size_t getBorrowedBytes() const;
+    // Size of the running coroutine's frame (0 when idle)
+    size_t getFrameBytes() const { return _task.frameBytes(); }
+    // As ZModemEngine::committedBytes(), plus the frame (one slab in practice)
+    static size_t committedBytes(bool sending) {
+        return ZModemEngine::committedBytes(sending) + ZModemBufferPool::SLAB_SIZE;
+    }
+
+    static const size_t IN_BUF_SIZE = ZModemEngine::IN_BUF_SIZE;
+    static const size_t CHUNK_SIZE = ZModemEngine::CHUNK_SIZE;
+    static const size_t FILE_INFO_SIZE = ZModemEngine::FILE_INFO_SIZE;
+
+    // Coroutine frames are borrowed from here (see ZModemCoTask)
+    ZModemBufferPool* framePool() const { return _pool; }
+
+private:
+    // What a session coroutine wakes up for
+    enum Event : uint8_t {
+        EV_NONE,
+        EV_FRAME,     // a header was parsed into _rxType/_rxFlags
+        EV_TIMER,     // the retry timer has expired (or was cancelled)
+        EV_TX_CREDIT  // this tick's send opportunity, no timer due
+    };
+
+    // co_await _event(): the next buffered header, else once per tick the
+    // timer/TX event, else suspend until the next tick
+    struct EventAwaiter {
+        ZModemCoEngine* engine;
+        Event ev;
+        bool await_ready() { ev = engine->_nextEvent(); return ev != EV_NONE; }
+        void await_suspend(std::coroutine_handle<>) {}
+        Event await_resume() { return ev != EV_NONE ? ev : engine->_nextEvent(); }
+    };
+    // co_await _input(): more bytes for a split subpacket, else suspend
+    // until the next tick
+    struct InputAwaiter {
+        ZModemCoEngine* engine;
+        bool await_ready() { return engine->_moreInput(); }
+        void await_suspend(std::coroutine_handle<>) {}
+        void await_resume() {}
+    };
+    // co_await _storageTurn(): suspend until the storage channel is ready;
+    // loop() skips ticks until then (see _storageWait)
+    struct StorageAwaiter {
+        ZModemCoEngine* engine;
+        bool await_ready() {
+            if (!engine->_storageReady()) return false;
+            engine->_storageWait = false;
+            return true;
+        }
+        void await_suspend(std::coroutine_handle<>) {}
+        void await_resume() {}
+    };
+    EventAwaiter _event() { return EventAwaiter{this, EV_NONE}; }
+    InputAwaiter _input() { return InputAwaiter{this}; }
+    StorageAwaiter _storageTurn() { return StorageAwaiter{this}; }
+    Event _nextEvent();
+    bool _moreInput();
+
+    ZModemCoTask _senderTask(bool skipHandshake);
+    ZModemCoTask _receiverTask();
+    ZModemCoTask _task;
+
+    Stream* _io = nullptr;
+    ZModemSource* _source = nullptr;
+    ZModemSink* _sink = nullptr;
+    ZModemFileSource _fileSource;
+    ZModemFileSink _fileSink;
+    bool _sinkDone = false;
+    bool _finishSink(bool ok);
+    ZModemEngine::AnnounceFn _announceFn = nullptr;
+    void* _announceCtx = nullptr;
+    bool _announce();
+    // Multi-file sessions (see ZModemEngine)
+    enum NextFile : uint8_t { NEXT_UNKNOWN, NEXT_NONE, NEXT_PIPELINED };
+    uint8_t _fileSeq = 0;
+    NextFile _next = NEXT_UNKNOWN;
+    size_t _nextInfoLen = 0;
+    bool _eofSent = false;
+    ZModemEngine::NextFileFn _batchNextFn = nullptr;
+    ZModemEngine::FileDoneFn _batchDoneFn = nullptr;
+    void* _batchCtx = nullptr;
+    void _sendEof();
+    void _peekNext();
+    bool _nextFile(bool delivered);
+    uint8_t _rxFileSeq = 0;
+    bool _fileEnded = false;
+    bool _followUp = false;
+    bool _skippedCur = false;
+    bool _rinitDue = false;
+    ZModemEngine::AnnounceFn _nextFileFn = nullptr;
+    void* _nextFileCtx = nullptr;
+    bool _endFile();
+    void _switchFile();
+    void _answerFile();
+    void _sendRinit();
+    void _reply(uint8_t type, const uint8_t* flags);
+    bool _staged = false;        // the sink holds chunks from past a gap
+    void _stageAhead(const uint8_t* buf, size_t n);
+    // File access, inline or through the storage worker (see ZModemEngine)
+#if AKZ_ENABLE_STORAGE_WORKER
+    ZModemStorageChannel* _storage = nullptr;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    ZModemWriteCoalescer _coalescer;
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    ZModemRunningSha256 _rxHash;
+#endif
+    bool _writeFailed = false;
+    bool _storageWait = false;
+    size_t _storageNeed = 0;
+    bool _storageReadyFor(size_t need);
+    bool _storageReady();
+    bool _storageFailed() const;
+    size_t _sourceRemaining();
+    size_t _readSource(uint8_t* buf, size_t n);
+    const uint8_t* _readChunk(size_t& len);
+    uint8_t* _sinkSpan(size_t& n);
+    void _seekSource(size_t pos);
+    void _writeSink(const uint8_t* buf, size_t n);
+
+    static const size_t FILENAME_MAX_LEN = 128;
+    char _filename[FILENAME_MAX_LEN];
+    size_t _fileSize = 0;
+    size_t _bytesTransferred = 0;
+    unsigned long _timeoutMs = 0;
+
+    State _state = ZModemEngine::STATE_IDLE;
+    bool _isSender = false;
+
+    ZModemBufferPool* _pool = nullptr;
+    bool _acquireBuffers();
+    void _releaseBuffers();
+
+    ZModemTimerWheel* _timers = nullptr;
+    ZModemTimer _timeoutTimer;
+    ZModemTimer _retryTimer;
+    ZModemTimer _holdTimer;
+    bool _hold = false;
+    uint32_t _holdMaxMs = 0;
+    bool _holdDeferred();
+    bool _wake = false;
+    // Per-tick bookkeeping for the awaiters
+    bool _tickEventSent = false; // EV_TIMER/EV_TX_CREDIT already delivered
+    bool _progressed = false;    // a unit of work done since the last budget check
+    unsigned long _tickStartUs = 0;
+    uint32_t _tickBudgetUs = 0;
+    bool _yielded = false;
+    uint32_t _maxLoopUs = 0;
+    bool _budgetSpent();
+    static void _onTimer(void* ctx);
+    void _touchActivity() { _timers->arm(_timeoutTimer, _timeoutMs); }
+    void _cancelTimers();
+    void _enterState(State s);
+    bool _isWaiting() const;
+
+    // Last received header
+    uint8_t _rxType = 0;
+    uint8_t _rxFlags[4];
+
+    // Sender retransmit state
+    uint8_t* _lastDataBuf = nullptr;
+    const uint8_t* _lastData = nullptr;
+    size_t _lastDataLen = 0;
+    size_t _lastDataPos = 0;
+    bool _lastDataPending = false;
+    unsigned long _retryIntervalMs;
+    int _retryCount = 0;
+    void _sendFileInfo();
+    void _sendZFile(uint8_t seq, const uint8_t* payload, size_t len);
+    void _sendChunk();
+    void _resendChunk();
+
+    // Receiver state
+    uint8_t* _fileInfoBuffer = nullptr;
+    ZModemFraming::FileInfoDecoder _fileInfo;
+    size_t _rxDataPos = 0;
+    bool _fileAnnounced = false;
+    bool _crashRecovery = false;
+    uint8_t _rinitFlags[4] = {0, 0, 0, 0};
+    bool _peerJoins = false;
+    int _readFileInfo();
+    bool _readDataSubpacket();
+
+    uint8_t* _inBuf = nullptr;
+    size_t _inBufLen = 0;
+    void _fillInput();
+
+    static const int MAX_RETRIES = 5;
+    static const unsigned long DEFAULT_BASE_RETRY_MS = 500;
+    static const unsigned long MAX_RETRY_INTERVAL_MS = 8000;
+    static const unsigned long HEADER_RETRY_MS = 1000;
+    static const unsigned long KEEPALIVE_MS = 3000;
+};
+
+#endif // AKZ_HAVE_COROUTINES
+
+#endif // ZMODEM_CO_ENGINE_H
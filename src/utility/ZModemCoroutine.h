@@ -0,0 +1,106 @@
+/**
+ * @file ZModemCoroutine.h
+ * @author Akita Engineering
+ * @brief Minimal C++20 coroutine task types. ZModemCoTask frames are
+ * borrowed from the owner's slab pool, so a session coroutine never touches
+ * the heap and its frame is returned with the rest of the session buffers.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_COROUTINE_H
+#define ZMODEM_COROUTINE_H
+
+#include "../AkitaMeshZmodemConfig.h"
+
+#if AKZ_HAVE_COROUTINES
+
+#include <Arduino.h>
+#include <coroutine>
+#include <cstddef>
+#include "ZModemBufferPool.h"
+
+// Lazily started, resumed explicitly by its owner. The coroutine must be
+// called inside a PoolScope naming the pool its frame is borrowed from; if
+// the pool is dry (or none is set) the task comes back empty instead of
+// allocating.
+class ZModemCoTask {
+public:
+    // Pool for the frames of coroutines called on this thread while in scope
+    class PoolScope {
+    public:
+        explicit PoolScope(ZModemBufferPool* pool) : _prev(_framePool) { _framePool = pool; }
+        ~PoolScope() { _framePool = _prev; }
+        PoolScope(const PoolScope&) = delete;
+        PoolScope& operator=(const PoolScope&) = delete;
+    private:
+        ZModemBufferPool* _prev;
+    };
+
+    struct promise_type {
+        // The plain form, so the frame's allocation and the usual operator
+        // delete below are a matching pair
+        static void* operator new(size_t n) noexcept {
+            ZModemBufferPool* pool = _framePool;
+            uint8_t* raw = pool ? pool->acquire(n + HEADER_SIZE) : nullptr;
+            if (!raw) return nullptr;
+            FrameHeader* h = reinterpret_cast<FrameHeader*>(raw);
+            h->pool = pool;
+            h->size = n;
+            return raw + HEADER_SIZE;
+        }
+        static void operator delete(void* p, size_t) noexcept {
+            uint8_t* raw = static_cast<uint8_t*>(p) - HEADER_SIZE;
+            reinterpret_cast<FrameHeader*>(raw)->pool->release(raw);
+        }
+        static ZModemCoTask get_return_object_on_allocation_failure() noexcept { return ZModemCoTask(); }
+
+        ZModemCoTask get_return_object() noexcept {
+            return ZModemCoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {} // built with -fno-exceptions
+    };
+
+    ZModemCoTask() = default;
+    ZModemCoTask(ZModemCoTask&& o) noexcept : _h(o._h) { o._h = nullptr; }
+    ZModemCoTask& operator=(ZModemCoTask&& o) noexcept {
+        if (this != &o) { reset(); _h = o._h; o._h = nullptr; }
+        return *this;
+    }
+    ZModemCoTask(const ZModemCoTask&) = delete;
+    ZModemCoTask& operator=(const ZModemCoTask&) = delete;
+    ~ZModemCoTask() { reset(); }
+
+    bool valid() const { return (bool)_h; }
+    bool done() const { return !_h || _h.done(); }
+    void resume() { if (_h && !_h.done()) _h.resume(); }
+    // Destroy the frame (suspended or finished) and give it back to the pool
+    void reset() { if (_h) { _h.destroy(); _h = nullptr; } }
+
+    // Compiler-chosen frame size, and what it actually holds in the pool
+    size_t frameBytes() const { return _h ? _header()->size : 0; }
+    size_t borrowedBytes() const { return _h ? ZModemBufferPool::footprint(_header()->size + HEADER_SIZE) : 0; }
+
+private:
+    struct FrameHeader {
+        ZModemBufferPool* pool;
+        size_t size;
+    };
+    // Keep the frame itself at the alignment operator new would give it
+    static const size_t HEADER_SIZE =
+        (sizeof(FrameHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+    explicit ZModemCoTask(std::coroutine_handle<promise_type> h) : _h(h) {}
+    const FrameHeader* _header() const {
+        return reinterpret_cast<const FrameHeader*>(static_cast<const uint8_t*>(_h.address()) - HEADER_SIZE);
+    }
+
+    std::coroutine_handle<promise_type> _h = nullptr;
+    static inline thread_local ZModemBufferPool* _framePool = nullptr;
+};
+
+#endif // AKZ_HAVE_COROUTINES
+
+#endif // ZMODEM_COROUTINE_H
@@ -0,0 +1,109 @@
+/**
+ * @file ZModemDataIO.cpp
+ * @author Akita Engineering
+ * @brief Stock ZModemSource / ZModemSink implementations.
+ * @version 1.1.0
+ */
+
+#include "ZModemDataIO.h"
+
+// --- ZModemFileSource ---
+
+size_t ZModemFileSource::remaining() {
+    if (!_file) return 0;
+    return _ranged ? _length - _pos : _file->available();
+}
+
+bool ZModemFileSource::seek(size_t pos) {
+    if (!_file) return false;
+    if (!_ranged) return _file->seek(pos);
+    if (pos > _length || !_file->seek(_start + pos)) return false;
+    _pos = pos;
+    return true;
+}
+
+size_t ZModemFileSource::read(uint8_t* dst, size_t n) {
+    if (!_file) return 0;
+    if (!_ranged) return _file->read(dst, n);
+    if (n > _length - _pos) n = _length - _pos;
+    size_t got = _file->read(dst, n);
+    _pos += got;
+    return got;
+}
+
+// --- ZModemMemorySource ---
+
+bool ZModemMemorySource::seek(size_t pos) {
+    if (pos > _len) return false;
+    _pos = pos;
+    return true;
+}
+
+size_t ZModemMemorySource::read(uint8_t* dst, size_t n) {
+    size_t left = _len - _pos;
+    if (n > left) n = left;
+    memcpy(dst, _data + _pos, n);
+    _pos += n;
+    return n;
+}
+
+const uint8_t* ZModemMemorySource::readSpan(size_t& n) {
+    size_t left = _len - _pos;
+    if (n > left) n = left;
+    const uint8_t* p = _data + _pos;
+    _pos += n;
+    return p;
+}
+
+#if defined(__AVR__)
+size_t ZModemProgmemSource::read(uint8_t* dst, size_t n) {
+    size_t left = _len - _pos;
+    if (n > left) n = left;
+    memcpy_P(dst, _data + _pos, n);
+    _pos += n;
+    return n;
+}
+#endif
+
+// --- ZModemMemorySink ---
+
+size_t ZModemMemorySink::write(const uint8_t* src, size_t n) {
+    size_t room = _cap - _len;
+    if (n > room) n = room;
+    // Data decoded in place via writeSpan() is already where it belongs
+    if (src != _buf + _len) memcpy(_buf + _len, src, n);
+    _len += n;
+    return n;
+}
+
+uint8_t* ZModemMemorySink::writeSpan(size_t& n) {
+    size_t room = _cap - _len;
+    if (n > room) n = room;
+    return _buf + _len;
+}
+
+// --- ZModemCallbackSource / ZModemCallbackSink ---
+
+bool ZModemCallbackSource::seek(size_t pos) {
+    if (pos > _size) return false;
+    _pos = pos;
+    return true;
+}
+
+size_t ZModemCallbackSource::read(uint8_t* dst, size_t n) {
+    size_t left = _size - _pos;
+    if (n > left) n = left;
+    if (n == 0 || !_read) return 0;
+    size_t got = _read(_pos, dst, n, _ctx);
+    if (got > n) got = n;
+    _pos += got;
+    return got;
+}
+
+size_t ZModemCallbackSink::write(const uint8_t* src, size_t n) {
+    if (!_write) return 0;
+    size_t took = _write(_pos, src, n, _ctx);
+    if (took > n) took = n;
+    _pos += took;
+    return took;
+}
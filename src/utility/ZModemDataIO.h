@@ -0,0 +1,182 @@
+/**
+ * @file ZModemDataIO.h
+ * @author Akita Engineering
+ * @brief Where a send's data comes from and a receive's data goes: the
+ * ZModemSource / ZModemSink interfaces and the stock implementations for FS
+ * files, RAM buffers, flash (PROGMEM) blobs and user callbacks. Memory-backed
+ * ones expose their bytes in place, so the engine reads and decodes without
+ * an intermediate copy.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_DATA_IO_H
+#define ZMODEM_DATA_IO_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Data to send. Read sequentially from the start; seek() moves back (or
+// forward) when the receiver asks for a resend from another offset.
+class ZModemSource {
+public:
+    virtual ~ZModemSource() {}
+    virtual size_t size() = 0;
+    // Bytes from the position to the end
+    virtual size_t remaining() = 0;
+    virtual bool seek(size_t pos) = 0;
+    // Copy up to n bytes from the position and advance past them
+    virtual size_t read(uint8_t* dst, size_t n) = 0;
+    // Up to n bytes at the position, in place, advancing past them (n is set
+    // to the count). nullptr if the data is not addressable; use read().
+    virtual const uint8_t* readSpan(size_t& n) { n = 0; return nullptr; }
+    // The file behind the source, for the storage worker; nullptr if none
+    virtual File* file() { return nullptr; }
+};
+
+// Destination of received data, appended in order
+class ZModemSink {
+public:
+    virtual ~ZModemSink() {}
+    // Bytes held so far; a receive continues from here
+    virtual size_t size() = 0;
+    // Append n bytes. A short count fails the transfer.
+    virtual size_t write(const uint8_t* src, size_t n) = 0;
+    // Room for up to n bytes right after the data held, in place (n is set
+    // to the room). Bytes placed there count once passed to write() with
+    // that same pointer, which then does not copy. nullptr if not in memory.
+    virtual uint8_t* writeSpan(size_t& n) { n = 0; return nullptr; }
+    // A chunk that arrived ahead of size(), at 'pos'. A sink that keeps it
+    // appends it once the data before it is written, moving size() past
+    // it, and returns true. False (the default) drops it; it is resent.
+    virtual bool stage(size_t pos, const uint8_t* src, size_t n) { (void)pos; (void)src; (void)n; return false; }
+    // Size announced in ZFILE, before its data. False refuses the file.
+    virtual bool expect(size_t size) { (void)size; return true; }
+    // Flash-backed: small writes are gathered (AKZ_WRITE_COALESCE_BYTES)
+    virtual bool gathersWrites() const { return false; }
+    virtual File* file() { return nullptr; }
+    // Called once: with true at ZEOF once every byte is written (false
+    // fails the transfer before it is confirmed), or with false when the
+    // transfer ends without getting there
+    virtual bool finalize(bool ok) { (void)ok; return true; }
+};
+
+// --- Files ---
+
+class ZModemFileSource : public ZModemSource {
+public:
+    explicit ZModemFileSource(File* file = nullptr) : _file(file) {}
+    void attach(File* file) { _file = file; _ranged = false; }
+    // Only bytes [start, start + length) of the file, sent as if they were
+    // all of it. The file must hold them; seek(0) before the first read.
+    void setRange(size_t start, size_t length) { _start = start; _length = length; _pos = 0; _ranged = true; }
+    size_t size() override { return _ranged ? _length : (_file ? _file->size() : 0); }
+    size_t remaining() override;
+    bool seek(size_t pos) override;
+    size_t read(uint8_t* dst, size_t n) override;
+    // None while ranged: the storage worker reads files to their end
+    File* file() override { return _ranged ? nullptr : _file; }
+private:
+    File* _file;
+    bool _ranged = false;
+    size_t _start = 0;
+    size_t _length = 0;
+    size_t _pos = 0;    // ranged: offset within the range
+};
+
+class ZModemFileSink : public ZModemSink {
+public:
+    explicit ZModemFileSink(File* file = nullptr) : _file(file) {}
+    void attach(File* file) { _file = file; }
+    size_t size() override { return _file ? _file->size() : 0; }
+    size_t write(const uint8_t* src, size_t n) override { return _file ? _file->write(src, n) : 0; }
+    bool gathersWrites() const override { return true; }
+    File* file() override { return _file; }
+private:
+    File* _file;
+};
+
+// --- Memory ---
+
+// A buffer in RAM, sent in place. It must stay valid and unchanged until
+// the session ends.
+class ZModemMemorySource : public ZModemSource {
+public:
+    ZModemMemorySource(const void* data, size_t len) : _data((const uint8_t*)data), _len(len) {}
+    size_t size() override { return _len; }
+    size_t remaining() override { return _len - _pos; }
+    bool seek(size_t pos) override;
+    size_t read(uint8_t* dst, size_t n) override;
+    const uint8_t* readSpan(size_t& n) override;
+protected:
+    const uint8_t* _data;
+    size_t _len;
+    size_t _pos = 0;
+};
+
+// A constant blob in flash. ESP32 maps flash into the address space, so it
+// is sent in place like RAM; on AVR it is copied out with memcpy_P.
+class ZModemProgmemSource : public ZModemMemorySource {
+public:
+    ZModemProgmemSource(const void* data, size_t len) : ZModemMemorySource(data, len) {}
+#if defined(__AVR__)
+    size_t read(uint8_t* dst, size_t n) override;
+    const uint8_t* readSpan(size_t& n) override { n = 0; return nullptr; }
+#endif
+};
+
+// Received data lands straight in a caller-owned buffer. More data than
+// 'capacity' fails the transfer. length() is the byte count held.
+class ZModemMemorySink : public ZModemSink {
+public:
+    ZModemMemorySink(void* buf, size_t capacity) : _buf((uint8_t*)buf), _cap(capacity) {}
+    size_t size() override { return _len; }
+    size_t length() const { return _len; }
+    const uint8_t* data() const { return _buf; }
+    void clear() { _len = 0; }
+    size_t write(const uint8_t* src, size_t n) override;
+    uint8_t* writeSpan(size_t& n) override;
+private:
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _len = 0;
+};
+
+// --- Callbacks ---
+
+// Data produced on demand: read(pos, dst, n) fills dst with up to n bytes
+// starting at offset pos and returns the count
+class ZModemCallbackSource : public ZModemSource {
+public:
+    typedef size_t (*ReadFn)(size_t pos, uint8_t* dst, size_t n, void* ctx);
+    ZModemCallbackSource(size_t size, ReadFn read, void* ctx = nullptr) : _size(size), _read(read), _ctx(ctx) {}
+    size_t size() override { return _size; }
+    size_t remaining() override { return _size - _pos; }
+    bool seek(size_t pos) override;
+    size_t read(uint8_t* dst, size_t n) override;
+private:
+    size_t _size;
+    ReadFn _read;
+    void* _ctx;
+    size_t _pos = 0;
+};
+
+// Data consumed as it arrives: write(pos, src, n) gets each run of bytes in
+// order with its offset and returns how many it took; finalize (optional)
+// is ZModemSink::finalize()
+class ZModemCallbackSink : public ZModemSink {
+public:
+    typedef size_t (*WriteFn)(size_t pos, const uint8_t* src, size_t n, void* ctx);
+    typedef bool (*FinalizeFn)(bool ok, void* ctx);
+    ZModemCallbackSink(WriteFn write, FinalizeFn finalize = nullptr, void* ctx = nullptr)
+        : _write(write), _finalize(finalize), _ctx(ctx) {}
+    size_t size() override { return _pos; }
+    size_t write(const uint8_t* src, size_t n) override;
+    bool finalize(bool ok) override { return _finalize ? _finalize(ok, _ctx) : true; }
+private:
+    WriteFn _write;
+    FinalizeFn _finalize;
+    void* _ctx;
+    size_t _pos = 0;
+};
+
+#endif // ZMODEM_DATA_IO_H
@@ -8,37 +8,34 @@
 
 #include "ZModemEngine.h"
 
-// ZModem Control Frame End (CRCE is final, CRCG/CRCW are intermediate)
-#define ZCRCE 0x45
-#define ZCRCG 0x47
-#define ZCRCW 0x48
+using ZModemFraming::ZERO_FLAGS;
 
-// Helper constants
-const uint8_t ZERO_FLAGS[4] = {0, 0, 0, 0};
+#if AKZ_ENABLE_STORAGE_WORKER
+// A whole subpacket must fit the write queue, or the receiver would wait forever
+static_assert(ZModemStorageChannel::DEPTH * ZModemStorageChannel::BLOCK_SIZE >= ZModemEngine::IN_BUF_SIZE,
+              "AKZ_STORAGE_QUEUE_BLOCKS * AKZ_POOL_SLAB_SIZE must be at least ZModemEngine::IN_BUF_SIZE");
+#endif
 
 ZModemEngine::ZModemEngine() {
     _io = nullptr;
-    _file = nullptr;
     _state = STATE_IDLE;
     _rState = RSTATE_IDLE;
     _bytesTransferred = 0;
     _fileSize = 0;
     _isSender = false;
+    _filename[0] = '\0';
+    _inBufLen = 0;
 
-    // File-info parsing state
-    _fileInfoIndex = 0;
-    _fileInfoEscape = false;
-    _fileInfoAwaitingCRC = false;
-
-    // Sender/receiver timing (instance vars instead of function-local statics)
-    _senderLastSend = 0;
-    _receiverLastAck = 0;
+    // Timers only mark the engine runnable; loop() does the work
+    _timeoutTimer.setCallback(_onTimer, this);
+    _retryTimer.setCallback(_onTimer, this);
+    _xmodemTimer.setCallback(_onTimer, this);
+    _holdTimer.setCallback(_onTimer, this);
 
     // Retransmit state
     _lastDataLen = 0;
     _lastDataPos = 0;
     _lastDataPending = false;
-    _lastSendTime = 0;
     _baseRetryIntervalMs = DEFAULT_BASE_RETRY_MS;
     _retryIntervalMs = _baseRetryIntervalMs;
     // XMODEM cache init
@@ -47,6 +44,120 @@ ZModemEngine::ZModemEngine() {
     _xmodemLastPending = false;
 }
 
+ZModemEngine::~ZModemEngine() {
+    _cancelTimers();
+    _releaseBuffers();
+}
+
+void ZModemEngine::_onTimer(void* ctx) {
+    static_cast<ZModemEngine*>(ctx)->_wake = true;
+}
+
+void ZModemEngine::_touchActivity() {
+    _timers->arm(_timeoutTimer, _timeoutMs);
+}
+
+void ZModemEngine::_cancelTimers() {
+    if (!_timers) return;
+    _timers->cancel(_timeoutTimer);
+    _timers->cancel(_retryTimer);
+    _timers->cancel(_xmodemTimer);
+    _timers->cancel(_holdTimer);
+}
+
+// Sender state change: whatever the new state sends goes out immediately
+void ZModemEngine::_enterState(State s) {
+    _state = s;
+    _timers->cancel(_retryTimer);
+}
+
+bool ZModemEngine::hasPendingWork() {
+    if (_state == STATE_IDLE || _state == STATE_COMPLETE || _state == STATE_ERROR) return false;
+    if (_storageWait) return _storageReady();
+    return _wake || (_io && _io->available() > 0);
+}
+
+// True when every action the engine could take is gated on input or on an
+// armed timer, so loop() can be skipped until one of those happens
+bool ZModemEngine::_isWaiting() const {
+    if (_storageWait) return true;
+    if (!_isSender) return true; // receiver only reacts to input and keepalive
+    if (_xmodemEnabled) return false;
+    // Ready to stream a new chunk unless a hold defers it
+    if (_state == STATE_SEND_ZDATA && !_lastDataPending) return _hold && _holdTimer.isArmed();
+    return _retryTimer.isArmed();
+}
+
+void ZModemEngine::setHold(bool hold, uint32_t maxDeferMs) {
+    if (!_timers || hold == _hold) return;
+    _hold = hold;
+    _holdMaxMs = maxDeferMs;
+    if (hold) {
+        _timers->arm(_holdTimer, maxDeferMs);
+    } else {
+        _timers->cancel(_holdTimer);
+        _wake = true; // resume streaming straight away
+    }
+}
+
+// While held, new chunks wait; one is let through every _holdMaxMs so the
+// receiver of this stream keeps hearing from us and does not time out
+bool ZModemEngine::_holdDeferred() {
+    if (!_hold) return false;
+    if (_holdTimer.isArmed()) return true;
+    _timers->arm(_holdTimer, _holdMaxMs);
+    return false;
+}
+
+bool ZModemEngine::_acquireBuffers() {
+    if (!_pool) return false;
+    if (!_inBuf) _inBuf = _pool->acquire(IN_BUF_SIZE);
+    if (_isSender && !_lastDataBuf) _lastDataBuf = _pool->acquire(CHUNK_SIZE);
+    if (!_inBuf || (_isSender && !_lastDataBuf)) {
+        _releaseBuffers();
+        return false;
+    }
+#if AKZ_HAVE_WRITE_COALESCER
+    // Optional: with the pool too dry for it, each subpacket is written as is
+    if (!_isSender && _sink && _sink->gathersWrites()) _coalescer.begin(_pool, _bytesTransferred);
+#endif
+    _inBufLen = 0;
+    return true;
+}
+
+void ZModemEngine::_releaseBuffers() {
+    if (!_pool) return;
+#if AKZ_HAVE_WRITE_COALESCER
+    flushWrites();
+    _coalescer.end();
+#endif
+    if (!_isSender) _finishSink(false);
+    _pool->release(_inBuf);
+    _pool->release(_lastDataBuf);
+    _pool->release(_fileInfoBuffer);
+    _pool->release(_xmodemLastBlock);
+    _inBuf = nullptr;
+    _lastDataBuf = nullptr;
+    _fileInfoBuffer = nullptr;
+    _xmodemLastBlock = nullptr;
+    _inBufLen = 0;
+    _lastDataLen = 0;
+    _lastDataPending = false;
+    _xmodemLastPending = false;
+}
+
+size_t ZModemEngine::getBorrowedBytes() const {
+    size_t n = 0;
+    if (_inBuf) n += ZModemBufferPool::footprint(IN_BUF_SIZE);
+    if (_lastDataBuf) n += ZModemBufferPool::footprint(CHUNK_SIZE);
+    if (_fileInfoBuffer) n += ZModemBufferPool::footprint(FILE_INFO_SIZE);
+    if (_xmodemLastBlock) n += ZModemBufferPool::footprint(XMODEM_BLOCK_SIZE);
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) n += ZModemBufferPool::footprint(ZModemWriteCoalescer::UNIT);
+#endif
+    return n;
+}
+
 void ZModemEngine::begin(Stream& ioStream) {
     _io = &ioStream;
     _inBufLen = 0;
@@ -60,7 +171,14 @@ void ZModemEngine::setFileStream(File* file, const String& filename, size_t file
 }
 
 void ZModemEngine::setFileStream(File* file, const char* filename, size_t fileSize) {
-    _file = file;
+    _fileSource.attach(file);
+    _fileSink.attach(file);
+    setSource(file ? &_fileSource : nullptr, filename, fileSize);
+    _sink = file ? &_fileSink : nullptr;
+}
+
+void ZModemEngine::setSource(ZModemSource* source, const char* filename, size_t fileSize) {
+    _source = source;
     if (filename && filename[0]) {
         strncpy(_filename, filename, FILENAME_MAX_LEN - 1);
         _filename[FILENAME_MAX_LEN - 1] = '\0';
@@ -69,35 +187,62 @@ void ZModemEngine::setFileStream(File* file, const char* filename, size_t fileSi
     }
     _fileSize = fileSize;
     _bytesTransferred = 0;
+    _fileAnnounced = false;
 }
 
-bool ZModemEngine::send(unsigned long timeout) {
-    if (!_io || !_file) return false;
+bool ZModemEngine::send(unsigned long timeout, bool skipHandshake) {
+    if (!_io || !_source || !_timers) return false;
     _isSender = true;
-    _state = STATE_SEND_ZRQINIT;
+    if (!_acquireBuffers()) return false;
+    _storageWait = false;
+    _fileSeq = 0;
+    _next = NEXT_UNKNOWN;
+    _eofSent = false;
+    // A stream joining a live session to the same peer goes straight to ZFILE
+    _enterState(skipHandshake ? STATE_SEND_ZFILE : STATE_SEND_ZRQINIT);
     _timeoutMs = timeout;
     _operationStartTime = millis();
-    _lastActivity = millis();
+    _touchActivity();
     _retryCount = 0;
+    _wake = true;
     if (_debug) {
         _debug->print("ZModemEngine: send() started\n");
     }
     return true;
 }
 
-bool ZModemEngine::receive(unsigned long timeout) {
-    if (!_io) return false;
+bool ZModemEngine::receive(unsigned long timeout, bool joined) {
+    if (!_io || !_timers) return false;
     _isSender = false;
+    _sinkDone = false;
+    _staged = false;
+    if (!_acquireBuffers()) return false;
+    _storageWait = false;
+    _eofPending = false;
+    _writeFailed = false;
+    _fileSeq = 0;
+    _fileEnded = false;
+    _followUp = false;
+    _skippedCur = false;
+    _rinitDue = false;
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.reset();
+#endif
     _state = STATE_AWAIT_ZRINIT; // Generic start state
     _rState = RSTATE_AWAIT_HEADER;
     _timeoutMs = timeout;
     _operationStartTime = millis();
-    _lastActivity = millis();
+    _touchActivity();
     
-    // Receiver sends ZRINIT to start
-    _sendHexHeader(ZRINIT, ZERO_FLAGS); 
+    _fileAnnounced = false;
+
+    // Receiver sends ZRINIT to start, unless the sender's ZFILE for a joined
+    // stream is already waiting to be parsed
+    if (!joined) _sendHexHeader(ZRINIT, _rinitFlags);
+    _timers->arm(_retryTimer, KEEPALIVE_MS);
+    _io->flush();
     if (_debug) {
-        _debug->print("ZModemEngine: receive() started, ZRINIT sent\n");
+        _debug->print("ZModemEngine: receive() started\n");
     }
     return true;
 }
@@ -106,8 +251,24 @@ void ZModemEngine::abort() {
     if (_io) {
         uint8_t abortSeq[] = {ZDLE, ZCAN, ZDLE, ZCAN, ZDLE, ZCAN, ZDLE, ZCAN};
         _io->write(abortSeq, 8);
+        _io->flush();
     }
     _state = STATE_ERROR;
+    _cancelTimers();
+    _releaseBuffers();
+}
+
+void ZModemEngine::flushWrites() {
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_sink && _coalescer.isActive() && !_coalescer.flush(_sink)) _writeFailed = true;
+#endif
+}
+
+size_t ZModemEngine::pendingWrites() const {
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return _coalescer.pending();
+#endif
+    return 0;
 }
 
 // Simple XMODEM constants
@@ -119,14 +280,31 @@ void ZModemEngine::abort() {
 #define XCAN 0x18
 
 
-int ZModemEngine::loop() {
+int ZModemEngine::loop(uint32_t budgetUs) {
     if (_state == STATE_IDLE || _state == STATE_COMPLETE || _state == STATE_ERROR) {
         return (_state == STATE_COMPLETE) ? 1 : (_state == STATE_ERROR ? -1 : 0);
     }
 
+    // Waiting on the storage worker: only its progress (or the inactivity
+    // timeout) moves this session on
+    if (_storageWait) {
+        if (!_storageReady() && _timeoutTimer.isArmed()) return 0;
+        _storageWait = false;
+        _wake = true;
+    }
+    // Nothing to do until input arrives or one of our timers fires
+    if (!_wake && !_io->available()) return 0;
+    _wake = false;
+    _tickStartUs = micros();
+    _tickBudgetUs = budgetUs;
+    _yielded = false;
+    State prevState = _state;
+
     // Timeout Check
-    if (millis() - _lastActivity > _timeoutMs) {
+    if (!_timeoutTimer.isArmed()) {
         _state = STATE_ERROR;
+        _cancelTimers();
+        _releaseBuffers();
         if (_debug) {
             _debug->print("ZModemEngine: timeout exceeded, entering ERROR state\n");
         }
@@ -138,15 +316,178 @@ int ZModemEngine::loop() {
     } else {
         _handleReceiverLoop();
     }
-    if (_debug) {
+    // Frames are batched in the transport; push out whatever this tick produced
+    _io->flush();
+    // Hand the working buffers and timers back as soon as the transfer is over
+    if (_state == STATE_COMPLETE || _state == STATE_ERROR) {
+        _cancelTimers();
+        _releaseBuffers();
+    } else {
+        _wake = _yielded || !_isWaiting();
+    }
+    if (_debug && _state != prevState) {
         // Log non-fatal state transitions for visibility
-        _debug->print("ZModemEngine: loop tick, state=");
+        _debug->print("ZModemEngine: state=");
         _debug->print((int)_state);
         _debug->print("\n");
     }
+    uint32_t tookUs = (uint32_t)(micros() - _tickStartUs);
+    if (tookUs > _maxLoopUs) _maxLoopUs = tookUs;
     return (_state == STATE_COMPLETE) ? 1 : (_state == STATE_ERROR ? -1 : 0);
 }
 
+// --- File access ---
+
+// True if the next storage step can run now: for a send the next block is
+// in, for a receive the write queue has room for 'need' bytes (need 0:
+// everything received is on disk). Otherwise the engine waits for the
+// worker. Always true inline, once coalesced data is written out.
+bool ZModemEngine::_storageReadyFor(size_t need) {
+    if (need == 0) flushWrites();
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage && !_storage->ready(need)) {
+        _storageNeed = need;
+        _storageWait = true;
+        return false;
+    }
+#else
+    (void)need;
+#endif
+    return true;
+}
+
+bool ZModemEngine::_storageReady() {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->ready(_storageNeed);
+#endif
+    return true;
+}
+
+bool ZModemEngine::_storageFailed() const {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->failed();
+#endif
+    return _writeFailed;
+}
+
+size_t ZModemEngine::_sourceRemaining() {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return _storage->remaining();
+#endif
+    return _source ? _source->remaining() : 0;
+}
+
+size_t ZModemEngine::_readSource(uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        int r = _storage->read(buf, n);
+        return r > 0 ? (size_t)r : 0;
+    }
+#endif
+    return _source ? _source->read(buf, n) : 0;
+}
+
+// The next chunk at the source's position: in place for a memory-backed
+// source, else read into the retransmit cache
+const uint8_t* ZModemEngine::_readChunk(size_t& len) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (!_storage)
+#endif
+    {
+        len = CHUNK_SIZE;
+        const uint8_t* p = _source ? _source->readSpan(len) : nullptr;
+        if (p) return p;
+    }
+    len = _readSource(_lastDataBuf, CHUNK_SIZE);
+    return _lastDataBuf;
+}
+
+void ZModemEngine::_seekSource(size_t pos) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        _storage->seek(pos);
+        return;
+    }
+#endif
+    if (_source) _source->seek(pos);
+}
+
+void ZModemEngine::_writeSink(const uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.update(_bytesTransferred, buf, n);
+#endif
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) {
+        _storage->write(buf, n);
+        return;
+    }
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) {
+        if (!_coalescer.write(_sink, buf, n)) _writeFailed = true;
+        return;
+    }
+#endif
+    if (_sink->write(buf, n) != n) _writeFailed = true;
+}
+
+// Room to decode the next subpacket straight into a memory-backed sink
+uint8_t* ZModemEngine::_sinkSpan(size_t& n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return nullptr;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return nullptr;
+#endif
+    return _sink ? _sink->writeSpan(n) : nullptr;
+}
+
+// Offer a chunk that arrived ahead of the write position to the sink
+void ZModemEngine::_stageAhead(const uint8_t* buf, size_t n) {
+#if AKZ_ENABLE_STORAGE_WORKER
+    if (_storage) return;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) return;
+#endif
+    if (_sink && n > 0 && _sink->stage(_rxDataPos, buf, n)) _staged = true;
+}
+
+// Tell the sink the announced size, and let the owner check the announced
+// file and pick the offset to continue from, before ZRPOS tells the sender
+bool ZModemEngine::_announce() {
+    if (_sink && !_sink->expect(_fileSize)) return false;
+    if (!_announceFn) return true;
+    size_t at = _bytesTransferred;
+    if (!_announceFn(_announceCtx, _filename, _fileSize, at)) return false;
+    if (at != _bytesTransferred) {
+        _bytesTransferred = at;
+#if AKZ_HAVE_WRITE_COALESCER
+        // Nothing is gathered yet; realign the units to the new offset
+        if (_coalescer.isActive()) _coalescer.begin(_pool, at);
+#endif
+    }
+    return true;
+}
+
+// Finalize the sink once: true when everything is written (ZEOF), false
+// when the transfer ends short of that. False from the sink fails it.
+bool ZModemEngine::_finishSink(bool ok) {
+    if (_sinkDone || !_sink) return true;
+    _sinkDone = true;
+    if (_sink->finalize(ok) || !ok) return true;
+    _writeFailed = true;
+    return false;
+}
+
+// True once this tick has used its budget; the caller stops after the unit
+// of work it just finished and leaves the rest for the next tick
+bool ZModemEngine::_budgetSpent() {
+    if (_tickBudgetUs == 0 || (uint32_t)(micros() - _tickStartUs) < _tickBudgetUs) return false;
+    _yielded = true;
+    return true;
+}
+
 // --- Sender Logic ---
 void ZModemEngine::_handleSenderLoop() {
     // If XMODEM compatibility is enabled, prefer using the XMODEM sender fallback
@@ -157,117 +498,105 @@ void ZModemEngine::_handleSenderLoop() {
     uint8_t rxType;
     uint8_t rxFlags[4];
     
-    // Check for incoming ACKs/NAKs
-    if (_io->available()) {
-        int res = _readHexHeader(rxType, rxFlags);
-        if (res == 1) {
-            _lastActivity = millis();
-            // Process response
-            switch(_state) {
-                case STATE_SEND_ZRQINIT:
-                case STATE_AWAIT_ZRINIT:
-                    if (rxType == ZRINIT) {
-                        _state = STATE_SEND_ZFILE;
-                    }
-                    break;
-                case STATE_SEND_ZFILE:
-                    if (rxType == ZRPOS) {
-                         // Ack for file, requested position
-                         size_t pos = rxFlags[0] | (rxFlags[1] << 8) | (rxFlags[2] << 16) | (rxFlags[3] << 24);
-                         if (_file) _file->seek(pos);
-                         _bytesTransferred = pos;
-                         _state = STATE_SEND_ZDATA;
-                    }
-                    break;
-                case STATE_SEND_ZDATA:
-                     if (rxType == ZACK) {
-                         // Chunk acked: clear pending resend state and reset backoff
+    // Check for incoming ACKs/NAKs. One mesh packet may carry several
+    // headers, so drain everything already buffered before sending.
+    while (_readHeader(rxType, rxFlags) == 1) {
+        _touchActivity();
+        // Process response
+        switch(_state) {
+            case STATE_SEND_ZRQINIT:
+            case STATE_AWAIT_ZRINIT:
+                if (rxType == ZRINIT) {
+                    _peerJoins = (rxFlags[ZF1] & CANJOIN) != 0;
+                    _enterState(STATE_SEND_ZFILE);
+                }
+                break;
+            case STATE_SEND_ZFILE:
+                if (rxType == ZRPOS) {
+                     // Ack for file, requested position
+                     size_t pos = _getPos(rxFlags);
+                     _seekSource(pos);
+                     _bytesTransferred = pos;
+                     _lastDataPending = false;
+                     _lastDataLen = 0;
+                     _enterState(STATE_SEND_ZDATA);
+                } else if (rxType == ZSKIP && rxFlags[ZFSEQ] == _fileSeq) {
+                     // Receiver refused this file: go on with the next
+                     _nextFile(false);
+                }
+                break;
+            case STATE_SEND_ZDATA:
+            case STATE_SEND_ZEOF:
+                 if (rxType == ZACK && _state == STATE_SEND_ZDATA) {
+                     // Chunk acked: only an ACK for the end of the outstanding
+                     // chunk clears it, so a late duplicate ACK cannot.
+                     if (_lastDataPending && _getPos(rxFlags) == _lastDataPos + _lastDataLen) {
                          _lastDataPending = false;
                          _retryCount = 0;
                          _retryIntervalMs = _baseRetryIntervalMs;
-                     } else if (rxType == ZRPOS) {
-                         // Resend from pos (Error or checkpoint)
-                         size_t pos = rxFlags[0] | (rxFlags[1] << 8) | (rxFlags[2] << 16) | (rxFlags[3] << 24);
-                         if (_file) _file->seek(pos);
-                         _bytesTransferred = pos;
-                         // If we have cached data overlapping this position, mark pending so sender will retransmit
-                         if (_lastDataLen > 0 && _lastDataPos == pos) {
-                             _lastDataPending = true;
-                             _retryIntervalMs = _baseRetryIntervalMs;
-                             _lastSendTime = millis();
-                             _retryCount = 0;
-                         }
+                         _timers->cancel(_retryTimer);
                      }
-                     break;
-                case STATE_SEND_ZEOF:
-                    if (rxType == ZRINIT) {
-                        // Receiver ready for next file or finish
-                        _state = STATE_SEND_ZFIN;
-                    }
-                    break;
-                case STATE_SEND_ZFIN:
-                    if (rxType == ZFIN) {
-                        // Two O's usually sent here
-                        _io->print("OO");
-                        _state = STATE_COMPLETE;
-                    }
-                    break;
-                default:
-                    // Unexpected response
-                    break;
-            }
+                 } else if (rxType == ZRPOS) {
+                     // Resend from pos (CRC error, lost chunk or lost tail before ZEOF)
+                     size_t pos = _getPos(rxFlags);
+                     _seekSource(pos);
+                     _bytesTransferred = pos;
+                     _eofSent = false;
+                     _enterState(STATE_SEND_ZDATA); // retransmit below without waiting
+                     // If we have cached data at this position, retransmit it from the cache
+                     if (_lastDataLen > 0 && _lastDataPos == pos) {
+                         _lastDataPending = true;
+                         _bytesTransferred = pos + _lastDataLen;
+                         _seekSource(_bytesTransferred);
+                         _retryIntervalMs = _baseRetryIntervalMs;
+                         _retryCount = 0;
+                     } else {
+                         _lastDataPending = false;
+                     }
+                 } else if (rxType == ZRINIT && _state == STATE_SEND_ZEOF && rxFlags[ZFSEQ] == _fileSeq) {
+                    // Receiver has the whole file: next file or finish
+                    _nextFile(true);
+                }
+                break;
+            case STATE_SEND_ZFIN:
+                if (rxType == ZFIN) {
+                    // Two O's usually sent here
+                    _io->print("OO");
+                    _state = STATE_COMPLETE;
+                }
+                break;
+            default:
+                // Unexpected response
+                break;
         }
+        if (_budgetSpent()) break;
     }
+    // Out of budget with replies still buffered: act on them first next tick
+    if (_yielded) return;
 
     // Sending Actions (Retry every 1 second if stuck on a state waiting for remote action)
     switch(_state) {
         case STATE_SEND_ZRQINIT:
-            if (millis() - _senderLastSend > 1000) { 
+            if (!_retryTimer.isArmed()) {
                 _sendHexHeader(ZRQINIT, ZERO_FLAGS);
-                _senderLastSend = millis();
+                _timers->arm(_retryTimer, HEADER_RETRY_MS);
             }
             break;
 
         case STATE_SEND_ZFILE:
              // Send ZFILE Header + Data Subpacket (Filename/Size)
-             if (millis() - _senderLastSend > 1000) {
-                 _sendBinaryHeader(ZFILE, ZERO_FLAGS);
-                 // Build filename\0filesize\0 in a bounded payload
-                 char payload[128];
-                 payload[0] = '\0';
-                 size_t used = 0;
-                 // copy filename
-                 if (_filename[0]) {
-                     strncpy(payload, _filename, sizeof(payload) - 1);
-                     payload[sizeof(payload) - 1] = '\0';
-                     used = strnlen(payload, sizeof(payload));
-                 }
-                 // append NUL and filesize string
-                 if (used + 1 < sizeof(payload)) {
-                     payload[used] = '\0';
-                     used += 1;
-                     // write filesize as ASCII
-                     char sizeStr[32];
-                     snprintf(sizeStr, sizeof(sizeStr), "%lu", (unsigned long)_fileSize);
-                     size_t sizeLen = strnlen(sizeStr, sizeof(sizeStr));
-                     size_t copyLen = ((used + sizeLen + 1) < sizeof(payload)) ? sizeLen : (sizeof(payload) - used - 1);
-                     if (copyLen > 0) {
-                         memcpy(payload + used, sizeStr, copyLen);
-                         used += copyLen;
-                     }
-                     // ensure trailing NUL
-                     if (used < sizeof(payload)) payload[used++] = '\0';
-                 }
-
-                 _sendDataSubpacket((const uint8_t*)payload, used, true); // End frame
-                 _senderLastSend = millis();
+             if (!_retryTimer.isArmed()) {
+                 uint8_t payload[ZModemFraming::FILE_INFO_MAX];
+                 size_t used = ZModemFraming::putFileInfo(payload, sizeof(payload), _filename, _fileSize);
+                 _sendFileInfo(_fileSeq, payload, used);
+                 _timers->arm(_retryTimer, HEADER_RETRY_MS);
              }
              break;
 
         case STATE_SEND_ZDATA:
             // If we have a pending last-data that needs retransmit and the retry timer expired, resend
             if (_lastDataPending) {
-                if (millis() - _lastSendTime >= _retryIntervalMs) {
+                if (!_retryTimer.isArmed()) {
                     if (_retryCount >= MAX_RETRIES) {
                         // Too many retries, abort
                         _state = STATE_ERROR;
@@ -281,18 +610,20 @@ void ZModemEngine::_handleSenderLoop() {
                     pos[2] = (_lastDataPos >> 16) & 0xFF;
                     pos[3] = (_lastDataPos >> 24) & 0xFF;
                     _sendBinaryHeader(ZDATA, pos);
-                    _sendDataSubpacket(_lastDataBuf, _lastDataLen, false);
-                    _lastSendTime = millis();
+                    _sendDataSubpacket(_lastData, _lastDataLen, false);
                     _retryCount++;
                     _retryIntervalMs = (unsigned long)min((unsigned long)MAX_RETRY_INTERVAL_MS, _retryIntervalMs * 2UL);
+                    _timers->arm(_retryTimer, _retryIntervalMs);
                 }
             } else {
                 // Stream new file data into a buffer and send
-                if (_file && _file->available()) {
-                    size_t chunkSz = sizeof(_lastDataBuf);
-                    size_t readLen = _file->read(_lastDataBuf, chunkSz);
+                if (_source && _sourceRemaining()) {
+                    if (!_storageReadyFor(0)) break; // next block still being read
+                    if (_holdDeferred()) break;
+                    size_t readLen;
+                    const uint8_t* chunk = _readChunk(readLen);
                     if (readLen > 0) {
-                        bool isLast = (_file->available() == 0);
+                        bool isLast = (_sourceRemaining() == 0);
                         // Use an explicit 4-byte little-endian offset for flags
                         uint8_t pos[4];
                         pos[0] = _bytesTransferred & 0xFF;
@@ -300,40 +631,57 @@ void ZModemEngine::_handleSenderLoop() {
                         pos[2] = (_bytesTransferred >> 16) & 0xFF;
                         pos[3] = (_bytesTransferred >> 24) & 0xFF;
                         _sendBinaryHeader(ZDATA, pos);
-                        _sendDataSubpacket(_lastDataBuf, readLen, isLast);
+                        _sendDataSubpacket(chunk, readLen, isLast);
                         // Cache last data for potential retransmit
+                        _lastData = chunk;
                         _lastDataLen = readLen;
                         _lastDataPos = _bytesTransferred;
                         _lastDataPending = true;
-                        _lastSendTime = millis();
                         _retryCount = 0;
                         _retryIntervalMs = _baseRetryIntervalMs;
+                        _timers->arm(_retryTimer, _retryIntervalMs);
 
                         _bytesTransferred += readLen;
-                        if (isLast) _state = STATE_SEND_ZEOF;
+                        if (isLast) _enterState(STATE_SEND_ZEOF);
                     }
                 } else if (_bytesTransferred == _fileSize) {
-                    _state = STATE_SEND_ZEOF;
+                    _enterState(STATE_SEND_ZEOF);
                 }
             }
             break;
              
         case STATE_SEND_ZEOF:
-             if (millis() - _senderLastSend > 1000) {
-                 uint8_t pos[4];
-                 pos[0] = _bytesTransferred & 0xFF;
-                 pos[1] = (_bytesTransferred >> 8) & 0xFF;
-                 pos[2] = (_bytesTransferred >> 16) & 0xFF;
-                 pos[3] = (_bytesTransferred >> 24) & 0xFF;
-                 _sendHexHeader(ZEOF, pos);
-                 _senderLastSend = millis();
+             if (!_retryTimer.isArmed()) {
+                 // The next file's ZFILE follows ZEOF at once, so the receiver
+                 // answers both together. Its resends stand in for ZEOF: the
+                 // receiver takes it as the end of this file once it has every
+                 // byte, and asks for the missing tail otherwise.
+                 if (!_eofSent || _next != NEXT_PIPELINED) {
+                     uint8_t pos[4];
+                     pos[0] = _bytesTransferred & 0xFF;
+                     pos[1] = (_bytesTransferred >> 8) & 0xFF;
+                     pos[2] = (_bytesTransferred >> 16) & 0xFF;
+                     pos[3] = (_bytesTransferred >> 24) & 0xFF;
+                     _sendHexHeader(ZEOF, pos);
+                 }
+                 if (!_eofSent && _next == NEXT_UNKNOWN) _peekNext();
+                 if (_next == NEXT_PIPELINED) _sendFileInfo((uint8_t)(_fileSeq + 1), _fileInfoBuffer, _nextInfoLen);
+                 _eofSent = true;
+                 _timers->arm(_retryTimer, HEADER_RETRY_MS);
              }
              break;
 
         case STATE_SEND_ZFIN:
-             if (millis() - _senderLastSend > 1000) {
+             if (!_retryTimer.isArmed()) {
+                 if (_retryCount >= MAX_RETRIES) {
+                     // The receiver already confirmed all data by answering ZEOF;
+                     // only its ZFIN reply was lost, so finish instead of timing out.
+                     _state = STATE_COMPLETE;
+                     break;
+                 }
                  _sendHexHeader(ZFIN, ZERO_FLAGS);
-                 _senderLastSend = millis();
+                 _timers->arm(_retryTimer, HEADER_RETRY_MS);
+                 _retryCount++;
              }
              break;
         default:
@@ -342,214 +690,106 @@ void ZModemEngine::_handleSenderLoop() {
     }
 }
 
+// ZFILE header (options, and the file's place in the session) and its
+// filename\0filesize\0 subpacket
+void ZModemEngine::_sendFileInfo(uint8_t seq, const uint8_t* payload, size_t len) {
+    uint8_t options[4] = {0, 0, 0, 0};
+    options[ZFSEQ] = seq;
+    if (_crashRecovery) options[ZF0] = ZCRESUM;
+    _sendBinaryHeader(ZFILE, options);
+    _sendDataSubpacket(payload, len, true); // End frame
+}
+
+// Ask the owner for the file after the current one and keep its ZFILE
+// payload. With the pool dry nothing is asked: the owner attaches the next
+// file when the receiver answers ZEOF, and its ZFILE goes out then.
+void ZModemEngine::_peekNext() {
+    if (!_batchNextFn) {
+        _next = NEXT_NONE;
+        return;
+    }
+    if (!_fileInfoBuffer) _fileInfoBuffer = _pool->acquire(FILE_INFO_SIZE);
+    if (!_fileInfoBuffer) return;
+    char name[FILENAME_MAX_LEN];
+    size_t size = 0;
+    if (!_batchNextFn(_batchCtx, name, sizeof(name), size)) {
+        _next = NEXT_NONE;
+        _pool->release(_fileInfoBuffer);
+        _fileInfoBuffer = nullptr;
+        return;
+    }
+    _nextInfoLen = ZModemFraming::putFileInfo(_fileInfoBuffer, ZModemFraming::FILE_INFO_MAX, name, size);
+    _next = NEXT_PIPELINED;
+}
+
+// The receiver is done with the current file: go on with the one the owner
+// attaches, or close the session
+void ZModemEngine::_nextFile(bool delivered) {
+    bool pipelined = _next == NEXT_PIPELINED;
+    bool more = _batchDoneFn && _batchDoneFn(_batchCtx, delivered);
+    _pool->release(_fileInfoBuffer);
+    _fileInfoBuffer = nullptr;
+    _next = NEXT_UNKNOWN;
+    _eofSent = false;
+    _retryCount = 0;
+    if (!more) {
+        _enterState(STATE_SEND_ZFIN);
+        return;
+    }
+    _fileSeq++;
+    _lastDataPending = false;
+    _lastDataLen = 0;
+    _enterState(STATE_SEND_ZFILE);
+    // Its ZFILE is already out, and likely answered in the same reply
+    if (pipelined) _timers->arm(_retryTimer, HEADER_RETRY_MS);
+}
+
 // --- Receiver Logic ---
 void ZModemEngine::_handleReceiverLoop() {
     uint8_t rxType;
     uint8_t rxFlags[4];
-    
-    // Process incoming control header
-    if (_io->available()) {
-        int res = _readHexHeader(rxType, rxFlags);
-        
-        if (res == 1) {
-             _lastActivity = millis();
-             
-             if (rxType == ZRQINIT) {
-                 // Sender requests initialization
-                 _sendHexHeader(ZRINIT, ZERO_FLAGS);
-                 _rState = RSTATE_AWAIT_HEADER;
-             }
-             else if (rxType == ZFILE) {
-                 // Sender announces file — next comes a data subpacket containing
-                 // NUL-terminated filename and ASCII filesize. Enter the
-                 // RSTATE_READ_ZFILE state and accumulate the subpacket
-                 // non-blocking (we will parse when the terminating ZDLE/... is seen).
-                 _fileInfoIndex = 0;
-                 _fileInfoEscape = false;
-                 _fileInfoAwaitingCRC = false;
-                 _rState = RSTATE_READ_ZFILE;
-             }
-             else if (rxType == ZDATA) {
-                 // ZDATA header received, next bytes are subpacket data
-                 // The main loop handles the file stream write based on RSTATE_READ_ZDATA
-                 
-                 // NOTE: Since the ZModem Engine does NOT handle data subpacket reading/escaping/CRC checks
-                 // directly in the loop, this is where commercial hardening is needed.
-                 // This engine expects the stream to contain clean data if in RSTATE_READ_ZDATA.
-                 
-                 // Implicitly ACK by sending ZACK or ZRPOS after data read
-             }
-             else if (rxType == ZEOF) {
-                 // Received End of File signal
-                 _sendHexHeader(ZRINIT, ZERO_FLAGS); // Ready for next file or ZFIN
-             }
-             else if (rxType == ZFIN) {
-                 _sendHexHeader(ZFIN, ZERO_FLAGS);
-                 _state = STATE_COMPLETE;
-             }
-        }
-    }
-    
-    // Data Writing Loop (if actively reading data)
-    if (_rState == RSTATE_READ_ZFILE) {
-        // Accumulate the ZFILE data subpacket (filename\0filesize\0), with ZDLE-escaping.
-        // Read available bytes non-destructively into the internal input buffer
-        _fillInput();
-        // Parse from _inBuf similar to header parsing but handle ZFILE subpacket bytes
-        // We will consume bytes from _inBuf as we process them.
-        size_t idx = 0;
-        while (idx < _inBufLen) {
-            uint8_t b = _inBuf[idx++];
-            if (!_fileInfoEscape) {
-                if (b == ZDLE) { _fileInfoEscape = true; continue; }
-                if (_fileInfoIndex < sizeof(_fileInfoBuffer) - 1) _fileInfoBuffer[_fileInfoIndex++] = b;
-                else { _state = STATE_ERROR; return; }
-            } else {
-                _fileInfoEscape = false;
-                if (b == ZCRCE || b == ZCRCG || b == ZCRCW) {
-                    // End-of-subpacket. Need two CRC bytes; ensure they are in _inBuf
-                    if (idx + 2 > _inBufLen) {
-                        // not enough bytes yet; roll back idx and wait
-                        idx -= 1; // put back the marker
-                        break;
-                    }
-                    // skip CRC bytes
-                    idx += 2;
-
-                    // Null-terminate and parse filename and filesize
-                    _fileInfoBuffer[_fileInfoIndex] = 0;
-                    const char* p = (const char*)_fileInfoBuffer;
-                    size_t fnameLen = strlen(p);
-                    const char* sizeStr = p + fnameLen + 1;
-                    size_t parsedSize = 0;
-                    if (sizeStr && *sizeStr) parsedSize = strtoul(sizeStr, NULL, 10);
-
-                    // Store parsed filename into fixed buffer
-                    strncpy(_filename, p, FILENAME_MAX_LEN - 1);
-                    _filename[FILENAME_MAX_LEN - 1] = '\0';
-                    _fileSize = parsedSize;
-
-                    // Acknowledge and move to reading actual file data
-                    _sendHexHeader(ZRPOS, ZERO_FLAGS);
-                    _rState = RSTATE_READ_ZDATA;
-
-                    // Reset file-info accumulators
-                    _fileInfoIndex = 0;
-                    _fileInfoEscape = false;
-                    _fileInfoAwaitingCRC = false;
-
-                    // Remove consumed bytes from _inBuf
-                    if (idx < _inBufLen) memmove(_inBuf, _inBuf + idx, _inBufLen - idx);
-                    _inBufLen -= idx;
-                    idx = 0;
-                    break;
-                } else {
-                    // Normal escaped byte
-                    uint8_t orig = b ^ 0x40;
-                    if (_fileInfoIndex < sizeof(_fileInfoBuffer) - 1) _fileInfoBuffer[_fileInfoIndex++] = orig;
-                    else { _state = STATE_ERROR; return; }
-                }
-            }
-        }
-        // if we've consumed some bytes without finishing, remove them
-        if (idx > 0 && idx <= _inBufLen) {
-            if (idx < _inBufLen) memmove(_inBuf, _inBuf + idx, _inBufLen - idx);
-            _inBufLen -= idx;
-        }
-    }
-    
-    else if (_rState == RSTATE_READ_ZDATA && _file) {
-        // Read escaped subpackets, validate CRC, then write payload in bulk.
-        _fillInput();
-
-        // Temporary buffer for unescaped data
-        const size_t SUBBUF_SZ = 512;
-        uint8_t subbuf[SUBBUF_SZ];
-        size_t subidx = 0;
-
-        size_t idx = 0;
-        bool escape = false;
-        while (idx < _inBufLen) {
-            uint8_t b = _inBuf[idx++];
-
-            if (!escape) {
-                if (b == ZDLE) { escape = true; continue; }
-                // normal data byte
-                if (subidx < SUBBUF_SZ) subbuf[subidx++] = b;
-                else { _state = STATE_ERROR; return; }
-            } else {
-                // escaped byte or end-of-subpacket marker
-                escape = false;
-                if (b == ZCRCE || b == ZCRCG || b == ZCRCW) {
-                    // End-of-subpacket marker: need two CRC bytes following
-                    if (idx + 2 > _inBufLen) {
-                        // wait for CRC bytes to arrive
-                        idx -= 1; // push back ZDLE marker handling
-                        break;
-                    }
 
-                    uint8_t crcHigh = _inBuf[idx++];
-                    uint8_t crcLow = _inBuf[idx++];
-                    uint16_t receivedCrc = ((uint16_t)crcHigh << 8) | crcLow;
-
-                    // Compute CRC over unescaped data
-                    uint16_t crc = 0;
-                    for (size_t j = 0; j < subidx; ++j) crc = _updcrc(subbuf[j], crc);
-                    // include the end marker in CRC as sender does
-                    crc = _updcrc(b, crc);
-
-                    if (crc == receivedCrc) {
-                        // Valid subpacket: write to file
-                        if (subidx > 0) {
-                            _file->write(subbuf, subidx);
-                            _bytesTransferred += subidx;
-                        }
-                        // ACK the chunk
-                        _sendHexHeader(ZACK, ZERO_FLAGS);
-                        _lastActivity = millis();
-                        // reset subbuffer
-                        subidx = 0;
-                    } else {
-                        // CRC mismatch: request resend from current offset
-                        uint8_t pos[4];
-                        pos[0] = _bytesTransferred & 0xFF;
-                        pos[1] = (_bytesTransferred >> 8) & 0xFF;
-                        pos[2] = (_bytesTransferred >> 16) & 0xFF;
-                        pos[3] = (_bytesTransferred >> 24) & 0xFF;
-                        _sendHexHeader(ZRPOS, pos);
-                        _lastActivity = millis();
-                        // on CRC error we discard subbuf and continue waiting for resend
-                        subidx = 0;
-                    }
-                    // remove consumed bytes from _inBuf by shifting remaining
-                    if (idx < _inBufLen) {
-                        size_t rem = _inBufLen - idx;
-                        memmove(_inBuf, _inBuf + idx, rem);
-                        _inBufLen = rem;
-                    } else {
-                        _inBufLen = 0;
-                    }
-                    idx = 0; // restart parsing from buffer start
-                    continue;
-                } else {
-                    // Normal escaped data byte
-                    uint8_t orig = b ^ 0x40;
-                    if (subidx < SUBBUF_SZ) subbuf[subidx++] = orig;
-                    else { _state = STATE_ERROR; return; }
-                }
-            }
+    // A ZEOF held back until every queued write reached the file
+    if (_eofPending) _answerEof();
+    if (_storageFailed()) {
+        if (_debug) _debug->print("ZModemEngine: storage write failed, entering ERROR state\n");
+        _state = STATE_ERROR;
+        return;
+    }
+    if (_eofPending) return;
+
+    // Parse everything buffered: a mesh packet can carry a header together
+    // with its data subpacket, or a subpacket can span several packets.
+    for (;;) {
+        if (_state == STATE_COMPLETE || _state == STATE_ERROR || _storageWait) break;
+        bool progress = false;
+        if (_rState == RSTATE_READ_ZFILE) {
+            progress = _readFileInfoSubpacket();
+        } else if (_rState == RSTATE_READ_ZDATA) {
+            progress = _readDataSubpacket();
+        } else if (_readHeader(rxType, rxFlags) == 1) {
+            progress = true;
+            _touchActivity();
+            _handleReceiverHeader(rxType, rxFlags);
         }
-        // remove any fully consumed bytes at front
-        if (idx > 0 && idx <= _inBufLen) {
-            if (idx < _inBufLen) memmove(_inBuf, _inBuf + idx, _inBufLen - idx);
-            _inBufLen -= idx;
+        if (!progress) {
+            if (_storageWait) break; // leave the rest buffered
+            size_t before = _inBufLen;
+            _fillInput();
+            if (_inBufLen == before) break;
+        } else if (_budgetSpent()) {
+            break;
         }
     }
-    
-    // Keepalive (If waiting for sender to act)
-    if (millis() - _receiverLastAck > 3000 && _state != STATE_COMPLETE && _state != STATE_ERROR) {
-        _sendHexHeader(ZRINIT, ZERO_FLAGS); // Keep poking sender
-        _receiverLastAck = millis();
+    // No ZFILE followed this tick's ZEOF: answer it on its own
+    _sendRinit();
+
+    // Keepalive (If waiting for sender to act). Only before the file is
+    // announced: once data flows the sender drives retries, and a stray
+    // ZRINIT would be mistaken for the answer to ZEOF.
+    if (!_fileAnnounced && !_retryTimer.isArmed() && _state != STATE_COMPLETE && _state != STATE_ERROR) {
+        _sendHexHeader(ZRINIT, _rinitFlags); // Keep poking sender
+        _timers->arm(_retryTimer, KEEPALIVE_MS);
     }
 
     // If XMODEM compatibility enabled and we haven't entered ZMODEM transfer after some time,
@@ -559,27 +799,282 @@ void ZModemEngine::_handleReceiverLoop() {
     }
 }
 
+void ZModemEngine::_handleReceiverHeader(uint8_t rxType, const uint8_t* rxFlags) {
+    uint8_t pos[4];
+    if (rxType == ZRQINIT) {
+        // Sender requests initialization
+        _reply(ZRINIT, _rinitFlags);
+        _rState = RSTATE_AWAIT_HEADER;
+    }
+    else if (rxType == ZFILE) {
+        // Sender announces file — next comes a data subpacket containing
+        // NUL-terminated filename and ASCII filesize, accumulated non-blocking.
+        if (!_fileInfoBuffer) _fileInfoBuffer = _pool->acquire(FILE_INFO_SIZE);
+        if (!_fileInfoBuffer) {
+            // Pool is dry: skip this announcement; the sender repeats ZFILE
+            // until we answer, by which time another session may have finished.
+            if (_debug) _debug->print("ZModemEngine: buffer pool dry, deferring ZFILE\n");
+            return;
+        }
+        if (!_fileAnnounced) _crashRecovery = rxFlags[ZF0] == ZCRESUM;
+        _rxFileSeq = rxFlags[ZFSEQ];
+        _fileInfo.reset();
+        _rState = RSTATE_READ_ZFILE;
+    }
+    else if (rxType == ZDATA) {
+        // ZDATA header carries the file offset of the subpacket that follows
+        _rxDataPos = _getPos(rxFlags);
+        _rState = RSTATE_READ_ZDATA;
+    }
+    else if (rxType == ZEOF) {
+        // Received End of File signal. Only confirm once every byte is on
+        // disk; otherwise ask for the missing tail.
+        if (_getPos(rxFlags) == _bytesTransferred) {
+            _answerEof();
+        } else {
+            _putPos(pos, _bytesTransferred);
+            _reply(ZRPOS, pos);
+        }
+    }
+    else if (rxType == ZFIN) {
+        _reply(ZFIN, ZERO_FLAGS);
+        _state = STATE_COMPLETE;
+    }
+}
+
+// Ready for the next file or ZFIN once every byte received is on disk.
+// Until then (write-behind) the receiver loop retries; a failed write is
+// never confirmed. The ZRINIT is held to the end of the tick, to go out
+// with the answer to the next file's ZFILE if that came in the same packet.
+void ZModemEngine::_answerEof() {
+    _eofPending = !_storageReadyFor(0);
+    if (_eofPending) return;
+    if (_storageFailed() || !_finishSink(true)) {
+        _state = STATE_ERROR;
+        return;
+    }
+    _sendRinit();
+    _fileEnded = true;
+    _rinitDue = true;
+}
+
+// The ZRINIT that ends the current file, if it is still held back
+void ZModemEngine::_sendRinit() {
+    if (!_rinitDue) return;
+    _rinitDue = false;
+    uint8_t flags[4] = {0, 0, 0, 0};
+    flags[ZFSEQ] = _fileSeq;
+    _sendHexHeader(ZRINIT, flags);
+}
+
+// Receiver headers go out after a held-back ZRINIT, in the order they were due
+void ZModemEngine::_reply(uint8_t type, const uint8_t* flags) {
+    _sendRinit();
+    _sendHexHeader(type, flags);
+}
+
+// ZFILE for the next file also ends the current one: its ZEOF was lost, or
+// it is a resend of a ZFILE that came right behind ZEOF. True once the file
+// is complete and on disk; with bytes missing the sender is asked for them.
+bool ZModemEngine::_endFile() {
+    if (_fileEnded || _skippedCur) return true;
+    if (_bytesTransferred != _fileSize) {
+        uint8_t pos[4];
+        _putPos(pos, _bytesTransferred);
+        _reply(ZRPOS, pos);
+        return false;
+    }
+    // Not on disk yet: the sender repeats ZFILE
+    if (!_storageReadyFor(0)) return false;
+    if (_storageFailed() || !_finishSink(true)) {
+        _state = STATE_ERROR;
+        return false;
+    }
+    _fileEnded = true;
+    return true;
+}
+
+// Go on with the file the last ZFILE named, from the owner's offset (0 by
+// default). Refused by the owner, or without a next-file callback, it is
+// skipped.
+void ZModemEngine::_switchFile() {
+    _fileSeq = _rxFileSeq;
+    _followUp = true;
+    _fileEnded = false;
+    _sinkDone = false;
+    _staged = false;
+    _rxDataPos = 0;
+    size_t at = 0;
+    _skippedCur = !_nextFileFn || !_nextFileFn(_nextFileCtx, _filename, _fileSize, at) ||
+                  (_sink && !_sink->expect(_fileSize));
+    if (_skippedCur) {
+        _sinkDone = true; // nothing to finalize
+        at = 0;
+    }
+    _bytesTransferred = at;
+#if AKZ_HAVE_WRITE_COALESCER
+    if (_coalescer.isActive()) _coalescer.begin(_pool, at);
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    _rxHash.reset();
+#endif
+}
+
+// Answer the current file's ZFILE with the offset to send from, or ZSKIP.
+// A follow-up file's answer starts with the previous file's ZRINIT, in the
+// same packet: the sender may still be waiting for it, and would take a
+// ZRPOS arriving alone for a request to resend the previous file.
+void ZModemEngine::_answerFile() {
+    uint8_t flags[4] = {0, 0, 0, 0};
+    if (_followUp) {
+        if (_io->availableForWrite() < (int)(2 * ZModemFraming::HEX_HEADER_LEN)) _io->flush();
+        _rinitDue = false;
+        flags[ZFSEQ] = (uint8_t)(_fileSeq - 1);
+        _sendHexHeader(ZRINIT, flags);
+    }
+    if (_skippedCur) {
+        flags[ZFSEQ] = _fileSeq;
+        _sendHexHeader(ZSKIP, flags);
+    } else {
+        _putPos(flags, _bytesTransferred);
+        _reply(ZRPOS, flags);
+    }
+}
+
+// Accumulate the ZFILE data subpacket (filename\0filesize\0), with ZDLE-escaping.
+// Returns true if any buffered input was consumed.
+bool ZModemEngine::_readFileInfoSubpacket() {
+    size_t used;
+    ZModemFraming::SubpacketResult r = _fileInfo.feed(_inBuf, _inBufLen, _fileInfoBuffer, FILE_INFO_SIZE, used);
+    if (r == ZModemFraming::SUB_OVERSIZE) { _state = STATE_ERROR; return true; }
+    _consumeInput(used);
+    if (r == ZModemFraming::SUB_INCOMPLETE) return used > 0;
+
+    if (r == ZModemFraming::SUB_BAD_CRC) {
+        // Corrupt announcement: wait for the sender to repeat ZFILE
+        _rState = RSTATE_AWAIT_HEADER;
+        return true;
+    }
+
+    _rState = RSTATE_AWAIT_HEADER;
+    if (!_fileAnnounced) {
+        ZModemFraming::getFileInfo(_fileInfoBuffer, _fileInfo.index, _filename, FILENAME_MAX_LEN, _fileSize);
+        _fileSeq = _rxFileSeq;
+        _fileAnnounced = true;
+        if (!_announce()) { _state = STATE_ERROR; return true; }
+        _answerFile();
+    } else if (_rxFileSeq == (uint8_t)(_fileSeq + 1)) {
+        // The session goes on with another file once this one is complete
+        if (_endFile()) {
+            ZModemFraming::getFileInfo(_fileInfoBuffer, _fileInfo.index, _filename, FILENAME_MAX_LEN, _fileSize);
+            _switchFile();
+            _answerFile();
+        }
+    } else if (_rxFileSeq == _fileSeq) {
+        // A repeated ZFILE (our answer was lost) gets the same answer
+        _answerFile();
+    }
+
+    // Reset file-info accumulators and return the borrowed buffer
+    _fileInfo.reset();
+    _pool->release(_fileInfoBuffer);
+    _fileInfoBuffer = nullptr;
+    return true;
+}
+
+// Decode one ZDATA subpacket from the front of _inBuf, validate its CRC and
+// write it. Nothing is consumed until the whole subpacket is buffered, so a
+// subpacket split across mesh packets is simply re-parsed on the next call.
+bool ZModemEngine::_readDataSubpacket() {
+    // Temporary buffer for unescaped data, unless a memory sink has room
+    // for the largest subpacket right where it goes
+    const size_t SUBBUF_SZ = 512;
+    uint8_t stackBuf[SUBBUF_SZ];
+    size_t span = SUBBUF_SZ;
+    uint8_t* subbuf = _sinkSpan(span);
+    if (!subbuf || span < SUBBUF_SZ) subbuf = stackBuf;
+    size_t subLen;
+    size_t used;
+    uint8_t pos[4];
+
+    ZModemFraming::SubpacketResult r = ZModemFraming::decodeSubpacket(_inBuf, _inBufLen, subbuf, SUBBUF_SZ, subLen, used);
+    if (r == ZModemFraming::SUB_RESYNC) {
+        _consumeInput(used);
+        _rState = RSTATE_AWAIT_HEADER;
+        return true;
+    }
+    // Write queue full: keep the subpacket buffered and hold back its ACK.
+    // The sender waits for that ACK, so it pauses instead of losing data.
+    if (r == ZModemFraming::SUB_OK && _rxDataPos == _bytesTransferred && subLen > 0 &&
+        !_storageReadyFor(subLen)) {
+        return false;
+    }
+    if (r == ZModemFraming::SUB_OK || r == ZModemFraming::SUB_BAD_CRC) {
+        _consumeInput(used);
+        _rState = RSTATE_AWAIT_HEADER;
+        _touchActivity();
+
+        if (r == ZModemFraming::SUB_BAD_CRC || _rxDataPos > _bytesTransferred) {
+            // CRC mismatch or a gap (an earlier chunk was lost): request
+            // resend from the current offset. A sink may keep the early chunk.
+            if (r == ZModemFraming::SUB_OK) _stageAhead(subbuf, subLen);
+            _putPos(pos, _bytesTransferred);
+            _reply(ZRPOS, pos);
+        } else if (_rxDataPos == _bytesTransferred) {
+            // Valid, in-order subpacket: write to file and ACK the new offset
+            if (subLen > 0 && _sink) {
+                _writeSink(subbuf, subLen);
+                _bytesTransferred += subLen;
+            }
+            if (_staged && _sink->size() > _bytesTransferred) {
+                // Staged chunks followed the gap into the sink: skip the
+                // sender past them
+                _bytesTransferred = _sink->size();
+                _putPos(pos, _bytesTransferred);
+                _reply(ZRPOS, pos);
+            } else {
+                _putPos(pos, _bytesTransferred);
+                _reply(ZACK, pos);
+            }
+        } else {
+            // Retransmit of data we already have (our ACK was lost): re-ACK it
+            _putPos(pos, _rxDataPos + subLen);
+            _reply(ZACK, pos);
+        }
+        return true;
+    }
+
+    if (_inBufLen == IN_BUF_SIZE || r == ZModemFraming::SUB_OVERSIZE) {
+        // Subpacket cannot fit in the input buffer; drop it and ask again
+        _inBufLen = 0;
+        _rState = RSTATE_AWAIT_HEADER;
+        _putPos(pos, _bytesTransferred);
+        _reply(ZRPOS, pos);
+        return true;
+    }
+    return false;
+}
+
 // Basic XMODEM receiver (non-blocking, checksum-based fallback)
 void ZModemEngine::_handleXmodemReceiver() {
-    if (!_io || !_file) return;
+    if (!_io || !_sink) return;
     // Non-blocking: only proceed if there's at least one byte
     if (!_io->available()) return;
 
     // We'll attempt CRC-mode first if enabled. If not started, periodically send 'C' to request CRC.
     if (!_xmodemStarted) {
-        unsigned long now = millis();
         if (_xmodemRetryInterval == 0) {
             _xmodemRetryInterval = DEFAULT_BASE_RETRY_MS;
-            _xmodemLastSend = 0;
+            _timers->cancel(_xmodemTimer);
             _xmodemRetryCount = 0;
         }
-        if (now - _xmodemLastSend >= _xmodemRetryInterval) {
+        if (!_xmodemTimer.isArmed()) {
             // send requester: 'C' for CRC mode or NAK for checksum
             if (_xmodemUseCRC) _io->write('C'); else _io->write(XNAK);
-            _xmodemLastSend = now;
             _xmodemRetryCount++;
             // exponential backoff
             if (_xmodemRetryInterval < MAX_RETRY_INTERVAL_MS) _xmodemRetryInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemRetryInterval * 2UL);
+            _timers->arm(_xmodemTimer, _xmodemRetryInterval);
             if (_xmodemRetryCount > XMODEM_MAX_RETRIES) {
                 if (_debug) _debug->print("ZModemEngine: XMODEM no response, giving up\n");
                 _xmodemStarted = false;
@@ -595,6 +1090,11 @@ void ZModemEngine::_handleXmodemReceiver() {
 
     // Check for EOT
     if (c == XEOT) {
+        if (!_storageReadyFor(0)) return; // acknowledged once the data is on disk
+        if (_storageFailed() || !_finishSink(true)) {
+            _state = STATE_ERROR;
+            return;
+        }
         _io->read();
         _io->write(XACK);
         _state = STATE_COMPLETE;
@@ -649,7 +1149,7 @@ void ZModemEngine::_handleXmodemReceiver() {
             if (_xmodemRetryCount++ >= XMODEM_MAX_RETRIES) { _state = STATE_ERROR; return; }
             if (_xmodemRetryInterval == 0) _xmodemRetryInterval = DEFAULT_BASE_RETRY_MS;
             _xmodemRetryInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemRetryInterval * 2UL);
-            _xmodemLastSend = millis();
+            _timers->arm(_xmodemTimer, _xmodemRetryInterval);
             return;
         }
     } else {
@@ -660,14 +1160,15 @@ void ZModemEngine::_handleXmodemReceiver() {
             if (_xmodemRetryCount++ >= XMODEM_MAX_RETRIES) { _state = STATE_ERROR; return; }
             if (_xmodemRetryInterval == 0) _xmodemRetryInterval = DEFAULT_BASE_RETRY_MS;
             _xmodemRetryInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemRetryInterval * 2UL);
-            _xmodemLastSend = millis();
+            _timers->arm(_xmodemTimer, _xmodemRetryInterval);
             return;
         }
     }
 
     // Block OK: check block number
     if (blk == _xmodemExpectedBlock) {
-        _file->write(dataBuf, blockSize);
+        if (!_storageReadyFor(blockSize)) return; // unacknowledged: the sender repeats it
+        _writeSink(dataBuf, blockSize);
         _bytesTransferred += blockSize;
         _io->write(XACK);
         _xmodemExpectedBlock++;
@@ -684,7 +1185,7 @@ void ZModemEngine::_handleXmodemReceiver() {
 
 // XMODEM sender implementation (CRC-mode preferred). Non-blocking.
 void ZModemEngine::_handleXmodemSender() {
-    if (!_io || !_file) return;
+    if (!_io || !_source) return;
 
     // Wait for receiver request ('C' for CRC or NAK for checksum)
     if (!_xmodemSendStarted) {
@@ -696,14 +1197,14 @@ void ZModemEngine::_handleXmodemSender() {
                 _xmodemSendBlock = 1;
                 _xmodemSendRetry = 0;
                 _xmodemSendInterval = DEFAULT_BASE_RETRY_MS;
-                _xmodemSendLast = 0;
+                _xmodemSendIdle();
             } else if (b == XNAK) {
                 _xmodemUseCRC = false;
                 _xmodemSendStarted = true;
                 _xmodemSendBlock = 1;
                 _xmodemSendRetry = 0;
                 _xmodemSendInterval = DEFAULT_BASE_RETRY_MS;
-                _xmodemSendLast = 0;
+                _xmodemSendIdle();
             } else {
                 // ignore other bytes
                 return;
@@ -714,14 +1215,14 @@ void ZModemEngine::_handleXmodemSender() {
     }
 
     // If currently waiting for ACK/NAK for last block, check for responses or timeout
-    if (_xmodemSendLast != 0 && (millis() - _xmodemSendLast) < _xmodemSendInterval) {
+    if (_xmodemSendAwaiting && _xmodemTimer.isArmed()) {
         // check for ACK/NAK
         if (_io->available()) {
             int r = _io->read();
             if (r == XACK) {
                 // success, advance block
                 _xmodemSendBlock++;
-                _xmodemSendLast = 0;
+                _xmodemSendIdle();
                 _xmodemSendRetry = 0;
                 _xmodemSendInterval = DEFAULT_BASE_RETRY_MS;
                 // On ACK, commit the cached block (advance bytesTransferred) and clear cache
@@ -735,7 +1236,7 @@ void ZModemEngine::_handleXmodemSender() {
                 if (_xmodemSendRetry++ >= XMODEM_MAX_RETRIES) { _state = STATE_ERROR; return; }
                 _xmodemSendInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemSendInterval * 2UL);
                 // leave _xmodemLastPending true and schedule immediate resend
-                _xmodemSendLast = 0; // trigger resend below
+                _xmodemSendIdle(); // trigger resend below
             } else if (r == XCAN) {
                 _state = STATE_ERROR; return;
             } else {
@@ -746,18 +1247,18 @@ void ZModemEngine::_handleXmodemSender() {
     }
 
     // Send next block if any
-    if (_file && !_file->available() && _bytesTransferred < _fileSize) {
+    if (_source && !_sourceRemaining() && _bytesTransferred < _fileSize) {
         // Ensure file pointer is at correct offset
-        _file->seek(_bytesTransferred);
+        _seekSource(_bytesTransferred);
     }
 
     if (_bytesTransferred >= _fileSize) {
         // No more data: send EOT and wait for ACK
-        if (_xmodemSendLast == 0) {
+        if (!_xmodemSendAwaiting) {
             _io->write(XEOT);
-            _xmodemSendLast = millis();
             _xmodemSendRetry = 0;
             _xmodemSendInterval = DEFAULT_BASE_RETRY_MS;
+            _xmodemSendArm();
             return;
         } else {
             // waiting for ACK for EOT
@@ -771,18 +1272,18 @@ void ZModemEngine::_handleXmodemSender() {
                         _state = STATE_ERROR;
                         return;
                     }
-                    _xmodemSendLast = 0; // resend EOT
+                    _xmodemSendIdle(); // resend EOT
                     _xmodemSendInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemSendInterval * 2UL);
                     return;
                 }
             }
             // timeout handling
-            if (millis() - _xmodemSendLast >= _xmodemSendInterval) {
+            if (!_xmodemTimer.isArmed()) {
                 if (_xmodemSendRetry++ >= XMODEM_MAX_RETRIES) {
                     _state = STATE_ERROR;
                     return;
                 }
-                _xmodemSendLast = 0; // resend
+                _xmodemSendIdle(); // resend
                 _xmodemSendInterval = min((unsigned long)MAX_RETRY_INTERVAL_MS, _xmodemSendInterval * 2UL);
             }
             return;
@@ -791,12 +1292,17 @@ void ZModemEngine::_handleXmodemSender() {
 
     // Prepare/send block using cached buffer when available. This avoids extra
     // file seeks/reads on retransmit and enables immediate resend of the last block.
+    if (!_xmodemLastBlock) {
+        _xmodemLastBlock = _pool->acquire(XMODEM_BLOCK_SIZE);
+        if (!_xmodemLastBlock) return; // pool dry: retry on a later tick
+    }
     if (!_xmodemLastPending) {
         // Need to fill cache with next block
-        if (_file) {
+        if (_source) {
             // ensure file pointer
-            _file->seek(_bytesTransferred);
-            size_t readLen = _file->read(_xmodemLastBlock, 128);
+            _seekSource(_bytesTransferred);
+            if (!_storageReadyFor(0)) return;
+            size_t readLen = _readSource(_xmodemLastBlock, 128);
             _xmodemLastLen = readLen;
             // pad if short
             if (_xmodemLastLen < 128) {
@@ -825,165 +1331,38 @@ void ZModemEngine::_handleXmodemSender() {
         _io->write(sum);
     }
 
-    _xmodemSendLast = millis();
     _xmodemSendRetry = 0;
     _xmodemSendInterval = DEFAULT_BASE_RETRY_MS;
+    _xmodemSendArm();
 }
 
-
-// --- Low Level Protocol (Unchanged, simplified implementation) ---
-
-void ZModemEngine::_sendHexHeader(uint8_t type, const uint8_t* flags) {
-    uint16_t crc = 0;
-    
-    _io->write(ZPAD); _io->write(ZPAD);
-    _io->write(ZDLE); _io->write(ZHEX);
-    
-    char hexBuf[12];
-    sprintf(hexBuf, "%02X%02X%02X%02X%02X", type, flags[0], flags[1], flags[2], flags[3]);
-    
-    crc = _updcrc(type, crc);
-    crc = _updcrc(flags[0], crc);
-    crc = _updcrc(flags[1], crc);
-    crc = _updcrc(flags[2], crc);
-    crc = _updcrc(flags[3], crc);
-    
-    _io->print(hexBuf);
-    
-    sprintf(hexBuf, "%02X%02X", (crc >> 8) & 0xFF, crc & 0xFF);
-    _io->print(hexBuf);
-    
-    _io->write('\r'); _io->write('\n');
-    if (type != ZFIN && type != ZACK) _io->write(0x11); // XON
+void ZModemEngine::_xmodemSendIdle() {
+    _xmodemSendAwaiting = false;
+    _timers->cancel(_xmodemTimer);
 }
 
-void ZModemEngine::_sendBinaryHeader(uint8_t type, const uint8_t* flags) {
-    uint16_t crc = 0;
-    _io->write(ZPAD); _io->write(ZDLE); _io->write(ZBIN);
-    
-    // ZDLE-escape helper: writes byte with escaping for control chars
-    auto zdleWrite = [&](uint8_t b) {
-        if (b == ZDLE || b == 0x10 || b == 0x11 || b == 0x13 || (b & 0x7F) == 0x0D) {
-            _io->write(ZDLE);
-            _io->write((uint8_t)(b ^ 0x40));
-        } else {
-            _io->write(b);
-        }
-    };
-    
-    crc = _updcrc(type, crc);       zdleWrite(type);
-    crc = _updcrc(flags[0], crc);   zdleWrite(flags[0]);
-    crc = _updcrc(flags[1], crc);   zdleWrite(flags[1]);
-    crc = _updcrc(flags[2], crc);   zdleWrite(flags[2]);
-    crc = _updcrc(flags[3], crc);   zdleWrite(flags[3]);
-    
-    zdleWrite((crc >> 8) & 0xFF);
-    zdleWrite(crc & 0xFF);
-}
-
-void ZModemEngine::_sendDataSubpacket(const uint8_t* data, size_t len, bool endFrame) {
-    uint16_t crc = 0;
-    for(size_t i=0; i<len; i++) {
-        // Simple escaping for ZDLE
-        // This is highly simplified and avoids complex 7E/9E escaping needed in traditional ZModem
-        // It only checks for ZDLE and common control codes
-        if (data[i] == ZDLE || data[i] == 0x10 || data[i] == 0x11 || data[i] == 0x13 || data[i] == 0x0d || data[i] == 0x8d) {
-             _io->write(ZDLE);
-             uint8_t esc = data[i] ^ 0x40;
-             _io->write(esc);
-             crc = _updcrc(data[i], crc); // CRC calculated on ORIGINAL byte
-        } else {
-             _io->write(data[i]);
-             crc = _updcrc(data[i], crc);
-        }
-    }
-    
-    _io->write(ZDLE);
-    _io->write(endFrame ? ZCRCE : ZCRCG); 
-    crc = _updcrc(endFrame ? ZCRCE : ZCRCG, crc);
-    
-    _io->write((crc >> 8) & 0xFF);
-    _io->write(crc & 0xFF);
+void ZModemEngine::_xmodemSendArm() {
+    _xmodemSendAwaiting = true;
+    _timers->arm(_xmodemTimer, _xmodemSendInterval);
 }
 
-// Simple CRC16 XMODEM update
-uint16_t ZModemEngine::_updcrc(uint8_t c, uint16_t crc) {
-    int count;
-    crc = crc ^ (((uint16_t)c) << 8);
-    for (count = 0; count < 8; count++) {
-        if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
-        else crc = crc << 1;
-    }
-    return crc;
-}
 
-// Compute 16-bit CRC-CCITT for buffer (compatible with XMODEM-CRC)
-uint16_t ZModemEngine::_calcCRC16(const uint8_t* data, size_t len) {
-    uint16_t crc = 0;
-    for (size_t i = 0; i < len; ++i) {
-        crc = _updcrc(data[i], crc);
-    }
-    return crc;
-}
+// --- Input buffer ---
 
-// Simplified Header Reader
-int ZModemEngine::_readHexHeader(uint8_t& type, uint8_t* flags) {
+// Header Reader (hex and binary headers)
+int ZModemEngine::_readHeader(uint8_t& type, uint8_t* flags) {
     // Non-destructive header parsing using internal buffer. We fill from
     // _io when available and parse only from _inBuf; bytes are removed from
     // the buffer only when a complete header is consumed.
-
     _fillInput();
-
-    // Scan forward to find the header start sequence (ZPAD ZPAD ZDLE ZHEX),
-    // discarding any leading garbage (e.g. XON bytes, CR/LF from previous frames).
-    while (_inBufLen >= 4) {
-        if (_inBuf[0] == ZPAD && _inBuf[1] == ZPAD && _inBuf[2] == ZDLE && _inBuf[3] == ZHEX)
-            break;
-        memmove(_inBuf, _inBuf + 1, _inBufLen - 1);
-        _inBufLen--;
-    }
-
-    // Minimum expected header length: 4 control bytes + 2(type) + 8(flags) + 4(crc) + 2(CRLF) = 20
-    const size_t MIN_HDR_LEN = 20;
-    if (_inBufLen < MIN_HDR_LEN) return 0;
-
-    // Ensure we have all ascii hex characters following
-    // ascii hex digits start at index 4 and span 16 bytes (2 + 8 + 4 + 2)
-    if (_inBufLen < 4 + 16) return 0;
-
-    auto hexToByte = [](uint8_t hi, uint8_t lo) -> uint8_t {
-        auto val = [](uint8_t c)->int {
-            if (c >= '0' && c <= '9') return c - '0';
-            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-            return -1;
-        };
-        int h = val(hi); int l = val(lo);
-        if (h < 0 || l < 0) return 0;
-        return (uint8_t)((h << 4) | l);
-    };
-
-    // Parse type
-    type = hexToByte(_inBuf[4], _inBuf[5]);
-    // Parse 4 flags (each two hex chars)
-    for (int i = 0; i < 4; ++i) {
-        size_t idx = 6 + i * 2;
-        flags[i] = hexToByte(_inBuf[idx], _inBuf[idx+1]);
-    }
-
-    // We consumed 4 control bytes + 16 ascii hex chars = 20 bytes
-    size_t consumed = 4 + 16;
-    // Remove consumed bytes from buffer
-    if (consumed < _inBufLen) memmove(_inBuf, _inBuf + consumed, _inBufLen - consumed);
-    _inBufLen -= consumed;
-    return 1;
+    return ZModemFraming::readHeader(_inBuf, _inBufLen, type, flags);
 }
 
 void ZModemEngine::_fillInput() {
-    if (!_io) return;
+    if (!_io || !_inBuf) return;
     int avail = _io->available();
     if (avail <= 0) return;
-    size_t space = sizeof(_inBuf) - _inBufLen;
+    size_t space = IN_BUF_SIZE - _inBufLen;
     if (space == 0) return;
     int toRead = avail < (int)space ? avail : (int)space;
     for (int i = 0; i < toRead; ++i) {
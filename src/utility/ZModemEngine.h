@@ -13,35 +13,13 @@
 #include <Arduino.h>
 #include <Stream.h>
 #include <FS.h>
-
-// ZModem Control Characters
-#define ZPAD  0x2A // '*'
-#define ZDLE  0x18 // CAN
-#define ZDLEE 0x58 // 'X' (Escaped ZDLE)
-#define ZBIN  0x41 // 'A'
-#define ZHEX  0x42 // 'B'
-#define ZBIN32 0x43 // 'C'
-
-// Frame Types
-#define ZRQINIT 0
-#define ZRINIT  1
-#define ZSINIT  2
-#define ZACK    3
-#define ZFILE   4
-#define ZSKIP   5
-#define ZNAK    6
-#define ZABORT  7
-#define ZFIN    8
-#define ZRPOS   9
-#define ZDATA   10
-#define ZEOF    11
-#define ZFERR   12
-#define ZCRC    13
-#define ZCHALLENGE 14
-#define ZCOMPL  15
-#define ZCAN    16
-#define ZFREECNT 17
-#define ZCOMMAND 18
+#include "ZModemBufferPool.h"
+#include "ZModemTimerWheel.h"
+#include "ZModemFraming.h"
+#include "ZModemDataIO.h"
+#include "ZModemStorageWorker.h"
+#include "ZModemWriteCoalescer.h"
+#include "ZModemSha256.h"
 
 class ZModemEngine {
 public:
@@ -70,32 +48,134 @@ public:
     };
 
     ZModemEngine();
+    ~ZModemEngine();
     
     // Setup the IO channels
     void begin(Stream& ioStream);
+    // Working buffers are borrowed from this pool by send()/receive() and
+    // returned when the transfer ends. Must be set before starting.
+    void setBufferPool(ZModemBufferPool* pool) { _pool = pool; }
+    // Retry, keepalive and inactivity deadlines are armed on this wheel; the
+    // owner advances it before calling loop(). Must be set before starting.
+    void setTimerWheel(ZModemTimerWheel* wheel) { _timers = wheel; }
     
     // Set the file storage stream
     void setFileStream(File* file, const String& filename, size_t fileSize);
     // C-string overload to avoid Arduino String allocations where possible
     void setFileStream(File* file, const char* filename, size_t fileSize);
+    // Sender: send from any source, announced under 'filename'. The source
+    // must outlive the transfer.
+    void setSource(ZModemSource* source, const char* filename, size_t fileSize);
+    // Receiver: append to any sink instead of a file. It is finalized at
+    // ZEOF, or with false if the transfer fails first.
+    void setSink(ZModemSink* sink) { setSource(nullptr, nullptr, 0); _sink = sink; }
+    // Receiver only, after setFileStream(): the file already holds this many
+    // bytes (opened for append), so the sender is asked to continue from here
+    void setResumeOffset(size_t offset) { _bytesTransferred = offset; }
+    // Receiver: called once when ZFILE names the file, before the answer.
+    // 'offset' is where the receive continues and may be changed (e.g. to 0
+    // when the partial file belongs to another transfer; the owner has then
+    // rewound the file). Returning false refuses the file.
+    typedef bool (*AnnounceFn)(void* ctx, const char* name, size_t size, size_t& offset);
+    void onAnnounce(AnnounceFn fn, void* ctx) { _announceFn = fn; _announceCtx = ctx; }
+    // Receiver: a session going on with another file once the current one
+    // is complete. 'fn' is called with the new file's name and size, after
+    // the previous file is finalized; the owner points the sink at the new
+    // file and may change 'offset' (0). Returning false skips the file.
+    // Without it, every file after the first is skipped.
+    void onNextFile(AnnounceFn fn, void* ctx) { _nextFileFn = fn; _nextFileCtx = ctx; }
+    // Sender: several files in one session, behind one handshake. 'next'
+    // names the file after the current one (false: there is none), so its
+    // ZFILE can go out right behind ZEOF, before the receiver answers it.
+    // 'done' is called once the receiver has the current file (delivered)
+    // or skipped it; it attaches the file 'next' named with setSource() or
+    // setFileStream() and returns true, or returns false to end the session.
+    typedef bool (*NextFileFn)(void* ctx, char* name, size_t cap, size_t& size);
+    typedef bool (*FileDoneFn)(void* ctx, bool delivered);
+    void onBatch(NextFileFn next, FileDoneFn done, void* ctx) { _batchNextFn = next; _batchDoneFn = done; _batchCtx = ctx; }
+    // Sender: announce the file with ZCRESUM, so a receiver that already
+    // holds the start of it continues from there. Receiver: whether the
+    // last ZFILE asked for that (read it from the announce callback).
+    void setCrashRecovery(bool on) { _crashRecovery = on; }
+    bool isCrashRecovery() const { return _crashRecovery; }
+    // Receiver: advertise CANJOIN in the handshake ZRINIT. Sender: whether
+    // the receiver's ZRINIT did, so another stream may skip the handshake.
+    void setAcceptsJoins(bool on) { _rinitFlags[ZF1] = on ? CANJOIN : 0; }
+    bool peerAcceptsJoins() const { return _peerJoins; }
+#if AKZ_ENABLE_STORAGE_WORKER
+    // File reads and writes go through this channel, already opened on the
+    // file by the owner, instead of the File itself. nullptr: inline I/O.
+    void setStorage(ZModemStorageChannel* channel) { _storage = channel; }
+#endif
     
-    // Start operations
-    bool send(unsigned long timeout);
-    bool receive(unsigned long timeout);
+    // Start operations. skipHandshake starts a sender at ZFILE, for a stream
+    // joining a peer that already answered ZRINIT; a joined receiver skips
+    // its opening ZRINIT.
+    bool send(unsigned long timeout, bool skipHandshake = false);
+    bool receive(unsigned long timeout, bool joined = false);
+    // Sender only: while held, new data chunks wait (a higher-priority stream
+    // to the same peer is streaming); ACKs and retransmits carry on, and one
+    // chunk goes out every maxDeferMs to keep the peer from timing out
+    void setHold(bool hold, uint32_t maxDeferMs);
     void abort();
+    // Receiver: write out data still held for coalescing. The owner calls
+    // this before closing the file.
+    void flushWrites();
+    // Receiver: bytes held for coalescing, counted as received but not written
+    size_t pendingWrites() const;
+#if AKZ_ENABLE_FILE_INDEX
+    // Receiver: SHA-256 of the current file, taken as its data was written.
+    // False unless all of it arrived in this session, from offset 0.
+    bool receivedSha256(uint8_t out[ZModemSha256::DIGEST_SIZE]) { return _rxHash.finish(_bytesTransferred, out); }
+#endif
 
-    // Main Loop
-    int loop(); // Returns 0 for busy, 1 for complete, -1 for error
+    // Main Loop. Returns 0 for busy, 1 for complete, -1 for error.
+    // With a non-zero budget the tick stops after the first header or
+    // subpacket that takes it past budgetUs; the rest stays buffered and
+    // hasPendingWork() reports it. 0 processes everything buffered.
+    int loop(uint32_t budgetUs = 0);
 
     // Getters
     size_t getBytesTransferred() const { return _bytesTransferred; }
+    // Sender: bytes the receiver has acknowledged, the chunk in flight excluded
+    size_t getAckedBytes() const { return _lastDataPending ? _lastDataPos : _bytesTransferred; }
     size_t getFileSize() const { return _fileSize; }
     const char* getFilename() const { return _filename; }
     State getState() const { return _state; }
+    // True when loop() has work right now (buffered input, a fired timer or
+    // data ready to stream); false while it only waits on the peer or a timer
+    bool hasPendingWork();
+    // Stopped until the storage worker has read the next block or made room
+    // in the write queue; the owner polls (or is woken) meanwhile
+    bool isWaitingOnStorage() const { return _storageWait; }
+    // Receiver: a write came back short
+    bool hasWriteError() const { return _storageFailed(); }
+    // Longest single loop() call so far, in microseconds
+    uint32_t getMaxLoopUs() const { return _maxLoopUs; }
+    // Bytes currently borrowed from the buffer pool (0 when idle)
+    size_t getBorrowedBytes() const;
+    // Pool bytes a transfer holds from send()/receive() to the end; the
+    // ZFILE and XMODEM buffers come and go on top and tolerate a dry pool
+    static size_t committedBytes(bool sending) {
+        size_t n = ZModemBufferPool::footprint(IN_BUF_SIZE) + (sending ? ZModemBufferPool::footprint(CHUNK_SIZE) : 0);
+#if AKZ_HAVE_WRITE_COALESCER
+        if (!sending) n += ZModemBufferPool::footprint(ZModemWriteCoalescer::UNIT);
+#endif
+        return n;
+    }
+
+    // Sizes of the borrowed working buffers
+    static const size_t IN_BUF_SIZE = 512;     // escaped input awaiting parse
+    static const size_t CHUNK_SIZE = 256;      // sender data chunk / retransmit cache
+    static const size_t FILE_INFO_SIZE = 256;  // ZFILE subpacket, transient: received, or the sender's next file
+    static const size_t XMODEM_BLOCK_SIZE = 128;
 
 private:
     Stream* _io;
-    File* _file;
+    ZModemSource* _source = nullptr;
+    ZModemSink* _sink = nullptr;
+    ZModemFileSource _fileSource;  // setFileStream() adapters
+    ZModemFileSink _fileSink;
     
     // Transfer context
     static const size_t FILENAME_MAX_LEN = 128;
@@ -104,38 +184,127 @@ private:
     size_t _bytesTransferred;
     unsigned long _operationStartTime;
     unsigned long _timeoutMs;
-    unsigned long _lastActivity;
     
     // State Machines
     State _state;
     ReceiveState _rState;
     bool _isSender;
     
-    // Buffers
-    uint8_t _txBuffer[256]; // Small chunk size for LoRa
+    // Buffers are borrowed from the pool only while a transfer runs, so an
+    // idle engine is just this control block
+    ZModemBufferPool* _pool = nullptr;
+    bool _acquireBuffers();
+    void _releaseBuffers();
 
-    // Sender/receiver timing (replaces function-static variables)
-    unsigned long _senderLastSend;
-    unsigned long _receiverLastAck;
+    // Deadlines live on the shared wheel instead of being polled with
+    // millis() every tick. An unarmed timer means "due now".
+    ZModemTimerWheel* _timers = nullptr;
+    ZModemTimer _timeoutTimer;  // inactivity timeout
+    ZModemTimer _retryTimer;    // header resend, chunk retransmit, receiver keepalive
+    ZModemTimer _xmodemTimer;   // XMODEM request/block retry
+    ZModemTimer _holdTimer;     // next chunk allowed through a hold
+    bool _hold = false;
+    uint32_t _holdMaxMs = 0;
+    bool _holdDeferred();
+    // Set by timer callbacks and by work that cannot wait; loop() returns
+    // straight away while this is clear and no input is buffered
+    bool _wake = false;
+    // Per-tick work budget; a tick that runs out sets _yielded and resumes
+    // from the buffered input on the next call
+    unsigned long _tickStartUs = 0;
+    uint32_t _tickBudgetUs = 0;
+    bool _yielded = false;
+    uint32_t _maxLoopUs = 0;
+    bool _budgetSpent();
+    static void _onTimer(void* ctx);
+    void _touchActivity();
+    void _cancelTimers();
+    void _enterState(State s);
+    bool _isWaiting() const;
 
     // Retransmit / backoff state
-    uint8_t _lastDataBuf[256];
+    uint8_t* _lastDataBuf = nullptr; // CHUNK_SIZE, sender only
+    const uint8_t* _lastData = nullptr; // last chunk: _lastDataBuf, or in place in the source
     size_t _lastDataLen;
     size_t _lastDataPos; // file offset for the lastDataBuf
     bool _lastDataPending;
-    unsigned long _lastSendTime;
     unsigned long _retryIntervalMs;
     unsigned long _baseRetryIntervalMs;
 
     // File-info parsing for incoming ZFILE header (non-blocking accumulation)
-    uint8_t _fileInfoBuffer[512];
-    size_t _fileInfoIndex;
-    bool _fileInfoEscape;
-    bool _fileInfoAwaitingCRC;
+    uint8_t* _fileInfoBuffer = nullptr; // FILE_INFO_SIZE, borrowed on ZFILE
+    ZModemFraming::FileInfoDecoder _fileInfo;
     // Internal input buffer to avoid destructive reads on Stream
-    uint8_t _inBuf[512];
+    uint8_t* _inBuf = nullptr; // IN_BUF_SIZE
     size_t _inBufLen;
     void _fillInput();
+    void _consumeInput(size_t n) { ZModemFraming::consume(_inBuf, _inBufLen, n); }
+    // Receiver progress: offset named by the last ZDATA header, and whether
+    // the ZFILE announcement has been accepted yet
+    size_t _rxDataPos = 0;
+    bool _fileAnnounced = false;
+    bool _crashRecovery = false; // ZFILE carries (sender) or carried (receiver) ZCRESUM
+    uint8_t _rinitFlags[4] = {0, 0, 0, 0}; // receiver: handshake ZRINIT
+    bool _peerJoins = false;     // sender: the receiver's ZRINIT had CANJOIN
+    // File access, inline or through the storage worker's channel. With a
+    // channel attached the File itself is only touched by the worker.
+#if AKZ_ENABLE_STORAGE_WORKER
+    ZModemStorageChannel* _storage = nullptr;
+#endif
+#if AKZ_HAVE_WRITE_COALESCER
+    ZModemWriteCoalescer _coalescer; // receiver, inline writes only
+#endif
+#if AKZ_ENABLE_FILE_INDEX
+    ZModemRunningSha256 _rxHash; // receiver: every write, for the file index
+#endif
+    bool _writeFailed = false;   // an inline write came back short
+    bool _storageWait = false;   // a step is waiting for the channel
+    size_t _storageNeed = 0;     // queue room it waits for (0: reads, or all writes done)
+    bool _eofPending = false;    // ZEOF answered once queued writes are on disk
+    void _answerEof();
+    bool _storageReadyFor(size_t need);
+    bool _storageReady();
+    bool _storageFailed() const;
+    size_t _sourceRemaining();
+    size_t _readSource(uint8_t* buf, size_t n);
+    const uint8_t* _readChunk(size_t& len);
+    uint8_t* _sinkSpan(size_t& n);
+    bool _sinkDone = false;      // sink finalized
+    bool _finishSink(bool ok);
+    AnnounceFn _announceFn = nullptr;
+    void* _announceCtx = nullptr;
+    bool _announce();
+    // Multi-file sessions. Sender: the next file's ZFILE payload waits in
+    // _fileInfoBuffer once named (NEXT_PIPELINED).
+    enum NextFile : uint8_t { NEXT_UNKNOWN, NEXT_NONE, NEXT_PIPELINED };
+    uint8_t _fileSeq = 0;        // current file's place in the session (ZFSEQ)
+    NextFile _next = NEXT_UNKNOWN;
+    size_t _nextInfoLen = 0;
+    bool _eofSent = false;       // ZEOF out for the current file since the last ZRPOS
+    NextFileFn _batchNextFn = nullptr;
+    FileDoneFn _batchDoneFn = nullptr;
+    void* _batchCtx = nullptr;
+    void _peekNext();
+    void _nextFile(bool delivered);
+    void _sendFileInfo(uint8_t seq, const uint8_t* payload, size_t len);
+    // Receiver: the file a ZFILE header named, the current file's progress,
+    // and the ZRINIT ending it, held back to go out with the next ZFILE's answer
+    uint8_t _rxFileSeq = 0;
+    bool _fileEnded = false;     // complete and finalized
+    bool _followUp = false;      // not the session's first file
+    bool _skippedCur = false;    // refused by the next-file callback
+    bool _rinitDue = false;
+    AnnounceFn _nextFileFn = nullptr;
+    void* _nextFileCtx = nullptr;
+    bool _endFile();
+    void _switchFile();
+    void _answerFile();
+    void _sendRinit();
+    void _reply(uint8_t type, const uint8_t* flags);
+    bool _staged = false;        // the sink holds chunks from past a gap
+    void _stageAhead(const uint8_t* buf, size_t n);
+    void _seekSource(size_t pos);
+    void _writeSink(const uint8_t* buf, size_t n);
     // Optional debug stream for logging
     Stream* _debug = nullptr;
     void setDebug(Stream* debugStream) { _debug = debugStream; }
@@ -147,37 +316,41 @@ private:
     bool _xmodemUseCRC = true; // prefer CRC mode
     uint8_t _xmodemExpectedBlock = 1;
     int _xmodemRetryCount = 0;
-    unsigned long _xmodemLastSend = 0;
     unsigned long _xmodemRetryInterval = 0;
     static const int XMODEM_MAX_RETRIES = 8;
     // XMODEM sender state
     bool _xmodemSendStarted = false;
     uint8_t _xmodemSendBlock = 1;
     int _xmodemSendRetry = 0;
-    unsigned long _xmodemSendLast = 0;
+    bool _xmodemSendAwaiting = false; // block or EOT sent, waiting for ACK/NAK
     unsigned long _xmodemSendInterval = 0;
+    void _xmodemSendIdle();
+    void _xmodemSendArm();
     // Cached last-sent XMODEM block to allow immediate retransmit without file seek
-    uint8_t _xmodemLastBlock[128];
+    uint8_t* _xmodemLastBlock = nullptr; // XMODEM_BLOCK_SIZE, borrowed on first block
     size_t _xmodemLastLen = 0;
     size_t _xmodemLastPos = 0; // file offset for the last-sent block
     bool _xmodemLastPending = false;
     
     // CRC Helpers
-    uint16_t _calcCRC16(const uint8_t* data, size_t len);
-    uint16_t _updcrc(uint8_t c, uint16_t crc);
+    uint16_t _calcCRC16(const uint8_t* data, size_t len) { return ZModemFraming::crc16(data, len); }
     
-    // Low Level ZModem OPS
-    void _sendHexHeader(uint8_t type, const uint8_t* flags);
-    void _sendBinaryHeader(uint8_t type, const uint8_t* flags);
-    void _sendDataSubpacket(const uint8_t* data, size_t len, bool endFrame);
+    // Low Level ZModem OPS (wire format lives in ZModemFraming)
+    void _sendHexHeader(uint8_t type, const uint8_t* flags) { ZModemFraming::sendHexHeader(*_io, type, flags); }
+    void _sendBinaryHeader(uint8_t type, const uint8_t* flags) { ZModemFraming::sendBinaryHeader(*_io, type, flags); }
+    void _sendDataSubpacket(const uint8_t* data, size_t len, bool endFrame) { ZModemFraming::sendDataSubpacket(*_io, data, len, endFrame); }
     
     // Input Handling
-    void _processInput();
-    int _readHexHeader(uint8_t& type, uint8_t* flags);
+    int _readHeader(uint8_t& type, uint8_t* flags); // hex or binary header
+    static size_t _getPos(const uint8_t* flags) { return ZModemFraming::getPos(flags); }
+    static void _putPos(uint8_t* flags, size_t pos) { ZModemFraming::putPos(flags, pos); }
     
     // Helper State handlers
     void _handleSenderLoop();
     void _handleReceiverLoop();
+    void _handleReceiverHeader(uint8_t rxType, const uint8_t* rxFlags);
+    bool _readFileInfoSubpacket();
+    bool _readDataSubpacket();
     // XMODEM fallback handlers
     void _handleXmodemReceiver();
     void _handleXmodemSender();
@@ -188,6 +361,8 @@ private:
 
     static const unsigned long DEFAULT_BASE_RETRY_MS = 500; // 0.5s base retry
     static const unsigned long MAX_RETRY_INTERVAL_MS = 8000; // cap backoff
+    static const unsigned long HEADER_RETRY_MS = 1000; // resend ZRQINIT/ZFILE/ZEOF/ZFIN
+    static const unsigned long KEEPALIVE_MS = 3000; // receiver ZRINIT until ZFILE arrives
 };
 
 #endif // ZMODEM_ENGINE_H
@@ -0,0 +1,112 @@
+/**
+ * @file ZModemEngineTask.cpp
+ * @author Akita Engineering
+ * @brief Engine thread and session lock, FreeRTOS or std::thread backed.
+ * @version 1.1.0
+ */
+
+#include "ZModemEngineTask.h"
+
+#if AKZ_HAVE_WORKER_THREADS
+
+#if defined(ESP32)
+
+#if AKZ_ENABLE_ENGINE_TASK
+ZModemMutex::ZModemMutex() { _handle = xSemaphoreCreateRecursiveMutex(); }
+ZModemMutex::~ZModemMutex() { if (_handle) vSemaphoreDelete(_handle); }
+void ZModemMutex::lock() { xSemaphoreTakeRecursive(_handle, portMAX_DELAY); }
+void ZModemMutex::unlock() { xSemaphoreGiveRecursive(_handle); }
+#endif
+
+bool ZModemEngineTask::start(StepFn step, void* ctx, const char* name, uint32_t stack, int priority, int core) {
+    if (_running.load()) return true;
+    _step = step;
+    _ctx = ctx;
+    _stopRequested = false;
+    _running = true;
+    if (xTaskCreatePinnedToCore(_entry, name, stack, this, priority, &_handle, core) != pdPASS) {
+        _running = false;
+        _handle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void ZModemEngineTask::stop() {
+    if (!_running.load()) return;
+    _stopRequested = true;
+    wake();
+    while (_running.load()) vTaskDelay(1);
+    _handle = nullptr;
+}
+
+void ZModemEngineTask::wake() {
+    TaskHandle_t h = _handle;
+    if (h) xTaskNotifyGive(h);
+}
+
+void ZModemEngineTask::_entry(void* arg) {
+    static_cast<ZModemEngineTask*>(arg)->_run();
+    vTaskDelete(nullptr);
+}
+
+void ZModemEngineTask::_run() {
+    while (!_stopRequested.load()) {
+        uint32_t ms = _step(_ctx);
+        if (ms > MAX_SLEEP_MS) ms = MAX_SLEEP_MS;
+        // Always block for at least a tick so lower-priority tasks on this
+        // core (and the idle task the watchdog checks) get to run
+        TickType_t ticks = pdMS_TO_TICKS(ms);
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+    }
+    _running = false;
+}
+
+#else // std::thread
+
+#if AKZ_ENABLE_ENGINE_TASK
+ZModemMutex::ZModemMutex() {}
+ZModemMutex::~ZModemMutex() {}
+void ZModemMutex::lock() { _mutex.lock(); }
+void ZModemMutex::unlock() { _mutex.unlock(); }
+#endif
+
+bool ZModemEngineTask::start(StepFn step, void* ctx, const char*, uint32_t, int, int) {
+    if (_running.load()) return true;
+    _step = step;
+    _ctx = ctx;
+    _stopRequested = false;
+    _running = true;
+    _thread = std::thread([this]() { _run(); });
+    return true;
+}
+
+void ZModemEngineTask::stop() {
+    if (!_thread.joinable()) return;
+    _stopRequested = true;
+    wake();
+    _thread.join();
+}
+
+void ZModemEngineTask::wake() {
+    {
+        std::lock_guard<std::mutex> lk(_wakeMutex);
+        _wakePending = true;
+    }
+    _wakeCv.notify_one();
+}
+
+void ZModemEngineTask::_run() {
+    while (!_stopRequested.load()) {
+        uint32_t ms = _step(_ctx);
+        if (ms > MAX_SLEEP_MS) ms = MAX_SLEEP_MS;
+        std::unique_lock<std::mutex> lk(_wakeMutex);
+        _wakeCv.wait_for(lk, std::chrono::milliseconds(ms), [this]() { return _wakePending; });
+        _wakePending = false;
+    }
+    _running = false;
+}
+
+#endif
+
+#endif // AKZ_HAVE_WORKER_THREADS
@@ -0,0 +1,101 @@
+/**
+ * @file ZModemEngineTask.h
+ * @author Akita Engineering
+ * @brief Optional engine thread (FreeRTOS task on ESP32, std::thread
+ * elsewhere) and the session lock shared with the mesh thread. With
+ * AKZ_ENABLE_ENGINE_TASK off the lock compiles away; the thread wrapper is
+ * also used by the storage worker.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_ENGINE_TASK_H
+#define ZMODEM_ENGINE_TASK_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+#if AKZ_HAVE_WORKER_THREADS
+#include <atomic>
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+#endif
+
+// Recursive lock guarding session state against concurrent API calls.
+class ZModemMutex {
+public:
+#if AKZ_ENABLE_ENGINE_TASK
+    ZModemMutex();
+    ~ZModemMutex();
+    void lock();
+    void unlock();
+private:
+#if defined(ESP32)
+    SemaphoreHandle_t _handle;
+#else
+    std::recursive_mutex _mutex;
+#endif
+#else
+    void lock() {}
+    void unlock() {}
+#endif
+};
+
+class ZModemLockGuard {
+public:
+    explicit ZModemLockGuard(ZModemMutex& m) : _m(m) { _m.lock(); }
+    ~ZModemLockGuard() { _m.unlock(); }
+    ZModemLockGuard(const ZModemLockGuard&) = delete;
+    ZModemLockGuard& operator=(const ZModemLockGuard&) = delete;
+private:
+    ZModemMutex& _m;
+};
+
+#if AKZ_HAVE_WORKER_THREADS
+// Runs 'step' repeatedly on its own thread. 'step' returns how long it may
+// sleep (ms); wake() cuts the sleep short, e.g. when a packet is queued.
+class ZModemEngineTask {
+public:
+    typedef uint32_t (*StepFn)(void* ctx);
+
+    ZModemEngineTask() {}
+    ~ZModemEngineTask() { stop(); }
+
+    // The engine task (AKZ_ENGINE_TASK_* settings)
+    bool start(StepFn step, void* ctx) {
+        return start(step, ctx, "akz_engine", AKZ_ENGINE_TASK_STACK, AKZ_ENGINE_TASK_PRIORITY, AKZ_ENGINE_TASK_CORE);
+    }
+    // Name, stack, priority and core only apply to the FreeRTOS task
+    bool start(StepFn step, void* ctx, const char* name, uint32_t stack, int priority, int core);
+    void stop();    // blocks until the thread has left its loop
+    void wake();    // safe from any thread
+    bool isRunning() const { return _running.load(); }
+
+    // Upper bound on one sleep, so work queued without wake() is still seen
+    static const uint32_t MAX_SLEEP_MS = 100;
+
+private:
+    StepFn _step = nullptr;
+    void* _ctx = nullptr;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _stopRequested{false};
+    void _run();
+#if defined(ESP32)
+    TaskHandle_t _handle = nullptr;
+    static void _entry(void* arg);
+#else
+    std::thread _thread;
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCv;
+    bool _wakePending = false;
+#endif
+};
+#endif // AKZ_HAVE_WORKER_THREADS
+
+#endif // ZMODEM_ENGINE_TASK_H
@@ -0,0 +1,284 @@
+/**
+ * @file ZModemFileIndex.cpp
+ * @author Akita Engineering
+ * @brief File metadata index and its on-flash text format.
+ * @version 1.1.0
+ */
+
+#include "ZModemFileIndex.h"
+#include "ZModemAtomicFile.h"
+
+// Header line, then one line per file, in path order:
+//   F <size> <mtime> <sha256 hex, or - if not hashed> <path>
+// The path is the rest of the line.
+static const char* const INDEX_HEADER = "AKZINDEX 1";
+static const size_t INDEX_LINE_MAX = 40 + 2 * ZModemSha256::DIGEST_SIZE + AKZ_JOB_PATH_MAX;
+
+uint8_t ZModemFileIndex::_search(const char* path, bool& found) const {
+    uint8_t lo = 0, hi = _count;
+    while (lo < hi) {
+        uint8_t mid = (uint8_t)((lo + hi) / 2);
+        int c = strcmp(_entries[mid].path, path);
+        if (c == 0) {
+            found = true;
+            return mid;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    found = false;
+    return lo;
+}
+
+const ZModemFileEntry* ZModemFileIndex::find(const char* path) const {
+    bool found;
+    uint8_t i = _search(path, found);
+    return found ? &_entries[i] : nullptr;
+}
+
+ZModemFileEntry* ZModemFileIndex::_insert(const char* path) {
+    bool found;
+    uint8_t i = _search(path, found);
+    if (found) return &_entries[i];
+    if (_count == CAPACITY) {
+        // Full: the entry looked up least recently makes room
+        uint8_t lru = 0;
+        for (uint8_t k = 1; k < _count; ++k) {
+            if ((int32_t)(_entries[k].used - _entries[lru].used) < 0) lru = k;
+        }
+        remove(_entries[lru].path);
+        i = _search(path, found);
+    }
+    memmove(&_entries[i + 1], &_entries[i], (_count - i) * sizeof(ZModemFileEntry));
+    _count++;
+    ZModemFileEntry& e = _entries[i];
+    memset(&e, 0, sizeof(e));
+    strncpy(e.path, path, sizeof(e.path) - 1);
+    e.used = _clock;
+    dirty = true;
+    return &e;
+}
+
+void ZModemFileIndex::remove(const char* path) {
+    bool found;
+    uint8_t i = _search(path, found);
+    if (!found) return;
+    memmove(&_entries[i], &_entries[i + 1], (_count - i - 1) * sizeof(ZModemFileEntry));
+    _count--;
+    dirty = true;
+}
+
+const ZModemFileEntry* ZModemFileIndex::lookup(FS& fs, const char* path) {
+    if (!path || strlen(path) >= AKZ_JOB_PATH_MAX) return nullptr;
+    uint32_t size, mtime;
+    if (!stat(fs, path, size, mtime)) {
+        remove(path);
+        return nullptr;
+    }
+    ZModemFileEntry* e = _insert(path);
+    e->used = ++_clock;
+    // Unchanged since it was indexed: no need to read it
+    if (e->hashed && e->size == size && e->mtime == mtime) return e;
+    e->hashed = hashFile(fs, path, e->sha256);
+    e->size = size;
+    e->mtime = mtime;
+    dirty = true;
+    return e->hashed ? e : nullptr;
+}
+
+const ZModemFileEntry* ZModemFileIndex::refresh(FS& fs, const char* path) {
+    if (!path || strlen(path) >= AKZ_JOB_PATH_MAX) return nullptr;
+    uint32_t size, mtime;
+    if (!stat(fs, path, size, mtime)) {
+        remove(path);
+        return nullptr;
+    }
+    ZModemFileEntry* e = _insert(path);
+    e->used = ++_clock;
+    if (e->size == size && e->mtime == mtime) return e;
+    e->hashed = false;
+    e->size = size;
+    e->mtime = mtime;
+    dirty = true;
+    return e;
+}
+
+bool ZModemFileIndex::hashPending() const {
+    if (_hashing) return true;
+    for (uint8_t i = 0; i < _count; ++i) {
+        if (!_entries[i].hashed) return true;
+    }
+    return false;
+}
+
+bool ZModemFileIndex::hashStep(FS& fs, size_t bytes) {
+    if (!_hashing) {
+        uint8_t i = 0;
+        while (i < _count && _entries[i].hashed) i++;
+        if (i == _count) return false;
+        const ZModemFileEntry& e = _entries[i];
+        _hashing = fs.open(e.path, FILE_READ);
+        if (!_hashing || _hashing.isDirectory()) {
+            _hashing.close();
+            remove(e.path); // gone, or not a file any more
+            return true;
+        }
+        memcpy(_hashPath, e.path, sizeof(_hashPath));
+        _hashSize = e.size;
+        _hashMtime = e.mtime;
+        _hashSha.begin();
+    }
+    uint8_t buf[256];
+    for (size_t done = 0; done < bytes;) {
+        size_t n = _hashing.read(buf, sizeof(buf));
+        if (n == 0) {
+            _endHash(fs);
+            return true;
+        }
+        _hashSha.update(buf, n);
+        done += n;
+    }
+    return true;
+}
+
+// The file has been read to its end: record the hash if neither the file nor
+// its entry changed meanwhile, else bring the entry up to date so the next
+// step starts over on it
+void ZModemFileIndex::_endHash(FS& fs) {
+    _hashing.close();
+    bool found;
+    uint8_t i = _search(_hashPath, found);
+    if (!found || _entries[i].hashed) return;
+    ZModemFileEntry& e = _entries[i];
+    uint32_t size, mtime;
+    if (!stat(fs, _hashPath, size, mtime)) {
+        remove(_hashPath);
+    } else if (size == _hashSize && mtime == _hashMtime && e.size == size && e.mtime == mtime) {
+        _hashSha.finish(e.sha256);
+        e.hashed = true;
+        dirty = true;
+    } else {
+        e.size = size;
+        e.mtime = mtime;
+        dirty = true;
+    }
+}
+
+void ZModemFileIndex::noteWritten(FS& fs, const char* path, const uint8_t* sha256) {
+    if (!path || strlen(path) >= AKZ_JOB_PATH_MAX) return;
+    uint32_t size, mtime;
+    if (!stat(fs, path, size, mtime)) {
+        remove(path);
+        return;
+    }
+    ZModemFileEntry* e = _insert(path);
+    e->size = size;
+    e->mtime = mtime;
+    e->hashed = sha256 != nullptr;
+    if (sha256) memcpy(e->sha256, sha256, sizeof(e->sha256));
+    dirty = true;
+}
+
+bool ZModemFileIndex::stat(FS& fs, const char* path, uint32_t& size, uint32_t& mtime) {
+    File f = fs.open(path, FILE_READ);
+    if (!f || f.isDirectory()) return false;
+    size = (uint32_t)f.size();
+#if AKZ_FS_HAS_MTIME
+    mtime = (uint32_t)f.getLastWrite();
+#else
+    mtime = 0;
+#endif
+    f.close();
+    return true;
+}
+
+bool ZModemFileIndex::hashFile(FS& fs, const char* path, uint8_t out[ZModemSha256::DIGEST_SIZE]) {
+    File f = fs.open(path, FILE_READ);
+    if (!f || f.isDirectory()) return false;
+    ZModemSha256 sha;
+    uint8_t buf[256];
+    for (;;) {
+        size_t n = f.read(buf, sizeof(buf));
+        if (n == 0) break;
+        sha.update(buf, n);
+    }
+    f.close();
+    sha.finish(out);
+    return true;
+}
+
+bool ZModemFileIndex::save(FS& fs, const char* path) {
+    auto write = [](File& f, const void* ctx) { return static_cast<const ZModemFileIndex*>(ctx)->_write(f); };
+    if (!akzAtomicRewrite(fs, path, write, this)) return false;
+    dirty = false;
+    return true;
+}
+
+bool ZModemFileIndex::_write(File& f) const {
+    char line[INDEX_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "%s\n", INDEX_HEADER);
+    bool ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    for (uint8_t i = 0; ok && i < _count; ++i) {
+        const ZModemFileEntry& e = _entries[i];
+        char hex[2 * ZModemSha256::DIGEST_SIZE + 1] = "-";
+        if (e.hashed) {
+            for (size_t k = 0; k < ZModemSha256::DIGEST_SIZE; ++k) snprintf(hex + 2 * k, 3, "%02x", e.sha256[k]);
+        }
+        n = snprintf(line, sizeof(line), "F %lu %lu %s %s\n", (unsigned long)e.size, (unsigned long)e.mtime, hex, e.path);
+        if (n <= 0 || n >= (int)sizeof(line)) continue; // cannot happen with a bounded path
+        ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    }
+    return ok;
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool ZModemFileIndex::load(FS& fs, const char* path) {
+    File f = akzAtomicOpen(fs, path);
+    if (!f) return false;
+
+    _hashing.close();
+    _count = 0;
+    dirty = false;
+    char line[INDEX_LINE_MAX];
+    bool header = false;
+    while (f.available() && _count < CAPACITY) {
+        size_t len = 0;
+        int c;
+        while ((c = f.read()) >= 0 && c != '\n') {
+            if (len < sizeof(line) - 1) line[len++] = (char)c;
+        }
+        line[len] = '\0';
+        if (!header) {
+            if (strcmp(line, INDEX_HEADER) != 0) break;
+            header = true;
+            continue;
+        }
+        unsigned long size, mtime;
+        char hex[2 * ZModemSha256::DIGEST_SIZE + 1];
+        int pathAt = 0;
+        if (sscanf(line, "F %lu %lu %64s %n", &size, &mtime, hex, &pathAt) != 3 || pathAt == 0 || line[pathAt] == '\0') {
+            continue;
+        }
+        // Written in path order; anything else is not ours
+        if (_count > 0 && strcmp(_entries[_count - 1].path, line + pathAt) >= 0) continue;
+        ZModemFileEntry& e = _entries[_count];
+        memset(&e, 0, sizeof(e));
+        e.size = (uint32_t)size;
+        e.mtime = (uint32_t)mtime;
+        e.hashed = strlen(hex) == 2 * ZModemSha256::DIGEST_SIZE;
+        for (size_t k = 0; e.hashed && k < ZModemSha256::DIGEST_SIZE; ++k) {
+            int hi = hexNibble(hex[2 * k]), lo = hexNibble(hex[2 * k + 1]);
+            if (hi < 0 || lo < 0) e.hashed = false;
+            else e.sha256[k] = (uint8_t)(hi << 4 | lo);
+        }
+        strncpy(e.path, line + pathAt, sizeof(e.path) - 1);
+        _count++;
+    }
+    f.close();
+    return header;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file ZModemFileIndex.h
+ * @author Akita Engineering
+ * @brief Sidecar index of file metadata (size, modification time, SHA-256)
+ * kept sorted by path and persisted to a small text file, so comparing
+ * files does not mean reading them back from flash each time.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_FILE_INDEX_H
+#define ZMODEM_FILE_INDEX_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+#include "ZModemSha256.h"
+
+static_assert(AKZ_FILE_INDEX_CAPACITY > 0 && AKZ_FILE_INDEX_CAPACITY <= 255, "AKZ_FILE_INDEX_CAPACITY must be 1..255");
+
+struct ZModemFileEntry {
+    uint32_t size;
+    uint32_t mtime;     // File::getLastWrite(), 0 where the FS has none
+    bool hashed;        // sha256 is valid; false until first needed
+    uint32_t used;      // lookup order, for eviction
+    uint8_t sha256[ZModemSha256::DIGEST_SIZE];
+    char path[AKZ_JOB_PATH_MAX];
+};
+
+class ZModemFileIndex {
+public:
+    static const uint8_t CAPACITY = AKZ_FILE_INDEX_CAPACITY;
+
+    // Entry for 'path', or nullptr. Binary search; does not touch the FS.
+    const ZModemFileEntry* find(const char* path) const;
+    // Entry for 'path', checked against the file's current size and mtime.
+    // A file changed by other code (or not hashed yet) is hashed again, a
+    // missing one is dropped. nullptr if the file does not exist or the
+    // path is too long.
+    const ZModemFileEntry* lookup(FS& fs, const char* path);
+    // Like lookup(), but never reads the file: a new or changed file gets an
+    // entry without a hash, which hashStep() fills in later.
+    const ZModemFileEntry* refresh(FS& fs, const char* path);
+    // Hash up to 'bytes' more of the next file whose entry has no hash. A
+    // file that changes while it is hashed is started again. False when
+    // every entry is hashed.
+    bool hashStep(FS& fs, size_t bytes);
+    bool hashPending() const;
+    // This library has just written 'path': record its size and mtime, and
+    // its hash when the writer took one as the data went out. Without it the
+    // hash is computed at the next lookup, not on the radio path.
+    void noteWritten(FS& fs, const char* path, const uint8_t* sha256 = nullptr);
+    void remove(const char* path);
+    uint8_t count() const { return _count; }
+    // Entries in path order
+    const ZModemFileEntry& at(uint8_t i) const { return _entries[i]; }
+
+    // Whole-file rewrite through "<path>.tmp"
+    bool save(FS& fs, const char* path);
+    bool load(FS& fs, const char* path);
+
+    bool dirty = false; // changed since the last save()
+
+    // Size and mtime of the file at 'path'; false if it is missing
+    static bool stat(FS& fs, const char* path, uint32_t& size, uint32_t& mtime);
+    static bool hashFile(FS& fs, const char* path, uint8_t out[ZModemSha256::DIGEST_SIZE]);
+
+private:
+    bool _write(File& f) const;
+    void _endHash(FS& fs);
+
+    ZModemFileEntry _entries[CAPACITY];
+    uint8_t _count = 0;
+    uint32_t _clock = 0;
+
+    // hashStep() in progress: the file, and its size and mtime at the start
+    File _hashing;
+    ZModemSha256 _hashSha;
+    char _hashPath[AKZ_JOB_PATH_MAX];
+    uint32_t _hashSize = 0;
+    uint32_t _hashMtime = 0;
+
+    // Position of 'path', or where it would be inserted; 'found' tells which
+    uint8_t _search(const char* path, bool& found) const;
+    ZModemFileEntry* _insert(const char* path);
+};
+
+#endif // ZMODEM_FILE_INDEX_H
@@ -0,0 +1,317 @@
+/**
+ * @file ZModemFraming.cpp
+ * @author Akita Engineering
+ * @brief ZModem wire format implementation.
+ * @version 1.1.0
+ */
+
+#include "ZModemFraming.h"
+
+namespace ZModemFraming {
+
+const uint8_t ZERO_FLAGS[4] = {0, 0, 0, 0};
+
+// Simple CRC16 XMODEM update
+uint16_t updcrc(uint8_t c, uint16_t crc) {
+    int count;
+    crc = crc ^ (((uint16_t)c) << 8);
+    for (count = 0; count < 8; count++) {
+        if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+        else crc = crc << 1;
+    }
+    return crc;
+}
+
+// Compute 16-bit CRC-CCITT for buffer (compatible with XMODEM-CRC)
+uint16_t crc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc = updcrc(data[i], crc);
+    }
+    return crc;
+}
+
+size_t getPos(const uint8_t* flags) {
+    return (size_t)flags[0] | ((size_t)flags[1] << 8) | ((size_t)flags[2] << 16) | ((size_t)flags[3] << 24);
+}
+
+void putPos(uint8_t* flags, size_t pos) {
+    flags[0] = pos & 0xFF;
+    flags[1] = (pos >> 8) & 0xFF;
+    flags[2] = (pos >> 16) & 0xFF;
+    flags[3] = (pos >> 24) & 0xFF;
+}
+
+size_t putFileInfo(uint8_t* out, size_t cap, const char* name, size_t size) {
+    char* payload = (char*)out;
+    size_t used = 0;
+    if (name && name[0]) {
+        strncpy(payload, name, cap - 1);
+        payload[cap - 1] = '\0';
+        used = strnlen(payload, cap);
+    }
+    if (used + 1 < cap) {
+        payload[used++] = '\0';
+        char sizeStr[32];
+        snprintf(sizeStr, sizeof(sizeStr), "%lu", (unsigned long)size);
+        size_t sizeLen = strnlen(sizeStr, sizeof(sizeStr));
+        size_t copyLen = ((used + sizeLen + 1) < cap) ? sizeLen : (cap - used - 1);
+        if (copyLen > 0) {
+            memcpy(payload + used, sizeStr, copyLen);
+            used += copyLen;
+        }
+        if (used < cap) payload[used++] = '\0';
+    }
+    return used;
+}
+
+void getFileInfo(uint8_t* buf, size_t len, char* name, size_t nameCap, size_t& size) {
+    buf[len] = 0;
+    const char* p = (const char*)buf;
+    size_t nameLen = strlen(p);
+    const char* sizeStr = p + nameLen + 1;
+    size = 0;
+    if (nameLen + 1 < len && *sizeStr) size = strtoul(sizeStr, NULL, 10);
+    strncpy(name, p, nameCap - 1);
+    name[nameCap - 1] = '\0';
+}
+
+void sendHexHeader(Stream& io, uint8_t type, const uint8_t* flags) {
+    uint16_t crc = 0;
+
+    io.write(ZPAD); io.write(ZPAD);
+    io.write(ZDLE); io.write(ZHEX);
+
+    char hexBuf[12];
+    sprintf(hexBuf, "%02X%02X%02X%02X%02X", type, flags[0], flags[1], flags[2], flags[3]);
+
+    crc = updcrc(type, crc);
+    crc = updcrc(flags[0], crc);
+    crc = updcrc(flags[1], crc);
+    crc = updcrc(flags[2], crc);
+    crc = updcrc(flags[3], crc);
+
+    io.print(hexBuf);
+
+    sprintf(hexBuf, "%02X%02X", (crc >> 8) & 0xFF, crc & 0xFF);
+    io.print(hexBuf);
+
+    io.write('\r'); io.write('\n');
+    if (type != ZFIN && type != ZACK) io.write(0x11); // XON
+}
+
+void sendBinaryHeader(Stream& io, uint8_t type, const uint8_t* flags) {
+    uint16_t crc = 0;
+    io.write(ZPAD); io.write(ZDLE); io.write(ZBIN);
+
+    // ZDLE-escape helper: writes byte with escaping for control chars
+    auto zdleWrite = [&](uint8_t b) {
+        if (b == ZDLE || b == 0x10 || b == 0x11 || b == 0x13 || (b & 0x7F) == 0x0D) {
+            io.write(ZDLE);
+            io.write((uint8_t)(b ^ 0x40));
+        } else {
+            io.write(b);
+        }
+    };
+
+    crc = updcrc(type, crc);       zdleWrite(type);
+    crc = updcrc(flags[0], crc);   zdleWrite(flags[0]);
+    crc = updcrc(flags[1], crc);   zdleWrite(flags[1]);
+    crc = updcrc(flags[2], crc);   zdleWrite(flags[2]);
+    crc = updcrc(flags[3], crc);   zdleWrite(flags[3]);
+
+    zdleWrite((crc >> 8) & 0xFF);
+    zdleWrite(crc & 0xFF);
+}
+
+void sendDataSubpacket(Stream& io, const uint8_t* data, size_t len, bool endFrame) {
+    uint16_t crc = 0;
+    for(size_t i=0; i<len; i++) {
+        // Simple escaping for ZDLE
+        // This is highly simplified and avoids complex 7E/9E escaping needed in traditional ZModem
+        // It only checks for ZDLE and common control codes
+        if (data[i] == ZDLE || data[i] == 0x10 || data[i] == 0x11 || data[i] == 0x13 || data[i] == 0x0d || data[i] == 0x8d) {
+             io.write(ZDLE);
+             uint8_t esc = data[i] ^ 0x40;
+             io.write(esc);
+             crc = updcrc(data[i], crc); // CRC calculated on ORIGINAL byte
+        } else {
+             io.write(data[i]);
+             crc = updcrc(data[i], crc);
+        }
+    }
+
+    io.write(ZDLE);
+    io.write(endFrame ? ZCRCE : ZCRCG);
+    crc = updcrc(endFrame ? ZCRCE : ZCRCG, crc);
+
+    io.write((crc >> 8) & 0xFF);
+    io.write(crc & 0xFF);
+}
+
+void consume(uint8_t* buf, size_t& len, size_t n) {
+    if (n == 0) return;
+    if (n >= len) { len = 0; return; }
+    memmove(buf, buf + n, len - n);
+    len -= n;
+}
+
+static int hexVal(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+int readHeader(uint8_t* buf, size_t& len, uint8_t& type, uint8_t* flags) {
+    for (;;) {
+        // Scan forward to a ZPAD, discarding leading garbage (e.g. XON bytes,
+        // CR/LF from previous frames, the sender's trailing "OO").
+        size_t skip = 0;
+        while (skip < len && buf[skip] != ZPAD) skip++;
+        consume(buf, len, skip);
+        if (len < 3) return 0;
+
+        uint8_t hdr[7]; // type, 4 flags, 2 CRC bytes
+        size_t consumed = 0;
+
+        if (buf[1] == ZDLE && buf[2] == ZBIN) {
+            // Binary header: ZPAD ZDLE ZBIN, then 7 ZDLE-escaped bytes
+            size_t idx = 3;
+            size_t n = 0;
+            while (n < sizeof(hdr) && idx < len) {
+                uint8_t b = buf[idx++];
+                if (b == ZDLE) {
+                    if (idx >= len) break;
+                    b = buf[idx++] ^ 0x40;
+                }
+                hdr[n++] = b;
+            }
+            if (n < sizeof(hdr)) return 0; // wait for the rest
+            consumed = idx;
+        } else if (buf[1] == ZPAD) {
+            // Hex header: ZPAD ZPAD ZDLE ZHEX + 14 hex digits + CR LF
+            if (len < 4) return 0;
+            if (buf[2] != ZDLE || buf[3] != ZHEX) { consume(buf, len, 1); continue; }
+            if (len < 4 + 14) return 0;
+            bool valid = true;
+            for (size_t i = 0; i < sizeof(hdr); ++i) {
+                int h = hexVal(buf[4 + i * 2]);
+                int l = hexVal(buf[5 + i * 2]);
+                if (h < 0 || l < 0) { valid = false; break; }
+                hdr[i] = (uint8_t)((h << 4) | l);
+            }
+            if (!valid) { consume(buf, len, 1); continue; }
+            consumed = 4 + 14;
+            if (consumed < len && buf[consumed] == '\r') consumed++;
+            if (consumed < len && buf[consumed] == '\n') consumed++;
+        } else {
+            consume(buf, len, 1);
+            continue;
+        }
+
+        uint16_t crc = crc16(hdr, 5);
+        if (crc != (((uint16_t)hdr[5] << 8) | hdr[6])) {
+            // Corrupt header: skip its ZPAD and hunt for the next one
+            consume(buf, len, 1);
+            continue;
+        }
+
+        type = hdr[0];
+        memcpy(flags, hdr + 1, 4);
+        consume(buf, len, consumed);
+        return 1;
+    }
+}
+
+SubpacketResult decodeSubpacket(const uint8_t* buf, size_t len, uint8_t* out, size_t outCap,
+                                size_t& outLen, size_t& consumed) {
+    size_t subidx = 0;
+    size_t idx = 0;
+    bool escape = false;
+    outLen = 0;
+    consumed = 0;
+    while (idx < len) {
+        uint8_t b = buf[idx++];
+
+        if (!escape) {
+            if (b == ZDLE) { escape = true; continue; }
+            // normal data byte
+            if (subidx < outCap) out[subidx++] = b;
+            else break; // oversized
+            continue;
+        }
+
+        // escaped byte or end-of-subpacket marker
+        escape = false;
+        if (b == ZBIN || b == ZHEX) {
+            // ZDLE+ZBIN/ZHEX never occurs inside escaped data: the tail of this
+            // subpacket was lost and a new header (usually the retransmit)
+            // started. Drop the partial subpacket and resync on that header.
+            size_t hdrStart = idx - 2;
+            while (hdrStart > 0 && buf[hdrStart - 1] == ZPAD) hdrStart--;
+            consumed = hdrStart;
+            return SUB_RESYNC;
+        }
+        if (b != ZCRCE && b != ZCRCG && b != ZCRCW) {
+            // Normal escaped data byte
+            if (subidx < outCap) out[subidx++] = b ^ 0x40;
+            else break; // oversized
+            continue;
+        }
+
+        // End-of-subpacket marker: need two CRC bytes following
+        if (idx + 2 > len) break;
+        uint16_t receivedCrc = ((uint16_t)buf[idx] << 8) | buf[idx + 1];
+        idx += 2;
+        consumed = idx;
+        outLen = subidx;
+
+        // CRC over unescaped data, including the end marker as the sender does
+        uint16_t crc = updcrc(b, crc16(out, subidx));
+        return crc == receivedCrc ? SUB_OK : SUB_BAD_CRC;
+    }
+    outLen = subidx;
+    return subidx >= outCap ? SUB_OVERSIZE : SUB_INCOMPLETE;
+}
+
+SubpacketResult FileInfoDecoder::feed(const uint8_t* buf, size_t len, uint8_t* out, size_t outCap, size_t& consumed) {
+    size_t idx = 0;
+    consumed = 0;
+    while (idx < len) {
+        uint8_t b = buf[idx++];
+        if (!escape) {
+            if (b == ZDLE) { escape = true; continue; }
+            if (index < outCap - 1) out[index++] = b;
+            else return SUB_OVERSIZE;
+        } else {
+            if (b == ZCRCE || b == ZCRCG || b == ZCRCW) {
+                // End-of-subpacket. Need two CRC bytes; ensure they are buffered
+                if (idx + 2 > len) {
+                    // not enough bytes yet; put back the marker (escape stays set) and wait
+                    idx -= 1;
+                    break;
+                }
+                escape = false;
+                uint16_t receivedCrc = ((uint16_t)buf[idx] << 8) | buf[idx + 1];
+                idx += 2;
+                uint16_t crc = updcrc(b, crc16(out, index));
+                consumed = idx;
+                if (crc != receivedCrc) {
+                    index = 0;
+                    return SUB_BAD_CRC;
+                }
+                return SUB_OK;
+            }
+            escape = false;
+            // Normal escaped byte
+            uint8_t orig = b ^ 0x40;
+            if (index < outCap - 1) out[index++] = orig;
+            else return SUB_OVERSIZE;
+        }
+    }
+    consumed = idx;
+    return SUB_INCOMPLETE;
+}
+
+} // namespace ZModemFraming
@@ -0,0 +1,125 @@
+/**
+ * @file ZModemFraming.h
+ * @author Akita Engineering
+ * @brief ZModem wire format shared by the engines: header and subpacket
+ * encoding, CRC-16 and input-side parsing. Keeping it in one place means
+ * every engine puts exactly the same bytes on the wire.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_FRAMING_H
+#define ZMODEM_FRAMING_H
+
+#include <Arduino.h>
+#include <Stream.h>
+
+// ZModem Control Characters
+#define ZPAD  0x2A // '*'
+#define ZDLE  0x18 // CAN
+#define ZDLEE 0x58 // 'X' (Escaped ZDLE)
+#define ZBIN  0x41 // 'A'
+#define ZHEX  0x42 // 'B'
+#define ZBIN32 0x43 // 'C'
+
+// ZModem Control Frame End (CRCE is final, CRCG/CRCW are intermediate)
+#define ZCRCE 0x45
+#define ZCRCG 0x47
+#define ZCRCW 0x48
+
+// Frame Types
+#define ZRQINIT 0
+#define ZRINIT  1
+#define ZSINIT  2
+#define ZACK    3
+#define ZFILE   4
+#define ZSKIP   5
+#define ZNAK    6
+#define ZABORT  7
+#define ZFIN    8
+#define ZRPOS   9
+#define ZDATA   10
+#define ZEOF    11
+#define ZFERR   12
+#define ZCRC    13
+#define ZCHALLENGE 14
+#define ZCOMPL  15
+#define ZCAN    16
+#define ZFREECNT 17
+#define ZCOMMAND 18
+
+// ZFILE header: index of the conversion option byte, and the option that
+// asks the receiver to continue its copy of the file from its length
+#define ZF0     3
+#define ZCRESUM 3
+// Flag byte carrying a file's place in a multi-file session (0 for the
+// first): set in ZFILE, and in the ZRINIT or ZSKIP that ends that file
+#define ZFSEQ   0
+// ZRINIT capability byte, and the bit a receiver sets when it takes a new
+// stream that skips the handshake on a link it already serves
+#define ZF1     2
+#define CANJOIN 0x40
+
+namespace ZModemFraming {
+
+extern const uint8_t ZERO_FLAGS[4];
+// Longest hex header on the wire, XON included
+const size_t HEX_HEADER_LEN = 21;
+// Longest ZFILE subpacket payload the senders build
+const size_t FILE_INFO_MAX = 128;
+
+// CRC-16/XMODEM
+uint16_t updcrc(uint8_t c, uint16_t crc);
+uint16_t crc16(const uint8_t* data, size_t len);
+
+// Header flags carry a little-endian 32-bit file offset
+size_t getPos(const uint8_t* flags);
+void putPos(uint8_t* flags, size_t pos);
+
+void sendHexHeader(Stream& io, uint8_t type, const uint8_t* flags);
+void sendBinaryHeader(Stream& io, uint8_t type, const uint8_t* flags);
+void sendDataSubpacket(Stream& io, const uint8_t* data, size_t len, bool endFrame);
+
+// ZFILE subpacket payload: filename\0filesize\0, cut to fit 'cap'.
+// Returns its length.
+size_t putFileInfo(uint8_t* out, size_t cap, const char* name, size_t size);
+// Name and size back from a decoded payload of 'len' bytes (out[len] must
+// be writable); the name is cut to nameCap - 1
+void getFileInfo(uint8_t* buf, size_t len, char* name, size_t nameCap, size_t& size);
+
+// Drop the first n bytes of an input buffer holding 'len' bytes
+void consume(uint8_t* buf, size_t& len, size_t n);
+
+// Parse one hex or binary header from the front of 'buf', discarding any
+// garbage before it. Returns 1 and consumes the header when one is complete
+// and its CRC matches, 0 when more input is needed.
+int readHeader(uint8_t* buf, size_t& len, uint8_t& type, uint8_t* flags);
+
+enum SubpacketResult {
+    SUB_INCOMPLETE, // need more input
+    SUB_OK,         // complete, CRC good
+    SUB_BAD_CRC,    // complete, CRC bad
+    SUB_RESYNC,     // tail lost: a new header starts at 'consumed'
+    SUB_OVERSIZE    // decoded data does not fit in 'out'
+};
+
+// Decode one ZDLE-escaped data subpacket from the front of 'buf' into 'out'.
+// Nothing is consumed unless the subpacket completes, so a subpacket split
+// across mesh packets is simply decoded again once the rest arrives. On
+// SUB_OK/SUB_BAD_CRC/SUB_RESYNC 'consumed' is the byte count to drop.
+SubpacketResult decodeSubpacket(const uint8_t* buf, size_t len, uint8_t* out, size_t outCap,
+                                size_t& outLen, size_t& consumed);
+
+// Incremental decoder for the ZFILE subpacket (filename\0filesize\0). Input
+// is consumed as it is decoded; state carries over between calls.
+struct FileInfoDecoder {
+    size_t index = 0;
+    bool escape = false;
+    void reset() { index = 0; escape = false; }
+    // SUB_INCOMPLETE (some or no input consumed), SUB_OK, SUB_BAD_CRC or
+    // SUB_OVERSIZE. 'consumed' is always set.
+    SubpacketResult feed(const uint8_t* buf, size_t len, uint8_t* out, size_t outCap, size_t& consumed);
+};
+
+} // namespace ZModemFraming
+
+#endif // ZMODEM_FRAMING_H
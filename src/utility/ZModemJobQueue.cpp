@@ -0,0 +1,205 @@
+/**
+ * @file ZModemJobQueue.cpp
+ * @author Akita Engineering
+ * @brief Transfer job list and its on-flash text format.
+ * @version 1.1.0
+ */
+
+#include "ZModemJobQueue.h"
+#include "ZModemAtomicFile.h"
+
+// One line per job after the header:
+//   J <id> <S|R> <prio> <failures> <maxAttempts> <resume> <peer> <owner>
+//     <seq> <offset> <deadlineLeftMs> <notBeforeLeftMs> <backoffMs> <path>
+// peer/owner in hex, times relative to the save. The path is the rest of the
+// line so it may contain spaces.
+static const char* const JOB_FILE_HEADER = "AKZJOBS 1";
+static const size_t JOB_LINE_MAX = 96 + AKZ_JOB_PATH_MAX;
+
+ZModemJobQueue::ZModemJobQueue() {
+    memset(_jobs, 0, sizeof(_jobs));
+}
+
+ZModemJob* ZModemJobQueue::add() {
+    for (uint8_t i = 0; i < CAPACITY; ++i) {
+        ZModemJob& j = _jobs[i];
+        if (j.id != 0) continue;
+        memset(&j, 0, sizeof(j));
+        // Ids wrap but skip 0 and any still in use
+        do {
+            j.id = _nextId++;
+        } while (j.id == 0 || _countId(j.id) > 1);
+        j.seq = _nextSeq++;
+        j.session = -1;
+        j.state = ZModemJob::PENDING;
+        dirty = true;
+        return &j;
+    }
+    return nullptr;
+}
+
+uint8_t ZModemJobQueue::_countId(uint16_t id) const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CAPACITY; ++i) if (_jobs[i].id == id) n++;
+    return n;
+}
+
+ZModemJob* ZModemJobQueue::find(uint16_t id) {
+    if (id == 0) return nullptr;
+    for (uint8_t i = 0; i < CAPACITY; ++i) {
+        if (_jobs[i].id == id) return &_jobs[i];
+    }
+    return nullptr;
+}
+
+void ZModemJobQueue::remove(ZModemJob& job) {
+    job.id = 0;
+    dirty = true;
+}
+
+void ZModemJobQueue::moveToFront(ZModemJob& job) {
+    uint32_t first = job.seq;
+    for (uint8_t i = 0; i < CAPACITY; ++i) {
+        const ZModemJob& j = _jobs[i];
+        if (j.id != 0 && j.priority == job.priority && (int32_t)(j.seq - first) < 0) first = j.seq;
+    }
+    if (first != job.seq) {
+        job.seq = first - 1;
+        dirty = true;
+    }
+}
+
+uint8_t ZModemJobQueue::count() const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CAPACITY; ++i) if (_jobs[i].id != 0) n++;
+    return n;
+}
+
+uint8_t ZModemJobQueue::ordered(ZModemJob** out) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CAPACITY; ++i) {
+        ZModemJob* j = &_jobs[i];
+        if (j->id == 0) continue;
+        // Insertion sort; the queue is a handful of entries
+        uint8_t k = n++;
+        while (k > 0 && _before(*j, *out[k - 1])) {
+            out[k] = out[k - 1];
+            k--;
+        }
+        out[k] = j;
+    }
+    return n;
+}
+
+// Time left until an absolute millis() stamp, 0 if it has passed
+static uint32_t timeLeft(uint32_t atMs, uint32_t nowMs) {
+    int32_t left = (int32_t)(atMs - nowMs);
+    return left > 0 ? (uint32_t)left : 0;
+}
+
+bool ZModemJobQueue::save(FS& fs, const char* path, uint32_t nowMs) {
+    if (count() == 0) {
+        akzAtomicRemove(fs, path);
+        dirty = false;
+        return true;
+    }
+    struct Save {
+        ZModemJobQueue* queue;
+        uint32_t nowMs;
+    } save = {this, nowMs};
+    auto write = [](File& f, const void* ctx) {
+        const Save* s = static_cast<const Save*>(ctx);
+        return s->queue->_write(f, s->nowMs);
+    };
+    if (!akzAtomicRewrite(fs, path, write, &save)) return false;
+    dirty = false;
+    return true;
+}
+
+bool ZModemJobQueue::_write(File& f, uint32_t nowMs) {
+    char line[JOB_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "%s\n", JOB_FILE_HEADER);
+    bool ok = f.write((const uint8_t*)line, n) == (size_t)n;
+
+    ZModemJob* order[CAPACITY];
+    uint8_t count = ordered(order);
+    for (uint8_t i = 0; ok && i < count; ++i) {
+        const ZModemJob& j = *order[i];
+        // A job interrupted by the reboot continues where its file stands
+        bool resume = j.resume || j.state != ZModemJob::PENDING;
+        n = snprintf(line, sizeof(line), "J %u %c %u %u %u %u %lx %lx %lu %lu %lu %lu %lu %s\n",
+                     (unsigned)j.id, j.sending ? 'S' : 'R', (unsigned)j.priority,
+                     (unsigned)j.failures, (unsigned)j.maxAttempts, resume ? 1u : 0u,
+                     (unsigned long)j.peer, (unsigned long)j.owner,
+                     (unsigned long)j.seq, (unsigned long)j.offset,
+                     (unsigned long)(j.deadlineMs ? timeLeft(j.deadlineMs, nowMs) + 1 : 0),
+                     (unsigned long)timeLeft(j.notBeforeMs, nowMs),
+                     (unsigned long)j.backoffMs, j.path);
+        if (n <= 0 || n >= (int)sizeof(line)) continue; // cannot happen with a bounded path
+        ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    }
+    return ok;
+}
+
+bool ZModemJobQueue::load(FS& fs, const char* path, uint32_t nowMs) {
+    File f = akzAtomicOpen(fs, path);
+    if (!f) return false;
+
+    memset(_jobs, 0, sizeof(_jobs));
+    _nextId = 1;
+    _nextSeq = 0;
+    dirty = false;
+
+    char line[JOB_LINE_MAX];
+    bool header = false;
+    uint8_t slot = 0;
+    while (f.available() && slot < CAPACITY) {
+        size_t len = 0;
+        int c;
+        while ((c = f.read()) >= 0 && c != '\n') {
+            if (len < sizeof(line) - 1) line[len++] = (char)c;
+        }
+        line[len] = '\0';
+        if (!header) {
+            if (strcmp(line, JOB_FILE_HEADER) != 0) break; // not ours, or a newer format
+            header = true;
+            continue;
+        }
+
+        unsigned id, prio, failures, maxAttempts, resume;
+        char dir;
+        unsigned long peer, owner, seq, offset, deadlineLeft, notBeforeLeft, backoff;
+        int pathAt = 0;
+        if (sscanf(line, "J %u %c %u %u %u %u %lx %lx %lu %lu %lu %lu %lu %n",
+                   &id, &dir, &prio, &failures, &maxAttempts, &resume, &peer, &owner,
+                   &seq, &offset, &deadlineLeft, &notBeforeLeft, &backoff, &pathAt) != 13 ||
+            pathAt == 0 || id == 0 || id > 0xFFFF || (dir != 'S' && dir != 'R') || line[pathAt] == '\0') {
+            continue;
+        }
+
+        ZModemJob& j = _jobs[slot++];
+        j.id = (uint16_t)id;
+        j.sending = dir == 'S';
+        j.priority = (uint8_t)prio;
+        j.state = ZModemJob::PENDING;
+        j.failures = (uint8_t)failures;
+        j.maxAttempts = (uint8_t)maxAttempts;
+        j.resume = resume != 0;
+        j.session = -1;
+        j.peer = (uint32_t)peer;
+        j.owner = (uint32_t)owner;
+        j.seq = (uint32_t)seq;
+        j.offset = (uint32_t)offset;
+        j.deadlineMs = deadlineLeft ? nowMs + (uint32_t)deadlineLeft : 0;
+        if (deadlineLeft && j.deadlineMs == 0) j.deadlineMs = 1;
+        j.notBeforeMs = nowMs + (uint32_t)notBeforeLeft;
+        j.backoffMs = (uint32_t)backoff;
+        strncpy(j.path, line + pathAt, sizeof(j.path) - 1);
+        j.path[sizeof(j.path) - 1] = '\0';
+
+        if (j.id >= _nextId) _nextId = j.id + 1;
+        if ((int32_t)(j.seq - _nextSeq) >= 0) _nextSeq = j.seq + 1;
+    }
+    f.close();
+    return header;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file ZModemJobQueue.h
+ * @author Akita Engineering
+ * @brief Fixed-capacity transfer job list with priority ordering, persisted
+ * to a small text file so queued jobs survive a reboot. Scheduling policy
+ * (admission, retries, preemption) lives in AkitaMeshZmodem.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_JOB_QUEUE_H
+#define ZMODEM_JOB_QUEUE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_JOB_QUEUE_CAPACITY > 0 && AKZ_JOB_QUEUE_CAPACITY <= 64, "AKZ_JOB_QUEUE_CAPACITY must be 1..64");
+
+struct ZModemJob {
+    enum State : uint8_t {
+        PENDING,  // waiting to start (or for its retry backoff)
+        RUNNING,  // owns a session
+        FINISHED  // session ended; outcome in lastOk, not yet handled
+    };
+
+    uint16_t id;            // 0 marks a free record
+    bool sending;
+    uint8_t priority;
+    uint8_t state;
+    uint8_t failures;
+    uint8_t maxAttempts;
+    bool resume;            // continue the partial transfer of an earlier run
+    bool lastOk;
+    int8_t session;         // running session handle, -1 if none
+    uint32_t peer;          // send destination
+    uint32_t owner;         // node that asked for the job, 0 if local
+    uint32_t seq;           // enqueue order, FIFO within a priority
+    uint32_t offset;        // bytes done when the last run was interrupted
+    uint32_t deadlineMs;    // millis() by which it must have started, 0: none
+    uint32_t notBeforeMs;   // retry backoff: earliest millis() of the next run
+    uint32_t backoffMs;     // first retry delay, doubled per failure
+    char path[AKZ_JOB_PATH_MAX];
+};
+
+class ZModemJobQueue {
+public:
+    static const uint8_t CAPACITY = AKZ_JOB_QUEUE_CAPACITY;
+
+    ZModemJobQueue();
+
+    // A cleared record with a fresh id and the next enqueue position, or
+    // nullptr when the queue is full
+    ZModemJob* add();
+    ZModemJob* find(uint16_t id);
+    void remove(ZModemJob& job);
+    // First in run order among jobs of its priority
+    void moveToFront(ZModemJob& job);
+    uint8_t count() const;
+    // Live jobs in run order (priority high first, then enqueue order).
+    // Fills 'out' with up to CAPACITY pointers and returns the count.
+    uint8_t ordered(ZModemJob** out);
+
+    // Whole-file rewrite through a temporary file; deadlines and backoffs are
+    // stored relative to 'nowMs'. An empty queue removes the file.
+    bool save(FS& fs, const char* path, uint32_t nowMs);
+    // Replaces the queue with the file's jobs. Running jobs come back pending
+    // with resume set. Returns false if there was nothing to load.
+    bool load(FS& fs, const char* path, uint32_t nowMs);
+
+    bool dirty = false; // changed since the last save()
+
+private:
+    bool _write(File& f, uint32_t nowMs);
+
+    ZModemJob _jobs[CAPACITY];
+    uint16_t _nextId = 1;
+    uint32_t _nextSeq = 0;
+
+    uint8_t _countId(uint16_t id) const;
+    static bool _before(const ZModemJob& a, const ZModemJob& b) {
+        if (a.priority != b.priority) return a.priority > b.priority;
+        return (int32_t)(a.seq - b.seq) < 0;
+    }
+};
+
+#endif // ZMODEM_JOB_QUEUE_H
@@ -0,0 +1,153 @@
+/**
+ * @file ZModemListing.cpp
+ * @author Akita Engineering
+ * @brief Listing pages: varints, the page writer and its reader.
+ * @version 1.1.0
+ */
+
+#include "ZModemListing.h"
+
+size_t ZModemListing::putVarint(uint8_t* dst, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        dst[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    dst[n++] = (uint8_t)v;
+    return n;
+}
+
+size_t ZModemListing::getVarint(const uint8_t* src, size_t n, uint32_t& v) {
+    v = 0;
+    for (size_t i = 0; i < n && i < 5; ++i) {
+        v |= (uint32_t)(src[i] & 0x7F) << (7 * i);
+        if (!(src[i] & 0x80)) return (i == 4 && src[i] > 0x0F) ? 0 : i + 1;
+    }
+    return 0;
+}
+
+uint32_t ZModemListing::nameHash(const char* name) {
+    uint32_t h = 2166136261UL;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+// --- Writer ---
+
+bool ZModemListingWriter::begin(uint8_t* buf, size_t cap, uint8_t pageFlags) {
+    _buf = buf;
+    _cap = cap;
+    _len = ZModemListing::HEADER_MAX;
+    _flags = pageFlags;
+    _count = 0;
+    return buf && cap >= (size_t)ZModemListing::HEADER_MAX + ZModemListing::ENTRY_MAX;
+}
+
+bool ZModemListingWriter::add(const char* name, uint8_t flags, uint32_t size, uint32_t mtime, const uint8_t* sha) {
+    uint8_t e[ZModemListing::ENTRY_MAX];
+    size_t len = strlen(name);
+    flags &= ZModemListing::ENTRY_DIR;
+    if (len > AKZ_LIST_NAME_MAX) {
+        flags |= ZModemListing::ENTRY_NAME_HASHED;
+        len = AKZ_LIST_NAME_MAX;
+    }
+    if (mtime) flags |= ZModemListing::ENTRY_MTIME;
+    if (sha) flags |= ZModemListing::ENTRY_SHA;
+    size_t n = 0;
+    e[n++] = flags;
+    e[n++] = (uint8_t)len;
+    memcpy(e + n, name, len);
+    n += len;
+    if (flags & ZModemListing::ENTRY_NAME_HASHED) {
+        uint32_t h = ZModemListing::nameHash(name);
+        for (int i = 0; i < 4; ++i) e[n++] = (uint8_t)(h >> (8 * i));
+    }
+    n += ZModemListing::putVarint(e + n, size);
+    if (mtime) n += ZModemListing::putVarint(e + n, mtime);
+    if (sha) {
+        memcpy(e + n, sha, ZModemListing::SHA_PREFIX);
+        n += ZModemListing::SHA_PREFIX;
+    }
+    if (_len + n > _cap) return false;
+    memcpy(_buf + _len, e, n);
+    _len += n;
+    _count++;
+    return true;
+}
+
+size_t ZModemListingWriter::finish(uint32_t total, uint32_t token, uint32_t cursor) {
+    uint8_t h[ZModemListing::HEADER_MAX];
+    size_t n = 0;
+    h[n++] = ZModemListing::MAGIC;
+    h[n++] = _flags;
+    n += ZModemListing::putVarint(h + n, total);
+    n += ZModemListing::putVarint(h + n, token);
+    n += ZModemListing::putVarint(h + n, cursor);
+    size_t body = _len - ZModemListing::HEADER_MAX;
+    memmove(_buf + n, _buf + ZModemListing::HEADER_MAX, body);
+    memcpy(_buf, h, n);
+    return n + body;
+}
+
+// --- Reader ---
+
+bool ZModemListingReader::open(const uint8_t* page, size_t len) {
+    _bad = true;
+    if (len < 5 || page[0] != ZModemListing::MAGIC) return false;
+    _flags = page[1];
+    _p = page + 2;
+    _left = len - 2;
+    uint32_t* fields[] = {&_total, &_token, &_cursor};
+    for (uint32_t* f : fields) {
+        size_t k = ZModemListing::getVarint(_p, _left, *f);
+        if (!k) return false;
+        _p += k;
+        _left -= k;
+    }
+    _bad = false;
+    return true;
+}
+
+bool ZModemListingReader::next(ZModemListEntry& e) {
+    if (_bad || _left == 0) return false;
+    _bad = true;
+    if (_left < 2) return false;
+    e.flags = _p[0];
+    size_t len = _p[1];
+    if (len > AKZ_LIST_NAME_MAX || _left < 2 + len) return false;
+    memcpy(e.name, _p + 2, len);
+    e.name[len] = '\0';
+    const uint8_t* p = _p + 2 + len;
+    size_t left = _left - 2 - len;
+    e.nameHash = 0;
+    if (e.flags & ZModemListing::ENTRY_NAME_HASHED) {
+        if (left < 4) return false;
+        for (int i = 0; i < 4; ++i) e.nameHash |= (uint32_t)p[i] << (8 * i);
+        p += 4;
+        left -= 4;
+    }
+    size_t k = ZModemListing::getVarint(p, left, e.size);
+    if (!k) return false;
+    p += k;
+    left -= k;
+    e.mtime = 0;
+    if (e.flags & ZModemListing::ENTRY_MTIME) {
+        k = ZModemListing::getVarint(p, left, e.mtime);
+        if (!k) return false;
+        p += k;
+        left -= k;
+    }
+    if (e.flags & ZModemListing::ENTRY_SHA) {
+        if (left < ZModemListing::SHA_PREFIX) return false;
+        memcpy(e.sha, p, ZModemListing::SHA_PREFIX);
+        p += ZModemListing::SHA_PREFIX;
+        left -= ZModemListing::SHA_PREFIX;
+    }
+    _p = p;
+    _left = left;
+    _bad = false;
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file ZModemListing.h
+ * @author Akita Engineering
+ * @brief Compact directory listings for remote nodes: entries packed with
+ * varints into pages that each fit one packet, with a cursor to ask for the
+ * next page and a token to ask later for only what changed.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_LISTING_H
+#define ZMODEM_LISTING_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_LIST_NAME_MAX > 0 && AKZ_LIST_NAME_MAX <= 255, "AKZ_LIST_NAME_MAX must be 1..255");
+
+// Page layout; varints are unsigned LEB128 (7 bits per byte, low first):
+//   MAGIC, page flags (1 byte each)
+//   total: entries in the directory matching the pattern (varint)
+//   token: pass as 'since' later to get only entries added or changed
+//          after this listing; 0 if the FS keeps no mtimes (varint).
+//          Deleted entries are never reported: only 'total' drops
+//   cursor: pass to get the next page; 0 on the last one (varint)
+//   per entry:
+//     entry flags (1 byte)
+//     name length (1 byte), name. With ENTRY_NAME_HASHED the name was
+//       longer than AKZ_LIST_NAME_MAX: it is cut to that, and the full
+//       name's nameHash() follows (4 bytes, little-endian).
+//     size (varint, 0 for directories)
+//     with ENTRY_MTIME: mtime (varint)
+//     with ENTRY_SHA: the first SHA_PREFIX bytes of the file's SHA-256
+class ZModemListing {
+public:
+    // Not a printable character, so a page is never taken for a text command
+    static const uint8_t MAGIC = 0x1D;
+    static const uint8_t SHA_PREFIX = 8;
+    // MAGIC, flags and three varints
+    static const uint8_t HEADER_MAX = 2 + 3 * 5;
+    static const uint16_t ENTRY_MAX = 2 + AKZ_LIST_NAME_MAX + 4 + 5 + 5 + SHA_PREFIX;
+
+    // Page flags
+    static const uint8_t PAGE_SINCE = 0x01; // only entries changed since a token
+
+    // Entry flags
+    static const uint8_t ENTRY_DIR = 0x01;
+    static const uint8_t ENTRY_NAME_HASHED = 0x02;
+    static const uint8_t ENTRY_MTIME = 0x04;
+    static const uint8_t ENTRY_SHA = 0x08;
+
+    // Bytes written (1..5)
+    static size_t putVarint(uint8_t* dst, uint32_t v);
+    // Bytes read from at most n; 0 if it runs past n or 32 bits
+    static size_t getVarint(const uint8_t* src, size_t n, uint32_t& v);
+    // FNV-1a, 32 bits
+    static uint32_t nameHash(const char* name);
+};
+
+static_assert(AKZ_LIST_PAGE_BYTES >= ZModemListing::HEADER_MAX + ZModemListing::ENTRY_MAX,
+              "AKZ_LIST_PAGE_BYTES must hold the header and one entry with the longest name");
+
+struct ZModemListEntry {
+    uint8_t flags = 0;
+    char name[AKZ_LIST_NAME_MAX + 1]; // cut with ENTRY_NAME_HASHED
+    uint32_t nameHash = 0;            // of the full name, with ENTRY_NAME_HASHED
+    uint32_t size = 0;
+    uint32_t mtime = 0;               // with ENTRY_MTIME
+    uint8_t sha[ZModemListing::SHA_PREFIX]; // with ENTRY_SHA
+};
+
+// Fills a caller's buffer with one page. The header goes in front once the
+// entries are known, so begin() leaves HEADER_MAX bytes for it.
+class ZModemListingWriter {
+public:
+    // False if the buffer cannot hold the header and one entry
+    bool begin(uint8_t* buf, size_t cap, uint8_t pageFlags);
+    // Adds a file, or a directory with ENTRY_DIR (size 0). mtime 0 is left
+    // out, as is sha unless given. False, adding nothing, if it does not fit.
+    bool add(const char* name, uint8_t flags, uint32_t size, uint32_t mtime, const uint8_t* sha = nullptr);
+    uint16_t count() const { return _count; }
+    // Writes the header in front of the entries; returns the page length
+    size_t finish(uint32_t total, uint32_t token, uint32_t cursor);
+
+private:
+    uint8_t* _buf = nullptr;
+    size_t _cap = 0;
+    size_t _len = 0;
+    uint8_t _flags = 0;
+    uint16_t _count = 0;
+};
+
+// Reads a page back, entry by entry
+class ZModemListingReader {
+public:
+    // False if it is not a listing page
+    bool open(const uint8_t* page, size_t len);
+    uint8_t flags() const { return _flags; }
+    uint32_t total() const { return _total; }
+    uint32_t token() const { return _token; }
+    uint32_t cursor() const { return _cursor; }
+    // False at the end of the page, or if the rest is malformed
+    bool next(ZModemListEntry& e);
+    bool malformed() const { return _bad; }
+
+private:
+    const uint8_t* _p = nullptr;
+    size_t _left = 0;
+    uint8_t _flags = 0;
+    uint32_t _total = 0;
+    uint32_t _token = 0;
+    uint32_t _cursor = 0;
+    bool _bad = false;
+};
+
+#endif // ZMODEM_LISTING_H
@@ -0,0 +1,50 @@
+/**
+ * @file ZModemManifest.cpp
+ * @author Akita Engineering
+ * @brief Remote directory manifests and their comparison with local files.
+ * @version 1.1.0
+ */
+
+#include "ZModemManifest.h"
+
+bool ZModemManifest::addPage(const uint8_t* page, size_t len) {
+    ZModemListingReader r;
+    if (!r.open(page, len)) return false;
+    ZModemListEntry e;
+    while (r.next(e)) {
+        if (e.flags & ZModemListing::ENTRY_DIR) continue;
+        if (_count == CAPACITY) return false;
+        _matched[_count] = false;
+        _entries[_count++] = e;
+    }
+    return !r.malformed();
+}
+
+// A cut name matches the local name it was cut from: same prefix, same hash
+int ZModemManifest::_find(const char* name) const {
+    size_t len = strlen(name);
+    bool cut = len > AKZ_LIST_NAME_MAX;
+    uint32_t hash = cut ? ZModemListing::nameHash(name) : 0;
+    for (uint16_t i = 0; i < _count; ++i) {
+        const ZModemListEntry& e = _entries[i];
+        if (cut != ((e.flags & ZModemListing::ENTRY_NAME_HASHED) != 0)) continue;
+        if (cut ? (e.nameHash == hash && strncmp(e.name, name, AKZ_LIST_NAME_MAX) == 0) : strcmp(e.name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool ZModemManifest::differs(const char* name, uint32_t size, const uint8_t* sha256) {
+    int i = _find(name);
+    if (i < 0) return true;
+    _matched[i] = true;
+    const ZModemListEntry& e = _entries[i];
+    if (e.size != size) return true;
+    if (!sha256 || !(e.flags & ZModemListing::ENTRY_SHA)) return true;
+    return memcmp(e.sha, sha256, ZModemListing::SHA_PREFIX) != 0;
+}
+
+bool ZModemManifest::orphaned(uint16_t i) const {
+    return !_matched[i] && !(_entries[i].flags & ZModemListing::ENTRY_NAME_HASHED);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file ZModemManifest.h
+ * @author Akita Engineering
+ * @brief What another node holds in a directory, read from its listing
+ * pages, compared file by file with a local copy of that directory to find
+ * what to send and what to delete there.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_MANIFEST_H
+#define ZMODEM_MANIFEST_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+#include "ZModemListing.h"
+
+class ZModemManifest {
+public:
+    // A sync sends at most one bundle's worth of files
+    static const uint16_t CAPACITY = AKZ_BUNDLE_MAX_FILES;
+
+    void clear() { _count = 0; }
+    // The files on a page; subdirectories are left out. False if the page is
+    // malformed or the manifest is full.
+    bool addPage(const uint8_t* page, size_t len);
+    uint16_t count() const { return _count; }
+    const ZModemListEntry& at(uint16_t i) const { return _entries[i]; }
+
+    // Does the other node's copy of this local file differ from it? True if
+    // it has none, another size, or another hash; also true if either side
+    // has no hash to compare (sha256 nullptr, or none listed). The remote
+    // entry is marked as matched either way.
+    bool differs(const char* name, uint32_t size, const uint8_t* sha256);
+    // A remote file no local file matched: deleted here since the last sync.
+    // Names cut in the listing are never orphaned, as they cannot be named
+    // back exactly.
+    bool orphaned(uint16_t i) const;
+
+private:
+    int _find(const char* name) const;
+
+    ZModemListEntry _entries[CAPACITY];
+    bool _matched[CAPACITY];
+    uint16_t _count = 0;
+};
+
+#endif // ZMODEM_MANIFEST_H
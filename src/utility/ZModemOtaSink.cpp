@@ -0,0 +1,168 @@
+/**
+ * @file ZModemOtaSink.cpp
+ * @author Akita Engineering
+ * @brief Streaming, verified firmware image sink.
+ * @version 1.1.0
+ */
+
+#include "ZModemOtaSink.h"
+
+#if defined(ESP32)
+
+size_t ZModemEspOtaTarget::capacity() {
+    const esp_partition_t* part = esp_ota_get_next_update_partition(nullptr);
+    return part ? part->size : 0;
+}
+
+bool ZModemEspOtaTarget::begin(size_t imageSize) {
+    _part = esp_ota_get_next_update_partition(nullptr);
+    if (!_part) return false;
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    (void)imageSize;
+    return esp_ota_begin(_part, OTA_WITH_SEQUENTIAL_WRITES, &_handle) == ESP_OK;
+#else
+    return esp_ota_begin(_part, imageSize, &_handle) == ESP_OK;
+#endif
+}
+
+bool ZModemEspOtaTarget::write(const uint8_t* data, size_t n) {
+    return _handle && esp_ota_write(_handle, data, n) == ESP_OK;
+}
+
+bool ZModemEspOtaTarget::commit() {
+    if (!_handle) return false;
+    // esp_ota_end() also checks the image header and checksum
+    bool ok = esp_ota_end(_handle) == ESP_OK;
+    _handle = 0;
+    return ok && esp_ota_set_boot_partition(_part) == ESP_OK;
+}
+
+void ZModemEspOtaTarget::abort() {
+    if (_handle) esp_ota_abort(_handle);
+    _handle = 0;
+}
+
+#endif // ESP32
+
+ZModemOtaSink::ZModemOtaSink(ZModemOtaTarget& target, size_t imageSize, const uint8_t* sha256)
+    : _target(target), _imageSize(imageSize), _checkHash(sha256 != nullptr) {
+    if (sha256) memcpy(_expected, sha256, sizeof(_expected));
+}
+
+void ZModemOtaSink::reset() {
+    if (_opened) _target.abort();
+    _opened = false;
+    _failed = false;
+    _committed = false;
+    _written = 0;
+    _sha.begin();
+#if AKZ_OTA_STAGE_BYTES
+    _rangeCount = 0;
+#endif
+}
+
+// Write in order to the partition, hashing on the way
+bool ZModemOtaSink::_append(const uint8_t* src, size_t n) {
+    if (_failed) return false;
+    if (!_opened) {
+        _opened = _imageSize > 0 && _imageSize <= _target.capacity() && _target.begin(_imageSize);
+        if (!_opened) {
+            _failed = true;
+            return false;
+        }
+    }
+    // Larger than announced: no point in writing the rest
+    if (_written + n > _imageSize || !_target.write(src, n)) {
+        _failed = true;
+        return false;
+    }
+    _sha.update(src, n);
+    _written += n;
+    return true;
+}
+
+size_t ZModemOtaSink::write(const uint8_t* src, size_t n) {
+    if (!_append(src, n)) return 0;
+#if AKZ_OTA_STAGE_BYTES
+    _slide(n);
+    // The gap is filled: write what was staged right behind it. Ranges never
+    // touch, so at most one starts here.
+    for (uint8_t i = 0; i < _rangeCount; ++i) {
+        if (_ranges[i].start != 0) continue;
+        size_t len = _ranges[i].end;
+        if (_append(_stage, len)) _slide(len);
+        break;
+    }
+#endif
+    return _failed ? 0 : n;
+}
+
+bool ZModemOtaSink::stage(size_t pos, const uint8_t* src, size_t n) {
+#if AKZ_OTA_STAGE_BYTES
+    if (_failed || n == 0 || pos <= _written || pos + n > _imageSize) return false;
+    size_t start = pos - _written;
+    size_t end = start + n;
+    if (end > AKZ_OTA_STAGE_BYTES) return false;
+    // Merged with every range it overlaps or touches, else a new range
+    uint8_t apart = 0;
+    for (uint8_t i = 0; i < _rangeCount; ++i) {
+        if (_ranges[i].end < start || _ranges[i].start > end) apart++;
+    }
+    if (apart == STAGE_RANGES) return false;
+    memcpy(_stage + start, src, n);
+    uint8_t k = 0;
+    for (uint8_t i = 0; i < _rangeCount; ++i) {
+        Range r = _ranges[i];
+        if (r.end < start || r.start > end) {
+            _ranges[k++] = r;
+            continue;
+        }
+        if (r.start < start) start = r.start;
+        if (r.end > end) end = r.end;
+    }
+    _ranges[k++] = {start, end};
+    _rangeCount = k;
+    return true;
+#else
+    (void)pos;
+    (void)src;
+    (void)n;
+    return false;
+#endif
+}
+
+#if AKZ_OTA_STAGE_BYTES
+// _written moved on by n: move the window with it
+void ZModemOtaSink::_slide(size_t n) {
+    if (_rangeCount == 0) return;
+    if (n >= AKZ_OTA_STAGE_BYTES) {
+        _rangeCount = 0;
+        return;
+    }
+    memmove(_stage, _stage + n, AKZ_OTA_STAGE_BYTES - n);
+    uint8_t k = 0;
+    for (uint8_t i = 0; i < _rangeCount; ++i) {
+        Range r = _ranges[i];
+        if (r.end <= n) continue; // all of it was just written
+        r.start = r.start > n ? r.start - n : 0;
+        r.end -= n;
+        _ranges[k++] = r;
+    }
+    _rangeCount = k;
+}
+#endif
+
+bool ZModemOtaSink::finalize(bool ok) {
+    bool good = ok && _opened && !_failed && _written == _imageSize;
+    if (good && _checkHash) {
+        uint8_t digest[ZModemSha256::DIGEST_SIZE];
+        _sha.finish(digest);
+        good = memcmp(digest, _expected, sizeof(digest)) == 0;
+    }
+    // Bootable only once complete and verified
+    if (good) good = _target.commit();
+    else if (_opened) _target.abort();
+    _opened = false;
+    _committed = good;
+    return good;
+}
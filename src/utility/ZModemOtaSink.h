@@ -0,0 +1,99 @@
+/**
+ * @file ZModemOtaSink.h
+ * @author Akita Engineering
+ * @brief A ZModemSink that streams a firmware image straight into the
+ * inactive app partition, hashing it on the way, and marks the partition
+ * bootable only when the image is complete and its SHA-256 matches. The
+ * partition is reached through ZModemOtaTarget; ZModemEspOtaTarget is the
+ * ESP32 implementation, and a host test can provide its own.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_OTA_SINK_H
+#define ZMODEM_OTA_SINK_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+#include "ZModemDataIO.h"
+#include "ZModemSha256.h"
+
+#if defined(ESP32)
+#include <esp_ota_ops.h>
+#endif
+
+// The partition an image is written to. Writes arrive in order, from
+// offset 0.
+class ZModemOtaTarget {
+public:
+    virtual ~ZModemOtaTarget() {}
+    // Largest image the partition holds
+    virtual size_t capacity() = 0;
+    // Prepare for an image of 'imageSize' bytes
+    virtual bool begin(size_t imageSize) = 0;
+    // Append n bytes
+    virtual bool write(const uint8_t* data, size_t n) = 0;
+    // Image complete and verified: make it the next boot
+    virtual bool commit() = 0;
+    // Drop what was written; the running firmware stays the boot image
+    virtual void abort() = 0;
+};
+
+#if defined(ESP32)
+// The next OTA app partition, through esp_ota_ops. Erases sector by sector
+// as the data arrives instead of all at once in begin().
+class ZModemEspOtaTarget : public ZModemOtaTarget {
+public:
+    size_t capacity() override;
+    bool begin(size_t imageSize) override;
+    bool write(const uint8_t* data, size_t n) override;
+    bool commit() override;
+    void abort() override;
+private:
+    const esp_partition_t* _part = nullptr;
+    esp_ota_handle_t _handle = 0;
+};
+#endif
+
+// Receive with akitaZmodem.startReceive(sink). 'imageSize' and 'sha256'
+// describe the expected image; sha256 may be nullptr to check the size
+// only. Chunks that arrive ahead of the write position are kept (up to
+// AKZ_OTA_STAGE_BYTES) and written once the gap before them is filled.
+class ZModemOtaSink : public ZModemSink {
+public:
+    ZModemOtaSink(ZModemOtaTarget& target, size_t imageSize, const uint8_t* sha256 = nullptr);
+
+    size_t size() override { return _written; }
+    size_t write(const uint8_t* src, size_t n) override;
+    bool stage(size_t pos, const uint8_t* src, size_t n) override;
+    bool finalize(bool ok) override;
+
+    bool isCommitted() const { return _committed; }
+    // Start over for another attempt, e.g. after a failed transfer
+    void reset();
+
+private:
+    bool _append(const uint8_t* src, size_t n);
+
+    ZModemOtaTarget& _target;
+    size_t _imageSize;
+    uint8_t _expected[ZModemSha256::DIGEST_SIZE];
+    bool _checkHash;
+    ZModemSha256 _sha;
+    size_t _written = 0;
+    bool _opened = false;
+    bool _failed = false;
+    bool _committed = false;
+
+#if AKZ_OTA_STAGE_BYTES
+    // Staged chunks, at their image offset minus _written; the window
+    // slides down as the gap is filled
+    static const uint8_t STAGE_RANGES = 4;
+    struct Range { size_t start; size_t end; };
+    Range _ranges[STAGE_RANGES];
+    uint8_t _rangeCount = 0;
+    uint8_t _stage[AKZ_OTA_STAGE_BYTES];
+    void _slide(size_t n);
+#endif
+};
+
+#endif // ZMODEM_OTA_SINK_H
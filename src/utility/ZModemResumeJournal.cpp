@@ -0,0 +1,66 @@
+/**
+ * @file ZModemResumeJournal.cpp
+ * @author Akita Engineering
+ * @brief Receive journal and its on-flash text format.
+ * @version 1.1.0
+ */
+
+#include "ZModemResumeJournal.h"
+#include "ZModemAtomicFile.h"
+
+// Header line, then one line:
+//   R <peer> <size> <offset> <name>
+// peer in hex. The name is the rest of the line.
+static const char* const JOURNAL_HEADER = "AKZRESUME 1";
+static const size_t JOURNAL_LINE_MAX = 48 + AKZ_JOB_PATH_MAX;
+
+bool ZModemResumeRecord::matches(uint32_t fromPeer, const char* announcedName, size_t announcedSize) const {
+    return peer == fromPeer && size == announcedSize && strncmp(name, announcedName, sizeof(name) - 1) == 0;
+}
+
+bool ZModemResumeJournal::save(FS& fs, const String& filePath, const ZModemResumeRecord& rec) {
+    auto write = [](File& f, const void* ctx) {
+        const ZModemResumeRecord& r = *static_cast<const ZModemResumeRecord*>(ctx);
+        char buf[JOURNAL_LINE_MAX + 16];
+        int n = snprintf(buf, sizeof(buf), "%s\nR %lx %lu %lu %s\n", JOURNAL_HEADER, (unsigned long)r.peer,
+                         (unsigned long)r.size, (unsigned long)r.offset, r.name);
+        return n > 0 && n < (int)sizeof(buf) && f.write((const uint8_t*)buf, n) == (size_t)n;
+    };
+    return akzAtomicRewrite(fs, pathFor(filePath).c_str(), write, &rec);
+}
+
+bool ZModemResumeJournal::load(FS& fs, const String& filePath, ZModemResumeRecord& rec) {
+    File f = akzAtomicOpen(fs, pathFor(filePath).c_str());
+    if (!f) return false;
+    char line[JOURNAL_LINE_MAX];
+    bool header = false;
+    bool found = false;
+    while (!found && f.available()) {
+        size_t len = 0;
+        int c;
+        while ((c = f.read()) >= 0 && c != '\n') {
+            if (len < sizeof(line) - 1) line[len++] = (char)c;
+        }
+        line[len] = '\0';
+        if (!header) {
+            if (strcmp(line, JOURNAL_HEADER) != 0) break;
+            header = true;
+            continue;
+        }
+        unsigned long peer, size, offset;
+        int nameAt = 0;
+        if (sscanf(line, "R %lx %lu %lu %n", &peer, &size, &offset, &nameAt) != 3 || nameAt == 0) break;
+        rec.peer = (uint32_t)peer;
+        rec.size = (uint32_t)size;
+        rec.offset = (uint32_t)offset;
+        strncpy(rec.name, line + nameAt, sizeof(rec.name) - 1);
+        rec.name[sizeof(rec.name) - 1] = '\0';
+        found = true;
+    }
+    f.close();
+    return found;
+}
+
+void ZModemResumeJournal::remove(FS& fs, const String& filePath) {
+    akzAtomicRemove(fs, pathFor(filePath).c_str());
+}
@@ -0,0 +1,37 @@
+/**
+ * @file ZModemResumeJournal.h
+ * @author Akita Engineering
+ * @brief Per-file receive journal: which transfer a partial file belongs to
+ * and how much of it is durably written, so a receive interrupted by a
+ * reboot continues instead of starting over.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_RESUME_JOURNAL_H
+#define ZMODEM_RESUME_JOURNAL_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+struct ZModemResumeRecord {
+    uint32_t peer;     // sending node
+    uint32_t size;     // size announced in ZFILE
+    uint32_t offset;   // bytes of the file flushed to flash
+    char name[AKZ_JOB_PATH_MAX]; // name announced in ZFILE
+
+    // Same transfer as announced now?
+    bool matches(uint32_t fromPeer, const char* announcedName, size_t announcedSize) const;
+};
+
+class ZModemResumeJournal {
+public:
+    // Journal of the file at 'filePath'
+    static String pathFor(const String& filePath) { return filePath + AKZ_RESUME_JOURNAL_SUFFIX; }
+    // Rewritten through "<journal>.tmp"; a reboot mid-save leaves the old one
+    static bool save(FS& fs, const String& filePath, const ZModemResumeRecord& rec);
+    static bool load(FS& fs, const String& filePath, ZModemResumeRecord& rec);
+    static void remove(FS& fs, const String& filePath);
+};
+
+#endif // ZMODEM_RESUME_JOURNAL_H
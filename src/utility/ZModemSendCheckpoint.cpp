@@ -0,0 +1,123 @@
+/**
+ * @file ZModemSendCheckpoint.cpp
+ * @author Akita Engineering
+ * @brief Send checkpoint and its on-flash text format.
+ * @version 1.1.0
+ */
+
+#include "ZModemSendCheckpoint.h"
+#include "ZModemAtomicFile.h"
+
+// Header line, then one line per send:
+//   S <session> <priority> <packet id> <peer> <size> <fingerprint> <offset> <path>
+// peer and fingerprint in hex. The path is the rest of the line.
+static const char* const CHECKPOINT_HEADER = "AKZSENDS 1";
+static const size_t CHECKPOINT_LINE_MAX = 80 + AKZ_JOB_PATH_MAX;
+// Bytes hashed from each end of the file
+static const size_t FINGERPRINT_SPAN = 256;
+
+ZModemSendCheckpoint::ZModemSendCheckpoint() {
+    memset(_records, 0, sizeof(_records));
+}
+
+uint8_t ZModemSendCheckpoint::count() const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CAPACITY; ++i) n += _records[i].used ? 1 : 0;
+    return n;
+}
+
+bool ZModemSendCheckpoint::save(FS& fs, const char* path) {
+    if (count() == 0) {
+        akzAtomicRemove(fs, path);
+        return true;
+    }
+    auto write = [](File& f, const void* ctx) { return static_cast<const ZModemSendCheckpoint*>(ctx)->_write(f); };
+    return akzAtomicRewrite(fs, path, write, this);
+}
+
+bool ZModemSendCheckpoint::_write(File& f) const {
+    char line[CHECKPOINT_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "%s\n", CHECKPOINT_HEADER);
+    bool ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    for (uint8_t i = 0; ok && i < CAPACITY; ++i) {
+        const ZModemSendRecord& r = _records[i];
+        if (!r.used) continue;
+        n = snprintf(line, sizeof(line), "S %u %u %u %lx %lu %lx %lu %s\n", (unsigned)r.sessionId,
+                     (unsigned)r.priority, (unsigned)r.packetId, (unsigned long)r.peer, (unsigned long)r.size,
+                     (unsigned long)r.fingerprint, (unsigned long)r.offset, r.path);
+        if (n <= 0 || n >= (int)sizeof(line)) continue; // cannot happen with a bounded path
+        ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    }
+    return ok;
+}
+
+bool ZModemSendCheckpoint::load(FS& fs, const char* path) {
+    File f = akzAtomicOpen(fs, path);
+    if (!f) return false;
+
+    memset(_records, 0, sizeof(_records));
+    char line[CHECKPOINT_LINE_MAX];
+    bool header = false;
+    uint8_t slot = 0;
+    while (f.available() && slot < CAPACITY) {
+        size_t len = 0;
+        int c;
+        while ((c = f.read()) >= 0 && c != '\n') {
+            if (len < sizeof(line) - 1) line[len++] = (char)c;
+        }
+        line[len] = '\0';
+        if (!header) {
+            if (strcmp(line, CHECKPOINT_HEADER) != 0) break;
+            header = true;
+            continue;
+        }
+        unsigned id, prio, pid;
+        unsigned long peer, size, fp, offset;
+        int pathAt = 0;
+        if (sscanf(line, "S %u %u %u %lx %lu %lx %lu %n", &id, &prio, &pid, &peer, &size, &fp, &offset, &pathAt) != 7 ||
+            pathAt == 0 || id == 0 || id > 0x7F || pid > 0xFFFF || line[pathAt] == '\0') {
+            continue;
+        }
+        ZModemSendRecord& r = _records[slot++];
+        r.used = true;
+        r.sessionId = (uint8_t)id;
+        r.priority = (uint8_t)prio;
+        r.packetId = (uint16_t)pid;
+        r.peer = (uint32_t)peer;
+        r.size = (uint32_t)size;
+        r.fingerprint = (uint32_t)fp;
+        r.offset = (uint32_t)offset;
+        strncpy(r.path, line + pathAt, sizeof(r.path) - 1);
+    }
+    f.close();
+    return header;
+}
+
+// FNV-1a
+static uint32_t fnv(uint32_t h, const uint8_t* p, size_t n) {
+    while (n--) {
+        h ^= *p++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+uint32_t ZModemSendCheckpoint::fingerprint(FS& fs, const char* path, size_t& size, size_t length) {
+    size = 0;
+    File f = fs.open(path, FILE_READ);
+    if (!f || f.isDirectory()) return 0;
+    size = f.size();
+    size_t end = min(size, length);
+    uint32_t h = 2166136261UL;
+    uint8_t buf[FINGERPRINT_SPAN];
+    uint32_t sz = (uint32_t)end;
+    h = fnv(h, (const uint8_t*)&sz, sizeof(sz));
+    size_t n = f.read(buf, min(end, FINGERPRINT_SPAN));
+    h = fnv(h, buf, n);
+    if (end > FINGERPRINT_SPAN) {
+        size_t tail = min(end - FINGERPRINT_SPAN, FINGERPRINT_SPAN);
+        if (f.seek(end - tail)) h = fnv(h, buf, f.read(buf, tail));
+    }
+    f.close();
+    return h;
+}
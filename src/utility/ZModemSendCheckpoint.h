@@ -0,0 +1,56 @@
+/**
+ * @file ZModemSendCheckpoint.h
+ * @author Akita Engineering
+ * @brief Checkpoint of the file sends in progress, one record per session
+ * slot, kept in a small text file so sends a reboot interrupts can be
+ * offered to their receivers again.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_SEND_CHECKPOINT_H
+#define ZMODEM_SEND_CHECKPOINT_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+struct ZModemSendRecord {
+    bool used;
+    uint8_t sessionId;    // session byte the receiver knows the send by
+    uint8_t priority;
+    uint16_t packetId;    // next mesh packet id of the stream
+    uint32_t peer;        // destination
+    uint32_t size;
+    uint32_t fingerprint; // see ZModemSendCheckpoint::fingerprint()
+    uint32_t offset;      // bytes the receiver has acknowledged
+    char path[AKZ_JOB_PATH_MAX];
+};
+
+class ZModemSendCheckpoint {
+public:
+    static const uint8_t CAPACITY = AKZ_MAX_SESSIONS;
+
+    ZModemSendCheckpoint();
+
+    ZModemSendRecord& at(uint8_t slot) { return _records[slot]; }
+    void clear(uint8_t slot) { _records[slot].used = false; }
+    uint8_t count() const;
+
+    // Whole-file rewrite through "<path>.tmp"; no records removes the file
+    bool save(FS& fs, const char* path);
+    // Replaces the records with the file's; false if there was nothing to load
+    bool load(FS& fs, const char* path);
+
+    // Hash of the file's size and its first and last bytes: tells whether
+    // the file at 'path' is still the one that was being sent. With
+    // 'length', of its first 'length' bytes only, as if it ended there.
+    // 0 and size 0 if it cannot be read; 'size' is the whole file's.
+    static uint32_t fingerprint(FS& fs, const char* path, size_t& size, size_t length = (size_t)-1);
+
+private:
+    bool _write(File& f) const;
+
+    ZModemSendRecord _records[CAPACITY];
+};
+
+#endif // ZMODEM_SEND_CHECKPOINT_H
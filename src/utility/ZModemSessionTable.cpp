@@ -0,0 +1,36 @@
+/**
+ * @file ZModemSessionTable.cpp
+ * @author Akita Engineering
+ * @brief Session demultiplexing table implementation.
+ * @version 1.1.0
+ */
+
+#include "ZModemSessionTable.h"
+
+ZModemSessionTable::ZModemSessionTable() {
+    for (uint8_t i = 0; i < CAPACITY; ++i) _keys[i] = 0;
+}
+
+uint8_t ZModemSessionTable::find(uint32_t peer, uint8_t sessionId) const {
+    uint64_t key = _key(peer, sessionId);
+    uint32_t mask = _usedMask;
+    for (uint8_t i = 0; mask; ++i, mask >>= 1) {
+        if ((mask & 1) && _keys[i] == key) return i;
+    }
+    return NO_SLOT;
+}
+
+bool ZModemSessionTable::bind(uint8_t slot, uint32_t peer, uint8_t sessionId) {
+    if (slot >= CAPACITY) return false;
+    uint8_t existing = find(peer, sessionId);
+    if (existing != NO_SLOT && existing != slot) return false;
+    _keys[slot] = _key(peer, sessionId);
+    _usedMask |= (1UL << slot);
+    return true;
+}
+
+void ZModemSessionTable::unbind(uint8_t slot) {
+    if (slot >= CAPACITY) return;
+    _usedMask &= ~(1UL << slot);
+    _keys[slot] = 0;
+}
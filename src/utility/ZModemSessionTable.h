@@ -0,0 +1,40 @@
+/**
+ * @file ZModemSessionTable.h
+ * @author Akita Engineering
+ * @brief Compact (peer NodeNum, session id) -> slot lookup used to
+ * demultiplex incoming ZModem data packets between concurrent sessions.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_SESSION_TABLE_H
+#define ZMODEM_SESSION_TABLE_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_MAX_SESSIONS > 0 && AKZ_MAX_SESSIONS <= 32, "AKZ_MAX_SESSIONS must be 1..32");
+
+class ZModemSessionTable {
+public:
+    static const uint8_t NO_SLOT = 0xFF;
+    static const uint8_t CAPACITY = AKZ_MAX_SESSIONS;
+
+    ZModemSessionTable();
+
+    // Returns the slot bound to (peer, sessionId), or NO_SLOT
+    uint8_t find(uint32_t peer, uint8_t sessionId) const;
+    // Bind a slot to a key. Fails if the slot is out of range or the key is taken.
+    bool bind(uint8_t slot, uint32_t peer, uint8_t sessionId);
+    void unbind(uint8_t slot);
+    bool isBound(uint8_t slot) const { return slot < CAPACITY && (_usedMask & (1UL << slot)); }
+
+private:
+    // Keys are packed as (peer << 8 | sessionId) and scanned linearly: with a
+    // handful of sessions this beats hashing and costs 8 bytes per slot.
+    uint64_t _keys[CAPACITY];
+    uint32_t _usedMask = 0;
+
+    static uint64_t _key(uint32_t peer, uint8_t sessionId) { return ((uint64_t)peer << 8) | sessionId; }
+};
+
+#endif // ZMODEM_SESSION_TABLE_H
@@ -0,0 +1,51 @@
+/**
+ * @file ZModemSha256.h
+ * @author Akita Engineering
+ * @brief Incremental SHA-256 (FIPS 180-4), fed as data streams through a
+ * sink so an image can be verified without reading it back.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_SHA256_H
+#define ZMODEM_SHA256_H
+
+#include <Arduino.h>
+
+class ZModemSha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    ZModemSha256() { begin(); }
+    void begin();
+    void update(const uint8_t* data, size_t n);
+    // Write the digest to 'out'; begin() again before reuse
+    void finish(uint8_t out[DIGEST_SIZE]);
+
+private:
+    void _block(const uint8_t* p);
+    uint32_t _h[8];
+    uint8_t _buf[64];
+    size_t _bufLen = 0;
+    uint64_t _total = 0;
+};
+
+// SHA-256 of data as it is written to a file, in file order from offset 0.
+// A write anywhere but where the last one ended voids it, until the data
+// starts over at 0 (e.g. a receiver resumed part way has no digest).
+class ZModemRunningSha256 {
+public:
+    void reset() {
+        _sha.begin();
+        _at = 0;
+    }
+    void update(size_t pos, const uint8_t* data, size_t n);
+    // The digest of bytes [0, end), if that is exactly what was fed
+    bool finish(size_t end, uint8_t out[ZModemSha256::DIGEST_SIZE]);
+
+private:
+    static const size_t VOID = (size_t)-1;
+    ZModemSha256 _sha;
+    size_t _at = 0;
+};
+
+#endif // ZMODEM_SHA256_H
@@ -0,0 +1,59 @@
+/**
+ * @file ZModemSpscRing.h
+ * @author Akita Engineering
+ * @brief Lock-free single-producer/single-consumer ring used to pass mesh
+ * packets between the mesh thread and the engine task. Slots are filled and
+ * drained in place, so a packet is copied once on each side.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_SPSC_RING_H
+#define ZMODEM_SPSC_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../AkitaMeshZmodemConfig.h"
+
+// One queued data-port packet. The payload includes the 4-byte stream header.
+struct ZModemQueuedPacket {
+    uint32_t peer;      // source (RX ring) or destination (TX ring) NodeNum
+    uint16_t len;
+    uint8_t data[AKZ_STREAM_TX_BUFFER_SIZE];
+};
+
+template <typename T, size_t N>
+class ZModemSpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring depth must be a power of two");
+
+public:
+    // Producer: slot to fill, or nullptr when full. Call commit() once filled.
+    T* acquireSlot() {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) return nullptr;
+        return &_slots[head & (N - 1)];
+    }
+    void commit() {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest slot, or nullptr when empty. Call pop() when done with it.
+    T* front() {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) return nullptr;
+        return &_slots[tail & (N - 1)];
+    }
+    void pop() {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T _slots[N];
+    std::atomic<uint32_t> _head{0}; // written by the producer only
+    std::atomic<uint32_t> _tail{0}; // written by the consumer only
+};
+
+#endif // ZMODEM_SPSC_RING_H
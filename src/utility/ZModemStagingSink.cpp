@@ -0,0 +1,134 @@
+/**
+ * @file ZModemStagingSink.cpp
+ * @author Akita Engineering
+ * @brief PSRAM-staged, verified receive sink.
+ * @version 1.1.0
+ */
+
+#include "ZModemStagingSink.h"
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+static uint8_t* stageAlloc(size_t n) {
+#if defined(ESP32)
+    // PSRAM only: internal RAM is too scarce to hold files
+    return (uint8_t*)heap_caps_malloc(n, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    return (uint8_t*)malloc(n);
+#endif
+}
+
+static void stageFree(uint8_t* p) {
+#if defined(ESP32)
+    heap_caps_free(p);
+#else
+    free(p);
+#endif
+}
+
+ZModemStagingSink::ZModemStagingSink(ZModemSink& target, const uint8_t* sha256, size_t maxBytes)
+    : _target(target), _maxBytes(maxBytes), _checkHash(sha256 != nullptr) {
+    if (sha256) memcpy(_expected, sha256, sizeof(_expected));
+}
+
+ZModemStagingSink::~ZModemStagingSink() {
+    if (_buf) stageFree(_buf);
+}
+
+void ZModemStagingSink::reset() {
+    if (_buf) stageFree(_buf);
+    _buf = nullptr;
+    _cap = 0;
+    _len = 0;
+    _direct = false;
+    _failed = false;
+    _targetWrites = 0;
+    _sha.begin();
+}
+
+// A buffer for n bytes, or direct writes if it is over the cap or cannot be had
+void ZModemStagingSink::_allocate(size_t n) {
+    if (_buf || _direct) return;
+    if (n > _maxBytes) n = 0;
+    _buf = n ? stageAlloc(n) : nullptr;
+    _cap = _buf ? n : 0;
+    _direct = _buf == nullptr;
+}
+
+bool ZModemStagingSink::expect(size_t size) {
+    // Sized for the part still to come. Unknown (0): the first write takes
+    // the whole cap.
+    size_t have = _target.size();
+    if (size > have) _allocate(size - have);
+    return true;
+}
+
+// The file outgrew the buffer after all (it was not announced, or its
+// announced size was wrong): write out what is held and pass the rest through
+void ZModemStagingSink::_goDirect() {
+    _writeOut();
+    stageFree(_buf);
+    _buf = nullptr;
+    _cap = 0;
+    _direct = true;
+}
+
+// Everything held goes to the target in one write
+bool ZModemStagingSink::_writeOut() {
+    if (_len == 0) return true;
+    _targetWrites++;
+    bool ok = _target.write(_buf, _len) == _len;
+    _len = 0;
+    if (!ok) _failed = true;
+    return ok;
+}
+
+uint8_t* ZModemStagingSink::writeSpan(size_t& n) {
+    if (!_buf) {
+        n = 0;
+        return nullptr;
+    }
+    size_t room = _cap - _len;
+    if (n > room) n = room;
+    return _buf + _len;
+}
+
+size_t ZModemStagingSink::write(const uint8_t* src, size_t n) {
+    if (_failed) return 0;
+    _allocate(_maxBytes); // data without a ZFILE announcement
+    if (_checkHash) _sha.update(src, n);
+    // Data decoded in place via writeSpan() always fits
+    if (_buf && n > _cap - _len) {
+        _goDirect();
+        if (_failed) return 0;
+    }
+    if (_direct) {
+        _targetWrites++;
+        size_t w = _target.write(src, n);
+        if (w != n) _failed = true;
+        return w;
+    }
+    // Data decoded in place via writeSpan() is already where it belongs
+    if (src != _buf + _len) memcpy(_buf + _len, src, n);
+    _len += n;
+    return n;
+}
+
+bool ZModemStagingSink::finalize(bool ok) {
+    bool good = ok && !_failed;
+    if (good && _checkHash) {
+        uint8_t digest[ZModemSha256::DIGEST_SIZE];
+        _sha.finish(digest);
+        good = memcmp(digest, _expected, sizeof(digest)) == 0;
+    }
+    // Flash is written only now, and only for a verified file
+    if (good) good = _writeOut();
+    _len = 0;
+    bool done = _target.finalize(good) && good;
+    if (_buf) stageFree(_buf);
+    _buf = nullptr;
+    _cap = 0;
+    return done;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file ZModemStagingSink.h
+ * @author Akita Engineering
+ * @brief A ZModemSink that holds a received file in PSRAM and writes it to
+ * another sink (usually a ZModemFileSink) in large sequential writes once it
+ * is complete and verified, instead of one flash write per subpacket.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_STAGING_SINK_H
+#define ZMODEM_STAGING_SINK_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+#include "ZModemDataIO.h"
+#include "ZModemSha256.h"
+
+// Receive with akitaZmodem.startReceive(sink). The buffer is sized from the
+// ZFILE announcement, up to 'maxBytes', and taken from PSRAM on ESP32 (the
+// heap elsewhere). Data is decoded straight into it.
+//
+// A file that fits reaches 'target' in one write at ZEOF, and only if it
+// matches 'sha256' (may be nullptr: no hash check). A failed or aborted
+// transfer then leaves no flash writes behind. A file announced larger than
+// the buffer, and a buffer that cannot be had (no PSRAM), are not staged:
+// writes go straight to 'target' and unverified() is set. The hash is still
+// checked at ZEOF, but a failure leaves what was written in 'target'.
+class ZModemStagingSink : public ZModemSink {
+public:
+    ZModemStagingSink(ZModemSink& target, const uint8_t* sha256 = nullptr, size_t maxBytes = AKZ_STAGE_MAX_BYTES);
+    ~ZModemStagingSink();
+
+    size_t size() override { return _target.size() + _len; }
+    bool expect(size_t size) override;
+    size_t write(const uint8_t* src, size_t n) override;
+    uint8_t* writeSpan(size_t& n) override;
+    bool finalize(bool ok) override;
+
+    // Buffer in use (0 before the first data, or when writing directly)
+    size_t capacity() const { return _cap; }
+    // Writes passed to the target so far
+    uint32_t targetWrites() const { return _targetWrites; }
+    // Data reached the target before the file was verified
+    bool unverified() const { return _direct; }
+    // Drop the buffer and its data, e.g. before reusing the sink
+    void reset();
+
+private:
+    void _allocate(size_t n);
+    bool _writeOut();
+    void _goDirect();
+
+    ZModemSink& _target;
+    size_t _maxBytes;
+    uint8_t _expected[ZModemSha256::DIGEST_SIZE];
+    bool _checkHash;
+    ZModemSha256 _sha;
+    uint8_t* _buf = nullptr;
+    size_t _cap = 0;
+    size_t _len = 0;
+    bool _direct = false;  // not staged (over the cap, or no buffer): pass writes through
+    bool _failed = false;
+    uint32_t _targetWrites = 0;
+};
+
+#endif // ZMODEM_STAGING_SINK_H
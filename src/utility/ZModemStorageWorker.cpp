@@ -0,0 +1,258 @@
+/**
+ * @file ZModemStorageWorker.cpp
+ * @author Akita Engineering
+ * @brief Background read-ahead / write-behind for session files.
+ * @version 1.1.0
+ */
+
+#include "ZModemStorageWorker.h"
+
+#if AKZ_ENABLE_STORAGE_WORKER
+
+// --- ZModemStorageChannel, engine side ---
+
+bool ZModemStorageChannel::open(File* file, bool reading, size_t pos, size_t size, ZModemBufferPool* pool,
+                                ZModemEngineTask* worker, ZModemStorageCounters* counters) {
+    close();
+    if (!file || !pool || !worker) return false;
+    _blocks = pool->acquire(DEPTH * BLOCK_SIZE);
+    if (!_blocks) return false;
+    for (uint32_t i = 0; i < DEPTH; ++i) {
+        _slots[i].buf = _blocks + i * BLOCK_SIZE;
+        _slots[i].state.store(FREE, std::memory_order_relaxed);
+    }
+    _pool = pool;
+    _worker = worker;
+    _counters = counters;
+    _reading = reading;
+    _size = size;
+    _readPos = _reqPos = pos;
+    _blockOff = 0;
+    _fillLen = 0;
+    _fillLimit = BLOCK_SIZE - pos % BLOCK_SIZE;
+    _filePos = file->position();
+    _failed.store(false, std::memory_order_relaxed);
+    // Everything above is published to the worker by the first request
+    _file = file;
+    _fill();
+    return true;
+}
+
+void ZModemStorageChannel::close() {
+    if (!_file) return;
+    // Reads not started yet are skipped; writes are all performed
+    if (_fillLen) _issueWrite();
+    _gen.fetch_add(1, std::memory_order_release);
+    while (_done.load(std::memory_order_acquire) != _head) {
+        _worker->wake();
+        delay(1);
+    }
+    for (uint32_t i = 0; i < DEPTH; ++i) {
+        _slots[i].state.store(FREE, std::memory_order_relaxed);
+        _slots[i].buf = nullptr;
+    }
+    _pool->release(_blocks);
+    _blocks = nullptr;
+    _tail = _head;
+    _file = nullptr;
+}
+
+// Take back blocks the engine has no further use for: performed writes and
+// reads issued before the last seek
+void ZModemStorageChannel::_reclaim() {
+    uint16_t gen = _gen.load(std::memory_order_relaxed);
+    while (_tail != _head) {
+        Slot& s = _slots[_tail % DEPTH];
+        uint8_t st = s.state.load(std::memory_order_acquire);
+        if (st != WRITE_DONE && !(st == READ_DONE && s.gen != gen)) break;
+        s.state.store(FREE, std::memory_order_relaxed);
+        _tail++;
+    }
+}
+
+// Request the blocks after the last one requested, as far as the ring allows
+void ZModemStorageChannel::_fill() {
+    if (!_reading) return;
+    bool issued = false;
+    while (_head - _tail < DEPTH && _reqPos < _size) {
+        Slot& s = _slots[_head % DEPTH];
+        size_t left = _size - _reqPos;
+        s.pos = _reqPos;
+        s.len = (uint16_t)(left < BLOCK_SIZE ? left : BLOCK_SIZE);
+        s.got = 0;
+        s.gen = _gen.load(std::memory_order_relaxed);
+        s.state.store(READ_REQ, std::memory_order_release);
+        _reqPos += s.len;
+        _head++;
+        issued = true;
+    }
+    if (issued) _worker->wake();
+}
+
+int ZModemStorageChannel::read(uint8_t* dst, size_t n) {
+    _reclaim();
+    size_t copied = 0;
+    while (copied < n && _tail != _head) {
+        Slot& s = _slots[_tail % DEPTH];
+        if (s.state.load(std::memory_order_acquire) != READ_DONE) break;
+        size_t take = s.got - _blockOff;
+        if (take > n - copied) take = n - copied;
+        memcpy(dst + copied, s.buf + _blockOff, take);
+        copied += take;
+        _blockOff += take;
+        _readPos += take;
+        if (_blockOff >= s.got) {
+            // A short block means the file is shorter than it was
+            if (s.got < s.len && _size > _readPos) _size = _readPos;
+            s.state.store(FREE, std::memory_order_relaxed);
+            _tail++;
+            _blockOff = 0;
+        }
+    }
+    _fill();
+    if (copied) return (int)copied;
+    if (!remaining()) return 0;
+    _counters->waits.fetch_add(1, std::memory_order_relaxed);
+    return WOULD_BLOCK;
+}
+
+void ZModemStorageChannel::seek(size_t pos) {
+    if (pos == _readPos) return; // prefetched blocks are still the right ones
+    _gen.fetch_add(1, std::memory_order_release);
+    _readPos = _reqPos = pos;
+    _blockOff = 0;
+    _reclaim();
+    _fill();
+}
+
+// Hand the head block to the worker. The next one starts at its buffer
+// start and still ends on the same block multiple in the file.
+void ZModemStorageChannel::_issueWrite() {
+    Slot& s = _slots[_head % DEPTH];
+    s.len = (uint16_t)_fillLen;
+    s.state.store(WRITE_REQ, std::memory_order_release);
+    _head++;
+    _fillLimit = _fillLen == _fillLimit ? BLOCK_SIZE : _fillLimit - _fillLen;
+    _fillLen = 0;
+    _worker->wake();
+}
+
+// Bytes write() accepts right now: the rest of the head block, then whole
+// free blocks behind it
+static size_t writeRoom(uint32_t freeSlots, size_t fillLimit, size_t fillLen, size_t block) {
+    return freeSlots ? (freeSlots - 1) * block + (fillLimit - fillLen) : 0;
+}
+
+bool ZModemStorageChannel::write(const uint8_t* src, size_t n) {
+    _reclaim();
+    if (n > writeRoom(DEPTH - (_head - _tail), _fillLimit, _fillLen, BLOCK_SIZE)) {
+        _counters->waits.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    while (n > 0) {
+        Slot& s = _slots[_head % DEPTH];
+        size_t k = _fillLimit - _fillLen;
+        if (k > n) k = n;
+        memcpy(s.buf + _fillLen, src, k);
+        _fillLen += k;
+        src += k;
+        n -= k;
+        if (_fillLen == _fillLimit) _issueWrite();
+    }
+    return true;
+}
+
+bool ZModemStorageChannel::ready(size_t need) {
+    _reclaim();
+    if (_reading) {
+        if (!remaining()) return true;
+        _fill();
+        return _tail != _head && _slots[_tail % DEPTH].state.load(std::memory_order_acquire) == READ_DONE;
+    }
+    if (need == 0) {
+        if (_fillLen) _issueWrite();
+        return _tail == _head;
+    }
+    return writeRoom(DEPTH - (_head - _tail), _fillLimit, _fillLen, BLOCK_SIZE) >= need;
+}
+
+// --- ZModemStorageChannel, worker side ---
+
+bool ZModemStorageChannel::service() {
+    uint32_t w = _done.load(std::memory_order_relaxed);
+    Slot& s = _slots[w % DEPTH];
+    uint8_t st = s.state.load(std::memory_order_acquire);
+    if (st != READ_REQ && st != WRITE_REQ) return false;
+
+    unsigned long t0 = micros();
+    if (st == READ_REQ) {
+        if (s.gen == _gen.load(std::memory_order_acquire)) {
+            if (_filePos != s.pos) _file->seek(s.pos);
+            int r = _file->read(s.buf, s.len);
+            s.got = r > 0 ? (uint16_t)r : 0;
+            _filePos = s.pos + s.got;
+            _counters->reads.fetch_add(1, std::memory_order_relaxed);
+            _counters->bytesRead.fetch_add(s.got, std::memory_order_relaxed);
+        } else {
+            s.got = 0; // superseded by a seek or close
+        }
+        s.state.store(READ_DONE, std::memory_order_release);
+    } else {
+        // Full blocks queued behind this one, up to the end of the ring, are
+        // adjacent in memory and in the file: write them in the same call
+        uint32_t n = 1;
+        size_t len = s.len;
+        while ((w + n) % DEPTH != 0 && _slots[(w + n - 1) % DEPTH].len == BLOCK_SIZE &&
+               _slots[(w + n) % DEPTH].state.load(std::memory_order_acquire) == WRITE_REQ) {
+            len += _slots[(w + n) % DEPTH].len;
+            n++;
+        }
+        size_t put = _file->write(s.buf, len);
+        if (put != len) _failed.store(true, std::memory_order_release);
+        _filePos += put;
+        _counters->writes.fetch_add(1, std::memory_order_relaxed);
+        _counters->bytesWritten.fetch_add((uint32_t)put, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; ++i) {
+            _slots[(w + i) % DEPTH].state.store(WRITE_DONE, std::memory_order_release);
+        }
+        w += n - 1;
+    }
+    uint32_t tookUs = (uint32_t)(micros() - t0);
+    uint32_t prev = _counters->maxOpUs.load(std::memory_order_relaxed);
+    while (tookUs > prev && !_counters->maxOpUs.compare_exchange_weak(prev, tookUs)) {}
+    // Last: close() waits on this, after which the slot is not touched again
+    _done.store(w + 1, std::memory_order_release);
+    return true;
+}
+
+// --- ZModemStorageWorker ---
+
+bool ZModemStorageWorker::start(NotifyFn onProgress, void* ctx) {
+    _notify = onProgress;
+    _notifyCtx = ctx;
+    return _task.start(_step, this, "akz_storage", AKZ_STORAGE_TASK_STACK, AKZ_STORAGE_TASK_PRIORITY,
+                       AKZ_STORAGE_TASK_CORE);
+}
+
+void ZModemStorageWorker::stop() {
+    for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) _channels[i].close();
+    _task.stop();
+}
+
+// Perform requests round-robin across sessions until none is left, telling
+// the owner after each one so a blocked engine resumes promptly
+uint32_t ZModemStorageWorker::_step(void* ctx) {
+    ZModemStorageWorker* self = static_cast<ZModemStorageWorker*>(ctx);
+    bool did;
+    do {
+        did = false;
+        for (int i = 0; i < AKZ_MAX_SESSIONS; ++i) {
+            if (!self->_channels[i].service()) continue;
+            did = true;
+            if (self->_notify) self->_notify(self->_notifyCtx);
+        }
+    } while (did);
+    return ZModemEngineTask::MAX_SLEEP_MS;
+}
+
+#endif // AKZ_ENABLE_STORAGE_WORKER
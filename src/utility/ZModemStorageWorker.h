@@ -0,0 +1,155 @@
+/**
+ * @file ZModemStorageWorker.h
+ * @author Akita Engineering
+ * @brief Optional background file I/O. Each session gets a channel, a small
+ * ring of pool blocks shared with the worker thread: a send keeps the next
+ * blocks of its file prefetched, a receive queues decoded data for the
+ * worker to write. The engine never waits on the filesystem; it waits on
+ * the channel instead. Built only with AKZ_ENABLE_STORAGE_WORKER.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_STORAGE_WORKER_H
+#define ZMODEM_STORAGE_WORKER_H
+
+#include "../AkitaMeshZmodemConfig.h"
+
+#if AKZ_ENABLE_STORAGE_WORKER
+
+#include <Arduino.h>
+#include <FS.h>
+#include <atomic>
+#include "ZModemBufferPool.h"
+#include "ZModemEngineTask.h"
+
+static_assert(AKZ_STORAGE_QUEUE_BLOCKS >= 2 && AKZ_STORAGE_QUEUE_BLOCKS <= 16, "AKZ_STORAGE_QUEUE_BLOCKS must be 2..16");
+
+// Counters kept by the worker thread, readable from any thread
+struct ZModemStorageCounters {
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> writes{0};
+    std::atomic<uint32_t> bytesRead{0};
+    std::atomic<uint32_t> bytesWritten{0};
+    std::atomic<uint32_t> maxOpUs{0};     // longest single filesystem call
+    std::atomic<uint32_t> waits{0};       // engine found the channel not ready
+};
+
+// One session's queue. The engine side (open/close/read/seek/write/ready)
+// is used by one thread at a time; service() runs on the worker. Blocks
+// move between the two through their state alone: the engine fills FREE
+// blocks in ring order and marks them requested, the worker performs
+// requests in the same order and marks them done. Written data is handed
+// over a whole block at a time, cut at block multiples in the file, and
+// the worker writes full blocks that are adjacent in the ring in one call.
+class ZModemStorageChannel {
+public:
+    static const size_t BLOCK_SIZE = ZModemBufferPool::SLAB_SIZE;
+    static const uint32_t DEPTH = AKZ_STORAGE_QUEUE_BLOCKS;
+    static const int WOULD_BLOCK = -1;
+
+    ZModemStorageChannel() {}
+    ~ZModemStorageChannel() { close(); }
+
+    // Borrow DEPTH blocks and start serving 'file' at offset 'pos'. A
+    // reading channel prefetches up to 'size'. False when the pool is dry;
+    // the session then does its I/O inline.
+    bool open(File* file, bool reading, size_t pos, size_t size, ZModemBufferPool* pool,
+              ZModemEngineTask* worker, ZModemStorageCounters* counters);
+    // Drop queued reads, wait for queued writes (the partial block too) and
+    // the operation in progress, return the blocks. The file stays open.
+    void close();
+    bool isOpen() const { return _file != nullptr; }
+
+    // Reading: copy up to n bytes from the current position. Returns the
+    // count, 0 at end of file, or WOULD_BLOCK while the next block is read.
+    int read(uint8_t* dst, size_t n);
+    void seek(size_t pos);
+    size_t remaining() const { return _size > _readPos ? _size - _readPos : 0; }
+
+    // Writing: queue n bytes (at most DEPTH * BLOCK_SIZE). False, with
+    // nothing queued, when there is not enough room yet. A block goes to the
+    // worker once full, or when ready(0) asks for everything.
+    bool write(const uint8_t* src, size_t n);
+
+    // Reading: the next block is in (or the file is done). Writing: room
+    // for 'need' bytes, or for need == 0 every queued write is on disk.
+    bool ready(size_t need);
+    // A write came back short; the data is not all on disk
+    bool failed() const { return _failed.load(std::memory_order_acquire); }
+
+    // Worker side: perform the oldest request. False if there is none.
+    bool service();
+
+private:
+    enum SlotState : uint8_t { FREE, READ_REQ, READ_DONE, WRITE_REQ, WRITE_DONE };
+    struct Slot {
+        std::atomic<uint8_t> state{FREE};
+        uint8_t* buf = nullptr;
+        size_t pos = 0;       // file offset (reads)
+        uint16_t len = 0;     // bytes requested
+        uint16_t got = 0;     // bytes read (reads)
+        uint16_t gen = 0;     // seek generation the read was issued in
+    };
+    Slot _slots[DEPTH];
+    uint8_t* _blocks = nullptr;  // one pool run, so adjacent slots are adjacent in memory
+    // Engine side
+    uint32_t _head = 0;       // next slot to fill
+    uint32_t _tail = 0;       // oldest slot not yet reclaimed
+    size_t _readPos = 0;      // reading: position of the next byte returned
+    size_t _reqPos = 0;       // reading: position of the next block requested
+    size_t _blockOff = 0;     // reading: bytes already taken from the tail block
+    size_t _fillLen = 0;      // writing: bytes in the head block, not yet handed over
+    size_t _fillLimit = 0;    // writing: head block size that ends on a block multiple
+    size_t _size = 0;
+    bool _reading = false;
+    File* _file = nullptr;
+    ZModemBufferPool* _pool = nullptr;
+    ZModemEngineTask* _worker = nullptr;
+    ZModemStorageCounters* _counters = nullptr;
+    std::atomic<uint16_t> _gen{0};   // bumped by seek(); stale reads are skipped
+    // Worker side
+    std::atomic<uint32_t> _done{0};  // requests performed so far (ring index)
+    size_t _filePos = 0;
+    std::atomic<bool> _failed{false};
+
+    void _reclaim();
+    void _fill();
+    void _issueWrite();
+};
+
+// The worker thread and one channel per session slot
+class ZModemStorageWorker {
+public:
+    typedef void (*NotifyFn)(void* ctx);
+
+    ZModemStorageWorker() {}
+    ~ZModemStorageWorker() { stop(); }
+
+    // 'onProgress' runs on the worker after it completes requests, so an
+    // engine blocked on a channel can be woken
+    bool start(NotifyFn onProgress, void* ctx);
+    void stop();
+    bool isRunning() const { return _task.isRunning(); }
+
+    ZModemStorageChannel& channel(int slot) { return _channels[slot]; }
+    const ZModemStorageChannel& channel(int slot) const { return _channels[slot]; }
+    bool open(int slot, File* file, bool reading, size_t pos, size_t size, ZModemBufferPool* pool) {
+        return isRunning() && _channels[slot].open(file, reading, pos, size, pool, &_task, &_counters);
+    }
+
+    const ZModemStorageCounters& counters() const { return _counters; }
+    // Pool bytes a channel holds for the whole transfer
+    static size_t committedBytes() { return ZModemStorageChannel::DEPTH * ZModemBufferPool::SLAB_SIZE; }
+
+private:
+    ZModemStorageChannel _channels[AKZ_MAX_SESSIONS];
+    ZModemStorageCounters _counters;
+    ZModemEngineTask _task;
+    NotifyFn _notify = nullptr;
+    void* _notifyCtx = nullptr;
+    static uint32_t _step(void* ctx);
+};
+
+#endif // AKZ_ENABLE_STORAGE_WORKER
+
+#endif // ZMODEM_STORAGE_WORKER_H
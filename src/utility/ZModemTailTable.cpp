@@ -0,0 +1,112 @@
+/**
+ * @file ZModemTailTable.cpp
+ * @author Akita Engineering
+ * @brief Tail send offsets and their on-flash text format.
+ * @version 1.1.0
+ */
+
+#include "ZModemTailTable.h"
+#include "ZModemAtomicFile.h"
+
+// Header line, then one line per (file, node), least recently used first:
+//   T <peer> <offset> <fingerprint> <follow ms> <path>
+// peer and fingerprint in hex. The path is the rest of the line.
+static const char* const TAIL_HEADER = "AKZTAILS 1";
+static const size_t TAIL_LINE_MAX = 64 + AKZ_JOB_PATH_MAX;
+
+ZModemTailRecord* ZModemTailTable::find(const char* path, uint32_t peer) {
+    for (uint8_t i = 0; i < _count; ++i) {
+        if (_records[i].peer == peer && strcmp(_records[i].path, path) == 0) return &_records[i];
+    }
+    return nullptr;
+}
+
+ZModemTailRecord* ZModemTailTable::use(const char* path, uint32_t peer) {
+    if (!path || strlen(path) >= AKZ_JOB_PATH_MAX) return nullptr;
+    ZModemTailRecord r;
+    ZModemTailRecord* found = find(path, peer);
+    if (found) {
+        r = *found;
+        remove(found);
+    } else {
+        memset(&r, 0, sizeof(r));
+        r.peer = peer;
+        strncpy(r.path, path, sizeof(r.path) - 1);
+        if (_count == CAPACITY) remove(&_records[0]);
+    }
+    _records[_count] = r;
+    dirty = true;
+    return &_records[_count++];
+}
+
+void ZModemTailTable::remove(ZModemTailRecord* r) {
+    uint8_t i = (uint8_t)(r - _records);
+    if (i >= _count) return;
+    memmove(&_records[i], &_records[i + 1], (_count - i - 1) * sizeof(ZModemTailRecord));
+    _count--;
+    dirty = true;
+}
+
+bool ZModemTailTable::save(FS& fs, const char* path) {
+    if (_count == 0) {
+        akzAtomicRemove(fs, path);
+        dirty = false;
+        return true;
+    }
+    auto write = [](File& f, const void* ctx) { return static_cast<const ZModemTailTable*>(ctx)->_write(f); };
+    if (!akzAtomicRewrite(fs, path, write, this)) return false;
+    dirty = false;
+    return true;
+}
+
+bool ZModemTailTable::_write(File& f) const {
+    char line[TAIL_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "%s\n", TAIL_HEADER);
+    bool ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    for (uint8_t i = 0; ok && i < _count; ++i) {
+        const ZModemTailRecord& r = _records[i];
+        n = snprintf(line, sizeof(line), "T %lx %lu %lx %lu %s\n", (unsigned long)r.peer, (unsigned long)r.offset,
+                     (unsigned long)r.fingerprint, (unsigned long)r.followMs, r.path);
+        if (n <= 0 || n >= (int)sizeof(line)) continue; // cannot happen with a bounded path
+        ok = f.write((const uint8_t*)line, n) == (size_t)n;
+    }
+    return ok;
+}
+
+bool ZModemTailTable::load(FS& fs, const char* path) {
+    File f = akzAtomicOpen(fs, path);
+    if (!f) return false;
+
+    _count = 0;
+    dirty = false;
+    char line[TAIL_LINE_MAX];
+    bool header = false;
+    while (f.available() && _count < CAPACITY) {
+        size_t len = 0;
+        int c;
+        while ((c = f.read()) >= 0 && c != '\n') {
+            if (len < sizeof(line) - 1) line[len++] = (char)c;
+        }
+        line[len] = '\0';
+        if (!header) {
+            if (strcmp(line, TAIL_HEADER) != 0) break;
+            header = true;
+            continue;
+        }
+        unsigned long peer, offset, fp, follow;
+        int pathAt = 0;
+        if (sscanf(line, "T %lx %lu %lx %lu %n", &peer, &offset, &fp, &follow, &pathAt) != 4 || pathAt == 0 ||
+            line[pathAt] == '\0') {
+            continue;
+        }
+        ZModemTailRecord& r = _records[_count++];
+        memset(&r, 0, sizeof(r));
+        r.peer = (uint32_t)peer;
+        r.offset = (uint32_t)offset;
+        r.fingerprint = (uint32_t)fp;
+        r.followMs = (uint32_t)follow;
+        strncpy(r.path, line + pathAt, sizeof(r.path) - 1);
+    }
+    f.close();
+    return header;
+}
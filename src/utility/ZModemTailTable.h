@@ -0,0 +1,57 @@
+/**
+ * @file ZModemTailTable.h
+ * @author Akita Engineering
+ * @brief How much of each file has been delivered to each node by tail
+ * sends, kept in a small text file so the next send of a growing log
+ * carries only what was appended. An auto-accepting node keeps the same
+ * records for its spool files, per node they came from.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_TAIL_TABLE_H
+#define ZMODEM_TAIL_TABLE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_TAIL_CAPACITY > 0 && AKZ_TAIL_CAPACITY <= 64, "AKZ_TAIL_CAPACITY must be 1..64");
+
+struct ZModemTailRecord {
+    uint32_t peer;
+    uint32_t offset;      // bytes the peer has confirmed
+    uint32_t fingerprint; // of those bytes, see ZModemSendCheckpoint::fingerprint()
+    uint32_t followMs;    // followed: poll period, else 0
+    uint32_t checkAt;     // followed: millis() of the next poll (not saved)
+    char path[AKZ_JOB_PATH_MAX];
+};
+
+class ZModemTailTable {
+public:
+    static const uint8_t CAPACITY = AKZ_TAIL_CAPACITY;
+
+    ZModemTailRecord* find(const char* path, uint32_t peer);
+    // The record for (path, peer), created at offset 0 if there is none
+    // (forgetting the least recently used one when full). Either way it
+    // becomes the most recently used. nullptr if the path is too long.
+    ZModemTailRecord* use(const char* path, uint32_t peer);
+    void remove(ZModemTailRecord* r);
+    uint8_t count() const { return _count; }
+    // Least recently used first
+    ZModemTailRecord& at(uint8_t i) { return _records[i]; }
+    const ZModemTailRecord& at(uint8_t i) const { return _records[i]; }
+
+    // Whole-file rewrite through "<path>.tmp"; no records removes the file
+    bool save(FS& fs, const char* path);
+    bool load(FS& fs, const char* path);
+
+    bool dirty = false; // changed since the last save()
+
+private:
+    bool _write(File& f) const;
+
+    ZModemTailRecord _records[CAPACITY];
+    uint8_t _count = 0;
+};
+
+#endif // ZMODEM_TAIL_TABLE_H
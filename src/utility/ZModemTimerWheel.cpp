@@ -0,0 +1,163 @@
+/**
+ * @file ZModemTimerWheel.cpp
+ * @author Akita Engineering
+ * @brief Timer wheel implementation: three levels of 32 slots, cascading
+ * lazily as the low level wraps.
+ * @version 1.1.0
+ */
+
+#include "ZModemTimerWheel.h"
+
+static const uint32_t SLOT_MASK = ZModemTimerWheel::SLOTS - 1;
+// Ticks covered by the whole wheel; later deadlines park in the top level and
+// are re-placed each time they cascade
+static const uint32_t WHEEL_SPAN = 1UL << (ZModemTimerWheel::SLOT_BITS * ZModemTimerWheel::LEVELS);
+static const uint32_t MAX_DELAY_MS = 0x40000000UL;
+
+ZModemTimerWheel::ZModemTimerWheel() {
+    for (uint8_t l = 0; l < LEVELS; ++l) {
+        for (uint8_t s = 0; s < SLOTS; ++s) _heads[l][s] = nullptr;
+        _occupied[l] = 0;
+    }
+    _nowTick = 0;
+    _baseMs = millis();
+    _armed = 0;
+}
+
+void ZModemTimerWheel::arm(ZModemTimer& t, uint32_t delayMs) {
+    if (t.isArmed()) _unlink(t);
+    if (delayMs > MAX_DELAY_MS) delayMs = MAX_DELAY_MS;
+    // Measured from the wheel's own tick base, so a wheel that has not been
+    // advanced for a while still fires no earlier than asked
+    uint32_t sinceBase = millis() - _baseMs;
+    t._expires = _nowTick + (sinceBase + delayMs + TICK_MS - 1) / TICK_MS;
+    // The current tick has already been processed
+    if ((int32_t)(t._expires - _nowTick) <= 0) t._expires = _nowTick + 1;
+    _place(t);
+    _armed++;
+}
+
+void ZModemTimerWheel::cancel(ZModemTimer& t) {
+    if (t.isArmed()) _unlink(t);
+}
+
+void ZModemTimerWheel::_place(ZModemTimer& t) {
+    uint32_t delta = t._expires - _nowTick;
+    uint32_t when = t._expires;
+    if ((int32_t)delta < 0) { delta = 0; when = _nowTick; }
+    uint8_t level = 0;
+    while (level < LEVELS - 1 && delta >= (1UL << (SLOT_BITS * (level + 1)))) level++;
+    if (delta >= WHEEL_SPAN) when = _nowTick + WHEEL_SPAN - 1;
+    uint8_t slot = (when >> (SLOT_BITS * level)) & SLOT_MASK;
+
+    ZModemTimer*& head = _heads[level][slot];
+    t._next = head;
+    if (head) head->_pprev = &t._next;
+    head = &t;
+    t._pprev = &head;
+    t._level = level;
+    t._slot = slot;
+    _occupied[level] |= 1UL << slot;
+}
+
+void ZModemTimerWheel::_unlink(ZModemTimer& t) {
+    *t._pprev = t._next;
+    if (t._next) t._next->_pprev = t._pprev;
+    t._next = nullptr;
+    t._pprev = nullptr;
+    if (!_heads[t._level][t._slot]) _occupied[t._level] &= ~(1UL << t._slot);
+    _armed--;
+}
+
+void ZModemTimerWheel::_cascade(uint8_t level, uint8_t slot) {
+    ZModemTimer* list = _heads[level][slot];
+    _heads[level][slot] = nullptr;
+    _occupied[level] &= ~(1UL << slot);
+    while (list) {
+        ZModemTimer* t = list;
+        list = t->_next;
+        _place(*t);
+    }
+}
+
+void ZModemTimerWheel::_moveTo(uint32_t tick) {
+    // Keep the millisecond base in step with the cursor so callbacks that
+    // re-arm mid-advance measure from the tick being processed
+    _baseMs += (tick - _nowTick) * TICK_MS;
+    _nowTick = tick;
+}
+
+void ZModemTimerWheel::_processTick(uint32_t tick) {
+    _moveTo(tick);
+    // Pull the next block of deadlines down from the upper levels, highest
+    // first so entries skip straight to the level they now belong in
+    for (uint8_t l = LEVELS - 1; l > 0; --l) {
+        uint8_t shift = SLOT_BITS * l;
+        if ((tick & ((1UL << shift) - 1)) == 0) _cascade(l, (tick >> shift) & SLOT_MASK);
+    }
+
+    uint8_t slot = tick & SLOT_MASK;
+    ZModemTimer* list = _heads[0][slot];
+    if (!list) return;
+    // Detach the slot so callbacks can re-arm freely; unlinking one at a time
+    // keeps cancel() valid for entries that have not fired yet
+    _heads[0][slot] = nullptr;
+    _occupied[0] &= ~(1UL << slot);
+    list->_pprev = &list;
+    while (list) {
+        ZModemTimer* t = list;
+        _unlink(*t);
+        if (t->_cb) t->_cb(t->_ctx);
+    }
+}
+
+void ZModemTimerWheel::advance(uint32_t nowMs) {
+    uint32_t ticks = (nowMs - _baseMs) / TICK_MS;
+    if (ticks == 0) return;
+    uint32_t target = _nowTick + ticks;
+
+    while (_nowTick != target) {
+        if (_armed == 0) {
+            _moveTo(target);
+            break;
+        }
+        // Skip empty low-level slots: only occupied slots and block boundaries
+        // (where upper levels cascade) need processing
+        uint32_t tick = _nowTick + 1;
+        if (tick & SLOT_MASK) {
+            uint32_t m = _occupied[0] & (0xFFFFFFFFUL << (tick & SLOT_MASK));
+            uint32_t stop = m ? ((tick & ~SLOT_MASK) | (uint32_t)__builtin_ctz(m)) : ((tick | SLOT_MASK) + 1);
+            if ((int32_t)(stop - target) > 0) {
+                _moveTo(target);
+                break;
+            }
+            tick = stop;
+        }
+        _processTick(tick);
+    }
+}
+
+uint8_t ZModemTimerWheel::_nextOccupied(uint8_t level, uint8_t index) const {
+    uint32_t m = _occupied[level];
+    if (!m) return 0;
+    uint8_t r = (index + 1) & SLOT_MASK;
+    uint32_t rotated = r ? ((m >> r) | (m << (SLOTS - r))) : m;
+    return (uint8_t)(__builtin_ctz(rotated) + 1);
+}
+
+uint32_t ZModemTimerWheel::msUntilNextDeadline(uint32_t nowMs) const {
+    if (_armed == 0) return NO_DEADLINE;
+    uint32_t best = NO_DEADLINE;
+    for (uint8_t l = 0; l < LEVELS; ++l) {
+        uint8_t shift = SLOT_BITS * l;
+        uint8_t d = _nextOccupied(l, (_nowTick >> shift) & SLOT_MASK);
+        if (!d) continue;
+        // Level 0 slots fire at that tick; upper slots cascade at the start of their block
+        uint32_t tick = ((_nowTick >> shift) + d) << shift;
+        uint32_t ahead = tick - _nowTick;
+        if (ahead < best) best = ahead;
+    }
+    uint32_t dueMs = best * TICK_MS;
+    uint32_t elapsed = nowMs - _baseMs;
+    return (elapsed >= dueMs) ? 0 : dueMs - elapsed;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file ZModemTimerWheel.h
+ * @author Akita Engineering
+ * @brief Hierarchical timer wheel shared by all sessions for retry, keepalive
+ * and inactivity deadlines. Arm and cancel are O(1); expiry costs O(1) per
+ * timer plus an occasional cascade.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_TIMER_WHEEL_H
+#define ZMODEM_TIMER_WHEEL_H
+
+#include <Arduino.h>
+#include "../AkitaMeshZmodemConfig.h"
+
+static_assert(AKZ_TIMER_TICK_MS > 0, "AKZ_TIMER_TICK_MS must be positive");
+
+class ZModemTimerWheel;
+
+// Intrusive timer node. Embed one per deadline in the owning object; it must
+// be cancelled (or have fired) before the owner is destroyed.
+class ZModemTimer {
+public:
+    typedef void (*Callback)(void* ctx);
+
+    ZModemTimer(Callback cb = nullptr, void* ctx = nullptr) : _cb(cb), _ctx(ctx) {}
+    ZModemTimer(const ZModemTimer&) = delete;
+    ZModemTimer& operator=(const ZModemTimer&) = delete;
+
+    void setCallback(Callback cb, void* ctx) { _cb = cb; _ctx = ctx; }
+    // False once the timer has fired or been cancelled
+    bool isArmed() const { return _pprev != nullptr; }
+
+private:
+    friend class ZModemTimerWheel;
+    ZModemTimer* _next = nullptr;
+    ZModemTimer** _pprev = nullptr; // link that points at us, for O(1) unlink
+    uint32_t _expires = 0;          // absolute tick
+    Callback _cb;
+    void* _ctx;
+    uint8_t _level = 0;
+    uint8_t _slot = 0;
+};
+
+class ZModemTimerWheel {
+public:
+    static const uint8_t LEVELS = 3;
+    static const uint8_t SLOT_BITS = 5;
+    static const uint8_t SLOTS = 1 << SLOT_BITS; // 32 slots -> one bitmask word per level
+    static const uint32_t TICK_MS = AKZ_TIMER_TICK_MS;
+    static const uint32_t NO_DEADLINE = 0xFFFFFFFFUL;
+
+    ZModemTimerWheel();
+
+    // (Re)arm 't' to fire 'delayMs' from now. Re-arming an armed timer moves it.
+    void arm(ZModemTimer& t, uint32_t delayMs);
+    void cancel(ZModemTimer& t);
+
+    // Fire every timer whose deadline is at or before 'nowMs'. Callbacks may
+    // arm or cancel any timer, including the one firing.
+    void advance(uint32_t nowMs);
+
+    // Milliseconds from 'nowMs' until the wheel next needs advance(): 0 if a
+    // timer is already due, NO_DEADLINE if nothing is armed. May undershoot
+    // while a far timer waits to cascade, never overshoots.
+    uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+
+    uint16_t armedCount() const { return _armed; }
+
+private:
+    ZModemTimer* _heads[LEVELS][SLOTS];
+    uint32_t _occupied[LEVELS]; // bit per non-empty slot
+    uint32_t _nowTick;          // last tick processed
+    uint32_t _baseMs;           // millis() at the start of _nowTick (wrap-safe deltas only)
+    uint16_t _armed;
+
+    void _place(ZModemTimer& t);
+    void _unlink(ZModemTimer& t);
+    void _moveTo(uint32_t tick);
+    void _cascade(uint8_t level, uint8_t slot);
+    void _processTick(uint32_t tick);
+    // First occupied slot strictly after 'index' (wrapping), as a distance 1..SLOTS, or 0 if none
+    uint8_t _nextOccupied(uint8_t level, uint8_t index) const;
+};
+
+#endif // ZMODEM_TIMER_WHEEL_H
@@ -0,0 +1,55 @@
+/**
+ * @file ZModemWriteCoalescer.cpp
+ * @author Akita Engineering
+ * @brief Unit-aligned write coalescing for received files.
+ * @version 1.1.0
+ */
+
+#include "ZModemWriteCoalescer.h"
+
+#if AKZ_HAVE_WRITE_COALESCER
+
+bool ZModemWriteCoalescer::begin(ZModemBufferPool* pool, size_t pos) {
+    end();
+    if (!pool) return false;
+    _buf = pool->acquire(UNIT);
+    if (!_buf) return false;
+    _pool = pool;
+    _len = 0;
+    // A resumed file may end mid-unit: the first write only tops it up
+    _limit = UNIT - pos % UNIT;
+    return true;
+}
+
+void ZModemWriteCoalescer::end() {
+    if (_pool) _pool->release(_buf);
+    _buf = nullptr;
+    _pool = nullptr;
+    _len = 0;
+}
+
+bool ZModemWriteCoalescer::write(ZModemSink* sink, const uint8_t* src, size_t n) {
+    bool ok = true;
+    while (n > 0) {
+        size_t k = _limit - _len;
+        if (k > n) k = n;
+        memcpy(_buf + _len, src, k);
+        _len += k;
+        src += k;
+        n -= k;
+        if (_len == _limit) ok = flush(sink) && ok;
+    }
+    return ok;
+}
+
+bool ZModemWriteCoalescer::flush(ZModemSink* sink) {
+    if (_len == 0) return true;
+    size_t put = sink->write(_buf, _len);
+    // A partial unit leaves the boundary where it was
+    _limit = _len == _limit ? UNIT : _limit - _len;
+    bool ok = put == _len;
+    _len = 0;
+    return ok;
+}
+
+#endif // AKZ_HAVE_WRITE_COALESCER
@@ -0,0 +1,48 @@
+/**
+ * @file ZModemWriteCoalescer.h
+ * @author Akita Engineering
+ * @brief Gathers a receiver's decoded data into AKZ_WRITE_COALESCE_BYTES
+ * units, cut at multiples of that size in the file, and writes each unit in
+ * one call. Built when AKZ_HAVE_WRITE_COALESCER is set.
+ * @version 1.1.0
+ */
+
+#ifndef ZMODEM_WRITE_COALESCER_H
+#define ZMODEM_WRITE_COALESCER_H
+
+#include "../AkitaMeshZmodemConfig.h"
+
+#if AKZ_HAVE_WRITE_COALESCER
+
+#include <Arduino.h>
+#include "ZModemBufferPool.h"
+#include "ZModemDataIO.h"
+
+class ZModemWriteCoalescer {
+public:
+    static const size_t UNIT = AKZ_WRITE_COALESCE_BYTES;
+
+    // Borrow the unit buffer; 'pos' is the file offset the next byte goes
+    // to. False when the pool is dry; the caller then writes directly.
+    bool begin(ZModemBufferPool* pool, size_t pos);
+    // Return the buffer. Anything not flushed is dropped.
+    void end();
+    bool isActive() const { return _buf != nullptr; }
+
+    // Append n bytes, writing out each unit as it fills. False if the sink
+    // took less than it was given; the data is then not all on disk.
+    bool write(ZModemSink* sink, const uint8_t* src, size_t n);
+    // Write out the partial unit, e.g. before the file is closed
+    bool flush(ZModemSink* sink);
+    size_t pending() const { return _len; }
+
+private:
+    ZModemBufferPool* _pool = nullptr;
+    uint8_t* _buf = nullptr;
+    size_t _len = 0;
+    size_t _limit = UNIT;  // fill that reaches the next unit boundary
+};
+
+#endif // AKZ_HAVE_WRITE_COALESCER
+
+#endif // ZMODEM_WRITE_COALESCER_H
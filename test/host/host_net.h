@@ -0,0 +1,237 @@
+/**
+ * @file host_net.h
+ * @author Akita Engineering
+ * @brief Two nodes over a simulated link, and the checks the host tests
+ * report with.
+ *
+ * Packets are delivered linkMs after they are sent, or dropped with
+ * probability 'loss' (seeded, so a run is repeatable). A node is driven
+ * either event-driven (each packet handed to processDataPacket() as it
+ * arrives, loop() when nextDeadline() says so) or by polling loop() every
+ * pollMs.
+ * @version 1.1.0
+ */
+
+#ifndef AKZ_HOST_NET_H
+#define AKZ_HOST_NET_H
+
+#include "AkitaMeshZmodem.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+inline int g_failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            ++g_failures;                                                             \
+        }                                                                             \
+    } while (0)
+
+// Exit code for main()
+inline int testResult() {
+    if (g_failures) fprintf(stderr, "%d check(s) failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
+
+// Write 'size' seeded pseudo-random bytes to 'path'; returns them
+inline std::vector<uint8_t> makeFile(FS& fs, const char* path, size_t size, uint32_t seed = 1) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& b : bytes) b = (uint8_t)rng();
+    File f = fs.open(path, FILE_WRITE);
+    f.write(bytes.data(), bytes.size());
+    f.close();
+    return bytes;
+}
+
+// Byte pipe between two engines driven directly; 'tap' keeps a copy of
+// what went through
+struct Pipe {
+    std::deque<uint8_t> bytes;
+    std::vector<uint8_t>* tap = nullptr;
+};
+
+class PipeEnd : public Stream {
+public:
+    PipeEnd(Pipe& in, Pipe& out) : _in(in), _out(out) {}
+    int available() override { return (int)_in.bytes.size(); }
+    int read() override {
+        if (_in.bytes.empty()) return -1;
+        int c = _in.bytes.front();
+        _in.bytes.pop_front();
+        return c;
+    }
+    int peek() override { return _in.bytes.empty() ? -1 : _in.bytes.front(); }
+    size_t write(uint8_t c) override {
+        _out.bytes.push_back(c);
+        if (_out.tap) _out.tap->push_back(c);
+        return 1;
+    }
+    using Print::write;
+
+private:
+    Pipe& _in;
+    Pipe& _out;
+};
+
+class HostLink {
+public:
+    static const NodeNum NODE_A = 0x10;
+    static const NodeNum NODE_B = 0x20;
+
+    uint32_t linkMs = 137;
+    double loss = 0;
+    uint32_t pollMs = 0;     // 0: event-driven
+    bool realTime = false;   // pace the simulated clock by the wall clock (engine task)
+    std::function<void()> onTick; // called once per simulated millisecond
+
+    // Counted over the last run()
+    uint64_t packets = 0;
+    uint64_t sentBytes[2] = {0, 0}; // payload bytes each node put on air
+    bool down[2] = {false, false};  // powered off (powerOff())
+    uint64_t wakeups[2] = {0, 0};  // loop() and processDataPacket() calls per node
+    uint64_t replies[2] = {0, 0};  // packets sent in answer to one received
+    uint64_t replyMs[2] = {0, 0};  // summed delay from receiving to answering
+    uint64_t busyUs[2] = {0, 0};   // time spent in those calls (micros())
+    uint64_t maxCallUs[2] = {0, 0};
+
+    Meshtastic mesh[2];
+    FS fs[2];
+    AkitaMeshZmodem node[2];
+
+    explicit HostLink(uint32_t seed = 42) : _rng(seed) {
+        mesh[0].node = NODE_A;
+        mesh[1].node = NODE_B;
+        for (int n = 0; n < 2; ++n) {
+            node[n].setProgressUpdateInterval(0);
+            node[n].begin(mesh[n], fs[n], &Serial);
+        }
+    }
+
+    AkitaMeshZmodem& a() { return node[0]; }
+    AkitaMeshZmodem& b() { return node[1]; }
+
+    // Power loss on node n: from now on it runs and receives nothing, the
+    // frames it had not sent yet are lost, and its files stay as they were
+    void powerOff(int n) {
+        down[n] = true;
+        mesh[n].outbox.clear();
+    }
+    // Boot node n again, with fresh RAM. Nothing runs on the old instance,
+    // as nothing would after a power loss (its destructor would end its
+    // sessions).
+    void reboot(int n) {
+        powerOff(n);
+        down[n] = false;
+        new (&node[n]) AkitaMeshZmodem();
+        node[n].setProgressUpdateInterval(0);
+        node[n].begin(mesh[n], fs[n], &Serial);
+        _wakeAt[n] = g_nowMs; // its restored sessions start at the next tick
+    }
+
+    double replyLatencyMs(int n) const { return replies[n] ? (double)replyMs[n] / replies[n] : 0.0; }
+
+    // Until no session or job is running or queued on either node and
+    // nothing is in the air. False if that takes longer than maxMs
+    // (simulated).
+    bool run(uint64_t maxMs = 600000) {
+        packets = 0;
+        for (int n = 0; n < 2; ++n) wakeups[n] = replies[n] = replyMs[n] = busyUs[n] = maxCallUs[n] = sentBytes[n] = 0;
+        _wakeAt[0] = _wakeAt[1] = g_nowMs;
+        uint64_t lastRx[2] = {0, 0};
+        uint64_t limit = g_nowMs + maxMs;
+        while (g_nowMs < limit) {
+            for (size_t i = 0; i < _air.size();) {
+                if (_air[i].at > g_nowMs) {
+                    ++i;
+                    continue;
+                }
+                int n = _air[i].dst;
+                MeshPacket p = _air[i].packet;
+                _air.erase(_air.begin() + i);
+                if (down[n]) continue;
+                lastRx[n] = g_nowMs;
+                if (pollMs == 0) {
+                    wakeups[n]++;
+                    uint64_t t0 = micros();
+                    node[n].processDataPacket(p);
+                    _charge(n, t0);
+                    _wakeAt[n] = _nextWake(n);
+                } else {
+                    _inbox[n].push_back(p);
+                }
+            }
+            for (int n = 0; n < 2; ++n) {
+                if (!down[n] && g_nowMs >= _wakeAt[n]) {
+                    wakeups[n]++;
+                    for (MeshPacket& p : _inbox[n]) {
+                        uint64_t t0 = micros();
+                        node[n].processDataPacket(p);
+                        _charge(n, t0);
+                    }
+                    _inbox[n].clear();
+                    uint64_t t0 = micros();
+                    node[n].loop();
+                    _charge(n, t0);
+                    _wakeAt[n] = _nextWake(n);
+                }
+                while (!mesh[n].outbox.empty()) {
+                    if (lastRx[n]) {
+                        replies[n]++;
+                        replyMs[n] += g_nowMs - lastRx[n];
+                        lastRx[n] = 0;
+                    }
+                    packets++;
+                    sentBytes[n] += mesh[n].outbox.front().decoded.payload.bytes.size();
+                    if (_lossDist(_rng) >= loss) _air.push_back({g_nowMs + linkMs, 1 - n, mesh[n].outbox.front()});
+                    mesh[n].outbox.pop_front();
+                }
+            }
+            if (onTick) onTick();
+            if (_air.empty() && _idle(0) && _idle(1)) return true;
+            if (realTime) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            g_nowMs++;
+        }
+        return false;
+    }
+
+private:
+    struct InFlight {
+        uint64_t at;
+        int dst;
+        MeshPacket packet;
+    };
+
+    void _charge(int n, uint64_t t0) {
+        uint64_t us = micros() - t0;
+        busyUs[n] += us;
+        maxCallUs[n] = std::max(maxCallUs[n], us);
+    }
+    bool _idle(int n) {
+        if (down[n]) return true;
+#if AKZ_ENABLE_JOB_QUEUE
+        if (node[n].getJobCount()) return false;
+#endif
+        return node[n].getActiveSessionCount() + node[n].getQueuedSessionCount() == 0;
+    }
+    uint64_t _nextWake(int n) {
+        if (pollMs) return g_nowMs + pollMs;
+        uint32_t d = node[n].nextDeadline();
+        return d == AkitaMeshZmodem::NO_DEADLINE ? UINT64_MAX : g_nowMs + d;
+    }
+
+    std::mt19937 _rng;
+    uint64_t _wakeAt[2] = {0, 0}; // next loop() per node, in run()
+    std::uniform_real_distribution<double> _lossDist{0.0, 1.0};
+    std::vector<InFlight> _air;
+    std::vector<MeshPacket> _inbox[2];
+};
+
+#endif // AKZ_HOST_NET_H
@@ -0,0 +1,140 @@
+/**
+ * @file Arduino.h
+ * @author Akita Engineering
+ * @brief Host stand-in for the Arduino core, enough to build the library
+ * and its tests with a desktop compiler.
+ *
+ * Time is simulated: millis() is g_nowMs, which the test advances, and
+ * micros() adds the CPU time the calling thread has been charged for
+ * (g_cpuUs, e.g. by the flash model in FS.h). Measurements taken with
+ * micros() are therefore the same on every run and every machine.
+ * @version 1.1.0
+ */
+
+#ifndef AKZ_HOST_ARDUINO_H
+#define AKZ_HOST_ARDUINO_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+
+extern std::atomic<uint64_t> g_nowMs;
+inline thread_local uint64_t g_cpuUs = 0;
+
+inline unsigned long millis() { return (unsigned long)g_nowMs.load(); }
+inline unsigned long micros() { return (unsigned long)(g_nowMs.load() * 1000 + g_cpuUs); }
+inline void delay(unsigned long) {}
+inline void yield() {}
+
+using std::max;
+using std::min;
+
+class String {
+public:
+    String() {}
+    String(const char* c) : _s(c ? c : "") {}
+    String(const std::string& s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+    bool operator==(const String& o) const { return _s == o._s; }
+    bool operator!=(const String& o) const { return _s != o._s; }
+    bool operator<(const String& o) const { return _s < o._s; }
+    String operator+(const String& o) const { return String(_s + o._s); }
+    String& operator+=(const String& o) { _s += o._s; return *this; }
+    String& operator+=(const char* c) { _s += c ? c : ""; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(_s.find(c, from)); }
+    int indexOf(const String& s, unsigned int from = 0) const { return found(_s.find(s._s, from)); }
+    int lastIndexOf(char c) const { return found(_s.rfind(c)); }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        return from < _s.size() ? String(_s.substr(from, to - from)) : String();
+    }
+    bool startsWith(const String& p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+    bool endsWith(const String& p) const {
+        return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+    }
+    long toInt() const { return atol(_s.c_str()); }
+    void trim() {
+        size_t a = _s.find_first_not_of(" \t\r\n");
+        size_t b = _s.find_last_not_of(" \t\r\n");
+        _s = a == std::string::npos ? std::string() : _s.substr(a, b - a + 1);
+    }
+    void toUpperCase() { for (char& c : _s) c = (char)toupper((unsigned char)c); }
+
+private:
+    static int found(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+    std::string _s;
+};
+inline String operator+(const char* a, const String& b) { return String(a) + b; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* b, size_t n) {
+        size_t k = 0;
+        while (k < n && write(b[k])) k++;
+        return k;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t println() { return write("\n"); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    size_t readBytes(uint8_t* b, size_t n) {
+        size_t k = 0;
+        while (k < n && available()) b[k++] = (uint8_t)read();
+        return k;
+    }
+    size_t readBytes(char* b, size_t n) { return readBytes((uint8_t*)b, n); }
+};
+
+// Debug output: silent unless a test sets verbose
+class HostSerial : public Stream {
+public:
+    bool verbose = false;
+    size_t write(uint8_t c) override {
+        if (verbose) fputc(c, stdout);
+        return 1;
+    }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+extern HostSerial Serial;
+
+#endif // AKZ_HOST_ARDUINO_H
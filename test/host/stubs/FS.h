@@ -0,0 +1,251 @@
+/**
+ * @file FS.h
+ * @author Akita Engineering
+ * @brief Host stand-in for the Arduino FS: an in-memory, flat file system
+ * with a flash cost model.
+ *
+ * Every write call counts as one metadata update and programs each 256-byte
+ * page it touches in full (a partial page is programmed again by the next
+ * append). The calling thread is charged g_fsWriteCallUs per call and
+ * g_fsPageUs per page it programs (see g_cpuUs in Arduino.h).
+ * @version 1.1.0
+ */
+
+#ifndef AKZ_HOST_FS_H
+#define AKZ_HOST_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+static const size_t HOST_FS_PAGE = 256;
+
+// Flash model: simulated cost, and what was written since the last reset
+inline uint32_t g_fsWriteCallUs = 0;
+inline uint32_t g_fsPageUs = 0;
+inline std::atomic<uint64_t> g_fsWriteCalls{0};
+inline std::atomic<uint64_t> g_fsWriteBytes{0};
+inline std::atomic<uint64_t> g_fsProgBytes{0};
+inline std::atomic<uint64_t> g_fsWriteUs{0};
+
+inline void resetFlashCounters() {
+    g_fsWriteCalls = 0;
+    g_fsWriteBytes = 0;
+    g_fsProgBytes = 0;
+    g_fsWriteUs = 0;
+}
+
+struct HostFileData {
+    std::vector<uint8_t> bytes;
+    uint64_t mtime = 0;
+    uint64_t writeCalls = 0;    // as the g_fs* counters, for this file only
+    uint64_t progBytes = 0;
+};
+typedef std::vector<std::pair<std::string, std::shared_ptr<HostFileData>>> HostListing;
+
+class File : public Stream {
+public:
+    File() {}
+    explicit operator bool() const { return _open; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* b, size_t n) override {
+        if (!_open || _dir) return 0;
+        size_t pages = n ? (_pos + n + HOST_FS_PAGE - 1) / HOST_FS_PAGE - _pos / HOST_FS_PAGE : 0;
+        uint64_t cost = g_fsWriteCallUs + (uint64_t)g_fsPageUs * pages;
+        g_cpuUs += cost;
+        g_fsWriteUs += cost;
+        g_fsWriteCalls++;
+        g_fsWriteBytes += n;
+        g_fsProgBytes += pages * HOST_FS_PAGE;
+        _d->writeCalls++;
+        _d->progBytes += pages * HOST_FS_PAGE;
+        if (_totals) {
+            _totals->writeCalls++;
+            _totals->progBytes += pages * HOST_FS_PAGE;
+        }
+        if (_d->bytes.size() < _pos + n) _d->bytes.resize(_pos + n);
+        if (n) memcpy(_d->bytes.data() + _pos, b, n);
+        _d->mtime = g_nowMs / 1000;
+        _pos += n;
+        return n;
+    }
+    using Print::write;
+    int available() override { return _open && !_dir ? (int)(_d->bytes.size() - _pos) : 0; }
+    int read() override { return available() ? _d->bytes[_pos++] : -1; }
+    int read(uint8_t* b, size_t n) {
+        size_t k = std::min(n, (size_t)available());
+        if (k) memcpy(b, _d->bytes.data() + _pos, k);
+        _pos += k;
+        return (int)k;
+    }
+    int peek() override { return available() ? _d->bytes[_pos] : -1; }
+    bool seek(uint32_t p, SeekMode mode = SeekSet) {
+        if (!_open || _dir) return false;
+        size_t np = mode == SeekSet ? p : mode == SeekCur ? _pos + p : _d->bytes.size() + p;
+        if (np > _d->bytes.size()) return false;
+        _pos = np;
+        return true;
+    }
+    size_t position() const { return _pos; }
+    size_t size() const { return _open && !_dir ? _d->bytes.size() : 0; }
+    void close() {
+        _open = false;
+        _d.reset();
+        _listing.reset();
+    }
+    bool isDirectory() const { return _dir; }
+    const char* name() const { return _path.c_str(); }
+    const char* path() const { return _path.c_str(); }
+    time_t getLastWrite() const { return _open && !_dir ? (time_t)_d->mtime : 0; }
+    File openNextFile() {
+        File f;
+        if (!_listing || _next >= _listing->size()) return f;
+        const auto& e = (*_listing)[_next++];
+        f._path = e.first.c_str();
+        if (e.second) {
+            f._d = e.second;
+        } else {
+            f._dir = true;
+        }
+        f._open = true;
+        return f;
+    }
+
+private:
+    friend class FS;
+    std::shared_ptr<HostFileData> _d;
+    HostFileData* _totals = nullptr;  // the file system's counters
+    std::shared_ptr<HostListing> _listing;
+    size_t _pos = 0;
+    size_t _next = 0;
+    bool _open = false;
+    bool _dir = false;
+    String _path;
+};
+
+// Directories exist implicitly, as prefixes of file paths
+class FS {
+public:
+    File open(const String& path, const char* mode = FILE_READ) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        File f;
+        f._path = path;
+        f._totals = &_totals;
+        std::string p = path.c_str();
+        auto it = _files.find(p);
+        if (mode[0] == 'r') {
+            if (it != _files.end()) {
+                f._d = it->second;
+                f._open = true;
+            } else if (isDir(p)) {
+                f._listing = listing(p);
+                f._dir = true;
+                f._open = true;
+            }
+        } else if (mode[0] == 'w') {
+            f._d = std::make_shared<HostFileData>();
+            f._d->mtime = g_nowMs / 1000;
+            _files[p] = f._d;
+            f._open = true;
+        } else {
+            if (it == _files.end()) it = _files.emplace(p, std::make_shared<HostFileData>()).first;
+            f._d = it->second;
+            f._pos = f._d->bytes.size();
+            f._open = true;
+        }
+        return f;
+    }
+    File open(const char* path, const char* mode = FILE_READ) { return open(String(path), mode); }
+    bool exists(const String& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _files.count(path.c_str()) > 0 || isDir(path.c_str());
+    }
+    bool exists(const char* path) { return exists(String(path)); }
+    bool remove(const String& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _files.erase(path.c_str()) > 0;
+    }
+    bool remove(const char* path) { return remove(String(path)); }
+    bool rename(const String& from, const String& to) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(from.c_str());
+        if (it == _files.end()) return false;
+        std::shared_ptr<HostFileData> d = it->second;
+        _files.erase(it);
+        _files[to.c_str()] = d;
+        return true;
+    }
+    bool rename(const char* from, const char* to) { return rename(String(from), String(to)); }
+    bool mkdir(const String&) { return true; }
+    bool mkdir(const char*) { return true; }
+
+    // Test access to a file's bytes, empty if it does not exist
+    std::vector<uint8_t> contents(const char* path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(path);
+        return it == _files.end() ? std::vector<uint8_t>() : it->second->bytes;
+    }
+    // Test access to a file's write counters, zero if it does not exist
+    HostFileData stats(const char* path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(path);
+        HostFileData d;
+        if (it != _files.end()) {
+            d.writeCalls = it->second->writeCalls;
+            d.progBytes = it->second->progBytes;
+        }
+        return d;
+    }
+    // The same over every file written through this file system
+    HostFileData stats() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        HostFileData d;
+        d.writeCalls = _totals.writeCalls;
+        d.progBytes = _totals.progBytes;
+        return d;
+    }
+
+private:
+    static std::string prefixOf(const std::string& dir) { return dir == "/" ? dir : dir + "/"; }
+    bool isDir(const std::string& dir) const {
+        std::string pre = prefixOf(dir);
+        auto it = _files.lower_bound(pre);
+        return it != _files.end() && it->first.compare(0, pre.size(), pre) == 0;
+    }
+    // Files and subdirectories directly in 'dir'; a subdirectory has no data
+    std::shared_ptr<HostListing> listing(const std::string& dir) const {
+        auto l = std::make_shared<HostListing>();
+        std::string pre = prefixOf(dir);
+        std::string lastSub;
+        for (auto it = _files.lower_bound(pre); it != _files.end() && it->first.compare(0, pre.size(), pre) == 0; ++it) {
+            size_t slash = it->first.find('/', pre.size());
+            if (slash == std::string::npos) {
+                l->emplace_back(it->first, it->second);
+            } else if (it->first.compare(0, slash, lastSub) != 0) {
+                lastSub = it->first.substr(0, slash);
+                l->emplace_back(lastSub, nullptr);
+            }
+        }
+        return l;
+    }
+
+    std::map<std::string, std::shared_ptr<HostFileData>> _files;
+    HostFileData _totals;
+    std::mutex _mutex;
+};
+
+namespace fs {
+using ::File;
+using ::FS;
+}
+
+#endif // AKZ_HOST_FS_H
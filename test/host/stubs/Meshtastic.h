@@ -0,0 +1,69 @@
+/**
+ * @file Meshtastic.h
+ * @author Akita Engineering
+ * @brief Host stand-in for the Meshtastic API: sent packets are kept in an
+ * outbox for the test to deliver.
+ * @version 1.1.0
+ */
+
+#ifndef AKZ_HOST_MESHTASTIC_H
+#define AKZ_HOST_MESHTASTIC_H
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+using NodeNum = uint32_t;
+constexpr NodeNum BROADCAST_ADDR = 0;
+
+#define MeshPacket_DataType_OPAQUE 0
+#define MeshPacket_DataType_TEXT_MESSAGE 1
+#define PortNum_TEXT_MESSAGE_APP 1
+
+struct Payload {
+    std::vector<uint8_t> bytes;
+    const uint8_t* getBuffer() const { return bytes.empty() ? nullptr : bytes.data(); }
+    size_t length() const { return bytes.size(); }
+};
+
+struct DecodedPacket {
+    Payload payload;
+    int portnum = 0;
+    int datatype = 0;
+};
+
+class MeshPacket {
+public:
+    DecodedPacket decoded;
+    NodeNum from = 0;
+    NodeNum to = 0;
+    void set_payload(const uint8_t* data, size_t len) { decoded.payload.bytes.assign(data, data + len); }
+    void set_to(NodeNum node) { to = node; }
+    void set_from(NodeNum node) { from = node; }
+    void set_portnum(int port) { decoded.portnum = port; }
+    void set_datatype(int type) { decoded.datatype = type; }
+    void set_want_ack(bool) {}
+    void set_hop_limit(int) {}
+};
+
+struct ReceivedPacket : public MeshPacket {
+    bool isValid = true;
+};
+
+class Meshtastic {
+public:
+    NodeNum node = 1;
+    std::deque<MeshPacket> outbox;
+    bool sendPacket(MeshPacket* p) {
+        outbox.push_back(*p);
+        outbox.back().from = node;
+        return true;
+    }
+    NodeNum getNodeNum() const { return node; }
+    int getHopLimit() const { return 3; }
+    bool available() { return false; }
+    ReceivedPacket receive() { return ReceivedPacket(); }
+    void releaseReceiveBuffer() {}
+};
+
+#endif // AKZ_HOST_MESHTASTIC_H
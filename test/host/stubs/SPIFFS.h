@@ -0,0 +1,8 @@
+#ifndef AKZ_HOST_SPIFFS_H
+#define AKZ_HOST_SPIFFS_H
+
+#include <FS.h>
+
+extern FS SPIFFS;
+
+#endif // AKZ_HOST_SPIFFS_H
@@ -0,0 +1,6 @@
+#ifndef AKZ_HOST_STREAM_H
+#define AKZ_HOST_STREAM_H
+
+#include <Arduino.h>
+
+#endif // AKZ_HOST_STREAM_H
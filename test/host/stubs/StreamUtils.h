@@ -0,0 +1,4 @@
+#ifndef AKZ_HOST_STREAM_UTILS_H
+#define AKZ_HOST_STREAM_UTILS_H
+
+#endif // AKZ_HOST_STREAM_UTILS_H
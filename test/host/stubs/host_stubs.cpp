@@ -0,0 +1,26 @@
+/**
+ * @file host_stubs.cpp
+ * @author Akita Engineering
+ * @brief Globals the library expects from the Arduino core and firmware.
+ * @version 1.1.0
+ */
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <cstdarg>
+
+std::atomic<uint64_t> g_nowMs{1000};
+HostSerial Serial;
+FS SPIFFS;
+FS& Filesystem = SPIFFS;
+Stream& Log = Serial;
+
+size_t Print::printf(const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return n > 0 ? write((const uint8_t*)buf, std::min((size_t)n, sizeof(buf) - 1)) : 0;
+}
@@ -0,0 +1,62 @@
+// Auto-accept: tail sends of a growing log into a spooling node. A sender
+// continuing its file (ZCRESUM) appends to the copy it left in the spool;
+// one that was changed since, or a plain send of the same name, gets a new
+// "-N" file.
+#include "host_net.h"
+
+static void append(FS& fs, const char* path, std::vector<uint8_t>& data, size_t n, uint32_t seed) {
+    std::vector<uint8_t> more = makeFile(fs, "/more.tmp", n, seed);
+    fs.remove("/more.tmp");
+    File f = fs.open(path, FILE_APPEND);
+    f.write(more.data(), more.size());
+    f.close();
+    data.insert(data.end(), more.begin(), more.end());
+}
+
+
+int main() {
+    HostLink link;
+    AkitaMeshZmodem::AutoAcceptPolicy policy;
+    policy.spoolDir = "/spool";
+    CHECK(link.b().setAutoAccept(policy));
+    std::vector<uint8_t> log = makeFile(link.fs[0], "/log.csv", 3000, 1);
+
+    CHECK(link.a().startTail("/log.csv", HostLink::NODE_B));
+    bool first = link.run();
+    CHECK(first && link.fs[1].contents("/spool/log.csv") == log);
+
+    // Appended to: only the new 200 B go, onto the same spool file
+    append(link.fs[0], "/log.csv", log, 200, 2);
+    HostFileData before = link.fs[1].stats();
+    CHECK(link.a().startTail("/log.csv", HostLink::NODE_B));
+    bool second = link.run();
+    uint64_t progBytes = link.fs[1].stats().progBytes - before.progBytes;
+    printf("tail after 200 B appended: ok %d  /spool/log.csv %zu B  log-1.csv %d  programmed %llu B\n", second,
+           link.fs[1].contents("/spool/log.csv").size(), link.fs[1].exists("/spool/log-1.csv"),
+           (unsigned long long)progBytes);
+    CHECK(second);
+    CHECK(link.fs[1].contents("/spool/log.csv") == log);
+    CHECK(!link.fs[1].exists("/spool/log-1.csv"));
+    CHECK(progBytes < 3000);
+
+    // A plain send of the same name is a new file
+    std::vector<uint8_t> other = makeFile(link.fs[0], "/x/log.csv", 500, 3);
+    CHECK(link.a().startSend("/x/log.csv", HostLink::NODE_B));
+    CHECK(link.run());
+    CHECK(link.fs[1].contents("/spool/log-1.csv") == other);
+    CHECK(link.fs[1].contents("/spool/log.csv") == log);
+
+    // The spool copy changed under it: the tail is not appended there, and
+    // its receiver asks for the whole file into a new name
+    std::vector<uint8_t> local = link.fs[1].contents("/spool/log.csv");
+    append(link.fs[1], "/spool/log.csv", local, 10, 4);
+    append(link.fs[0], "/log.csv", log, 100, 5);
+    CHECK(link.a().startTail("/log.csv", HostLink::NODE_B));
+    bool third = link.run();
+    printf("tail after the spool copy changed: ok %d  log-2.csv %zu B\n", third,
+           link.fs[1].contents("/spool/log-2.csv").size());
+    CHECK(third);
+    CHECK(link.fs[1].contents("/spool/log.csv") == local);
+    CHECK(link.fs[1].contents("/spool/log-2.csv") == log);
+    return testResult();
+}
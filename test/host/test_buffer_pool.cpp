@@ -0,0 +1,78 @@
+// Slab pool and per-session footprint: sessions borrow buffers only while
+// they run, and give every slab back when they end.
+#include "host_net.h"
+
+static void poolBasics() {
+    static ZModemBufferPool pool;
+    const size_t slab = ZModemBufferPool::SLAB_SIZE;
+    CHECK(pool.freeBytes() == pool.capacityBytes());
+    CHECK(ZModemBufferPool::footprint(1) == slab);
+    CHECK(ZModemBufferPool::footprint(slab + 1) == 2 * slab);
+
+    std::vector<uint8_t*> held;
+    for (uint8_t* p = pool.acquire(slab); p; p = pool.acquire(slab)) held.push_back(p);
+    CHECK(held.size() == ZModemBufferPool::SLAB_COUNT);
+    CHECK(pool.freeBytes() == 0);
+    CHECK(pool.acquire(1) == nullptr);
+
+    // A run needs contiguous slabs: two free but apart do not make one
+    pool.release(held[0]);
+    pool.release(held[2]);
+    CHECK(pool.acquire(2 * slab) == nullptr);
+    pool.release(held[1]);
+    uint8_t* run = pool.acquire(3 * slab);
+    CHECK(run == held[0]);
+    pool.release(run);
+    for (size_t i = 3; i < held.size(); ++i) pool.release(held[i]);
+    CHECK(pool.freeBytes() == pool.capacityBytes());
+}
+
+int main() {
+    poolBasics();
+
+    HostLink link;
+    AkitaMeshZmodem* node[2] = {&link.a(), &link.b()};
+    for (AkitaMeshZmodem* z : node) CHECK(z->getPoolFreeBytes() == z->getPoolCapacityBytes());
+
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+    int tx = AkitaMeshZmodem::INVALID_SESSION, rx = AkitaMeshZmodem::INVALID_SESSION;
+    CHECK(link.b().startReceive("/dst.bin", &rx));
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B, &tx));
+
+    // While running, what the sessions report is what the pool is missing
+    size_t maxBuffers[2] = {0, 0}, controlBytes[2] = {0, 0};
+    bool consistent = true;
+    link.onTick = [&]() {
+        const int session[2] = {tx, rx};
+        for (int n = 0; n < 2; ++n) {
+            AkitaMeshZmodem::SessionStats st;
+            if (!node[n]->getSessionStats(session[n], st)) continue;
+            consistent &= st.bufferBytes == node[n]->getPoolCapacityBytes() - node[n]->getPoolFreeBytes();
+            consistent &= st.bufferBytes % ZModemBufferPool::SLAB_SIZE == 0;
+            maxBuffers[n] = std::max(maxBuffers[n], st.bufferBytes);
+            controlBytes[n] = std::max(controlBytes[n], st.controlBytes);
+        }
+    };
+    CHECK(link.run());
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+    CHECK(consistent);
+
+    // Finished sessions hold no buffers, only their record
+    for (int n = 0; n < 2; ++n) {
+        AkitaMeshZmodem::SessionStats st;
+        CHECK(node[n]->getSessionStats(n == 0 ? tx : rx, st));
+        CHECK(st.bufferBytes == 0);
+        CHECK(node[n]->getPoolFreeBytes() == node[n]->getPoolCapacityBytes());
+    }
+
+    // README "Memory": 6 slabs per sender, 7 (+1 while parsing ZFILE) per receiver
+    const size_t slab = ZModemBufferPool::SLAB_SIZE;
+    CHECK(maxBuffers[0] == 6 * slab);
+    CHECK(maxBuffers[1] >= 7 * slab && maxBuffers[1] <= 8 * slab);
+    CHECK(sizeof(ZModemEngine) < 1024);
+
+    printf("idle session %zu B; engine %zu B; sender control %zu B + buffers %zu B; receiver control %zu B + buffers %zu B; pool %zu B\n",
+           link.a().getIdleSessionFootprint(), sizeof(ZModemEngine), controlBytes[0], maxBuffers[0], controlBytes[1],
+           maxBuffers[1], link.a().getPoolCapacityBytes());
+    return testResult();
+}
@@ -0,0 +1,120 @@
+// Coroutine engine (AKZ_ENABLE_COROUTINE_ENGINE, C++20): same wire output
+// as the state machine, a frame of at most one slab, and co_await transfer().
+#include "host_net.h"
+
+struct PairRun {
+    bool ok = false;
+    std::vector<uint8_t> toReceiver, toSender;
+    size_t maxBorrowed = 0;
+    size_t frameBytes = 0;
+    double cpuUs = 0;
+};
+
+template <typename Engine>
+static size_t frameBytesOf(const Engine& e) {
+    if constexpr (requires { e.getFrameBytes(); }) {
+        return e.getFrameBytes();
+    } else {
+        return 0;
+    }
+}
+
+// A sender and a receiver of the same engine type over a byte pipe
+template <typename Engine>
+static PairRun runPair(FS& fs, const char* path, size_t size) {
+    ZModemBufferPool pool;
+    ZModemTimerWheel wheel;
+    PairRun r;
+    Pipe ab, ba;
+    ab.tap = &r.toReceiver;
+    ba.tap = &r.toSender;
+    PipeEnd ea(ba, ab), eb(ab, ba);
+    File src = fs.open(path);
+    File dst = fs.open("/dst.bin", FILE_WRITE);
+    Engine a, b;
+    for (Engine* e : {&a, &b}) {
+        e->setBufferPool(&pool);
+        e->setTimerWheel(&wheel);
+    }
+    a.begin(ea);
+    b.begin(eb);
+    a.setFileStream(&src, path, size);
+    b.setFileStream(&dst, "", 0);
+    b.receive(20000);
+    a.send(20000);
+    auto t0 = std::chrono::steady_clock::now();
+    int ra = 0, rb = 0;
+    for (int i = 0; i < 1000000 && !(ra == 1 && rb == 1) && ra != -1 && rb != -1; ++i) {
+        wheel.advance(g_nowMs);
+        ra = a.loop();
+        rb = b.loop();
+        r.maxBorrowed = std::max(r.maxBorrowed, a.getBorrowedBytes() + b.getBorrowedBytes());
+        r.frameBytes = std::max(r.frameBytes, std::max(frameBytesOf(a), frameBytesOf(b)));
+        g_nowMs++;
+    }
+    r.cpuUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    dst.close();
+    r.ok = ra == 1 && rb == 1 && fs.contents("/dst.bin") == fs.contents(path);
+    return r;
+}
+
+static void sameWire(size_t size) {
+    FS fs;
+    makeFile(fs, "/src.bin", size);
+    PairRun sm = runPair<ZModemEngine>(fs, "/src.bin", size);
+    PairRun co = runPair<ZModemCoEngine>(fs, "/src.bin", size);
+    printf("%6zu B: state machine ok %d, %zu/%zu wire bytes, %zu B pooled, %.0f us; "
+           "coroutine ok %d, %zu B pooled + frame %zu B, %.0f us\n",
+           size, sm.ok, sm.toReceiver.size(), sm.toSender.size(), sm.maxBorrowed, sm.cpuUs, co.ok, co.maxBorrowed,
+           co.frameBytes, co.cpuUs);
+    CHECK(sm.ok && co.ok);
+    CHECK(co.toReceiver == sm.toReceiver);
+    CHECK(co.toSender == sm.toSender);
+    // One slab per session for the frame, on top of the same buffers
+    CHECK(co.frameBytes > 0 && co.frameBytes <= ZModemBufferPool::SLAB_SIZE);
+    CHECK(co.maxBorrowed == sm.maxBorrowed + 2 * ZModemBufferPool::SLAB_SIZE);
+}
+
+// Fire-and-forget host coroutine
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+    };
+};
+
+static Detached awaitTransfer(AkitaMeshZmodem& z, int session, AkitaMeshZmodem::TransferState& result, int& done) {
+    result = co_await z.transfer(session);
+    done++;
+}
+
+int main() {
+    printf("sizeof ZModemEngine %zu B, ZModemCoEngine %zu B\n", sizeof(ZModemEngine), sizeof(ZModemCoEngine));
+    for (size_t size : {0, 777, 20000}) sameWire(size);
+
+    // Sessions run on the coroutine engine, over a lossy link, awaited
+    HostLink link;
+    link.loss = 0.05;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+    int tx = AkitaMeshZmodem::INVALID_SESSION, rx = AkitaMeshZmodem::INVALID_SESSION;
+    CHECK(link.b().startReceive("/dst.bin", &rx));
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B, &tx));
+    using State = AkitaMeshZmodem::TransferState;
+    State txResult = State::IDLE, rxResult = State::IDLE, idleResult = State::ERROR;
+    int done = 0;
+    awaitTransfer(link.a(), tx, txResult, done);
+    awaitTransfer(link.b(), rx, rxResult, done);
+    CHECK(done == 0);
+    CHECK(link.run());
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+    CHECK(done == 2);
+    CHECK(txResult == State::COMPLETE && rxResult == State::COMPLETE);
+    // A session with nothing running completes at once
+    awaitTransfer(link.a(), link.a().getMaxSessions() - 1, idleResult, done);
+    CHECK(done == 3 && idleResult == State::IDLE);
+    CHECK(link.a().getPoolFreeBytes() == link.a().getPoolCapacityBytes());
+    return testResult();
+}
@@ -0,0 +1,62 @@
+// Event-driven integration: packets handed to processDataPacket() as they
+// arrive and loop() called when nextDeadline() says, against polling loop().
+#include "host_net.h"
+
+struct Run {
+    bool ok;
+    double replyMs;
+    uint64_t wakeups;
+    uint64_t timeMs;
+};
+
+static Run transfer(uint32_t pollMs, double loss) {
+    HostLink link;
+    link.pollMs = pollMs;
+    link.loss = loss;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+    // Nothing armed: after its first loop() the host may sleep until a packet arrives
+    link.a().loop();
+    link.b().loop();
+    CHECK(link.a().nextDeadline() == AkitaMeshZmodem::NO_DEADLINE);
+    CHECK(link.b().nextDeadline() == AkitaMeshZmodem::NO_DEADLINE);
+    link.b().startReceive("/dst.bin");
+    link.a().startSend("/src.bin", HostLink::NODE_B);
+    // The sender has its ZRQINIT to put out
+    CHECK(link.a().nextDeadline() == 0);
+    uint64_t t0 = g_nowMs;
+    Run r;
+    r.ok = link.run() && link.fs[1].contents("/dst.bin") == data;
+    r.timeMs = g_nowMs - t0;
+    r.replyMs = link.replyLatencyMs(1);
+    r.wakeups = link.wakeups[0] + link.wakeups[1];
+    for (int n = 0; n < 2; ++n) CHECK(link.node[n].nextDeadline() == AkitaMeshZmodem::NO_DEADLINE);
+    return r;
+}
+
+static void report(const char* what, const Run& r) {
+    printf("%-26s ok %d  reply latency %5.1f ms  transfer %5.1f s  wakeups %llu\n", what, r.ok, r.replyMs,
+           r.timeMs / 1000.0, (unsigned long long)r.wakeups);
+}
+
+int main() {
+    Run poll50 = transfer(50, 0), poll100 = transfer(100, 0), event = transfer(0, 0);
+    Run poll50Lossy = transfer(50, 0.05), eventLossy = transfer(0, 0.05);
+    report("poll every 50 ms", poll50);
+    report("poll every 100 ms", poll100);
+    report("event-driven", event);
+    report("poll every 50 ms, 5% loss", poll50Lossy);
+    report("event-driven, 5% loss", eventLossy);
+
+    for (const Run* r : {&poll50, &poll100, &event, &poll50Lossy, &eventLossy}) CHECK(r->ok);
+    // Answers go out in the call that received the packet
+    CHECK(event.replyMs == 0);
+    CHECK(eventLossy.replyMs == 0);
+    CHECK(poll50.replyMs > 0 && poll100.replyMs > poll50.replyMs);
+    // ...and the nodes wake only for packets and timers
+    CHECK(event.timeMs < poll50.timeMs && poll50.timeMs < poll100.timeMs);
+    CHECK(event.wakeups * 3 < poll50.wakeups);
+    CHECK(event.wakeups * 2 < poll100.wakeups);
+    CHECK(eventLossy.timeMs < poll50Lossy.timeMs);
+    CHECK(eventLossy.wakeups * 3 < poll50Lossy.wakeups);
+    return testResult();
+}
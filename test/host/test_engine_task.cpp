@@ -0,0 +1,120 @@
+// Threaded engine (AKZ_ENABLE_ENGINE_TASK): the SPSC rings between the mesh
+// thread and the engine task, and what the mesh thread is left paying for.
+#include "host_net.h"
+#include "utility/ZModemSpscRing.h"
+
+static void ringOrder() {
+    static ZModemSpscRing<uint32_t, 8> ring;
+    CHECK(ring.front() == nullptr);
+    for (uint32_t i = 0; i < 8; ++i) {
+        uint32_t* slot = ring.acquireSlot();
+        CHECK(slot != nullptr);
+        if (!slot) return;
+        *slot = i;
+        ring.commit();
+    }
+    CHECK(ring.acquireSlot() == nullptr);
+    CHECK(ring.size() == 8);
+    // Wraps around many times in FIFO order
+    uint32_t expect = 0, next = 8;
+    for (int round = 0; round < 1000; ++round) {
+        for (int k = 0; k < 3; ++k) {
+            CHECK(ring.front() && *ring.front() == expect);
+            ring.pop();
+            expect++;
+        }
+        for (int k = 0; k < 3; ++k) {
+            *ring.acquireSlot() = next++;
+            ring.commit();
+        }
+    }
+    while (ring.front()) {
+        CHECK(*ring.front() == expect);
+        ring.pop();
+        expect++;
+    }
+    CHECK(expect == next);
+}
+
+static void ringAcrossThreads() {
+    static ZModemSpscRing<uint32_t, 16> ring;
+    const uint32_t count = 200000;
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count;) {
+            uint32_t* slot = ring.acquireSlot();
+            if (!slot) {
+                std::this_thread::yield();
+                continue;
+            }
+            *slot = i++;
+            ring.commit();
+        }
+    });
+    uint32_t expect = 0;
+    bool ordered = true;
+    while (expect < count) {
+        uint32_t* v = ring.front();
+        if (!v) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered &= *v == expect++;
+        ring.pop();
+    }
+    producer.join();
+    CHECK(ordered);
+}
+
+int main() {
+    ringOrder();
+    ringAcrossThreads();
+
+    // Flash writes cost 2 ms, on whichever thread makes them
+    const uint32_t writeUs = 2000;
+    g_fsWriteCallUs = writeUs;
+    HostLink link;
+    link.realTime = true;   // the engine task sleeps on the wall clock
+    link.linkMs = 20;
+    CHECK(link.b().isEngineThreaded());
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 6000);
+    CHECK(link.b().startReceive("/dst.bin"));
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    link.b().resetMeshThreadLatency();
+    resetFlashCounters();
+    CHECK(link.run(120000));
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+
+    // The receiver's writes ran on its engine task, not in loop() or
+    // processDataPacket()
+    AkitaMeshZmodem::MeshThreadLatency l;
+    link.b().getMeshThreadLatency(l);
+    CHECK(g_fsWriteCalls > 0);
+    CHECK(l.packetCalls > 0 && l.loopCalls > 0);
+    CHECK(l.loopMaxUs < writeUs);
+    CHECK(l.packetMaxUs < writeUs);
+    CHECK(l.rxQueueDrops == 0);
+    printf("engine task: %llu flash writes (%llu ms) off the mesh thread; receiver loop() max %u us, "
+           "processDataPacket() max %u us (%u calls)\n",
+           (unsigned long long)g_fsWriteCalls.load(), (unsigned long long)(g_fsWriteUs / 1000), l.loopMaxUs,
+           l.packetMaxUs, l.packetCalls);
+
+    // Queued jobs are started, and the queue file rewritten, by the engine
+    // task as well
+    std::vector<uint8_t> jobData = makeFile(link.fs[0], "/job.bin", 3000);
+    g_nowMs += AKZ_AIRTIME_WINDOW_MS; // the first transfer's airtime ages out
+    link.a().resetMeshThreadLatency();
+    CHECK(link.b().enqueueReceive("/job.bin") != 0);
+    CHECK(link.a().enqueueSend("/job.bin", HostLink::NODE_B) != 0);
+    for (int i = 0; i < 5000 && !(link.a().getActiveSessionCount() && link.b().getActiveSessionCount()); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        g_nowMs++; // the scheduler polls on the simulated clock
+    }
+    CHECK(link.a().getActiveSessionCount() == 1);
+    CHECK(link.run(120000));
+    CHECK(link.fs[1].contents("/job.bin") == jobData);
+    CHECK(link.a().getJobCount() == 0);
+    link.a().getMeshThreadLatency(l);
+    CHECK(l.loopMaxUs < writeUs);
+    printf("engine task: queued job done, sender loop() max %u us\n", l.loopMaxUs);
+    return testResult();
+}
@@ -0,0 +1,136 @@
+// File index: a received file is indexed with the SHA-256 the engine took
+// as its data was written, follow-up files of a batch included. A receive
+// resumed part way is indexed unhashed and hashed from loop(), as are the
+// files a hashing listing found without a current hash.
+#include "host_net.h"
+#include "utility/ZModemListing.h"
+
+static std::vector<uint8_t> sha256(const std::vector<uint8_t>& data) {
+    ZModemSha256 sha;
+    sha.update(data.data(), data.size());
+    std::vector<uint8_t> out(ZModemSha256::DIGEST_SIZE);
+    sha.finish(out.data());
+    return out;
+}
+
+// The index entry as recorded, without the lookup that would hash the file
+static bool indexed(AkitaMeshZmodem& node, const char* path, AkitaMeshZmodem::FileInfo& out) {
+    for (size_t i = 0; i < node.getIndexedFileCount(); ++i) {
+        if (node.getIndexedFile(i, out) && out.path == path) return true;
+    }
+    return false;
+}
+
+static bool hashedAs(AkitaMeshZmodem& node, const char* path, const std::vector<uint8_t>& data) {
+    AkitaMeshZmodem::FileInfo info;
+    return indexed(node, path, info) && info.hashed && info.size == data.size() &&
+           std::vector<uint8_t>(info.sha256, info.sha256 + sizeof(info.sha256)) == sha256(data);
+}
+
+int main() {
+    {
+        // One file over a lossy link: retransmits and rewinds are hashed once
+        HostLink link;
+        link.loss = 0.05;
+        std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+        link.b().startReceive("/in/one.bin");
+        link.a().startSend("/src.bin", HostLink::NODE_B);
+        bool done = link.run();
+        bool hashed = hashedAs(link.b(), "/in/one.bin", data);
+        printf("single file, 5%% loss: ok %d  indexed hashed %d\n", done, hashed);
+        CHECK(done);
+        CHECK(link.fs[1].contents("/in/one.bin") == data);
+        CHECK(hashed);
+    }
+    {
+        // A batch: the first file at session end, the others as they close
+        HostLink link;
+        std::vector<uint8_t> a = makeFile(link.fs[0], "/a.bin", 3000, 1);
+        std::vector<uint8_t> b = makeFile(link.fs[0], "/b.txt", 1500, 2);
+        std::vector<uint8_t> e = makeFile(link.fs[0], "/e.bin", 0, 3);
+        ZModemBatch batch;
+        for (const char* p : {"/a.bin", "/b.txt", "/e.bin"}) batch.add(p);
+        link.b().startReceive("/in/first.bin");
+        link.a().startSend(batch, HostLink::NODE_B);
+        bool done = link.run();
+        int hashed = hashedAs(link.b(), "/in/first.bin", a) + hashedAs(link.b(), "/in/b.txt", b) +
+                     hashedAs(link.b(), "/in/e.bin", e);
+        printf("batch of %u: ok %d  indexed hashed %d\n", batch.count(), done, hashed);
+        CHECK(done);
+        CHECK(batch.countOf(ZModemBatch::Result::SENT) == 3);
+        CHECK(hashed == 3);
+    }
+    {
+        // Resumed at 1000 from the journal: the engine saw only the rest
+        HostLink link;
+        std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+        File part = link.fs[1].open("/dst.bin", FILE_WRITE);
+        part.write(data.data(), 1000);
+        part.close();
+        ZModemResumeRecord rec = {HostLink::NODE_A, (uint32_t)data.size(), 1000, "/src.bin"};
+        ZModemResumeJournal::save(link.fs[1], "/dst.bin", rec);
+        link.b().startReceive("/dst.bin", nullptr, true);
+        link.a().startSend("/src.bin", HostLink::NODE_B);
+        bool done = link.run();
+        AkitaMeshZmodem::FileInfo info;
+        bool recorded = indexed(link.b(), "/dst.bin", info) && info.size == data.size();
+        int loops = 0;
+        while (!hashedAs(link.b(), "/dst.bin", data) && loops < 100) {
+            link.b().loop();
+            loops++;
+        }
+        bool hashed = hashedAs(link.b(), "/dst.bin", data);
+        bool looked = link.b().getFileInfo("/dst.bin", info, false) && info.hashed;
+        printf("resumed at 1000: ok %d  indexed %d  hashed from loop() %d\n", done, recorded, hashed);
+        CHECK(done);
+        CHECK(recorded);
+        CHECK(hashed && looked);
+    }
+    {
+        // A hashing listing reads nothing: it answers with the hashes the
+        // index has and leaves the rest to loop(), a piece per call
+        HostLink link;
+        std::vector<uint8_t> big = makeFile(link.fs[1], "/d/big.bin", 100000, 4);
+        std::vector<uint8_t> small = makeFile(link.fs[1], "/d/small.bin", 500, 5);
+        auto listed = [&](int& withSha) {
+            AkitaMeshZmodem::ListRequest req;
+            req.hashFiles = true;
+            uint8_t page[AKZ_LIST_PAGE_BYTES];
+            size_t len = link.b().listDirectory("/d", req, page);
+            ZModemListingReader r;
+            ZModemListEntry e;
+            int n = 0;
+            withSha = 0;
+            if (!r.open(page, len)) return 0;
+            while (r.next(e)) {
+                n++;
+                const std::vector<uint8_t>& data = strcmp(e.name, "big.bin") == 0 ? big : small;
+                if (e.flags & ZModemListing::ENTRY_SHA) {
+                    withSha += memcmp(e.sha, sha256(data).data(), ZModemListing::SHA_PREFIX) == 0;
+                }
+            }
+            return n;
+        };
+        int withSha;
+        CHECK(listed(withSha) == 2 && withSha == 0);
+        CHECK(link.b().nextDeadline() == 0);
+        int loops = 0;
+        while (link.b().nextDeadline() == 0 && loops < 1000) {
+            link.b().loop();
+            loops++;
+        }
+        CHECK(listed(withSha) == 2 && withSha == 2);
+        CHECK(loops >= (int)(big.size() / AKZ_INDEX_HASH_STEP_BYTES));
+        printf("listing: 2 files unhashed, hashed by %d loop() calls of %u B\n", loops,
+               (unsigned)AKZ_INDEX_HASH_STEP_BYTES);
+
+        // A file changed since (its size, as the host FS keeps no mtime):
+        // listed without its hash until it is hashed again
+        small = makeFile(link.fs[1], "/d/small.bin", 600, 6);
+        CHECK(listed(withSha) == 2 && withSha == 1);
+        for (loops = 0; link.b().nextDeadline() == 0 && loops < 1000; ++loops) link.b().loop();
+        CHECK(listed(withSha) == 2 && withSha == 2);
+        CHECK(loops <= 3);
+    }
+    return testResult();
+}
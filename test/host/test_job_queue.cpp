@@ -0,0 +1,128 @@
+// Transfer jobs: a receive job interrupted by a reboot is restored from the
+// queue file and continues its partial file, and an urgent job preempts a
+// bulk one, which goes back to the queue and resumes once the link is free.
+#include "host_net.h"
+
+struct Done {
+    uint16_t ids[4];
+    AkitaMeshZmodem::TransferState results[4];
+    uint8_t failures[4];
+    int count = 0;
+};
+
+static void onJobDone(const AkitaMeshZmodem::JobInfo& job, AkitaMeshZmodem::TransferState result, void* ctx) {
+    Done* d = static_cast<Done*>(ctx);
+    if (d->count == 4) return;
+    d->ids[d->count] = job.id;
+    d->results[d->count] = result;
+    d->failures[d->count++] = job.failures;
+}
+
+static size_t bytesDone(HostLink& link, int n, uint16_t id) {
+    AkitaMeshZmodem::JobInfo info;
+    return link.node[n].findJob(id, info) ? info.bytesDone : 0;
+}
+
+// The receiving node loses power 20000 bytes into a 30 KB job
+static void restoredAfterReboot() {
+    HostLink link;
+    link.loss = 0.05;
+    g_nowMs += AKZ_AIRTIME_WINDOW_MS;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 30000, 6);
+    AkitaMeshZmodem::JobOptions opts;
+    opts.retryBackoffMs = 5000;
+    uint16_t rx = link.b().enqueueReceive("/dst.bin", opts);
+    uint16_t tx = link.a().enqueueSend("/src.bin", HostLink::NODE_B, opts);
+    CHECK(rx && tx);
+    uint64_t limit = g_nowMs + 600000;
+    while (bytesDone(link, 1, rx) < 20000 && g_nowMs < limit) link.run(10);
+    CHECK(bytesDone(link, 1, rx) >= 20000);
+    CHECK(link.fs[1].exists(AKZ_JOB_QUEUE_FILE));
+
+    link.reboot(1);
+    Done done[2];
+    link.a().onJobDone(onJobDone, &done[0]);
+    link.b().onJobDone(onJobDone, &done[1]);
+    // Back in the queue, to continue the partial file
+    AkitaMeshZmodem::JobInfo info;
+    CHECK(link.b().getJobCount() == 1);
+    CHECK(link.b().findJob(rx, info) && !info.sending && info.path == "/dst.bin");
+    CHECK(info.state == AkitaMeshZmodem::JobState::PENDING);
+
+    size_t resumedAt = 0;
+    link.onTick = [&] {
+        AkitaMeshZmodem::JobInfo j;
+        if (!resumedAt && link.b().findJob(rx, j) && j.state == AkitaMeshZmodem::JobState::RUNNING) {
+            resumedAt = j.bytesDone;
+        }
+    };
+    CHECK(link.run(3600000));
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+    CHECK(done[1].count == 1 && done[1].ids[0] == rx && done[1].results[0] == AkitaMeshZmodem::TransferState::COMPLETE);
+    // The sender's run failed with the receiver gone and was retried
+    CHECK(done[0].count == 1 && done[0].ids[0] == tx && done[0].results[0] == AkitaMeshZmodem::TransferState::COMPLETE);
+    CHECK(done[0].failures[0] >= 1);
+    printf("restored: receive job continued at %zu after the reboot, send job done after %u failed run(s)\n",
+           resumedAt, (unsigned)done[0].failures[0]);
+    CHECK(resumedAt >= AKZ_RESUME_JOURNAL_BYTES && resumedAt <= 20000);
+    // Nothing left to restore at the next boot
+    CHECK(link.a().getJobCount() == 0 && link.b().getJobCount() == 0);
+}
+
+// A bulk transfer is running when an urgent one is queued on both sides.
+// The receiving node has room for one of them: it preempts its bulk receive,
+// and the sender's bulk run fails and is retried.
+static void preempted() {
+    HostLink link;
+    g_nowMs += AKZ_AIRTIME_WINDOW_MS;
+    std::vector<uint8_t> bulk = makeFile(link.fs[0], "/bulk.bin", 30000, 7);
+    std::vector<uint8_t> urgent = makeFile(link.fs[0], "/urgent.bin", 5000, 8);
+    AkitaMeshZmodem::JobOptions lo, hi;
+    lo.priority = AkitaMeshZmodem::PRIORITY_BULK;
+    hi.priority = AkitaMeshZmodem::PRIORITY_URGENT;
+    Done done[2];
+    link.a().onJobDone(onJobDone, &done[0]);
+    link.b().onJobDone(onJobDone, &done[1]);
+
+    uint16_t bulkRx = link.b().enqueueReceive("/bulk.bin", lo);
+    uint16_t bulkTx = link.a().enqueueSend("/bulk.bin", HostLink::NODE_B, lo);
+    uint64_t limit = g_nowMs + 600000;
+    while (bytesDone(link, 1, bulkRx) < 12000 && g_nowMs < limit) link.run(10);
+    CHECK(bytesDone(link, 1, bulkRx) >= 12000);
+
+    uint16_t urgentRx = link.b().enqueueReceive("/urgent.bin", hi);
+    uint16_t urgentTx = link.a().enqueueSend("/urgent.bin", HostLink::NODE_B, hi);
+    // Started at once, in the bulk receive's place
+    link.run(1);
+    AkitaMeshZmodem::JobInfo info;
+    CHECK(link.b().findJob(urgentRx, info) && info.state == AkitaMeshZmodem::JobState::RUNNING);
+    CHECK(link.b().findJob(bulkRx, info) && info.state != AkitaMeshZmodem::JobState::RUNNING);
+    size_t preemptedAt = info.bytesDone;
+
+    // Where the bulk receive's next run starts
+    size_t resumedAt = 0;
+    link.onTick = [&] {
+        AkitaMeshZmodem::JobInfo j;
+        if (!resumedAt && link.b().findJob(bulkRx, j) && j.state == AkitaMeshZmodem::JobState::RUNNING) {
+            resumedAt = j.bytesDone;
+        }
+    };
+    CHECK(link.run(3600000));
+    CHECK(link.fs[1].contents("/urgent.bin") == urgent);
+    CHECK(link.fs[1].contents("/bulk.bin") == bulk);
+    // Urgent first, on both nodes
+    CHECK(done[0].count == 2 && done[0].ids[0] == urgentTx && done[0].ids[1] == bulkTx);
+    CHECK(done[1].count == 2 && done[1].ids[0] == urgentRx && done[1].ids[1] == bulkRx);
+    for (int n = 0; n < 2; ++n) {
+        for (int i = 0; i < done[n].count; ++i) CHECK(done[n].results[i] == AkitaMeshZmodem::TransferState::COMPLETE);
+    }
+    printf("preempted: bulk receive stopped at %zu, its next run started at %zu\n", preemptedAt, resumedAt);
+    // It continued its partial file rather than starting from 0
+    CHECK(preemptedAt >= 12000 && resumedAt >= AKZ_RESUME_JOURNAL_BYTES && resumedAt <= preemptedAt);
+}
+
+int main() {
+    restoredAfterReboot();
+    preempted();
+    return testResult();
+}
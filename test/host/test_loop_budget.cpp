@@ -0,0 +1,123 @@
+// Bounded work per call: with a budget, a call stops after the header or
+// subpacket that used it up, so it overruns by at most one flash write.
+#include "host_net.h"
+
+static ZModemBufferPool g_pool;
+static ZModemTimerWheel g_wheel;
+
+// What a sender puts on the wire for a whole transfer of 'path'
+static std::vector<uint8_t> captureSender(FS& fs, const char* path, size_t size) {
+    std::vector<uint8_t> wire;
+    Pipe ab, ba;
+    ab.tap = &wire;
+    PipeEnd ea(ba, ab), eb(ab, ba);
+    File src = fs.open(path);
+    File dst = fs.open("/capture.bin", FILE_WRITE);
+    ZModemEngine a, b;
+    for (ZModemEngine* e : {&a, &b}) {
+        e->setBufferPool(&g_pool);
+        e->setTimerWheel(&g_wheel);
+    }
+    a.begin(ea);
+    b.begin(eb);
+    a.setFileStream(&src, path, size);
+    b.setFileStream(&dst, "", 0);
+    b.receive(20000);
+    a.send(20000);
+    for (int i = 0; i < 100000; ++i) {
+        g_wheel.advance(g_nowMs);
+        int ra = a.loop(), rb = b.loop();
+        if (ra == 1 && rb == 1) break;
+        g_nowMs++;
+    }
+    return wire;
+}
+
+struct Burst {
+    bool ok;
+    int calls;
+    uint64_t maxUs;
+};
+
+// A receiver that finds the whole transfer already buffered
+static Burst replay(FS& fs, const std::vector<uint8_t>& wire, const std::vector<uint8_t>& data, uint32_t budgetUs) {
+    Pipe in, out;
+    in.bytes.assign(wire.begin(), wire.end());
+    PipeEnd end(in, out);
+    File dst = fs.open("/replay.bin", FILE_WRITE);
+    ZModemEngine r;
+    r.setBufferPool(&g_pool);
+    r.setTimerWheel(&g_wheel);
+    r.begin(end);
+    r.setFileStream(&dst, "", 0);
+    r.receive(20000);
+    Burst b = {false, 0, 0};
+    int res = 0;
+    while (res == 0 && b.calls < 10000) {
+        g_wheel.advance(g_nowMs);
+        unsigned long t0 = micros();
+        res = r.loop(budgetUs);
+        b.maxUs = std::max<uint64_t>(b.maxUs, micros() - t0);
+        b.calls++;
+        if (res == 0 && !r.hasPendingWork()) g_nowMs++;
+    }
+    dst.close();
+    b.ok = res == 1 && fs.contents("/replay.bin") == data;
+    return b;
+}
+
+struct Run {
+    bool ok;
+    AkitaMeshZmodem::MeshThreadLatency rx;
+    uint32_t engineMaxUs;
+};
+
+static Run transfer(uint32_t budgetUs) {
+    HostLink link;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+    for (int n = 0; n < 2; ++n) link.node[n].setLoopBudget(budgetUs);
+    int rx = AkitaMeshZmodem::INVALID_SESSION;
+    link.b().startReceive("/dst.bin", &rx);
+    link.a().startSend("/src.bin", HostLink::NODE_B);
+    link.b().resetMeshThreadLatency();
+    Run r;
+    r.ok = link.run() && link.fs[1].contents("/dst.bin") == data;
+    link.b().getMeshThreadLatency(r.rx);
+    AkitaMeshZmodem::SessionStats st;
+    link.b().getSessionStats(rx, st);
+    r.engineMaxUs = st.maxLoopUs;
+    return r;
+}
+
+int main() {
+    // One write call, the unit that can overrun a budget, costs 2 ms
+    const uint32_t writeUs = 2000, budgetUs = 1000;
+
+    FS fs;
+    std::vector<uint8_t> data = makeFile(fs, "/src.bin", 20000);
+    std::vector<uint8_t> wire = captureSender(fs, "/src.bin", data.size());
+    g_fsWriteCallUs = writeUs;
+    Burst whole = replay(fs, wire, data, 0), bounded = replay(fs, wire, data, budgetUs);
+    printf("buffered 20 KB, unbounded: ok %d in %d call(s), longest %llu us\n", whole.ok, whole.calls,
+           (unsigned long long)whole.maxUs);
+    printf("buffered 20 KB, %u us:     ok %d in %d calls, longest %llu us\n", budgetUs, bounded.ok, bounded.calls,
+           (unsigned long long)bounded.maxUs);
+    CHECK(whole.ok && bounded.ok);
+    CHECK(whole.calls == 1);
+    CHECK(bounded.maxUs <= budgetUs + writeUs);
+    CHECK(bounded.calls > 20);
+
+    // Over the mesh: the receiver's calls, resume journal updates included
+    Run free = transfer(0), capped = transfer(budgetUs);
+    for (const Run* r : {&free, &capped}) {
+        printf("transfer, %-9s ok %d  processDataPacket() avg %4u max %5u us  engine tick max %5u us  over budget %u\n",
+               r == &free ? "unbounded" : "1000 us", r->ok, r->rx.packetAvgUs, r->rx.packetMaxUs, r->engineMaxUs,
+               r->rx.overBudget);
+    }
+    CHECK(free.ok && capped.ok);
+    CHECK(free.rx.overBudget == 0);
+    CHECK(capped.rx.overBudget > 0);
+    CHECK(capped.rx.packetMaxUs <= budgetUs + writeUs);
+    CHECK(capped.engineMaxUs <= budgetUs + writeUs);
+    return testResult();
+}
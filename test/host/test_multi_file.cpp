@@ -0,0 +1,31 @@
+// Multi-file sessions: each file after the first is saved under its
+// announced name next to the armed path, and never over an existing file.
+#include "host_net.h"
+
+int main() {
+    HostLink link;
+    std::vector<uint8_t> a = makeFile(link.fs[0], "/a.bin", 3000, 1);
+    std::vector<uint8_t> b = makeFile(link.fs[0], "/b.txt", 1500, 2);
+    std::vector<uint8_t> x = makeFile(link.fs[0], "/x/d.bin", 700, 3);
+    std::vector<uint8_t> y = makeFile(link.fs[0], "/y/d.bin", 900, 4);
+    std::vector<uint8_t> old = makeFile(link.fs[1], "/in/b.txt", 100, 5);
+
+    ZModemBatch batch;
+    for (const char* p : {"/a.bin", "/b.txt", "/x/d.bin", "/y/d.bin"}) batch.add(p);
+    link.b().startReceive("/in/first.bin");
+    link.a().startSend(batch, HostLink::NODE_B);
+    bool done = link.run();
+    printf("batch of %u: ok %d  sent %u  packets %llu\n", batch.count(), done,
+           batch.countOf(ZModemBatch::Result::SENT), (unsigned long long)link.packets);
+
+    CHECK(done);
+    CHECK(batch.countOf(ZModemBatch::Result::SENT) == 4);
+    CHECK(link.fs[1].contents("/in/first.bin") == a);
+    // Taken on flash: the follow-up gets "-1", the old file stays
+    CHECK(link.fs[1].contents("/in/b.txt") == old);
+    CHECK(link.fs[1].contents("/in/b-1.txt") == b);
+    // Taken by an earlier file of the same session
+    CHECK(link.fs[1].contents("/in/d.bin") == x);
+    CHECK(link.fs[1].contents("/in/d-1.bin") == y);
+    return testResult();
+}
@@ -0,0 +1,180 @@
+// Firmware image sink against a mock partition: in-order writes and commit,
+// a hash mismatch or an oversize image that aborts, and chunks staged ahead
+// of the write position and drained once the gap is filled.
+#include "host_net.h"
+#include "utility/ZModemOtaSink.h"
+
+struct MockPartition : ZModemOtaTarget {
+    size_t cap = 64 * 1024;
+    std::vector<uint8_t> image;
+    int begins = 0, commits = 0, aborts = 0;
+    size_t writes = 0;
+
+    size_t capacity() override { return cap; }
+    bool begin(size_t) override {
+        begins++;
+        image.clear();
+        return true;
+    }
+    bool write(const uint8_t* data, size_t n) override {
+        writes++;
+        image.insert(image.end(), data, data + n);
+        return true;
+    }
+    bool commit() override {
+        commits++;
+        return true;
+    }
+    void abort() override {
+        aborts++;
+        image.clear();
+    }
+};
+
+static std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> v(size);
+    for (size_t i = 0; i < size; ++i) v[i] = (uint8_t)(i * 7 + (i >> 8));
+    return v;
+}
+
+static void sha256(const std::vector<uint8_t>& data, uint8_t* digest) {
+    ZModemSha256 sha;
+    sha.update(data.data(), data.size());
+    sha.finish(digest);
+}
+
+static void onComplete(int, AkitaMeshZmodem::TransferState result, void* ctx) {
+    *static_cast<AkitaMeshZmodem::TransferState*>(ctx) = result;
+}
+
+// A whole image over the simulated link, with frame loss
+static void inOrderCommit() {
+    HostLink link;
+    link.loss = 0.05;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/fw.bin", 20000);
+    uint8_t digest[ZModemSha256::DIGEST_SIZE];
+    sha256(data, digest);
+
+    MockPartition part;
+    ZModemOtaSink ota(part, data.size(), digest);
+    AkitaMeshZmodem::TransferState result = AkitaMeshZmodem::TransferState::IDLE;
+    link.b().onComplete(onComplete, &result);
+    CHECK(link.b().startReceive(ota));
+    CHECK(link.a().startSend("/fw.bin", HostLink::NODE_B));
+    CHECK(link.run(3600000));
+    CHECK(result == AkitaMeshZmodem::TransferState::COMPLETE);
+    CHECK(ota.isCommitted() && part.commits == 1 && part.aborts == 0);
+    CHECK(part.image == data);
+    // Nothing reached the receiver's filesystem
+    CHECK(link.fs[1].stats().writeCalls == 0);
+    printf("in order: %zu B in %zu partition writes, committed\n", part.image.size(), part.writes);
+}
+
+// The same image with a wrong hash: the receive fails and nothing boots
+static void hashMismatch() {
+    HostLink link;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/fw.bin", 6000);
+    uint8_t digest[ZModemSha256::DIGEST_SIZE];
+    sha256(data, digest);
+    digest[0] ^= 0x80;
+
+    MockPartition part;
+    ZModemOtaSink ota(part, data.size(), digest);
+    AkitaMeshZmodem::TransferState result = AkitaMeshZmodem::TransferState::IDLE;
+    link.b().onComplete(onComplete, &result);
+    CHECK(link.b().startReceive(ota));
+    CHECK(link.a().startSend("/fw.bin", HostLink::NODE_B));
+    CHECK(link.run(3600000));
+    CHECK(result == AkitaMeshZmodem::TransferState::ERROR);
+    CHECK(!ota.isCommitted() && part.commits == 0 && part.aborts == 1);
+    printf("hash mismatch: aborted after %zu partition writes\n", part.writes);
+}
+
+static void oversize() {
+    std::vector<uint8_t> data = pattern(3000);
+
+    // Announced larger than the partition: never begun
+    MockPartition small;
+    small.cap = 2048;
+    ZModemOtaSink tooBig(small, data.size());
+    CHECK(tooBig.write(data.data(), 512) == 0);
+    CHECK(!tooBig.finalize(true));
+    CHECK(small.begins == 0 && small.writes == 0 && small.commits == 0);
+
+    // More data than announced: the write that overruns fails the image
+    MockPartition part;
+    ZModemOtaSink overrun(part, 2000);
+    CHECK(overrun.write(data.data(), 1500) == 1500);
+    CHECK(overrun.write(data.data() + 1500, 1000) == 0);
+    CHECK(overrun.write(data.data() + 2500, 100) == 0);
+    CHECK(!overrun.finalize(true));
+    CHECK(part.commits == 0 && part.aborts == 1);
+
+    // Short of the announced size
+    MockPartition shortPart;
+    ZModemOtaSink truncated(shortPart, data.size());
+    CHECK(truncated.write(data.data(), 2000) == 2000);
+    CHECK(!truncated.finalize(true));
+    CHECK(shortPart.commits == 0 && shortPart.aborts == 1);
+}
+
+// Chunks ahead of the write position, offered through stage() the way the
+// receiver does for data after a gap
+static void outOfOrder() {
+    std::vector<uint8_t> data = pattern(4000);
+    uint8_t digest[ZModemSha256::DIGEST_SIZE];
+    sha256(data, digest);
+    const uint8_t* d = data.data();
+
+    MockPartition part;
+    ZModemOtaSink ota(part, data.size(), digest);
+    CHECK(ota.write(d, 500) == 500);
+    // Nothing at or behind the write position, past the window or the image
+    CHECK(!ota.stage(500, d + 500, 100));
+    CHECK(!ota.stage(400, d + 400, 100));
+    CHECK(!ota.stage(500 + AKZ_OTA_STAGE_BYTES - 50, d + 500 + AKZ_OTA_STAGE_BYTES - 50, 100));
+    CHECK(!ota.stage(3950, d + 3950, 100));
+    // Two touching chunks merge; a third stays apart
+    CHECK(ota.stage(900, d + 900, 200));
+    CHECK(ota.stage(1100, d + 1100, 200));
+    CHECK(ota.stage(600, d + 600, 100));
+    CHECK(ota.size() == 500 && part.image.size() == 500);
+
+    // Filling the first gap writes the chunk behind it
+    CHECK(ota.write(d + 500, 100) == 100);
+    CHECK(ota.size() == 700);
+    // The second gap drains the merged range
+    CHECK(ota.write(d + 700, 200) == 200);
+    CHECK(ota.size() == 1300);
+    CHECK(part.image.size() == 1300 && std::equal(part.image.begin(), part.image.end(), d));
+
+    // A full set of separate ranges refuses one more
+    CHECK(ota.stage(1400, d + 1400, 50));
+    CHECK(ota.stage(1500, d + 1500, 50));
+    CHECK(ota.stage(1600, d + 1600, 50));
+    CHECK(ota.stage(1700, d + 1700, 50));
+    CHECK(!ota.stage(1800, d + 1800, 50));
+    // Overlapping what is already staged is fine
+    CHECK(ota.stage(1420, d + 1420, 100));
+
+    // Each filled gap drains the range behind it
+    CHECK(ota.write(d + 1300, 100) == 100);
+    CHECK(ota.size() == 1550);
+    CHECK(ota.write(d + 1550, 50) == 50);
+    CHECK(ota.size() == 1650);
+    CHECK(ota.write(d + 1650, 50) == 50);
+    CHECK(ota.size() == 1750);
+    CHECK(ota.write(d + 1750, data.size() - 1750) == data.size() - 1750);
+    CHECK(ota.finalize(true));
+    CHECK(ota.isCommitted() && part.commits == 1 && part.aborts == 0);
+    CHECK(part.image == data);
+    printf("out of order: %zu B committed in %zu partition writes\n", part.image.size(), part.writes);
+}
+
+int main() {
+    inOrderCommit();
+    hashMismatch();
+    oversize();
+    outOfOrder();
+    return testResult();
+}
@@ -0,0 +1,79 @@
+// A receiver that loses power mid-receive: armed again with resume after the
+// reboot, it asks for the file from its journaled offset, and only the rest
+// is sent. Another file announced into the same path starts over from 0.
+#include "host_net.h"
+#include "utility/ZModemResumeJournal.h"
+
+static const size_t FILE_SIZE = 30000;
+static const size_t RESET_AT = 20000;
+
+static size_t received(HostLink& link, int session) {
+    AkitaMeshZmodem::SessionStats st;
+    return link.b().getSessionStats(session, st) ? st.bytesTransferred : 0;
+}
+
+// Arms with resume, waiting out the airtime the failed attempt used
+static void rearm(HostLink& link) {
+    if (!link.b().startReceive("/dst.bin", nullptr, true)) {
+        g_nowMs += link.b().getLastAdmission().retryAfterMs;
+        CHECK(link.b().startReceive("/dst.bin", nullptr, true));
+    }
+}
+
+// Receives until RESET_AT bytes, resets the receiver and lets the sender's
+// session fail; returns the offset the journal holds
+static size_t receiveUntilReset(HostLink& link, std::vector<uint8_t>& data) {
+    link.loss = 0.05;
+    data = makeFile(link.fs[0], "/src.bin", FILE_SIZE, 4);
+    int rxSession = 0;
+    CHECK(link.b().startReceive("/dst.bin", &rxSession));
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    uint64_t limit = g_nowMs + 600000;
+    while (received(link, rxSession) < RESET_AT && g_nowMs < limit) link.run(10);
+    CHECK(received(link, rxSession) >= RESET_AT);
+    link.reboot(1);
+    CHECK(link.run(3600000));
+    CHECK(link.a().getActiveSessionCount() == 0);
+
+    ZModemResumeRecord rec;
+    CHECK(ZModemResumeJournal::load(link.fs[1], "/dst.bin", rec));
+    CHECK(rec.peer == HostLink::NODE_A && rec.size == FILE_SIZE);
+    return rec.offset;
+}
+
+static void sameFile() {
+    HostLink link;
+    std::vector<uint8_t> data;
+    size_t offset = receiveUntilReset(link, data);
+    CHECK(offset >= AKZ_RESUME_JOURNAL_BYTES && offset <= RESET_AT);
+    rearm(link);
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    CHECK(link.run(3600000));
+    uint64_t resent = link.sentBytes[0];
+    printf("same file: journal held %zu, %llu bytes sent after the reboot\n", offset, (unsigned long long)resent);
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+    CHECK(resent < FILE_SIZE - offset + FILE_SIZE / 4);
+    // Complete: nothing left to resume
+    CHECK(!link.fs[1].exists(ZModemResumeJournal::pathFor("/dst.bin")));
+}
+
+// The sender has a different file by the time the receiver is back
+static void otherFile() {
+    HostLink link;
+    std::vector<uint8_t> data;
+    size_t offset = receiveUntilReset(link, data);
+    std::vector<uint8_t> other = makeFile(link.fs[0], "/src.bin", FILE_SIZE + 1000, 5);
+    rearm(link);
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    CHECK(link.run(3600000));
+    uint64_t resent = link.sentBytes[0];
+    printf("other file: journal held %zu, %llu bytes sent after the reboot\n", offset, (unsigned long long)resent);
+    CHECK(link.fs[1].contents("/dst.bin") == other);
+    CHECK(resent >= other.size());
+}
+
+int main() {
+    sameFile();
+    otherFile();
+    return testResult();
+}
@@ -0,0 +1,80 @@
+// A sender that loses power mid-send: after the reboot it offers the send
+// again from its checkpoint, and the receiver asks for the unacknowledged
+// tail only, whether its receive is still running or had timed out and was
+// re-armed from its journal.
+#include "host_net.h"
+#include "utility/ZModemSendCheckpoint.h"
+
+static const size_t FILE_SIZE = 30000;
+static const size_t RESET_AT = 20000;
+
+static size_t received(HostLink& link, int session) {
+    AkitaMeshZmodem::SessionStats st;
+    return link.b().getSessionStats(session, st) ? st.bytesTransferred : 0;
+}
+
+// Runs the send until the receiver holds RESET_AT bytes; returns the
+// offset the sender's checkpoint holds at that point
+static size_t sendUntilReset(HostLink& link, std::vector<uint8_t>& data, int& rxSession) {
+    link.loss = 0.05;
+    data = makeFile(link.fs[0], "/src.bin", FILE_SIZE, 3);
+    CHECK(link.b().startReceive("/dst.bin", &rxSession));
+    CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    uint64_t limit = g_nowMs + 600000;
+    while (received(link, rxSession) < RESET_AT && g_nowMs < limit) link.run(10);
+    CHECK(received(link, rxSession) >= RESET_AT);
+
+    ZModemSendCheckpoint ckpt;
+    CHECK(ckpt.load(link.fs[0], AKZ_SEND_CHECKPOINT_FILE));
+    CHECK(ckpt.count() == 1);
+    return ckpt.at(0).offset;
+}
+
+static void finish(HostLink& link, const std::vector<uint8_t>& data, size_t offset, const char* what) {
+    CHECK(link.run(3600000));
+    uint64_t resent = link.sentBytes[0];
+    printf("%s: checkpoint held %zu, %llu bytes sent after the reboot\n", what, offset,
+           (unsigned long long)resent);
+    CHECK(link.fs[1].contents("/dst.bin") == data);
+    // The tail past the checkpoint, not the whole file again
+    CHECK(resent < FILE_SIZE - offset + FILE_SIZE / 4);
+    // Finished sends leave nothing to offer at the next boot
+    CHECK(!link.fs[0].exists(AKZ_SEND_CHECKPOINT_FILE));
+}
+
+// The receive is still running when the sender comes back
+static void receiverWaiting() {
+    HostLink link;
+    std::vector<uint8_t> data;
+    int rxSession = 0;
+    size_t offset = sendUntilReset(link, data, rxSession);
+    CHECK(offset >= AKZ_SEND_CHECKPOINT_BYTES && offset <= RESET_AT);
+    link.reboot(0);
+    CHECK(link.a().getActiveSessionCount() + link.a().getQueuedSessionCount() == 1);
+    finish(link, data, offset, "receiver waiting");
+}
+
+// The sender stays down long enough for the receive to time out; the
+// receiver re-arms it with resume before the sender comes back
+static void receiverRearmed() {
+    HostLink link;
+    std::vector<uint8_t> data;
+    int rxSession = 0;
+    size_t offset = sendUntilReset(link, data, rxSession);
+    link.powerOff(0);
+    CHECK(link.run(3600000));
+    CHECK(link.b().getActiveSessionCount() == 0);
+    // The airtime the first attempt used may hold the new receive back
+    if (!link.b().startReceive("/dst.bin", nullptr, true)) {
+        g_nowMs += link.b().getLastAdmission().retryAfterMs;
+        CHECK(link.b().startReceive("/dst.bin", nullptr, true));
+    }
+    link.reboot(0);
+    finish(link, data, offset, "receiver re-armed");
+}
+
+int main() {
+    receiverWaiting();
+    receiverRearmed();
+    return testResult();
+}
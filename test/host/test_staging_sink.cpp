@@ -0,0 +1,99 @@
+// Staged receive: the file is held in RAM and reaches flash in one write
+// once its SHA-256 matches, against writing each unit as it arrives.
+#include "host_net.h"
+#include "utility/ZModemStagingSink.h"
+
+enum Mode { DIRECT, STAGED };
+
+struct Run {
+    bool ok;           // completed, file intact
+    bool failed;       // ended in ERROR
+    uint64_t calls;    // receiver's write calls, journal and index included
+    uint64_t flashUs;  // at the stand-in's cost per call and per page
+    uint64_t radioUs;  // receiver's processDataPacket() and loop() time
+    uint64_t maxCallUs;
+    uint32_t targetWrites;
+    bool unverified;
+    size_t dstBytes;
+};
+
+static void onComplete(int, AkitaMeshZmodem::TransferState result, void* ctx) {
+    *static_cast<AkitaMeshZmodem::TransferState*>(ctx) = result;
+}
+
+static Run transfer(Mode mode, size_t size, size_t maxBytes = AKZ_STAGE_MAX_BYTES, bool badHash = false) {
+    HostLink link;
+    link.loss = 0.05;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", size);
+    uint8_t digest[ZModemSha256::DIGEST_SIZE];
+    ZModemSha256 sha;
+    sha.update(data.data(), data.size());
+    sha.finish(digest);
+    if (badHash) digest[5] ^= 1;
+
+    File target = link.fs[1].open("/dst.bin", FILE_WRITE);
+    ZModemFileSink file(&target);
+    ZModemStagingSink staged(file, digest, maxBytes);
+    AkitaMeshZmodem::TransferState result = AkitaMeshZmodem::TransferState::IDLE;
+    link.b().onComplete(onComplete, &result);
+    if (mode == STAGED) {
+        link.b().startReceive(staged);
+    } else {
+        target.close();
+        link.b().startReceive("/dst.bin");
+    }
+    link.a().startSend("/src.bin", HostLink::NODE_B);
+    bool done = link.run(3600000);
+
+    Run r;
+    HostFileData w = link.fs[1].stats();
+    r.ok = done && result == AkitaMeshZmodem::TransferState::COMPLETE && link.fs[1].contents("/dst.bin") == data;
+    r.failed = result == AkitaMeshZmodem::TransferState::ERROR;
+    r.calls = w.writeCalls;
+    r.flashUs = w.writeCalls * g_fsWriteCallUs + w.progBytes / HOST_FS_PAGE * g_fsPageUs;
+    r.radioUs = link.busyUs[1];
+    r.maxCallUs = link.maxCallUs[1];
+    r.targetWrites = staged.targetWrites();
+    r.unverified = staged.unverified();
+    r.dstBytes = link.fs[1].contents("/dst.bin").size();
+    return r;
+}
+
+static void report(const char* what, const Run& r) {
+    printf("%-26s ok %d  write calls %3llu  flash %5.1f ms  radio loop %6.1f ms  longest %5.2f ms  target writes %u\n",
+           what, r.ok, (unsigned long long)r.calls, r.flashUs / 1000.0, r.radioUs / 1000.0, r.maxCallUs / 1000.0,
+           r.targetWrites);
+}
+
+int main() {
+    g_fsWriteCallUs = 3000;
+    g_fsPageUs = 700;
+
+    Run direct = transfer(DIRECT, 20000), staged = transfer(STAGED, 20000);
+    Run capped = transfer(STAGED, 20000, 8192), bad = transfer(STAGED, 20000, AKZ_STAGE_MAX_BYTES, true);
+    Run cappedBad = transfer(STAGED, 20000, 8192, true);
+    Run bigDirect = transfer(DIRECT, 200000), bigStaged = transfer(STAGED, 200000);
+    report("20 KB, direct", direct);
+    report("20 KB, staged", staged);
+    report("20 KB, staged, 8 KB cap", capped);
+    report("20 KB, staged, bad hash", bad);
+    report("20 KB, 8 KB cap, bad hash", cappedBad);
+    report("200 KB, direct", bigDirect);
+    report("200 KB, staged", bigStaged);
+
+    CHECK(direct.ok && staged.ok && capped.ok && bigDirect.ok && bigStaged.ok);
+    // A file that fits: one write, at ZEOF, and nothing else on flash
+    CHECK(staged.targetWrites == 1 && staged.calls == 1 && !staged.unverified);
+    CHECK(bigStaged.targetWrites == 1 && bigStaged.calls == 1);
+    CHECK(staged.maxCallUs >= staged.flashUs);
+    // Over the cap: not staged, written as it arrives and labelled so
+    CHECK(capped.unverified && capped.targetWrites > 3);
+    // A bad hash fails the transfer and leaves nothing written
+    CHECK(bad.failed && !bad.unverified && bad.targetWrites == 0 && bad.calls == 0 && bad.dstBytes == 0);
+    // Over the cap the hash is still checked, but only after the writes
+    CHECK(cappedBad.failed && cappedBad.unverified && cappedBad.dstBytes > 0);
+    // Staging cuts flash time by about three quarters
+    CHECK(staged.flashUs * 3 < direct.flashUs);
+    CHECK(bigStaged.flashUs * 3 < bigDirect.flashUs);
+    return testResult();
+}
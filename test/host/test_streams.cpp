@@ -0,0 +1,56 @@
+// Multiplexed streams: an URGENT send to a peer that is already receiving a
+// bulk send from us. Built with the receiver's default (joined streams off),
+// where the urgent send opens its own handshake and binds to the armed
+// receive, and with AKZ_ACCEPT_JOINED_STREAMS=1, where it joins the link.
+#include "host_net.h"
+
+struct Outcome {
+    AkitaMeshZmodem::TransferState result[AKZ_MAX_SESSIONS];
+    bool done[AKZ_MAX_SESSIONS];
+};
+
+static void onComplete(int session, AkitaMeshZmodem::TransferState result, void* ctx) {
+    Outcome* o = static_cast<Outcome*>(ctx);
+    o->result[session] = result;
+    o->done[session] = true;
+}
+
+int main() {
+    HostLink link;
+    std::vector<uint8_t> bulk = makeFile(link.fs[0], "/bulk.bin", 20000, 1);
+    std::vector<uint8_t> urgent = makeFile(link.fs[0], "/u.bin", 500, 2);
+    Outcome out = {};
+    link.a().onComplete(onComplete, &out);
+    link.b().startReceive("/in/r1.bin");
+    link.b().startReceive("/in/r2.bin");
+    int bulkSession = -1, urgentSession = -1;
+    link.a().startSend("/bulk.bin", HostLink::NODE_B, &bulkSession, AkitaMeshZmodem::PRIORITY_BULK);
+
+    // 5 s in, with the bulk stream under way, the urgent file follows
+    uint64_t t0 = g_nowMs, urgentAt = 0, urgentDoneAt = 0;
+    bool joined = false;
+    link.onTick = [&]() {
+        if (!urgentAt && g_nowMs - t0 >= 5000) {
+            urgentAt = g_nowMs;
+            CHECK(link.a().startSend("/u.bin", HostLink::NODE_B, &urgentSession, AkitaMeshZmodem::PRIORITY_URGENT));
+        }
+        AkitaMeshZmodem::SessionStats st;
+        if (urgentSession >= 0 && !urgentDoneAt && link.a().getSessionStats(urgentSession, st)) joined = st.joined;
+        if (urgentSession >= 0 && !urgentDoneAt && out.done[urgentSession]) urgentDoneAt = g_nowMs;
+    };
+    bool done = link.run();
+    const char* urgentPath = AKZ_ACCEPT_JOINED_STREAMS ? "/in/u.bin" : "/in/r2.bin";
+    printf("joined streams %s: ok %d  urgent %s  joined %d  done after %.1f s\n",
+           AKZ_ACCEPT_JOINED_STREAMS ? "on " : "off", done, urgentPath, joined,
+           (urgentDoneAt - urgentAt) / 1000.0);
+
+    CHECK(done);
+    CHECK(urgentSession >= 0 && out.done[urgentSession] && out.result[urgentSession] == AkitaMeshZmodem::TransferState::COMPLETE);
+    CHECK(out.done[bulkSession] && out.result[bulkSession] == AkitaMeshZmodem::TransferState::COMPLETE);
+    CHECK(link.fs[1].contents("/in/r1.bin") == bulk);
+    CHECK(link.fs[1].contents(urgentPath) == urgent);
+    CHECK(joined == (AKZ_ACCEPT_JOINED_STREAMS != 0));
+    // Well ahead of the bulk stream's remaining 15 KB
+    CHECK(urgentDoneAt && urgentDoneAt - urgentAt < 10000);
+    return testResult();
+}
@@ -0,0 +1,45 @@
+// Tail sends of a followed log: an empty file starts no session, a file that
+// has not changed is not sent again, and a rotation that ends at the length
+// already delivered is noticed by its fingerprint and sent in full.
+#include "host_net.h"
+
+int main() {
+    HostLink link;
+    AkitaMeshZmodem::AutoAcceptPolicy policy;
+    policy.spoolDir = "/spool";
+    CHECK(link.b().setAutoAccept(policy));
+
+    // Nothing to send: "nothing new", no session
+    makeFile(link.fs[0], "/empty.log", 0);
+    int session = 0;
+    CHECK(link.a().startTail("/empty.log", HostLink::NODE_B, &session));
+    CHECK(session == AkitaMeshZmodem::INVALID_SESSION);
+    CHECK(link.a().getActiveSessionCount() == 0 && link.a().getQueuedSessionCount() == 0);
+
+    const uint32_t periodMs = 60000;
+    std::vector<uint8_t> log = makeFile(link.fs[0], "/app.log", 2000, 1);
+    CHECK(link.a().followTail("/app.log", HostLink::NODE_B, periodMs));
+    CHECK(link.run());
+    CHECK(link.fs[1].contents("/spool/app.log") == log);
+    CHECK(link.a().getTailOffset("/app.log", HostLink::NODE_B) == log.size());
+
+    // Unchanged at the next check: nothing goes on air
+    g_nowMs += periodMs;
+    CHECK(link.run());
+    uint64_t idlePackets = link.packets;
+    CHECK(idlePackets == 0);
+
+    // Rotated, and grown back to the same length by the next check
+    std::vector<uint8_t> rotated = makeFile(link.fs[0], "/app.log", log.size(), 2);
+    g_nowMs += periodMs;
+    CHECK(link.run());
+    uint64_t rotatedPackets = link.packets;
+    printf("tail: unchanged check %llu packets, same-length rotation %llu packets\n",
+           (unsigned long long)idlePackets, (unsigned long long)rotatedPackets);
+    CHECK(rotatedPackets > 0);
+    // Sent whole, without ZCRESUM, so the spool keeps it apart
+    CHECK(link.fs[1].contents("/spool/app.log") == log);
+    CHECK(link.fs[1].contents("/spool/app-1.log") == rotated);
+    CHECK(link.a().getTailOffset("/app.log", HostLink::NODE_B) == rotated.size());
+    return testResult();
+}
@@ -0,0 +1,146 @@
+// The shared timer wheel: deadlines on every level fire in order, never early
+// and within a tick, when the host sleeps as msUntilNextDeadline() says;
+// cancel, re-arm and callbacks that arm timers; the millis() wrap. Over the
+// link, the retry deadlines of four sends to a silent peer are all served
+// from it, with loop() called only when one is due.
+#include "host_net.h"
+
+// A timer that records when it fired against when it was due
+struct Probe {
+    ZModemTimerWheel& wheel;
+    ZModemTimer timer;
+    uint32_t dueMs = 0;    // deadline asked for
+    uint32_t firedMs = 0;  // millis() when it last fired
+    uint32_t repeatMs = 0; // re-armed from the callback, 0 for one shot
+    int fired = 0;
+    bool late = false;     // fired early or more than a tick late, ever
+
+    explicit Probe(ZModemTimerWheel& w) : wheel(w), timer(onFire, this) {}
+    void arm(uint32_t delayMs) {
+        dueMs = (uint32_t)millis() + delayMs;
+        wheel.arm(timer, delayMs);
+    }
+    bool onTime() const { return fired && !late; }
+
+    static void onFire(void* ctx) {
+        Probe* p = static_cast<Probe*>(ctx);
+        p->firedMs = (uint32_t)millis();
+        p->fired++;
+        uint32_t lateMs = p->firedMs - p->dueMs;
+        if ((int32_t)lateMs < 0 || lateMs > ZModemTimerWheel::TICK_MS) p->late = true;
+        if (p->repeatMs) p->arm(p->repeatMs);
+    }
+};
+
+// Sleep until the wheel says, advance, repeat; returns the wakeups
+static uint32_t sleepAndAdvance(ZModemTimerWheel& wheel, uint32_t untilMs) {
+    uint32_t wakeups = 0;
+    while ((int32_t)((uint32_t)millis() - untilMs) < 0) {
+        uint32_t d = wheel.msUntilNextDeadline((uint32_t)millis());
+        if (d == ZModemTimerWheel::NO_DEADLINE) break;
+        uint32_t left = untilMs - (uint32_t)millis();
+        g_nowMs += d < left ? d : left;
+        wheel.advance((uint32_t)millis());
+        wakeups++;
+    }
+    return wakeups;
+}
+
+static void levels() {
+    ZModemTimerWheel wheel;
+    // Level 0, level 1, level 2 and past the wheel's span (parked at the top)
+    const uint32_t delays[] = {5, 100, 3000, 90000, 400000};
+    const int n = sizeof(delays) / sizeof(delays[0]);
+    Probe* t[n];
+    for (int i = n - 1; i >= 0; --i) {
+        t[i] = new Probe(wheel);
+        t[i]->arm(delays[i]);
+    }
+    CHECK(wheel.armedCount() == n);
+    uint32_t wakeups = sleepAndAdvance(wheel, (uint32_t)millis() + 500000);
+    uint32_t prev = 0;
+    for (int i = 0; i < n; ++i) {
+        CHECK(t[i]->onTime() && t[i]->fired == 1 && t[i]->firedMs >= prev);
+        prev = t[i]->firedMs;
+    }
+    CHECK(wheel.armedCount() == 0);
+    CHECK(wheel.msUntilNextDeadline((uint32_t)millis()) == ZModemTimerWheel::NO_DEADLINE);
+    printf("levels: %d timers up to %lu ms fired on time in %lu wakeups\n", n, (unsigned long)delays[n - 1],
+           (unsigned long)wakeups);
+    // Undershoots only while far timers cascade
+    CHECK(wakeups < 64);
+    for (int i = 0; i < n; ++i) delete t[i];
+}
+
+static void cancelAndRearm() {
+    ZModemTimerWheel wheel;
+    Probe cancelled(wheel), moved(wheel), periodic(wheel);
+    cancelled.arm(50);
+    moved.arm(2000);
+    periodic.repeatMs = 300;
+    periodic.arm(300);
+    wheel.cancel(cancelled.timer);
+    CHECK(!cancelled.timer.isArmed());
+    wheel.cancel(cancelled.timer); // twice is harmless
+    moved.arm(700);                // earlier
+    CHECK(wheel.armedCount() == 2);
+
+    sleepAndAdvance(wheel, (uint32_t)millis() + 1000);
+    CHECK(cancelled.fired == 0);
+    CHECK(moved.fired == 1 && moved.onTime());
+    CHECK(periodic.fired == 3 && periodic.timer.isArmed());
+    moved.arm(5000);               // armed again after firing, now later
+    sleepAndAdvance(wheel, (uint32_t)millis() + 6000);
+    CHECK(moved.fired == 2 && moved.onTime());
+    // Re-armed from its own callback each time, a tick late at most
+    CHECK(periodic.fired >= 20 && periodic.onTime());
+    wheel.cancel(periodic.timer);
+    wheel.cancel(moved.timer);
+    CHECK(wheel.armedCount() == 0);
+
+    // A wheel not advanced for a while still fires no earlier than asked
+    g_nowMs += 12345;
+    Probe idle(wheel);
+    idle.arm(40);
+    CHECK(wheel.msUntilNextDeadline((uint32_t)millis()) <= 40);
+    sleepAndAdvance(wheel, (uint32_t)millis() + 100);
+    CHECK(idle.onTime());
+}
+
+// Four sends to a node that never answers: each runs out of retries on the
+// wheel, and the sender wakes for its deadlines, not every millisecond
+static void silentPeer() {
+    HostLink link;
+    link.loss = 1.0;
+    makeFile(link.fs[0], "/src.bin", 4000);
+    for (int i = 0; i < 4; ++i) CHECK(link.a().startSend("/src.bin", HostLink::NODE_B));
+    CHECK(link.a().getActiveSessionCount() + link.a().getQueuedSessionCount() == 4);
+    uint64_t t0 = g_nowMs;
+    CHECK(link.run());
+    uint64_t elapsed = g_nowMs - t0;
+    printf("silent peer: 4 sends failed after %llu ms, %llu sender wakeups\n", (unsigned long long)elapsed,
+           (unsigned long long)link.wakeups[0]);
+    CHECK(link.a().getActiveSessionCount() == 0);
+    CHECK(link.a().nextDeadline() == AkitaMeshZmodem::NO_DEADLINE);
+    CHECK(elapsed > 1000 && link.wakeups[0] < elapsed / 50);
+}
+
+// Deadlines armed just before millis() wraps fire just after it
+static void wrap() {
+    g_nowMs = 0xFFFFFFFFULL - 100;
+    ZModemTimerWheel wheel;
+    Probe a(wheel), b(wheel);
+    a.arm(60);
+    b.arm(3000);
+    sleepAndAdvance(wheel, (uint32_t)millis() + 4000);
+    CHECK(a.onTime() && b.onTime());
+    CHECK(b.firedMs < 0x10000000UL);
+}
+
+int main() {
+    levels();
+    cancelAndRearm();
+    silentPeer();
+    wrap();
+    return testResult();
+}
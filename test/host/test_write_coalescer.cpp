@@ -0,0 +1,74 @@
+// Write coalescing: a receiver writes whole AKZ_WRITE_COALESCE_BYTES units
+// cut at multiples of the unit, so flash sees few calls and full pages.
+// Built once with the default unit and once with coalescing off (0).
+#include "host_net.h"
+
+struct Run {
+    bool ok;
+    uint64_t calls;
+    uint64_t programmed;
+    size_t reserved;
+};
+
+static bool onReserve(int, File&, size_t needed, void* ctx) {
+    *static_cast<size_t*>(ctx) = needed;
+    return true;
+}
+
+// 20 KB into /dst.bin, which already holds its first 'resumeAt' bytes
+// with the journal an interrupted run would have left
+static Run transfer(size_t resumeAt) {
+    HostLink link;
+    std::vector<uint8_t> data = makeFile(link.fs[0], "/src.bin", 20000);
+    if (resumeAt) {
+        File part = link.fs[1].open("/dst.bin", FILE_WRITE);
+        part.write(data.data(), resumeAt);
+        part.close();
+        ZModemResumeRecord rec = {HostLink::NODE_A, (uint32_t)data.size(), (uint32_t)resumeAt, "/src.bin"};
+        ZModemResumeJournal::save(link.fs[1], "/dst.bin", rec);
+    }
+    HostFileData before = link.fs[1].stats("/dst.bin");
+    Run r;
+    r.reserved = 0;
+    link.b().onReserve(onReserve, &r.reserved);
+    link.b().startReceive("/dst.bin", nullptr, resumeAt > 0);
+    link.a().startSend("/src.bin", HostLink::NODE_B);
+    r.ok = link.run() && link.fs[1].contents("/dst.bin") == data;
+    HostFileData after = link.fs[1].stats("/dst.bin");
+    r.calls = after.writeCalls - before.writeCalls;
+    r.programmed = after.progBytes - before.progBytes;
+    return r;
+}
+
+static void report(const char* what, const Run& r) {
+    // Write path time at 3 ms per call and 0.7 ms per programmed page
+    double ms = r.calls * 3.0 + r.programmed / HOST_FS_PAGE * 0.7;
+    printf("unit %4d B, %-16s ok %d  write calls %3llu  programmed %6llu B  (%.0f ms)  reserved %zu B\n",
+           AKZ_WRITE_COALESCE_BYTES, what, r.ok, (unsigned long long)r.calls, (unsigned long long)r.programmed, ms,
+           r.reserved);
+}
+
+int main() {
+    Run fresh = transfer(0), resumed = transfer(1000);
+    report("new file", fresh);
+    report("resumed at 1000", resumed);
+
+    CHECK(fresh.ok && resumed.ok);
+    // The announced size (less what the file held) reaches the host first
+    CHECK(fresh.reserved == 20000);
+    CHECK(resumed.reserved == 19000);
+#if AKZ_WRITE_COALESCE_BYTES == 512
+    // 39 full units and the 32-byte tail; resumed, one top-up to 1024 first
+    CHECK(fresh.calls == 40);
+    CHECK(fresh.programmed == 20224);
+    CHECK(resumed.calls == 39);
+    CHECK(resumed.programmed == 19456);
+#elif AKZ_WRITE_COALESCE_BYTES == 0
+    // One call per subpacket; resumed off a page boundary, every page twice
+    CHECK(fresh.calls == 79);
+    CHECK(fresh.programmed == 20224);
+    CHECK(resumed.calls == 75);
+    CHECK(resumed.programmed == 38400);
+#endif
+    return testResult();
+}